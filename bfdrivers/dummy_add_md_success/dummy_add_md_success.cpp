@@ -29,3 +29,11 @@ add_md(struct memory_descriptor *md)
     (void) md;
     return return_success();
 }
+
+extern "C" int64_t
+add_heap(uint64_t virt, uint64_t size)
+{
+    (void) virt;
+    (void) size;
+    return return_success();
+}
@@ -23,6 +23,12 @@
 #include <stdint.h>
 #include <error_codes.h>
 
+extern "C" uint64_t g_pool_generation;
+uint64_t g_pool_generation = 0;
+
+extern "C" uint64_t g_heap_token;
+uint64_t g_heap_token = 0x1234;
+
 int64_t
 return_success()
 { return SUCCESS; }
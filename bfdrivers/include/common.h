@@ -123,6 +123,20 @@ common_fini(void);
 int64_t
 common_add_module(const char *file, uint64_t fsize);
 
+/**
+ * Set Extra Heap Chunks
+ *
+ * When the VMM is loaded, the driver entry donates one heap chunk to the
+ * VMM for every HEAP_CHUNK_CPUS CPUs. This function sets how many chunks
+ * are donated on top of that, and is typically called with a load time
+ * parameter. It must be called before the VMM is loaded to take effect.
+ *
+ * @param num the number of extra heap chunks to donate
+ * @return BF_SUCCESS on success, negative error code on failure
+ */
+int64_t
+common_set_extra_heap_chunks(uint64_t num);
+
 /**
  * Load VMM
  *
@@ -197,6 +211,21 @@ common_dump_vmm(struct debug_ring_resources_t **drr, uint64_t vcpuid);
 int64_t
 common_vmcall(struct vmcall_registers_t *regs, uint64_t cpuid);
 
+/**
+ * Poll VMM
+ *
+ * This grows the VMM's heap and page pool if they need more memory. The
+ * VMM exports a counter that is bumped every time either pool serves an
+ * allocation, so the VMM is only asked how many chunks it needs if this
+ * counter has changed since the last poll. The driver entry should call
+ * this every HEAP_POLL_INTERVAL milliseconds, serialized with the other
+ * common functions. If the VMM is not running, this does nothing.
+ *
+ * @return BF_SUCCESS on success, negative error code on failure
+ */
+int64_t
+common_poll_vmm(void);
+
 #ifdef __cplusplus
 }
 #endif
@@ -28,6 +28,8 @@
 #include <linux/kallsyms.h>
 #include <linux/notifier.h>
 #include <linux/reboot.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
 
 #include <debug.h>
 #include <types.h>
@@ -48,6 +50,12 @@ uint64_t files_size[MAX_NUM_MODULES] = { 0 };
 uint64_t g_cpuid = 0;
 uint64_t g_vcpuid = 0;
 
+static unsigned long heap_chunks = 0;
+module_param(heap_chunks, ulong, 0444);
+MODULE_PARM_DESC(heap_chunks, "number of extra heap chunks to donate to the vmm");
+
+static DEFINE_MUTEX(g_mutex);
+
 /* -------------------------------------------------------------------------- */
 /* Misc Device                                                                */
 /* -------------------------------------------------------------------------- */
@@ -380,12 +388,8 @@ ioctl_vmcall(struct vmcall_registers_t *regs)
 }
 
 static long
-dev_unlocked_ioctl(struct file *file,
-                   unsigned int cmd,
-                   unsigned long arg)
+dev_ioctl(unsigned int cmd, unsigned long arg)
 {
-    (void) file;
-
     switch (cmd)
     {
         case IOCTL_ADD_MODULE:
@@ -426,6 +430,22 @@ dev_unlocked_ioctl(struct file *file,
     }
 }
 
+static long
+dev_unlocked_ioctl(struct file *file,
+                   unsigned int cmd,
+                   unsigned long arg)
+{
+    long ret;
+
+    (void) file;
+
+    mutex_lock(&g_mutex);
+    ret = dev_ioctl(cmd, arg);
+    mutex_unlock(&g_mutex);
+
+    return ret;
+}
+
 static struct file_operations fops =
 {
     .open = dev_open,
@@ -440,6 +460,33 @@ static struct miscdevice bareflank_dev =
     &fops
 };
 
+/* -------------------------------------------------------------------------- */
+/* Memory Pools                                                               */
+/* -------------------------------------------------------------------------- */
+
+static void dev_poll(struct work_struct *work);
+static DECLARE_DELAYED_WORK(g_poll_work, dev_poll);
+
+static void
+dev_poll(struct work_struct *work)
+{
+    int64_t ret;
+
+    (void) work;
+
+    mutex_lock(&g_mutex);
+    ret = common_poll_vmm();
+    mutex_unlock(&g_mutex);
+
+    if (ret != BF_SUCCESS)
+    {
+        ALERT("dev_poll: common_poll_vmm failed: %p - %s\n", \
+              (void *)ret, ec_to_str(ret));
+    }
+
+    schedule_delayed_work(&g_poll_work, msecs_to_jiffies(HEAP_POLL_INTERVAL));
+}
+
 /* -------------------------------------------------------------------------- */
 /* Entry / Exit                                                               */
 /* -------------------------------------------------------------------------- */
@@ -452,6 +499,7 @@ dev_reboot(struct notifier_block *nb,
     (void) code;
     (void) unused;
 
+    cancel_delayed_work_sync(&g_poll_work);
     common_fini();
 
     return NOTIFY_DONE;
@@ -479,6 +527,14 @@ dev_init(void)
         return -EPERM;
     }
 
+    if (common_set_extra_heap_chunks(heap_chunks) != 0)
+    {
+        ALERT("common_set_extra_heap_chunks failed\n");
+        return -EPERM;
+    }
+
+    schedule_delayed_work(&g_poll_work, msecs_to_jiffies(HEAP_POLL_INTERVAL));
+
     DEBUG("dev_init succeeded\n");
     return 0;
 }
@@ -486,6 +542,7 @@ dev_init(void)
 void
 dev_exit(void)
 {
+    cancel_delayed_work_sync(&g_poll_work);
     common_fini();
 
     misc_deregister(&bareflank_dev);
@@ -93,6 +93,8 @@ bareflankEvtDeviceD0Entry(
     UNREFERENCED_PARAMETER(Device);
     UNREFERENCED_PARAMETER(PreviousState);
 
+    bareflankStartPoll();
+
     DEBUG("bareflankEvtDeviceD0Entry: success\n");
     return STATUS_SUCCESS;
 }
@@ -106,6 +108,7 @@ bareflankEvtDeviceD0Exit(
     UNREFERENCED_PARAMETER(Device);
     UNREFERENCED_PARAMETER(TargetState);
 
+    bareflankStopPoll();
     common_fini();
 
     DEBUG("bareflankEvtDeviceD0Entry: success\n");
@@ -39,6 +39,10 @@ struct pmodule_t pmodules[MAX_NUM_MODULES] = { 0 };
 uint64_t g_cpuid = 0;
 uint64_t g_vcpuid = 0;
 
+WDFWAITLOCK g_lock = 0;
+WDFTIMER g_poll_timer = 0;
+BOOLEAN g_polling = FALSE;
+
 /* -------------------------------------------------------------------------- */
 /* IO Functions                                                               */
 /* -------------------------------------------------------------------------- */
@@ -272,6 +276,8 @@ bareflankQueueInitialize(
     WDFQUEUE queue;
     NTSTATUS status;
     WDF_IO_QUEUE_CONFIG queueConfig;
+    WDF_TIMER_CONFIG timerConfig;
+    WDF_OBJECT_ATTRIBUTES attributes;
 
     WDF_IO_QUEUE_CONFIG_INIT_DEFAULT_QUEUE(
         &queueConfig,
@@ -285,6 +291,31 @@ bareflankQueueInitialize(
     if (!NT_SUCCESS(status))
         return status;
 
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = Device;
+
+    status = WdfWaitLockCreate(&attributes, &g_lock);
+    if (!NT_SUCCESS(status))
+        return status;
+
+    /*
+     * The VMM's memory pools are grown from a passive level timer, as
+     * common_poll_vmm allocates memory. The timer re-arms itself (under
+     * g_lock) instead of being periodic, so that bareflankStopPoll can
+     * stop it for good.
+     */
+
+    WDF_TIMER_CONFIG_INIT(&timerConfig, bareflankEvtTimerPoll);
+    timerConfig.AutomaticSerialization = FALSE;
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = Device;
+    attributes.ExecutionLevel = WdfExecutionLevelPassive;
+
+    status = WdfTimerCreate(&timerConfig, &attributes, &g_poll_timer);
+    if (!NT_SUCCESS(status))
+        return status;
+
     if (common_init() != BF_SUCCESS)
     {
         ALERT("common_init failed\n");
@@ -330,6 +361,8 @@ bareflankEvtIoDeviceControl(
             goto FAILURE;
     }
 
+    WdfWaitLockAcquire(g_lock, NULL);
+
     switch (IoControlCode)
     {
         case IOCTL_ADD_MODULE:
@@ -373,9 +406,12 @@ bareflankEvtIoDeviceControl(
             break;
 
         default:
+            WdfWaitLockRelease(g_lock);
             goto FAILURE;
     }
 
+    WdfWaitLockRelease(g_lock);
+
     if (OutputBufferLength != 0)
         WdfRequestSetInformation(Request, out_size);
 
@@ -404,3 +440,45 @@ bareflankEvtIoStop(
     WdfRequestComplete(Request, STATUS_SUCCESS);
     return;
 }
+
+VOID
+bareflankStartPoll(VOID)
+{
+    WdfWaitLockAcquire(g_lock, NULL);
+    g_polling = TRUE;
+    WdfWaitLockRelease(g_lock);
+
+    WdfTimerStart(g_poll_timer, WDF_REL_TIMEOUT_IN_MS(HEAP_POLL_INTERVAL));
+}
+
+VOID
+bareflankStopPoll(VOID)
+{
+    WdfWaitLockAcquire(g_lock, NULL);
+    g_polling = FALSE;
+    WdfWaitLockRelease(g_lock);
+
+    WdfTimerStop(g_poll_timer, TRUE);
+}
+
+VOID
+bareflankEvtTimerPoll(
+    _In_ WDFTIMER Timer
+)
+{
+    int64_t ret;
+
+    WdfWaitLockAcquire(g_lock, NULL);
+
+    ret = common_poll_vmm();
+    if (ret != BF_SUCCESS)
+    {
+        ALERT("bareflankEvtTimerPoll: common_poll_vmm failed: %p - %s\n", \
+              (void *)ret, ec_to_str(ret));
+    }
+
+    if (g_polling)
+        WdfTimerStart(Timer, WDF_REL_TIMEOUT_IN_MS(HEAP_POLL_INTERVAL));
+
+    WdfWaitLockRelease(g_lock);
+}
@@ -35,7 +35,14 @@ bareflankQueueInitialize(
     _In_ WDFDEVICE hDevice
 );
 
+VOID
+bareflankStartPoll(VOID);
+
+VOID
+bareflankStopPoll(VOID);
+
 EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL bareflankEvtIoDeviceControl;
 EVT_WDF_IO_QUEUE_IO_STOP bareflankEvtIoStop;
+EVT_WDF_TIMER bareflankEvtTimerPoll;
 
 EXTERN_C_END
@@ -50,6 +50,18 @@ uint64_t g_tls_size = 0;
 uint64_t g_stack_size = 0;
 uint64_t g_stack_top = 0;
 
+uint64_t g_num_heap_chunks = 0;
+uint64_t g_extra_heap_chunks = 0;
+void *g_heap_chunks[MAX_HEAP_CHUNKS];
+
+uint64_t g_num_page_chunks = 0;
+void *g_page_chunks[MAX_PAGE_CHUNKS];
+
+uint64_t *g_pool_generation = 0;
+uint64_t g_last_pool_generation = 0;
+
+uint64_t g_heap_token = 0;
+
 /* -------------------------------------------------------------------------- */
 /* Entry Points                                                               */
 /* -------------------------------------------------------------------------- */
@@ -120,6 +132,7 @@ execute_symbol(const char *sym, uint64_t arg1, uint64_t arg2, uint64_t cpuid)
 
     tc->cpuid = cpuid;
     tc->tlsptr = (uint64_t)g_tls + (THREAD_LOCAL_STORAGE_SIZE * cpuid);
+    tc->vmx_root = 0;
 
     ret = execute_entry(g_stack_top - sizeof(struct thread_context_t) - 1, entry_point, arg1, arg2);
     if (ret != ENTRY_SUCCESS)
@@ -132,18 +145,42 @@ execute_symbol(const char *sym, uint64_t arg1, uint64_t arg2, uint64_t cpuid)
 }
 
 int64_t
-add_raw_md_to_memory_manager(uint64_t virt, uint64_t type)
+add_raw_md_to_memory_manager(uint64_t virt, uint64_t size, uint64_t type)
 {
     int64_t ret = 0;
-    struct memory_descriptor md = {0, 0, 0};
+    uint64_t offset = 0;
+    struct memory_descriptor md = {0, 0, 0, 0};
 
-    md.virt = virt;
-    md.phys = (uint64_t)platform_virt_to_phys((void *)md.virt);
-    md.type = type;
+    for (offset = 0; offset < size; offset += MAX_PAGE_SIZE)
+    {
+        uint64_t page_virt = virt + offset;
+        uint64_t page_phys = (uint64_t)platform_virt_to_phys((void *)page_virt);
 
-    ret = execute_symbol("add_md", (uint64_t)&md, 0, 0);
-    if (ret != MEMORY_MANAGER_SUCCESS)
-        return ret;
+        if (md.size != 0 && md.phys + md.size == page_phys)
+        {
+            md.size += MAX_PAGE_SIZE;
+            continue;
+        }
+
+        if (md.size != 0)
+        {
+            ret = execute_symbol("add_md", (uint64_t)&md, 0, 0);
+            if (ret != MEMORY_MANAGER_SUCCESS)
+                return ret;
+        }
+
+        md.virt = page_virt;
+        md.phys = page_phys;
+        md.type = type;
+        md.size = MAX_PAGE_SIZE;
+    }
+
+    if (md.size != 0)
+    {
+        ret = execute_symbol("add_md", (uint64_t)&md, 0, 0);
+        if (ret != MEMORY_MANAGER_SUCCESS)
+            return ret;
+    }
 
     return BF_SUCCESS;
 }
@@ -161,6 +198,7 @@ add_md_to_memory_manager(struct module_t *module)
     {
         uint64_t exec_s = 0;
         uint64_t exec_e = 0;
+        uint64_t size = 0;
         struct bfelf_load_instr *instr = 0;
 
         ret = bfelf_file_get_load_instr(&module->file, s, &instr);
@@ -172,16 +210,150 @@ add_md_to_memory_manager(struct module_t *module)
         exec_s &= ~(MAX_PAGE_SIZE - 1);
         exec_e &= ~(MAX_PAGE_SIZE - 1);
 
-        for (; exec_s <= exec_e; exec_s += MAX_PAGE_SIZE)
-        {
-            if ((instr->perm & bfpf_x) != 0)
-                ret = add_raw_md_to_memory_manager(exec_s, MEMORY_TYPE_R | MEMORY_TYPE_E);
-            else
-                ret = add_raw_md_to_memory_manager(exec_s, MEMORY_TYPE_R | MEMORY_TYPE_W);
+        size = exec_e - exec_s + MAX_PAGE_SIZE;
 
-            if (ret != MEMORY_MANAGER_SUCCESS)
-                return ret;
-        }
+        if ((instr->perm & bfpf_x) != 0)
+            ret = add_raw_md_to_memory_manager(exec_s, size, MEMORY_TYPE_R | MEMORY_TYPE_E);
+        else
+            ret = add_raw_md_to_memory_manager(exec_s, size, MEMORY_TYPE_R | MEMORY_TYPE_W);
+
+        if (ret != MEMORY_MANAGER_SUCCESS)
+            return ret;
+    }
+
+    return BF_SUCCESS;
+}
+
+int64_t
+add_heap_chunk_to_vmm(void)
+{
+    int64_t ret = 0;
+    void *chunk = 0;
+    struct vmcall_registers_t regs;
+
+    if (g_num_heap_chunks >= MAX_HEAP_CHUNKS)
+        return BF_ERROR_OUT_OF_MEMORY;
+
+    chunk = platform_alloc_rw(MAX_HEAP_POOL);
+    if (chunk == 0)
+        return BF_ERROR_OUT_OF_MEMORY;
+
+    if (common_vmm_status() == VMM_RUNNING)
+    {
+        regs.r00 = VMCALL_HEAP;
+        regs.r01 = VMCALL_MAGIC_NUMBER;
+        regs.r02 = (uint64_t)chunk;
+        regs.r03 = MAX_HEAP_POOL;
+        regs.r04 = VMCALL_HEAP_POOL_HEAP;
+        regs.r05 = g_heap_token;
+
+        platform_vmcall(&regs);
+        ret = regs.r01 == 0 ? BF_SUCCESS : BF_ERROR_VMM_INVALID_STATE;
+    }
+    else
+    {
+        ret = add_raw_md_to_memory_manager((uint64_t)chunk, MAX_HEAP_POOL, MEMORY_TYPE_R | MEMORY_TYPE_W);
+        if (ret == BF_SUCCESS)
+            ret = execute_symbol("add_heap", (uint64_t)chunk, MAX_HEAP_POOL, 0);
+    }
+
+    if (ret != BF_SUCCESS)
+    {
+        platform_free_rw(chunk, MAX_HEAP_POOL);
+        return ret;
+    }
+
+    g_heap_chunks[g_num_heap_chunks++] = chunk;
+    return BF_SUCCESS;
+}
+
+int64_t
+add_page_chunk_to_vmm(void)
+{
+    void *chunk = 0;
+    struct vmcall_registers_t regs;
+
+    if (g_num_page_chunks >= MAX_PAGE_CHUNKS)
+        return BF_ERROR_OUT_OF_MEMORY;
+
+    if (common_vmm_status() != VMM_RUNNING)
+        return BF_ERROR_VMM_INVALID_STATE;
+
+    chunk = platform_alloc_rw(MAX_PAGE_POOL);
+    if (chunk == 0)
+        return BF_ERROR_OUT_OF_MEMORY;
+
+    regs.r00 = VMCALL_HEAP;
+    regs.r01 = VMCALL_MAGIC_NUMBER;
+    regs.r02 = (uint64_t)chunk;
+    regs.r03 = MAX_PAGE_POOL;
+    regs.r04 = VMCALL_HEAP_POOL_PAGE;
+    regs.r05 = g_heap_token;
+
+    platform_vmcall(&regs);
+
+    if (regs.r01 != 0)
+    {
+        platform_free_rw(chunk, MAX_PAGE_POOL);
+        return BF_ERROR_VMM_INVALID_STATE;
+    }
+
+    g_page_chunks[g_num_page_chunks++] = chunk;
+    return BF_SUCCESS;
+}
+
+int64_t
+take_heap_token(void)
+{
+    int64_t ret = 0;
+    uint64_t *token = 0;
+
+    ret = resolve_symbol("g_heap_token", (void **)&token);
+    if (ret != BF_SUCCESS)
+        return ret;
+
+    /*
+     * The VMM only accepts heap vmcalls that carry this token. It is taken
+     * (and the VMM's copy cleared) before the VMM is started, so that once
+     * the VMM is running, only this driver holds it.
+     */
+
+    g_heap_token = *(volatile uint64_t *)token;
+    *(volatile uint64_t *)token = 0;
+
+    return BF_SUCCESS;
+}
+
+int64_t
+grow_vmm_heap(void)
+{
+    int64_t ret = 0;
+    uint64_t i = 0;
+    struct vmcall_registers_t regs;
+
+    regs.r00 = VMCALL_HEAP;
+    regs.r01 = VMCALL_MAGIC_NUMBER;
+    regs.r02 = 0;
+    regs.r03 = 0;
+    regs.r04 = 0;
+    regs.r05 = g_heap_token;
+
+    platform_vmcall(&regs);
+    if (regs.r01 != 0)
+        return BF_SUCCESS;
+
+    for (i = 0; i < regs.r02; i++)
+    {
+        ret = add_heap_chunk_to_vmm();
+        if (ret != BF_SUCCESS)
+            return ret;
+    }
+
+    for (i = 0; i < regs.r03; i++)
+    {
+        ret = add_page_chunk_to_vmm();
+        if (ret != BF_SUCCESS)
+            return ret;
     }
 
     return BF_SUCCESS;
@@ -256,6 +428,20 @@ common_reset(void)
     if (g_stack != 0)
         platform_free_rw(g_stack, g_stack_size);
 
+    for (i = 0; i < (int64_t)g_num_heap_chunks; i++)
+        platform_free_rw(g_heap_chunks[i], MAX_HEAP_POOL);
+
+    for (i = 0; i < (int64_t)g_num_page_chunks; i++)
+        platform_free_rw(g_page_chunks[i], MAX_PAGE_POOL);
+
+    g_num_heap_chunks = 0;
+    g_num_page_chunks = 0;
+
+    g_pool_generation = 0;
+    g_last_pool_generation = 0;
+
+    g_heap_token = 0;
+
     g_tls = 0;
     g_stack = 0;
     g_stack_top = 0;
@@ -269,6 +455,16 @@ common_init(void)
     return common_reset();
 }
 
+int64_t
+common_set_extra_heap_chunks(uint64_t num)
+{
+    if (num > MAX_HEAP_CHUNKS)
+        return BF_ERROR_INVALID_ARG;
+
+    g_extra_heap_chunks = num;
+    return BF_SUCCESS;
+}
+
 int64_t
 common_fini(void)
 {
@@ -359,6 +555,7 @@ common_load_vmm(void)
     int64_t i = 0;
     int64_t ret = 0;
     int64_t ignore_ret = 0;
+    uint64_t num_heap_chunks = 0;
     struct module_t *module = 0;
 
     if (common_vmm_status() == VMM_CORRUPT)
@@ -424,16 +621,22 @@ common_load_vmm(void)
             goto failure;
     }
 
-    {
-        uint64_t tlss = (uint64_t)g_tls;
-        uint64_t tlse = tlss + g_tls_size;
+    ret = add_raw_md_to_memory_manager((uint64_t)g_tls, g_tls_size, MEMORY_TYPE_R | MEMORY_TYPE_W);
+    if (ret != BF_SUCCESS)
+        return ret;
 
-        for (; tlss <= tlse; tlss += MAX_PAGE_SIZE)
-        {
-            ret = add_raw_md_to_memory_manager(tlss, MEMORY_TYPE_R | MEMORY_TYPE_W);
-            if (ret != BF_SUCCESS)
-                return ret;
-        }
+    ret = take_heap_token();
+    if (ret != BF_SUCCESS)
+        goto failure;
+
+    num_heap_chunks = ((uint64_t)platform_num_cpus() + HEAP_CHUNK_CPUS - 1) / HEAP_CHUNK_CPUS;
+    num_heap_chunks += g_extra_heap_chunks;
+
+    for (i = 0; i < (int64_t)num_heap_chunks; i++)
+    {
+        ret = add_heap_chunk_to_vmm();
+        if (ret != BF_SUCCESS)
+            goto failure;
     }
 
     g_vmm_status = VMM_LOADED;
@@ -606,6 +809,18 @@ common_dump_vmm(struct debug_ring_resources_t **drr, uint64_t vcpuid)
     return BF_SUCCESS;
 }
 
+int64_t
+flush_vmm_translations(void)
+{
+    struct vmcall_registers_t regs;
+
+    regs.r00 = VMCALL_FLUSH;
+    regs.r01 = VMCALL_MAGIC_NUMBER;
+
+    platform_vmcall(&regs);
+    return regs.r01 == 0 ? BF_SUCCESS : BF_ERROR_VMM_INVALID_STATE;
+}
+
 int64_t
 common_vmcall(struct vmcall_registers_t *regs, uint64_t cpuid)
 {
@@ -635,13 +850,52 @@ common_vmcall(struct vmcall_registers_t *regs, uint64_t cpuid)
             return ret;
     }
 
+    /*
+     * The buffers of a forwarded vmcall are addresses in the caller's
+     * process, and the VMM only drops the translations it has cached when
+     * the guest's CR3 changes. A process's addresses can be reused for
+     * different memory once they are unmapped (and its CR3 once it exits),
+     * so the VMM is told to drop its translations before the vmcall is
+     * forwarded.
+     */
+
+    ret = BF_SUCCESS;
+
     if (regs->r00 == VMCALL_EVENT)
         platform_vmcall_event(regs);
     else
-        platform_vmcall(regs);
+    {
+        ret = flush_vmm_translations();
+        if (ret == BF_SUCCESS)
+            platform_vmcall(regs);
+    }
 
     if (signed_cpuid >= 0)
         platform_restore_affinity(caller_affinity);
 
-    return BF_SUCCESS;
+    return ret;
+}
+
+int64_t
+common_poll_vmm(void)
+{
+    int64_t ret = 0;
+    uint64_t generation = 0;
+
+    if (common_vmm_status() != VMM_RUNNING)
+        return BF_SUCCESS;
+
+    if (g_pool_generation == 0)
+    {
+        ret = resolve_symbol("g_pool_generation", (void **)&g_pool_generation);
+        if (ret != BF_SUCCESS)
+            return ret;
+    }
+
+    generation = *(volatile uint64_t *)g_pool_generation;
+    if (generation == g_last_pool_generation)
+        return BF_SUCCESS;
+
+    g_last_pool_generation = generation;
+    return grow_vmm_heap();
 }
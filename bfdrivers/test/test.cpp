@@ -156,9 +156,12 @@ driver_entry_ut::list()
     this->test_common_load_add_md_tls_failed();
     this->test_common_load_tls_platform_alloc_failed();
     this->test_common_load_stack_platform_alloc_failed();
+    this->test_common_load_heap_platform_alloc_failed();
+    this->test_common_load_extra_heap_chunks();
     this->test_common_load_loader_add_failed();
     this->test_common_load_resolve_symbol_failed();
     this->test_common_load_execute_symbol_failed();
+    this->test_common_load_takes_heap_token();
 
     this->test_common_unload_unload_when_already_unloaded();
     this->test_common_unload_unload_when_running();
@@ -198,6 +201,11 @@ driver_entry_ut::list()
     this->test_common_vmcall_vmcall_when_corrupt();
     this->test_common_vmcall_vmcall_when_loaded();
 
+    this->test_common_poll_poll_when_unloaded();
+    this->test_common_poll_poll_when_loaded();
+    this->test_common_poll_poll_when_unchanged();
+    this->test_common_poll_poll_when_changed();
+
     this->test_helper_common_vmm_status();
     this->test_helper_get_file_invalid_index();
     this->test_helper_get_file_success();
@@ -72,9 +72,12 @@ private:
     void test_common_load_add_md_tls_failed();
     void test_common_load_tls_platform_alloc_failed();
     void test_common_load_stack_platform_alloc_failed();
+    void test_common_load_heap_platform_alloc_failed();
+    void test_common_load_extra_heap_chunks();
     void test_common_load_loader_add_failed();
     void test_common_load_resolve_symbol_failed();
     void test_common_load_execute_symbol_failed();
+    void test_common_load_takes_heap_token();
 
     void test_common_unload_unload_when_already_unloaded();
     void test_common_unload_unload_when_running();
@@ -114,6 +117,11 @@ private:
     void test_common_vmcall_vmcall_when_corrupt();
     void test_common_vmcall_vmcall_when_loaded();
 
+    void test_common_poll_poll_when_unloaded();
+    void test_common_poll_poll_when_loaded();
+    void test_common_poll_poll_when_unchanged();
+    void test_common_poll_poll_when_changed();
+
     void test_helper_common_vmm_status();
     void test_helper_get_file_invalid_index();
     void test_helper_get_file_success();
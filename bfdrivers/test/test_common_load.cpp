@@ -37,11 +37,12 @@ extern "C"
     struct module_t *get_module(uint64_t index);
     int64_t resolve_symbol(const char *name, void **sym);
     int64_t execute_symbol(const char *sym, uint64_t arg1, uint64_t arg2, uint64_t cpuid);
-    int64_t add_raw_md_to_memory_manager(uint64_t virt, uint64_t type);
+    int64_t add_raw_md_to_memory_manager(uint64_t virt, uint64_t size, uint64_t type);
     int64_t add_md_to_memory_manager(struct module_t *module);
 }
 
 extern uint64_t g_malloc_fails;
+extern "C" uint64_t g_heap_token;
 
 // -----------------------------------------------------------------------------
 // Tests
@@ -190,6 +191,42 @@ driver_entry_ut::test_common_load_stack_platform_alloc_failed()
     this->expect_true(common_fini() == BF_SUCCESS);
 }
 
+void
+driver_entry_ut::test_common_load_heap_platform_alloc_failed()
+{
+    g_malloc_fails = MAX_HEAP_POOL;
+
+    auto ___ = gsl::finally([&]
+    { g_malloc_fails = 0; });
+
+    this->expect_true(common_add_module(m_dummy_start_vmm_success.get(), m_dummy_start_vmm_success_length) == BF_SUCCESS);
+    this->expect_true(common_add_module(m_dummy_stop_vmm_success.get(), m_dummy_stop_vmm_success_length) == BF_SUCCESS);
+    this->expect_true(common_add_module(m_dummy_add_md_success.get(), m_dummy_add_md_success_length) == BF_SUCCESS);
+    this->expect_true(common_add_module(m_dummy_misc.get(), m_dummy_misc_length) == BF_SUCCESS);
+    this->expect_true(common_load_vmm() == BF_ERROR_OUT_OF_MEMORY);
+    this->expect_true(common_vmm_status() == VMM_UNLOADED);
+    this->expect_true(common_fini() == BF_SUCCESS);
+}
+
+void
+driver_entry_ut::test_common_load_extra_heap_chunks()
+{
+    this->expect_true(common_set_extra_heap_chunks(MAX_HEAP_CHUNKS + 1) == BF_ERROR_INVALID_ARG);
+    this->expect_true(common_set_extra_heap_chunks(2) == BF_SUCCESS);
+
+    auto ___ = gsl::finally([&]
+    { common_set_extra_heap_chunks(0); });
+
+    this->expect_true(common_add_module(m_dummy_start_vmm_success.get(), m_dummy_start_vmm_success_length) == BF_SUCCESS);
+    this->expect_true(common_add_module(m_dummy_stop_vmm_success.get(), m_dummy_stop_vmm_success_length) == BF_SUCCESS);
+    this->expect_true(common_add_module(m_dummy_add_md_success.get(), m_dummy_add_md_success_length) == BF_SUCCESS);
+    this->expect_true(common_add_module(m_dummy_misc.get(), m_dummy_misc_length) == BF_SUCCESS);
+    this->expect_true(common_load_vmm() == BF_SUCCESS);
+    this->expect_true(common_vmm_status() == VMM_LOADED);
+    this->expect_true(common_fini() == BF_SUCCESS);
+    this->expect_true(common_vmm_status() == VMM_UNLOADED);
+}
+
 void
 driver_entry_ut::test_common_load_loader_add_failed()
 {
@@ -246,3 +283,22 @@ driver_entry_ut::test_common_load_execute_symbol_failed()
 
     this->expect_true(common_fini() == BF_SUCCESS);
 }
+
+void
+driver_entry_ut::test_common_load_takes_heap_token()
+{
+    uint64_t *token = nullptr;
+
+    this->expect_true(common_add_module(m_dummy_start_vmm_success.get(), m_dummy_start_vmm_success_length) == BF_SUCCESS);
+    this->expect_true(common_add_module(m_dummy_stop_vmm_success.get(), m_dummy_stop_vmm_success_length) == BF_SUCCESS);
+    this->expect_true(common_add_module(m_dummy_add_md_success.get(), m_dummy_add_md_success_length) == BF_SUCCESS);
+    this->expect_true(common_add_module(m_dummy_misc.get(), m_dummy_misc_length) == BF_SUCCESS);
+    this->expect_true(common_load_vmm() == BF_SUCCESS);
+    this->expect_true(resolve_symbol("g_heap_token", reinterpret_cast<void **>(&token)) == BF_SUCCESS);
+
+    this->expect_true(g_heap_token == 0x1234);
+    this->expect_true(*token == 0);
+
+    this->expect_true(common_fini() == BF_SUCCESS);
+    this->expect_true(g_heap_token == 0);
+}
@@ -0,0 +1,123 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <gsl/gsl>
+
+#include <test.h>
+
+#include <common.h>
+#include <platform.h>
+
+extern "C"
+{
+    int64_t resolve_symbol(const char *name, void **sym);
+}
+
+void
+driver_entry_ut::test_common_poll_poll_when_unloaded()
+{
+    MockRepository mocks;
+    mocks.NeverCallFunc(platform_vmcall);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_true(common_poll_vmm() == BF_SUCCESS);
+    });
+}
+
+void
+driver_entry_ut::test_common_poll_poll_when_loaded()
+{
+    this->expect_true(common_add_module(m_dummy_start_vmm_success.get(), m_dummy_start_vmm_success_length) == BF_SUCCESS);
+    this->expect_true(common_add_module(m_dummy_stop_vmm_success.get(), m_dummy_stop_vmm_success_length) == BF_SUCCESS);
+    this->expect_true(common_add_module(m_dummy_add_md_success.get(), m_dummy_add_md_success_length) == BF_SUCCESS);
+    this->expect_true(common_add_module(m_dummy_misc.get(), m_dummy_misc_length) == BF_SUCCESS);
+    this->expect_true(common_load_vmm() == BF_SUCCESS);
+
+    {
+        MockRepository mocks;
+        mocks.NeverCallFunc(platform_vmcall);
+
+        RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+        {
+            this->expect_true(common_poll_vmm() == BF_SUCCESS);
+        });
+    }
+
+    this->expect_true(common_fini() == BF_SUCCESS);
+}
+
+void
+driver_entry_ut::test_common_poll_poll_when_unchanged()
+{
+    this->expect_true(common_add_module(m_dummy_start_vmm_success.get(), m_dummy_start_vmm_success_length) == BF_SUCCESS);
+    this->expect_true(common_add_module(m_dummy_stop_vmm_success.get(), m_dummy_stop_vmm_success_length) == BF_SUCCESS);
+    this->expect_true(common_add_module(m_dummy_add_md_success.get(), m_dummy_add_md_success_length) == BF_SUCCESS);
+    this->expect_true(common_add_module(m_dummy_misc.get(), m_dummy_misc_length) == BF_SUCCESS);
+    this->expect_true(common_load_vmm() == BF_SUCCESS);
+    this->expect_true(common_start_vmm() == BF_SUCCESS);
+
+    {
+        MockRepository mocks;
+        mocks.NeverCallFunc(platform_vmcall);
+
+        RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+        {
+            this->expect_true(common_poll_vmm() == BF_SUCCESS);
+        });
+    }
+
+    this->expect_true(common_fini() == BF_SUCCESS);
+}
+
+void
+driver_entry_ut::test_common_poll_poll_when_changed()
+{
+    uint64_t *generation = nullptr;
+
+    this->expect_true(common_add_module(m_dummy_start_vmm_success.get(), m_dummy_start_vmm_success_length) == BF_SUCCESS);
+    this->expect_true(common_add_module(m_dummy_stop_vmm_success.get(), m_dummy_stop_vmm_success_length) == BF_SUCCESS);
+    this->expect_true(common_add_module(m_dummy_add_md_success.get(), m_dummy_add_md_success_length) == BF_SUCCESS);
+    this->expect_true(common_add_module(m_dummy_misc.get(), m_dummy_misc_length) == BF_SUCCESS);
+    this->expect_true(common_load_vmm() == BF_SUCCESS);
+    this->expect_true(common_start_vmm() == BF_SUCCESS);
+    this->expect_true(resolve_symbol("g_pool_generation", reinterpret_cast<void **>(&generation)) == BF_SUCCESS);
+
+    (*generation)++;
+
+    {
+        MockRepository mocks;
+        mocks.ExpectCallFunc(platform_vmcall).Do([](auto regs)
+        {
+            regs->r01 = 0;
+            regs->r02 = 0;
+            regs->r03 = 0;
+        });
+
+        RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+        {
+            this->expect_true(common_poll_vmm() == BF_SUCCESS);
+            this->expect_true(common_poll_vmm() == BF_SUCCESS);
+        });
+    }
+
+    this->expect_true(common_fini() == BF_SUCCESS);
+}
@@ -39,7 +39,8 @@ enum type
     stop = 5,
     dump = 6,
     status = 7,
-    vmcall = 8
+    vmcall = 8,
+    stats = 9
 };
 }
 
@@ -134,9 +135,9 @@ public:
 
     /// VMCall Registers
     ///
-    /// When a VMCall command is provided, this struct is filled in which
-    /// is then sent to the driver to be delivered to the hypervisor for
-    /// processing.
+    /// When a VMCall or stats command is provided, this struct is filled in
+    /// which is then sent to the driver to be delivered to the hypervisor
+    /// for processing.
     ///
     /// @expects none
     /// @ensures none
@@ -174,6 +175,7 @@ private:
     void parse_dump(arg_list_type &args);
     void parse_status(arg_list_type &args);
     void parse_vmcall(arg_list_type &args);
+    void parse_stats(arg_list_type &args);
 
     void parse_vmcall_version(arg_list_type &args);
     void parse_vmcall_registers(arg_list_type &args);
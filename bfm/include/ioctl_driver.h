@@ -95,6 +95,8 @@ private:
     void vmcall_event(registers_type &regs);
     void vmcall_unittest(registers_type &regs);
 
+    void vmm_stats();
+
     status_type get_status() const;
 
 private:
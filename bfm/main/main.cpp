@@ -81,6 +81,8 @@ help()
     std::cout << "  or:  bfm [OPTION]... vmcall data type ifile ofile..." << std::endl;
     std::cout << "  or:  bfm [OPTION]... vmcall unittest index..." << std::endl;
     std::cout << "  or:  bfm [OPTION]... vmcall event index..." << std::endl;
+    std::cout << "  or:  bfm [OPTION]... stats type..." << std::endl;
+    std::cout << "  or:  bfm [OPTION]... stats exits [reset]" << std::endl;
     std::cout << "Controls or queries the bareflank hypervisor" << std::endl;
     std::cout << std::endl;
     std::cout << "       -h, --help      show this help menu" << std::endl;
@@ -94,6 +96,13 @@ help()
     std::cout << " vmcall binary types:" << std::endl;
     std::cout << "       unformatted     unformatted binary data" << std::endl;
     std::cout << std::endl;
+    std::cout << " stats types:" << std::endl;
+    std::cout << "       memory          memory pool statistics and live bytes per tag" << std::endl;
+    std::cout << "       exits           exit counts and cycles of the vcpu on --cpuid" << std::endl;
+    std::cout << std::endl;
+    std::cout << " stats notes:" << std::endl;
+    std::cout << "       - exits reset clears the exit stats once returned" << std::endl;
+    std::cout << std::endl;
     std::cout << " vmcall notes:" << std::endl;
     std::cout << "       - registers are represented in hex" << std::endl;
     std::cout << "       - data / string uuids equal 0" << std::endl;
@@ -90,6 +90,7 @@ command_line_parser::parse(const arg_list_type &args)
     if (cmd == "dump") return parse_dump(filtered_args);
     if (cmd == "status") return parse_status(filtered_args);
     if (cmd == "vmcall") return parse_vmcall(filtered_args);
+    if (cmd == "stats") return parse_stats(filtered_args);
 
     throw unknown_command(cmd);
 }
@@ -198,6 +199,36 @@ command_line_parser::parse_vmcall(arg_list_type &args)
     throw unknown_vmcall_type(opcode);
 }
 
+void
+command_line_parser::parse_stats(arg_list_type &args)
+{
+    if (args.empty())
+        throw missing_argument();
+
+    auto type = bfn::take(args, 0);
+
+    m_registers.r00 = VMCALL_STATS;
+    m_registers.r01 = VMCALL_MAGIC_NUMBER;
+
+    if (type == "memory")
+    {
+        m_registers.r02 = VMCALL_STATS_MEMORY;
+    }
+    else if (type == "exits")
+    {
+        m_registers.r02 = VMCALL_STATS_EXITS;
+
+        if (!args.empty() && args[0] == "reset")
+            m_registers.r03 = 1;
+    }
+    else
+    {
+        throw unknown_stats_type(type);
+    }
+
+    m_cmd = command_type::stats;
+}
+
 void
 command_line_parser::parse_vmcall_version(arg_list_type &args)
 {
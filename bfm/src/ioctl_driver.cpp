@@ -64,6 +64,9 @@ ioctl_driver::process()
 
         case command_line_parser::command_type::vmcall:
             return this->vmcall();
+
+        case command_line_parser::command_type::stats:
+            return this->vmm_stats();
     }
 }
 
@@ -372,6 +375,35 @@ ioctl_driver::vmcall_unittest(registers_type &regs)
     std::cout << "\033[1;36m" << std::hex << "0x" << regs.r02 << std::dec << ":\033[1;32m passed\033[0m\n";
 }
 
+void
+ioctl_driver::vmm_stats()
+{
+    auto regs = m_clp->registers();
+
+    switch (get_status())
+    {
+        case VMM_RUNNING: break;
+        case VMM_LOADED: throw invalid_vmm_state("vmm must be running first");
+        case VMM_UNLOADED: throw invalid_vmm_state("vmm must be running first");
+        case VMM_CORRUPT: throw corrupt_vmm();
+        default: throw unknown_status();
+    }
+
+    auto &&obuffer = std::make_unique<char[]>(VMCALL_OUT_BUFFER_SIZE);
+    regs.r08 = reinterpret_cast<decltype(regs.r08)>(obuffer.get());
+    regs.r09 = VMCALL_OUT_BUFFER_SIZE;
+
+    vmcall_send_regs(regs);
+
+    if (regs.r07 != VMCALL_DATA_STRING_JSON)
+        return;
+
+    if (regs.r09 >= VMCALL_OUT_BUFFER_SIZE)
+        throw std::out_of_range("return output buffer size out of range");
+
+    std::cout << json::parse(std::string(obuffer.get(), regs.r09)).dump(4) << '\n';
+}
+
 ioctl_driver::status_type
 ioctl_driver::get_status() const
 {
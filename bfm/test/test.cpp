@@ -95,6 +95,11 @@ bfm_ut::list()
     this->test_command_line_parser_vmcall_event_missing_index();
     this->test_command_line_parser_vmcall_event_invalid_index();
     this->test_command_line_parser_vmcall_event_success();
+    this->test_command_line_parser_stats_missing_type();
+    this->test_command_line_parser_stats_unknown_type();
+    this->test_command_line_parser_stats_memory();
+    this->test_command_line_parser_stats_exits();
+    this->test_command_line_parser_stats_exits_reset();
 
     this->test_file_read_with_bad_filename();
     this->test_file_write_with_bad_filename();
@@ -196,6 +201,11 @@ bfm_ut::list()
     this->test_ioctl_driver_process_vmcall_data_binary_unformatted_out_of_range();
     this->test_ioctl_driver_process_vmcall_data_binary_unformatted_success_no_return();
     this->test_ioctl_driver_process_vmcall_data_binary_unformatted_success_unformatted();
+    this->test_ioctl_driver_process_stats_vmm_loaded();
+    this->test_ioctl_driver_process_stats_ioctl_return_failed();
+    this->test_ioctl_driver_process_stats_out_of_range();
+    this->test_ioctl_driver_process_stats_success();
+    this->test_ioctl_driver_process_stats_exits_reset();
 
     return true;
 }
@@ -94,6 +94,11 @@ private:
     void test_command_line_parser_vmcall_event_missing_index();
     void test_command_line_parser_vmcall_event_invalid_index();
     void test_command_line_parser_vmcall_event_success();
+    void test_command_line_parser_stats_missing_type();
+    void test_command_line_parser_stats_unknown_type();
+    void test_command_line_parser_stats_memory();
+    void test_command_line_parser_stats_exits();
+    void test_command_line_parser_stats_exits_reset();
 
     void test_file_read_with_bad_filename();
     void test_file_write_with_bad_filename();
@@ -195,6 +200,11 @@ private:
     void test_ioctl_driver_process_vmcall_data_binary_unformatted_out_of_range();
     void test_ioctl_driver_process_vmcall_data_binary_unformatted_success_no_return();
     void test_ioctl_driver_process_vmcall_data_binary_unformatted_success_unformatted();
+    void test_ioctl_driver_process_stats_vmm_loaded();
+    void test_ioctl_driver_process_stats_ioctl_return_failed();
+    void test_ioctl_driver_process_stats_out_of_range();
+    void test_ioctl_driver_process_stats_success();
+    void test_ioctl_driver_process_stats_exits_reset();
 };
 
 #endif
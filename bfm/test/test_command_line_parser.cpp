@@ -40,6 +40,9 @@ static auto operator"" _uvste(const char *str, std::size_t len)
 static auto operator"" _uvdte(const char *str, std::size_t len)
 { (void)str; (void)len; return std::make_shared<bfn::unknown_vmcall_data_type_error>(""); }
 
+static auto operator"" _uste(const char *str, std::size_t len)
+{ (void)str; (void)len; return std::make_shared<bfn::unknown_stats_type_error>(""); }
+
 void
 bfm_ut::test_command_line_parser_with_no_args()
 {
@@ -672,3 +675,68 @@ bfm_ut::test_command_line_parser_vmcall_event_success()
     this->expect_true(clp.registers().r01 == VMCALL_MAGIC_NUMBER);
     this->expect_true(clp.registers().r02 == 1);
 }
+
+void
+bfm_ut::test_command_line_parser_stats_missing_type()
+{
+    auto &&args = {"stats"_s};
+    auto &&clp = command_line_parser{};
+
+    this->expect_exception([&] { clp.parse(args); }, ""_mae);
+    this->expect_true(clp.cmd() == command_line_parser::command_type::help);
+}
+
+void
+bfm_ut::test_command_line_parser_stats_unknown_type()
+{
+    auto &&args = {"stats"_s, "unknown"_s};
+    auto &&clp = command_line_parser{};
+
+    this->expect_exception([&] { clp.parse(args); }, ""_uste);
+    this->expect_true(clp.cmd() == command_line_parser::command_type::help);
+}
+
+void
+bfm_ut::test_command_line_parser_stats_memory()
+{
+    auto &&args = {"stats"_s, "memory"_s};
+    auto &&clp = command_line_parser{};
+
+    this->expect_no_exception([&] { clp.parse(args); });
+    this->expect_true(clp.cmd() == command_line_parser::command_type::stats);
+
+    this->expect_true(clp.registers().r00 == VMCALL_STATS);
+    this->expect_true(clp.registers().r01 == VMCALL_MAGIC_NUMBER);
+    this->expect_true(clp.registers().r02 == VMCALL_STATS_MEMORY);
+}
+
+void
+bfm_ut::test_command_line_parser_stats_exits()
+{
+    auto &&args = {"stats"_s, "exits"_s};
+    auto &&clp = command_line_parser{};
+
+    this->expect_no_exception([&] { clp.parse(args); });
+    this->expect_true(clp.cmd() == command_line_parser::command_type::stats);
+
+    this->expect_true(clp.registers().r00 == VMCALL_STATS);
+    this->expect_true(clp.registers().r01 == VMCALL_MAGIC_NUMBER);
+    this->expect_true(clp.registers().r02 == VMCALL_STATS_EXITS);
+    this->expect_true(clp.registers().r03 == 0);
+}
+
+void
+bfm_ut::test_command_line_parser_stats_exits_reset()
+{
+    auto &&args = {"--cpuid"_s, "2"_s, "stats"_s, "exits"_s, "reset"_s};
+    auto &&clp = command_line_parser{};
+
+    this->expect_no_exception([&] { clp.parse(args); });
+    this->expect_true(clp.cmd() == command_line_parser::command_type::stats);
+    this->expect_true(clp.cpuid() == 2);
+
+    this->expect_true(clp.registers().r00 == VMCALL_STATS);
+    this->expect_true(clp.registers().r01 == VMCALL_MAGIC_NUMBER);
+    this->expect_true(clp.registers().r02 == VMCALL_STATS_EXITS);
+    this->expect_true(clp.registers().r03 == 1);
+}
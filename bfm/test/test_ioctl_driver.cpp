@@ -1926,3 +1926,151 @@ bfm_ut::test_ioctl_driver_process_vmcall_data_binary_unformatted_success_unforma
         this->expect_no_exception([&]{ driver.process(); });
     });
 }
+
+void
+bfm_ut::test_ioctl_driver_process_stats_vmm_loaded()
+{
+    MockRepository mocks;
+
+    auto &&fil = setup_file(mocks);
+    auto &&ctl = setup_ioctl(mocks, VMM_LOADED);
+    auto &&clp = setup_command_line_parser(mocks, command_line_parser::command_type::stats);
+
+    mocks.NeverCall(ctl, ioctl::call_ioctl_vmcall);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&driver = ioctl_driver(fil, ctl, clp);
+        this->expect_exception([&]{ driver.process(); }, ""_ivse);
+    });
+}
+
+void
+bfm_ut::test_ioctl_driver_process_stats_ioctl_return_failed()
+{
+    MockRepository mocks;
+
+    auto &&fil = setup_file(mocks);
+    auto &&ctl = setup_ioctl(mocks, VMM_RUNNING);
+    auto &&clp = setup_command_line_parser(mocks, command_line_parser::command_type::stats);
+
+    mocks.OnCall(clp, command_line_parser::registers).Return(ioctl::registers_type
+    {
+        VMCALL_STATS,
+        0,
+        VMCALL_STATS_MEMORY,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    });
+
+    mocks.ExpectCall(ctl, ioctl::call_ioctl_vmcall).Do([](gsl::not_null<ioctl::registers_pointer> regs, auto)
+    {
+        regs->r01 = 1;
+    });
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&driver = ioctl_driver(fil, ctl, clp);
+        this->expect_exception([&]{ driver.process(); }, ""_ife);
+    });
+}
+
+void
+bfm_ut::test_ioctl_driver_process_stats_out_of_range()
+{
+    MockRepository mocks;
+
+    auto &&fil = setup_file(mocks);
+    auto &&ctl = setup_ioctl(mocks, VMM_RUNNING);
+    auto &&clp = setup_command_line_parser(mocks, command_line_parser::command_type::stats);
+
+    mocks.OnCall(clp, command_line_parser::registers).Return(ioctl::registers_type
+    {
+        VMCALL_STATS,
+        0,
+        VMCALL_STATS_MEMORY,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    });
+
+    mocks.ExpectCall(ctl, ioctl::call_ioctl_vmcall).Do([](gsl::not_null<ioctl::registers_pointer> regs, auto)
+    {
+        regs->r07 = VMCALL_DATA_STRING_JSON;
+        regs->r09 = VMCALL_OUT_BUFFER_SIZE + 1;
+    });
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&driver = ioctl_driver(fil, ctl, clp);
+        this->expect_exception([&]{ driver.process(); }, ""_ut_ore);
+    });
+}
+
+void
+bfm_ut::test_ioctl_driver_process_stats_success()
+{
+    MockRepository mocks;
+
+    auto &&fil = setup_file(mocks);
+    auto &&ctl = setup_ioctl(mocks, VMM_RUNNING);
+    auto &&clp = setup_command_line_parser(mocks, command_line_parser::command_type::stats);
+
+    mocks.OnCall(clp, command_line_parser::registers).Return(ioctl::registers_type
+    {
+        VMCALL_STATS,
+        0,
+        VMCALL_STATS_MEMORY,
+        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    });
+
+    mocks.ExpectCall(ctl, ioctl::call_ioctl_vmcall).Do([](gsl::not_null<ioctl::registers_pointer> regs, auto)
+    {
+        auto &&output = "{\"heap\":{\"allocs\":1}}"_s;
+        __builtin_memcpy(reinterpret_cast<char *>(regs->r08), output.c_str(), output.size());
+
+        regs->r07 = VMCALL_DATA_STRING_JSON;
+        regs->r09 = output.size();
+    });
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&driver = ioctl_driver(fil, ctl, clp);
+        this->expect_no_exception([&]{ driver.process(); });
+    });
+}
+
+void
+bfm_ut::test_ioctl_driver_process_stats_exits_reset()
+{
+    MockRepository mocks;
+
+    auto &&fil = setup_file(mocks);
+    auto &&ctl = setup_ioctl(mocks, VMM_RUNNING);
+    auto &&clp = setup_command_line_parser(mocks, command_line_parser::command_type::stats);
+
+    mocks.OnCall(clp, command_line_parser::registers).Return(ioctl::registers_type
+    {
+        VMCALL_STATS,
+        0,
+        VMCALL_STATS_EXITS,
+        1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
+    });
+
+    auto &&reset = false;
+
+    mocks.ExpectCall(ctl, ioctl::call_ioctl_vmcall).Do([&](gsl::not_null<ioctl::registers_pointer> regs, auto)
+    {
+        auto &&output = "{\"vcpuid\":0,\"exits\":{\"cpuid\":{\"count\":1,\"cycles\":300}}}"_s;
+        reset = regs->r02 == VMCALL_STATS_EXITS && regs->r03 == 1;
+
+        __builtin_memcpy(reinterpret_cast<char *>(regs->r08), output.c_str(), output.size());
+
+        regs->r07 = VMCALL_DATA_STRING_JSON;
+        regs->r09 = output.size();
+    });
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&driver = ioctl_driver(fil, ctl, clp);
+        this->expect_no_exception([&]{ driver.process(); });
+        this->expect_true(reset);
+    });
+}
@@ -0,0 +1,255 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#ifndef CPUID_CACHE_X64_H
+#define CPUID_CACHE_X64_H
+
+#include <map>
+
+#include <intrinsics/cpuid_x64.h>
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+
+constexpr const auto cpuid_cache_max_entries = 64UL;
+
+// -----------------------------------------------------------------------------
+// Definition
+// -----------------------------------------------------------------------------
+
+namespace bfn
+{
+
+/// CPUID Cache
+///
+/// CPUID always causes a VM exit, and executing CPUID in the VMM to emulate
+/// it is expensive (100+ cycles, more on some microcode). This cache keeps
+/// the result of each (leaf, subleaf) the first time it is executed, so
+/// that the CPUID instruction only runs on a miss. It is meant to be owned
+/// by a vCPU (each exit handler has one), as some leaves report values that
+/// belong to the CPU they run on (e.g. the APIC IDs of leaves 0x1 and 0xB),
+/// which stay correct as long as the cache is only used on that CPU.
+///
+/// Leaves can be masked or overridden (e.g. to hide a feature from the
+/// guest), which is applied when the result is cached, so that it costs
+/// nothing on a hit. The following are never taken from the cache:
+///
+/// - Leaf 0xD, whose XSAVE area sizes depend on the current XCR0 / XSS,
+///   is executed on every lookup (masks / overrides are still applied).
+///
+/// - CPUID.1:ECX.OSXSAVE and CPUID.7.0:ECX.OSPKE mirror CR4.OSXSAVE and
+///   CR4.PKE, which belong to the guest (and not the VMM that executes
+///   CPUID), so they are computed from the guest's CR4 on each lookup,
+///   unless they have been masked or overridden.
+///
+/// Most leaves ignore ECX, so the subleaf of these leaves is treated as 0
+/// (e.g. a mask of (1, 0) applies to CPUID.1 whatever the guest's ECX is).
+/// Only the leaves that take a subleaf (0x4, 0x7, 0xB, 0xD, 0xF, 0x10, 0x12,
+/// 0x14, 0x17, 0x18, 0x1F and 0x8000001D) are cached per subleaf.
+///
+/// Once cpuid_cache_max_entries results are cached, new (leaf, subleaf)
+/// pairs are executed without being cached, which bounds the size of the
+/// cache when the guest executes CPUID with garbage in ECX. The cache is
+/// never flushed on its own. Call invalidate if the CPU's answers may have
+/// changed (e.g. after a microcode update).
+///
+/// This class is not thread safe. Each vCPU should have its own.
+///
+class cpuid_cache_x64
+{
+public:
+
+    using leaf_type = x64::cpuid::field_type;
+    using value_type = x64::cpuid::value_type;
+    using cr4_type = uint64_t;
+    using size_type = size_t;
+
+    /// Result
+    ///
+    /// The values of EAX, EBX, ECX and EDX returned by CPUID.
+    ///
+    struct result_type
+    {
+        value_type eax;
+        value_type ebx;
+        value_type ecx;
+        value_type edx;
+    };
+
+    /// Default Constructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    cpuid_cache_x64() noexcept;
+
+    /// Destructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    virtual ~cpuid_cache_x64() = default;
+
+    /// Get
+    ///
+    /// Returns the result of CPUID for (leaf, subleaf), with any masks or
+    /// overrides applied, executing CPUID if the result is not cached.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param leaf the value of EAX
+    /// @param subleaf the value of ECX
+    /// @param cr4 the guest's CR4
+    /// @return the result of CPUID
+    ///
+    virtual result_type get(leaf_type leaf, leaf_type subleaf, cr4_type cr4);
+
+    /// Mask
+    ///
+    /// Changes the result of CPUID for (leaf, subleaf) to
+    /// (result & ~clear) | set, for each of the registers. Masking the same
+    /// (leaf, subleaf) again replaces the previous mask (or override).
+    ///
+    /// @b Example: @n
+    /// @code
+    /// // hide the hypervisor present bit
+    /// cache.mask(1, 0, {0, 0, 0x80000000, 0}, {0, 0, 0, 0});
+    /// @endcode
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param leaf the value of EAX
+    /// @param subleaf the value of ECX
+    /// @param clear the bits to clear
+    /// @param set the bits to set
+    ///
+    virtual void mask(leaf_type leaf, leaf_type subleaf, const result_type &clear, const result_type &set);
+
+    /// Override
+    ///
+    /// Replaces the result of CPUID for (leaf, subleaf). Same as masking
+    /// the leaf with every bit cleared.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param leaf the value of EAX
+    /// @param subleaf the value of ECX
+    /// @param result the result of CPUID to report
+    ///
+    virtual void set_override(leaf_type leaf, leaf_type subleaf, const result_type &result);
+
+    /// Clear Override
+    ///
+    /// Removes the mask or override of (leaf, subleaf), if there is one.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param leaf the value of EAX
+    /// @param subleaf the value of ECX
+    ///
+    virtual void clear_override(leaf_type leaf, leaf_type subleaf);
+
+    /// Invalidate
+    ///
+    /// Drops all of the cached results. Masks and overrides are kept.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    virtual void invalidate() noexcept;
+
+    /// Invalidate Leaf
+    ///
+    /// Drops the cached result of (leaf, subleaf).
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param leaf the value of EAX
+    /// @param subleaf the value of ECX
+    ///
+    virtual void invalidate(leaf_type leaf, leaf_type subleaf);
+
+    /// Hits
+    ///
+    /// @return the number of lookups that were found in the cache
+    ///
+    size_type hits() const noexcept
+    { return m_hits; }
+
+    /// Misses
+    ///
+    /// @return the number of lookups that had to execute CPUID
+    ///
+    size_type misses() const noexcept
+    { return m_misses; }
+
+private:
+
+    struct mask_type
+    {
+        result_type clear;
+        result_type set;
+    };
+
+    using key_type = uint64_t;
+
+    static key_type key(leaf_type leaf, leaf_type subleaf) noexcept;
+
+    // guest_ecx holds the bits of ECX that are computed from the guest's
+    // CR4 on each lookup
+
+    struct entry_type
+    {
+        result_type result;
+        value_type guest_ecx;
+    };
+
+    result_type execute(leaf_type leaf, leaf_type subleaf) const;
+
+    static value_type guest_bits(leaf_type leaf, leaf_type subleaf) noexcept;
+    static result_type with_guest_bits(const entry_type &entry, leaf_type leaf, cr4_type cr4) noexcept;
+
+private:
+
+    size_type m_hits;
+    size_type m_misses;
+
+    std::map<key_type, entry_type> m_results;
+    std::map<key_type, mask_type> m_masks;
+
+public:
+
+    cpuid_cache_x64(cpuid_cache_x64 &&) noexcept = default;
+    cpuid_cache_x64 &operator=(cpuid_cache_x64 &&) noexcept = default;
+
+    cpuid_cache_x64(const cpuid_cache_x64 &) = delete;
+    cpuid_cache_x64 &operator=(const cpuid_cache_x64 &) = delete;
+};
+
+}
+
+#endif
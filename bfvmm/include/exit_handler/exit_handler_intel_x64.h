@@ -22,15 +22,33 @@
 #ifndef EXIT_HANDLER_INTEL_X64_H
 #define EXIT_HANDLER_INTEL_X64_H
 
+#include <map>
+#include <array>
 #include <memory>
+#include <vector>
+#include <functional>
 
 #include <json.h>
 #include <vmcall_interface.h>
 #include <vmcs/vmcs_intel_x64.h>
+#include <exit_handler/exit_stats.h>
+#include <exit_handler/cpuid_cache_x64.h>
 #include <memory_manager/map_ptr_x64.h>
+#include <memory_manager/page_walk_cache_x64.h>
 
 class vcpu_intel_x64;
 
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+
+// basic exit reasons go from 0 to 64 (xrstors)
+constexpr const auto exit_handler_num_exit_reasons = 65UL;
+
+// vmcall opcodes that are counted on their own by the exit stats (the
+// rest, including the opcodes used by extensions, are counted together)
+constexpr const auto exit_handler_num_vmcall_opcodes = 16UL;
+
 // -----------------------------------------------------------------------------
 // Exit Handler
 // -----------------------------------------------------------------------------
@@ -46,14 +64,56 @@ class vcpu_intel_x64;
 /// handler needed to execute a 64bit guest, with the TRUE controls being used.
 /// In general, the only instruction that needs to be emulated is the CPUID
 /// instruction. If more functionality is needed (which is likely), the user
-/// can subclass this class, and overload the handlers that are needed. The
-/// basics are provided with this class to ease development.
+/// can register handlers (and hooks) for the exit reasons that are needed
+/// (see register_handler), or subclass this class, and overload the
+/// handlers that are needed. The basics are provided with this class to
+/// ease development.
 ///
 class exit_handler_intel_x64
 {
 public:
 
     using ret_type = int64_t;
+    using handler_type = std::function<void(exit_handler_intel_x64 &)>;
+
+    /// Dispatch Entry
+    ///
+    /// The handler of a basic exit reason, and the hooks that are called
+    /// before (pre_hooks) and after (post_hooks) it, in the order they
+    /// were registered. If there is no handler, the exit is unimplemented,
+    /// and the CPU is halted.
+    ///
+    struct dispatch_entry_type
+    {
+        handler_type handler;
+        std::vector<handler_type> pre_hooks;
+        std::vector<handler_type> post_hooks;
+    };
+
+    using dispatch_table_type = std::array<dispatch_entry_type, exit_handler_num_exit_reasons>;
+    using exit_stats_type = exit_stats<exit_handler_num_exit_reasons, exit_handler_num_vmcall_opcodes>;
+
+    /// I/O Instruction
+    ///
+    /// An io_instruction exit, decoded from the exit qualification (see
+    /// the Intel SDM, table 27-5). The string forms (INS / OUTS) are
+    /// emulated one element per exit, and address is the guest linear
+    /// address of the element being transferred.
+    ///
+    struct io_instruction_type
+    {
+        vmcs_intel_x64_io_bitmap::port_type port;
+        uint32_t size;
+        bool in;
+        bool string;
+        bool rep;
+        bool immediate;
+        uintptr_t address;
+    };
+
+    using io_value_type = uint32_t;
+    using io_in_handler_type = std::function<io_value_type(exit_handler_intel_x64 &, const io_instruction_type &)>;
+    using io_out_handler_type = std::function<void(exit_handler_intel_x64 &, const io_instruction_type &, io_value_type)>;
 
     /// Default Constructor
     ///
@@ -106,6 +166,202 @@ public:
     ///
     virtual void complete_vmcall(ret_type ret, vmcall_registers_t &regs) noexcept;
 
+    /// Flush Guest Translations
+    ///
+    /// CR3 loads and INVLPG are not trapped, so the translations of guest
+    /// virtual addresses that each vCPU caches are only dropped when the
+    /// guest's CR3 changes. If the guest may have changed the memory behind
+    /// an address without changing its CR3, this tells every vCPU to drop
+    /// its translations before it handles its next vmcall. The
+    /// VMCALL_FLUSH vmcall calls this on behalf of the guest.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    virtual void flush_guest_translations() noexcept;
+
+    /// Register Handler
+    ///
+    /// Replaces the handler of a basic exit reason in this exit handler's
+    /// dispatch table. Each VM exit is dispatched by indexing the table
+    /// with its basic exit reason, so the cost of dispatching an exit does
+    /// not depend on the number of handlers (or extensions) registered.
+    /// The handler that was replaced is returned, so that the new handler
+    /// can still call it if it only handles some of the exits (e.g. some
+    /// of the MSRs).
+    ///
+    /// @note the handler is passed the exit handler that dispatched the
+    ///     exit, and should not capture it, as an exit handler can be
+    ///     moved.
+    ///
+    /// @b Example: @n
+    /// @code
+    /// auto &&prev = ehlr->register_handler(basic_exit_reason::cpuid, nullptr);
+    ///
+    /// ehlr->register_handler(basic_exit_reason::cpuid, [prev](exit_handler_intel_x64 & ehlr)
+    /// {
+    ///     g_count++;
+    ///     prev(ehlr);
+    /// });
+    /// @endcode
+    ///
+    /// @expects reason < exit_handler_num_exit_reasons
+    /// @ensures none
+    ///
+    /// @param reason the basic exit reason to handle
+    /// @param handler the new handler, or nullptr to remove the handler
+    /// @return the handler that was replaced
+    ///
+    virtual handler_type register_handler(intel_x64::vmcs::value_type reason, handler_type handler);
+
+    /// Register Pre Hook
+    ///
+    /// Adds a hook that is called before the handler of a basic exit
+    /// reason (e.g. to collect statistics, or to trace the exit).
+    ///
+    /// @expects reason < exit_handler_num_exit_reasons
+    /// @expects hook != nullptr
+    /// @ensures none
+    ///
+    /// @param reason the basic exit reason to hook
+    /// @param hook the hook to add
+    ///
+    virtual void register_pre_hook(intel_x64::vmcs::value_type reason, handler_type hook);
+
+    /// Register Post Hook
+    ///
+    /// Adds a hook that is called after the handler of a basic exit
+    /// reason returns. Handlers that do not return (e.g. VMXOFF, which
+    /// promotes the guest) do not call their post hooks.
+    ///
+    /// @expects reason < exit_handler_num_exit_reasons
+    /// @expects hook != nullptr
+    /// @ensures none
+    ///
+    /// @param reason the basic exit reason to hook
+    /// @param hook the hook to add
+    ///
+    virtual void register_post_hook(intel_x64::vmcs::value_type reason, handler_type hook);
+
+    /// Dispatch Table
+    ///
+    /// @note handlers and hooks should not be registered (and the table
+    ///     should not be modified) while the exit they handle is being
+    ///     dispatched.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return this exit handler's dispatch table
+    ///
+    dispatch_table_type &dispatch_table() noexcept
+    { return *m_dispatch_table; }
+
+    /// Set Dispatch Table
+    ///
+    /// Replaces this exit handler's dispatch table, which can be used to
+    /// switch between sets of handlers at runtime. Each exit handler (and
+    /// thus each vCPU) has its own table.
+    ///
+    /// @expects table != nullptr
+    /// @ensures none
+    ///
+    /// @param table the new dispatch table
+    /// @return the dispatch table that was replaced
+    ///
+    virtual std::unique_ptr<dispatch_table_type> set_dispatch_table(
+        std::unique_ptr<dispatch_table_type> table);
+
+    /// Make Default Dispatch Table
+    ///
+    /// @expects none
+    /// @ensures ret != nullptr
+    ///
+    /// @return a dispatch table containing the handlers provided by this
+    ///     class (CPUID, INVD, VMCALL, VMXOFF, RDMSR, WRMSR and
+    ///     I/O instructions)
+    ///
+    static std::unique_ptr<dispatch_table_type> make_default_dispatch_table();
+
+    /// Register I/O Handler
+    ///
+    /// Traps the guest's accesses of port (see vmcs_intel_x64_io_bitmap),
+    /// and emulates them using the provided handlers: the in handler
+    /// returns the value read by IN / INS, and the out handler is given
+    /// the value written by OUT / OUTS. The exit handler takes care of
+    /// the instruction itself (the guest's registers, memory and RIP).
+    /// If one of the handlers is a nullptr, that direction is executed
+    /// on the port on behalf of the guest, so a device can be emulated
+    /// for reads only, or for writes only.
+    ///
+    /// A handler is called for the first port of an access, with
+    /// io.size giving the number of ports that are accessed. Registering
+    /// a port again replaces its handlers.
+    ///
+    /// @b Example: @n
+    /// @code
+    /// ehlr->register_io_handler(0x3F8, nullptr,
+    ///     [](exit_handler_intel_x64 &, const auto &, auto value)
+    /// { bfdebug << "COM1: " << static_cast<char>(value) << bfendl; });
+    /// @endcode
+    ///
+    /// @expects in != nullptr || out != nullptr
+    /// @ensures none
+    ///
+    /// @param port the port to trap
+    /// @param in the handler for reads of port
+    /// @param out the handler for writes of port
+    ///
+    virtual void register_io_handler(vmcs_intel_x64_io_bitmap::port_type port,
+                                     io_in_handler_type in, io_out_handler_type out);
+
+    /// Decode I/O Instruction
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param qualification the exit qualification of an io_instruction
+    ///     exit
+    /// @return the decoded exit qualification (address is left as 0)
+    ///
+    static io_instruction_type decode_io_instruction(intel_x64::vmcs::value_type qualification) noexcept;
+
+    /// CPUID Cache
+    ///
+    /// The results of CPUID reported to the guest by this exit handler
+    /// (see bfn::cpuid_cache_x64). Extensions can use it to mask or
+    /// override leaves without handling the CPUID exit themselves.
+    ///
+    /// @b Example: @n
+    /// @code
+    /// ehlr->cpuid_cache().set_override(0x40000000, 0, {0x40000001, 0, 0, 0});
+    /// @endcode
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return this exit handler's CPUID cache
+    ///
+    bfn::cpuid_cache_x64 &cpuid_cache() noexcept
+    { return m_cpuid_cache; }
+
+    /// Exit Stats
+    ///
+    /// The number of VM exits handled by this exit handler (i.e. by this
+    /// vCPU) for each basic exit reason, and of VMCalls for each opcode,
+    /// with the cycles spent handling them (see exit_stats). The cycles
+    /// are counted from the start of dispatch() to the VM entry, so the
+    /// cost of the VM exit / VM entry transitions is not included. The
+    /// stats can be read from the host using "bfm stats exits".
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return this exit handler's exit stats
+    ///
+    exit_stats_type &stats() noexcept
+    { return *m_exit_stats; }
+
 protected:
 
     virtual void handle_exit(intel_x64::vmcs::value_type reason);
@@ -116,6 +372,10 @@ protected:
     void handle_vmxoff();
     void handle_rdmsr();
     void handle_wrmsr();
+    void handle_io_instruction();
+
+    io_value_type io_in(const io_instruction_type &io);
+    void io_out(const io_instruction_type &io, io_value_type value);
 
     void advance_rip() noexcept;
     void unimplemented_handler() noexcept;
@@ -126,8 +386,14 @@ protected:
     virtual void handle_vmcall_event(vmcall_registers_t &regs);
     virtual void handle_vmcall_start(vmcall_registers_t &regs);
     virtual void handle_vmcall_stop(vmcall_registers_t &regs);
+    virtual void handle_vmcall_heap(vmcall_registers_t &regs);
+    virtual void handle_vmcall_stats(vmcall_registers_t &regs);
+    virtual void handle_vmcall_flush(vmcall_registers_t &regs);
     virtual void handle_vmcall_unittest(vmcall_registers_t &regs);
 
+    virtual void handle_vmcall_stats_memory(json &ojson);
+    virtual void handle_vmcall_stats_exits(json &ojson);
+
     virtual void handle_vmcall_data_string_unformatted(
         const std::string &istr, std::string &ostr);
 
@@ -146,6 +412,8 @@ protected:
         vmcall_registers_t &regs, const json &str,
         const bfn::unique_map_ptr_x64<char> &omap);
 
+    uintptr_t map_guest_buffer(uintptr_t virt, size_t size);
+
 public:
 
     // The following are only marked public for unit testing. Do not use
@@ -154,9 +422,22 @@ public:
 
     vmcs_intel_x64 *m_vmcs;
     state_save_intel_x64 *m_state_save;
+    bfn::page_walk_cache_x64 m_walk_cache;
+    bfn::cpuid_cache_x64 m_cpuid_cache;
+    std::unique_ptr<dispatch_table_type> m_dispatch_table;
+    std::unique_ptr<exit_stats_type> m_exit_stats;
+    uint64_t m_exit_tsc;
+    uint64_t m_walk_cache_generation;
 
-    virtual void set_vmcs(gsl::not_null<vmcs_intel_x64 *> vmcs)
-    { m_vmcs = vmcs; }
+    struct io_handlers_type
+    {
+        io_in_handler_type in;
+        io_out_handler_type out;
+    };
+
+    std::map<vmcs_intel_x64_io_bitmap::port_type, io_handlers_type> m_io_handlers;
+
+    virtual void set_vmcs(gsl::not_null<vmcs_intel_x64 *> vmcs);
 
     virtual void set_state_save(gsl::not_null<state_save_intel_x64 *> state_save)
     { m_state_save = state_save; }
@@ -179,6 +460,13 @@ private:
     void unittest_1101_io_manipulators() const;
 #endif
 
+public:
+
+    exit_handler_intel_x64(exit_handler_intel_x64 &&) noexcept = default;
+    exit_handler_intel_x64 &operator=(exit_handler_intel_x64 &&) noexcept = default;
+
+    exit_handler_intel_x64(const exit_handler_intel_x64 &) = delete;
+    exit_handler_intel_x64 &operator=(const exit_handler_intel_x64 &) = delete;
 };
 
 #endif
@@ -0,0 +1,243 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#ifndef EXIT_STATS_H
+#define EXIT_STATS_H
+
+#include <gsl/gsl>
+
+#include <array>
+#include <atomic>
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+
+constexpr const auto exit_stats_num_buckets = 32UL;
+
+// -----------------------------------------------------------------------------
+// Definition
+// -----------------------------------------------------------------------------
+
+///
+/// *INDENT-OFF*
+///
+
+/// Exit Statistics
+///
+/// Counts the VM exits handled by a vCPU for each basic exit reason, and
+/// the VMCalls for each opcode, along with the number of cycles (TSC
+/// ticks) spent handling them, and a histogram of these cycles (bucket n
+/// counts the exits that took [2^n, 2^(n+1)) cycles, with the last bucket
+/// counting everything longer). Exit reasons and opcodes that are out of
+/// range share one extra set of counters.
+///
+/// This class is meant to be owned by a vCPU (each exit handler has one),
+/// so there is only ever one writer, and recording an exit is a handful of
+/// plain loads and stores (no lock, and no locked instruction). The
+/// counters are atomics so that they can still be read from another core
+/// without tearing.
+///
+/// @param num_reasons the number of basic exit reasons that have their
+///     own counters
+/// @param num_opcodes the number of vmcall opcodes that have their own
+///     counters
+///
+template<size_t num_reasons, size_t num_opcodes>
+class exit_stats
+{
+public:
+
+    using size_type = size_t;
+    using counter_type = uint64_t;
+
+    /// Report
+    ///
+    /// The counters of one exit reason, or one vmcall opcode.
+    ///
+    struct report_type
+    {
+        counter_type count;
+        counter_type cycles;
+        std::array<counter_type, exit_stats_num_buckets> histogram;
+    };
+
+    /// Constructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    exit_stats() noexcept
+    { clear(); }
+
+    /// Default Destructor
+    ///
+    ~exit_stats() = default;
+
+    /// Record Exit
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param reason the basic exit reason of the exit
+    /// @param cycles the number of cycles spent handling the exit
+    ///
+    void
+    record_exit(size_type reason, counter_type cycles) noexcept
+    { record(gsl::at(m_exits, index(reason, num_reasons)), cycles); }
+
+    /// Record VMCall
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param opcode the opcode of the vmcall (i.e. r0)
+    /// @param cycles the number of cycles spent handling the vmcall
+    ///
+    void
+    record_vmcall(size_type opcode, counter_type cycles) noexcept
+    { record(gsl::at(m_vmcalls, index(opcode, num_opcodes)), cycles); }
+
+    /// Exit Report
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param reason the basic exit reason (num_reasons returns the
+    ///     counters of the exit reasons that are out of range)
+    /// @return the counters of reason
+    ///
+    report_type
+    exit_report(size_type reason) const noexcept
+    { return report(gsl::at(m_exits, index(reason, num_reasons))); }
+
+    /// VMCall Report
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param opcode the vmcall opcode (num_opcodes returns the counters
+    ///     of the opcodes that are out of range)
+    /// @return the counters of opcode
+    ///
+    report_type
+    vmcall_report(size_type opcode) const noexcept
+    { return report(gsl::at(m_vmcalls, index(opcode, num_opcodes))); }
+
+    /// Clear
+    ///
+    /// Sets all of the counters back to 0.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    void
+    clear() noexcept
+    {
+        for (auto &&counters : m_exits)
+            clear(counters);
+
+        for (auto &&counters : m_vmcalls)
+            clear(counters);
+    }
+
+    /// Bucket
+    ///
+    /// @param cycles the number of cycles an exit took
+    /// @return the histogram bucket that counts cycles
+    ///
+    static size_type
+    bucket(counter_type cycles) noexcept
+    {
+        if (cycles == 0)
+            return 0;
+
+        auto &&index = 63UL - static_cast<size_type>(__builtin_clzl(cycles));
+        return index < exit_stats_num_buckets ? index : exit_stats_num_buckets - 1;
+    }
+
+private:
+
+    struct counters_type
+    {
+        std::atomic<counter_type> count;
+        std::atomic<counter_type> cycles;
+        std::array<std::atomic<counter_type>, exit_stats_num_buckets> histogram;
+    };
+
+    static size_type
+    index(size_type value, size_type max) noexcept
+    { return value < max ? value : max; }
+
+    static void
+    inc(std::atomic<counter_type> &counter, counter_type value) noexcept
+    { counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed); }
+
+    static void
+    record(counters_type &counters, counter_type cycles) noexcept
+    {
+        inc(counters.count, 1);
+        inc(counters.cycles, cycles);
+        inc(gsl::at(counters.histogram, bucket(cycles)), 1);
+    }
+
+    static report_type
+    report(const counters_type &counters) noexcept
+    {
+        report_type report = {};
+
+        report.count = counters.count.load(std::memory_order_relaxed);
+        report.cycles = counters.cycles.load(std::memory_order_relaxed);
+
+        for (auto i = 0UL; i < exit_stats_num_buckets; i++)
+            gsl::at(report.histogram, i) = gsl::at(counters.histogram, i).load(std::memory_order_relaxed);
+
+        return report;
+    }
+
+    static void
+    clear(counters_type &counters) noexcept
+    {
+        counters.count.store(0, std::memory_order_relaxed);
+        counters.cycles.store(0, std::memory_order_relaxed);
+
+        for (auto &&count : counters.histogram)
+            count.store(0, std::memory_order_relaxed);
+    }
+
+private:
+
+    std::array<counters_type, num_reasons + 1> m_exits;
+    std::array<counters_type, num_opcodes + 1> m_vmcalls;
+
+public:
+
+    exit_stats(const exit_stats &) = delete;
+    exit_stats &operator=(const exit_stats &) = delete;
+    exit_stats(exit_stats &&) noexcept = delete;
+    exit_stats &operator=(exit_stats &&) noexcept = delete;
+};
+
+///
+/// *INDENT-ON*
+///
+
+#endif
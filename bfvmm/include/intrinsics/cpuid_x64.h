@@ -101,6 +101,25 @@ namespace cpuid
         }
     }
 
+    namespace extended_processor_information
+    {
+        constexpr const auto addr = 0x80000001U;
+        constexpr const auto name = "extended_processor_information";
+
+        namespace edx
+        {
+            namespace pdpe1gb
+            {
+                constexpr const auto mask = 0x04000000U;
+                constexpr const auto from = 26;
+                constexpr const auto name = "pdpe1gb";
+
+                inline auto get() noexcept
+                { return get_bit(__cpuid_edx(addr), from) != 0; }
+            }
+        }
+    }
+
     namespace feature_information
     {
         constexpr const auto addr = 0x00000001U;
@@ -22,7 +22,13 @@
 #ifndef TLB_X64_H
 #define TLB_X64_H
 
+#include <cstdint>
+#include <type_traits>
+
+#include <constants.h>
+
 extern "C" void __invlpg(const void *virt) noexcept;
+extern "C" void __flush_tlb(void) noexcept;
 
 // *INDENT-OFF*
 
@@ -32,6 +38,34 @@ namespace tlb
 {
     template<class T, class = typename std::enable_if<std::is_pointer<T>::value>::type>
     void invlpg(T val) noexcept { __invlpg(val); }
+
+    /// Flush
+    ///
+    /// Flushes all of the (non-global) TLB entries of the current address
+    /// space by reloading CR3.
+    ///
+    inline void flush() noexcept { __flush_tlb(); }
+
+    /// Invalidate Range
+    ///
+    /// Invalidates the TLB entries of the pages in [virt, virt + size). Each
+    /// INVLPG is serializing, so once the range is larger than
+    /// TLB_FLUSH_RANGE_THRESHOLD pages, the whole TLB is flushed instead.
+    ///
+    inline void invlpg_range(uintptr_t virt, size_t size) noexcept
+    {
+        auto &&start = virt & ~(MAX_PAGE_SIZE - 1);
+        auto &&end = virt + size;
+
+        if (size > TLB_FLUSH_RANGE_THRESHOLD * MAX_PAGE_SIZE)
+        {
+            flush();
+            return;
+        }
+
+        for (auto addr = start; addr < end; addr += MAX_PAGE_SIZE)
+            __invlpg(reinterpret_cast<const void *>(addr));
+    }
 }
 }
 
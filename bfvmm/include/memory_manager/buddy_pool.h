@@ -0,0 +1,685 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#ifndef BUDDY_POOL_H
+#define BUDDY_POOL_H
+
+#include <gsl/gsl>
+
+#include <mutex>
+#include <array>
+#include <atomic>
+
+#include <constants.h>
+#include <memory_manager/mem_pool.h>
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+
+constexpr const auto buddy_pool_max_order = 18UL;
+constexpr const auto buddy_pool_num_orders = buddy_pool_max_order + 1;
+
+constexpr const auto buddy_pool_free_head = 0x80U;
+constexpr const auto buddy_pool_used_head = 0x40U;
+constexpr const auto buddy_pool_order_mask = 0x3FU;
+
+// -----------------------------------------------------------------------------
+// Definition
+// -----------------------------------------------------------------------------
+
+///
+/// *INDENT-OFF*
+///
+
+/// Buddy Pool
+///
+/// A binary buddy allocator for page sized memory. Unlike the mem_pool,
+/// which can only promise page alignment, each block this pool hands out
+/// is 2^order pages in size, and is naturally aligned (i.e. a block of
+/// order 9 is 2M in size, and 2M aligned). Alignment is based on the
+/// virtual address of the block, and not on the starting address of the
+/// pool, so the pool can start at any page aligned address.
+///
+/// Free blocks are stored in a free list per order, using the free memory
+/// itself for the list nodes, and the only metadata that is needed is a
+/// single byte per page that records the order of the block that starts
+/// at that page, and if that block is free or allocated. When a block is
+/// freed, it is merged with its buddy for as long as the buddy is also
+/// free, so large blocks become available again once their pieces have
+/// been freed. A second byte per page records the tag given to the block
+/// that was allocated at that page (see mem_tag.h).
+///
+/// Like the mem_pool, more buddy pools of the same type can be chained to
+/// this one using add_region, in which case allocations that this pool
+/// cannot serve are served by the regions.
+///
+/// Note that blocks are contiguous in the VMM's address space. They are
+/// only physically contiguous if the memory backing the pool is.
+///
+/// @param total_size total size in bytes of the memory pool
+/// @param page_shift page size in bit shifts
+///
+template<size_t total_size, size_t page_shift>
+class buddy_pool
+{
+    static_assert(total_size > 0, "total size must be larger than 0");
+    static_assert(total_size % (1UL << page_shift) == 0, "total size must be a multiple of page size");
+
+public:
+
+    using size_type = size_t;
+    using order_type = size_t;
+    using integer_pointer = uintptr_t;
+    using tag_type = uint8_t;
+
+    /// Report
+    ///
+    /// Describes how fragmented the pool is. free_blocks provides the
+    /// number of free blocks of each order, and largest_free is the size of
+    /// the largest block that can currently be allocated. high_water is the
+    /// largest number of bytes that have been allocated at any one time.
+    ///
+    struct report_type
+    {
+        size_type pool_size;
+        size_type free_size;
+        size_type largest_free;
+        size_type high_water;
+        std::array<size_type, buddy_pool_num_orders> free_blocks;
+    };
+
+    /// Constructor
+    ///
+    /// Creates a buddy pool with the starting virtual address of addr.
+    ///
+    /// @expects addr != 0
+    /// @expects addr is page aligned
+    /// @ensures none
+    ///
+    /// @param addr the starting address of the buddy pool
+    ///
+    buddy_pool(integer_pointer addr) noexcept_testing :
+        m_addr(addr),
+        m_region(nullptr)
+    {
+        if (addr == 0 || (addr & (page_size() - 1)) != 0)
+            static_construction_error();
+
+        integer_pointer end;
+        if (__builtin_uaddl_overflow(m_addr, total_size, &end))
+            static_construction_error();
+
+        region_clear();
+    }
+
+    /// Default Destructor
+    ///
+    ~buddy_pool() = default;
+
+    /// Allocate Memory
+    ///
+    /// Allocates the smallest block that is greater than or equal to size.
+    /// The block is aligned to its own size. If this pool's own region is
+    /// full, the regions that have been added using add_region are tried
+    /// in turn.
+    ///
+    /// @expects size > 0
+    /// @expects size <= total_size
+    /// @ensures ret != 0
+    ///
+    /// @param size the number of bytes to allocate
+    /// @param tag the tag to record for the allocation
+    /// @return the starting address of the allocated memory
+    ///
+    integer_pointer
+    alloc(size_type size, tag_type tag = 0)
+    {
+        // [[ensures ret: ret != 0]]
+        expects(size > 0);
+        expects(size <= total_size);
+
+        auto &&order = size_to_order(size);
+
+        for (auto pool = this; pool != nullptr; pool = pool->m_region.load(std::memory_order_acquire))
+        {
+            if (auto &&addr = pool->region_alloc(order, order, tag))
+                return addr;
+        }
+
+        throw std::bad_alloc();
+    }
+
+    /// Allocate Local Memory
+    ///
+    /// Same as alloc, but the block is only allocated from this pool's own
+    /// region, and never from the regions that have been added using
+    /// add_region. This is needed by users that keep metadata for the
+    /// pool's own region only (see slab_pool).
+    ///
+    /// @expects size > 0
+    /// @expects size <= total_size
+    /// @ensures ret != 0
+    ///
+    /// @param size the number of bytes to allocate
+    /// @param tag the tag to record for the allocation
+    /// @return the starting address of the allocated memory
+    ///
+    integer_pointer
+    alloc_local(size_type size, tag_type tag = 0)
+    {
+        // [[ensures ret: ret != 0]]
+        expects(size > 0);
+        expects(size <= total_size);
+
+        auto &&order = size_to_order(size);
+
+        if (auto &&addr = this->region_alloc(order, order, tag))
+            return addr;
+
+        throw std::bad_alloc();
+    }
+
+    /// Allocate Contiguous Memory
+    ///
+    /// Allocates a block of 2^order contiguous pages, aligned to the size of
+    /// the block.
+    ///
+    /// @expects order <= buddy_pool_max_order
+    /// @ensures ret != 0
+    ///
+    /// @param order the order of the block to allocate
+    /// @param tag the tag to record for the allocation
+    /// @return the starting address of the allocated memory
+    ///
+    integer_pointer
+    alloc_contiguous(order_type order, tag_type tag = 0)
+    {
+        // [[ensures ret: ret != 0]]
+        expects(order <= buddy_pool_max_order);
+
+        for (auto pool = this; pool != nullptr; pool = pool->m_region.load(std::memory_order_acquire))
+        {
+            if (auto &&addr = pool->region_alloc(order, order, tag))
+                return addr;
+        }
+
+        throw std::bad_alloc();
+    }
+
+    /// Allocate Aligned Memory
+    ///
+    /// Allocates a block that is greater than or equal to size, whose
+    /// starting address is aligned to align. Alignments smaller than a page
+    /// are rounded up to a page. Only the block needed for size is taken,
+    /// the rest of the aligned block is left in the pool. Like the block
+    /// itself, the alignment is only of the VMM's virtual address (see the
+    /// note on physical contiguity above).
+    ///
+    /// @expects size > 0
+    /// @expects size <= total_size
+    /// @expects align is a power of 2
+    /// @ensures ret != 0
+    ///
+    /// @param size the number of bytes to allocate
+    /// @param align the required alignment in bytes
+    /// @param tag the tag to record for the allocation
+    /// @return the starting address of the allocated memory
+    ///
+    integer_pointer
+    alloc_aligned(size_type size, size_type align, tag_type tag = 0)
+    {
+        // [[ensures ret: ret != 0]]
+        expects(size > 0);
+        expects(size <= total_size);
+        expects(align != 0 && (align & (align - 1)) == 0);
+
+        auto &&order = size_to_order(size);
+        auto &&align_order = size_to_order(align);
+        auto &&min_order = align_order > order ? align_order : order;
+
+        for (auto pool = this; pool != nullptr; pool = pool->m_region.load(std::memory_order_acquire))
+        {
+            if (auto &&addr = pool->region_alloc(order, min_order, tag))
+                return addr;
+        }
+
+        throw std::bad_alloc();
+    }
+
+    /// Free Memory
+    ///
+    /// Free's previously allocated memory, merging the block with its
+    /// buddy for as long as the buddy is also free. Addresses that were
+    /// not returned by one of the alloc functions are ignored.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param addr the address to free
+    /// @param tag if not nullptr, receives the tag that was recorded for
+    ///     the allocation
+    /// @return the number of bytes that were freed (0 if addr was not
+    ///     returned by one of the alloc functions)
+    ///
+    size_type
+    free(integer_pointer addr, tag_type *tag = nullptr) noexcept
+    {
+        if (auto &&pool = find_region(this, addr))
+            return pool->region_free(addr, tag);
+
+        return 0;
+    }
+
+    /// Contains Address
+    ///
+    /// Returns true if this buddy pool (or one of the regions added to it)
+    /// contains this address, returns false otherwise.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param addr to lookup
+    ///
+    bool
+    contains(integer_pointer addr) const noexcept
+    { return find_region(this, addr) != nullptr; }
+
+    /// Allocation Size
+    ///
+    /// Returns the size of the block that was allocated at addr. Returns
+    /// 0 if addr was not returned by one of the alloc functions.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param addr to lookup
+    ///
+    size_type
+    size(integer_pointer addr) const noexcept
+    {
+        if (auto &&pool = find_region(this, addr))
+            return pool->region_size(addr);
+
+        return 0;
+    }
+
+    /// Allocation Tag
+    ///
+    /// Returns the tag that was recorded for the block that was allocated
+    /// at addr. Returns 0 if addr was not returned by one of the alloc
+    /// functions.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param addr to lookup
+    ///
+    tag_type
+    tag(integer_pointer addr) const noexcept
+    {
+        if (auto &&pool = find_region(this, addr))
+            return pool->region_tag(addr);
+
+        return 0;
+    }
+
+    /// Add Region
+    ///
+    /// Chains another buddy pool of the same type to this one. Once added,
+    /// allocations that do not fit in this pool are served by the region,
+    /// and free / size / tag / contains work on addresses that came from
+    /// it. Regions are never removed, and the region must outlive this
+    /// pool. Adding a region is safe while other cores are allocating.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param region the buddy pool to add
+    ///
+    void
+    add_region(buddy_pool *region) noexcept
+    {
+        if (region == nullptr || region == this)
+            return;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        region->m_region.store(m_region.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        m_region.store(region, std::memory_order_release);
+    }
+
+    /// Fragmentation Report
+    ///
+    /// The report covers this pool, and all of the regions that have been
+    /// added to it. Blocks never span regions, so largest_free is the
+    /// largest block of any one region.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return a report of the free blocks in the pool
+    ///
+    report_type
+    report() const noexcept
+    {
+        report_type report = {};
+
+        for (auto pool = this; pool != nullptr; pool = pool->m_region.load(std::memory_order_acquire))
+            pool->region_report(report);
+
+        return report;
+    }
+
+    /// Clear Buddy Pool
+    ///
+    /// This is a very dangerous function, and will effectively run free() on
+    /// all memory previously allocated, including the memory allocated from
+    /// the regions that have been added to this pool.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    void
+    clear() noexcept
+    {
+        for (auto pool = this; pool != nullptr; pool = pool->m_region.load(std::memory_order_acquire))
+            pool->region_clear();
+    }
+
+    /// Size To Order
+    ///
+    /// @param size the number of bytes requested
+    /// @return the order of the smallest block that can hold size
+    ///
+    static order_type
+    size_to_order(size_type size) noexcept
+    {
+        if (size <= page_size())
+            return 0;
+
+        return 64UL - static_cast<order_type>(__builtin_clzl(size - 1)) - page_shift;
+    }
+
+private:
+
+    struct free_block
+    {
+        free_block *next;
+        free_block *prev;
+    };
+
+    integer_pointer
+    region_alloc(order_type order, order_type min_order, tag_type tag) noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto search = min_order;
+
+        while (search <= buddy_pool_max_order && gsl::at(m_free, search) == nullptr)
+            search++;
+
+        if (search > buddy_pool_max_order)
+            return 0;
+
+        auto &&addr = reinterpret_cast<integer_pointer>(gsl::at(m_free, search));
+        remove_block(addr, search);
+
+        while (search > order)
+        {
+            search--;
+            push_block(addr + (page_size() << search), search);
+        }
+
+        page_state(addr) = static_cast<uint8_t>(buddy_pool_used_head | order);
+        page_tag(addr) = tag;
+
+        m_allocated += page_size() << order;
+        if (m_allocated > m_high_water)
+            m_high_water = m_allocated;
+
+        return addr;
+    }
+
+    size_type
+    region_free(integer_pointer addr, tag_type *tag) noexcept
+    {
+        if ((addr & (page_size() - 1)) != 0)
+            return 0;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto &&state = page_state(addr);
+        if ((state & buddy_pool_used_head) == 0)
+            return 0;
+
+        auto order = static_cast<order_type>(state & buddy_pool_order_mask);
+        auto &&freed = page_size() << order;
+
+        if (tag != nullptr)
+            *tag = page_tag(addr);
+
+        state = 0;
+        m_allocated -= freed;
+
+        while (order < buddy_pool_max_order)
+        {
+            auto &&buddy = addr ^ (page_size() << order);
+
+            if (!contains_block(buddy, order))
+                break;
+
+            if (page_state(buddy) != (buddy_pool_free_head | order))
+                break;
+
+            remove_block(buddy, order);
+
+            addr = addr < buddy ? addr : buddy;
+            order++;
+        }
+
+        push_block(addr, order);
+        return freed;
+    }
+
+    size_type
+    region_size(integer_pointer addr) const noexcept
+    {
+        if ((addr & (page_size() - 1)) != 0)
+            return 0;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto &&state = page_state(addr);
+        if ((state & buddy_pool_used_head) == 0)
+            return 0;
+
+        return page_size() << (state & buddy_pool_order_mask);
+    }
+
+    tag_type
+    region_tag(integer_pointer addr) const noexcept
+    {
+        if ((addr & (page_size() - 1)) != 0)
+            return 0;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if ((page_state(addr) & buddy_pool_used_head) == 0)
+            return 0;
+
+        return page_tag(addr);
+    }
+
+    void
+    region_report(report_type &report) const noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        report.pool_size += total_size;
+        report.high_water += m_high_water;
+
+        for (auto order = 0UL; order < buddy_pool_num_orders; order++)
+        {
+            auto &&count = gsl::at(m_free_count, order);
+
+            gsl::at(report.free_blocks, order) += count;
+            report.free_size += count * (page_size() << order);
+
+            if (count != 0 && (page_size() << order) > report.largest_free)
+                report.largest_free = page_size() << order;
+        }
+    }
+
+    void
+    region_clear() noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_allocated = 0;
+        m_high_water = 0;
+
+        m_free.fill(nullptr);
+        m_free_count.fill(0);
+        m_state.fill(0);
+
+        auto addr = m_addr;
+        while (addr < m_addr + total_size)
+        {
+            auto order = 0UL;
+
+            while (order < buddy_pool_max_order &&
+                   (addr & ((page_size() << (order + 1)) - 1)) == 0 &&
+                   contains_block(addr, order + 1))
+            {
+                order++;
+            }
+
+            push_block(addr, order);
+            addr += page_size() << order;
+        }
+    }
+
+    bool
+    region_contains(integer_pointer addr) const noexcept
+    { return (addr >= m_addr && addr < m_addr + total_size); }
+
+    template<class pool_type>
+    static pool_type *
+    find_region(pool_type *pool, integer_pointer addr) noexcept
+    {
+        for (; pool != nullptr; pool = pool->m_region.load(std::memory_order_acquire))
+        {
+            if (pool->region_contains(addr))
+                return pool;
+        }
+
+        return nullptr;
+    }
+
+    void
+    push_block(integer_pointer addr, order_type order) noexcept
+    {
+        auto &&block = reinterpret_cast<free_block *>(addr);
+        auto &&head = gsl::at(m_free, order);
+
+        block->next = head;
+        block->prev = nullptr;
+
+        if (head != nullptr)
+            head->prev = block;
+
+        head = block;
+        gsl::at(m_free_count, order)++;
+
+        page_state(addr) = static_cast<uint8_t>(buddy_pool_free_head | order);
+    }
+
+    void
+    remove_block(integer_pointer addr, order_type order) noexcept
+    {
+        auto &&block = reinterpret_cast<free_block *>(addr);
+
+        if (block->prev != nullptr)
+            block->prev->next = block->next;
+        else
+            gsl::at(m_free, order) = block->next;
+
+        if (block->next != nullptr)
+            block->next->prev = block->prev;
+
+        gsl::at(m_free_count, order)--;
+        page_state(addr) = 0;
+    }
+
+    bool
+    contains_block(integer_pointer addr, order_type order) const noexcept
+    { return addr >= m_addr && addr + (page_size() << order) <= m_addr + total_size; }
+
+    uint8_t &
+    page_state(integer_pointer addr) noexcept
+    { return gsl::at(m_state, (addr - m_addr) >> page_shift); }
+
+    const uint8_t &
+    page_state(integer_pointer addr) const noexcept
+    { return gsl::at(m_state, (addr - m_addr) >> page_shift); }
+
+    tag_type &
+    page_tag(integer_pointer addr) noexcept
+    { return gsl::at(m_tag, (addr - m_addr) >> page_shift); }
+
+    const tag_type &
+    page_tag(integer_pointer addr) const noexcept
+    { return gsl::at(m_tag, (addr - m_addr) >> page_shift); }
+
+    static constexpr size_type
+    page_size() noexcept
+    { return 1UL << page_shift; }
+
+private:
+
+    integer_pointer m_addr;
+    size_type m_allocated;
+    size_type m_high_water;
+
+    mutable std::mutex m_mutex;
+
+    std::array<free_block *, buddy_pool_num_orders> m_free;
+    std::array<size_type, buddy_pool_num_orders> m_free_count;
+    std::array < uint8_t, (total_size >> page_shift) > m_state;
+    std::array < tag_type, (total_size >> page_shift) > m_tag;
+
+    std::atomic<buddy_pool *> m_region;
+
+public:
+
+    buddy_pool(const buddy_pool &) = delete;
+    buddy_pool &operator=(const buddy_pool &) = delete;
+    buddy_pool(buddy_pool &&) noexcept = delete;
+    buddy_pool &operator=(buddy_pool &&) noexcept = delete;
+};
+
+///
+/// *INDENT-ON*
+///
+
+#endif
@@ -0,0 +1,209 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#ifndef GRACE_PERIOD_H
+#define GRACE_PERIOD_H
+
+#include <gsl/gsl>
+
+#include <array>
+#include <atomic>
+
+#include <constants.h>
+
+// -----------------------------------------------------------------------------
+// Definition
+// -----------------------------------------------------------------------------
+
+///
+/// *INDENT-OFF*
+///
+
+/// Grace Period
+///
+/// Tells a writer when memory that it unlinked from a lock-free structure
+/// can no longer be in use by a reader, and thus can be freed or reused
+/// (i.e. epoch based reclamation).
+///
+/// Each CPU has a slot that holds the epoch it was in when it entered the
+/// VMM, or 0 while it is outside of it. A CPU enters the VMM when it
+/// starts to handle a VM exit, and leaves it right before it resumes the
+/// guest, at which point it no longer holds a pointer into any shared
+/// structure. The driver's calls into the VMM, which are serialized by
+/// the driver, and which are not VM exits, use the extra driver slot.
+///
+/// Once a writer has unlinked something, it calls advance(), and the
+/// memory can be reused as soon as passed() returns true for the epoch
+/// advance() returned. By then, every CPU has either been outside of the
+/// VMM, or entered it again after the unlink, and thus cannot reach it.
+/// A CPU that stays in the VMM (e.g. one that halted) only delays this.
+/// CPUs whose id does not have a slot share a count instead, and while any
+/// of them is in the VMM, no epoch has passed.
+///
+class grace_period
+{
+public:
+
+    using epoch_type = uint64_t;
+    using cpuid_type = uint64_t;
+
+    /// The cpuid used by the driver's calls into the VMM
+    ///
+    static constexpr const cpuid_type driver = 0xFFFFFFFFFFFFFFFF;
+
+    /// Default Constructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    grace_period() noexcept :
+        m_epoch(1),
+        m_overflow(0)
+    {
+        for (auto &&slot : m_slots)
+            slot.store(0, std::memory_order_relaxed);
+    }
+
+    /// Destructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    ~grace_period() = default;
+
+    /// Enter
+    ///
+    /// Marks cpuid as being in the VMM, in the current epoch.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param cpuid the CPU (or driver) that is entering the VMM
+    ///
+    void
+    enter(cpuid_type cpuid) noexcept
+    {
+        if (auto &&slot = this->slot(cpuid))
+            slot->store(m_epoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        else
+            m_overflow.fetch_add(1, std::memory_order_relaxed);
+
+        // Pairs with the fence in passed(). Either the writer sees this
+        // slot, or this CPU sees everything the writer unlinked before it
+        // advanced the epoch.
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+    }
+
+    /// Leave
+    ///
+    /// Marks cpuid as no longer being in the VMM.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param cpuid the CPU (or driver) that is leaving the VMM
+    ///
+    void
+    leave(cpuid_type cpuid) noexcept
+    {
+        if (auto &&slot = this->slot(cpuid))
+            slot->store(0, std::memory_order_release);
+        else
+            m_overflow.fetch_sub(1, std::memory_order_release);
+    }
+
+    /// Advance
+    ///
+    /// Starts a new epoch. Must be called after the memory is unlinked.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the epoch to pass to passed() for the memory unlinked
+    ///     before this call
+    ///
+    epoch_type
+    advance() noexcept
+    { return m_epoch.fetch_add(1) + 1; }
+
+    /// Passed
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param epoch the epoch returned by advance()
+    /// @return true if no CPU entered the VMM before epoch and is still in
+    ///     it, false otherwise
+    ///
+    bool
+    passed(epoch_type epoch) const noexcept
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+
+        if (m_overflow.load(std::memory_order_acquire) != 0)
+            return false;
+
+        for (const auto &slot : m_slots)
+        {
+            auto &&entered = slot.load(std::memory_order_acquire);
+
+            if (entered != 0 && entered < epoch)
+                return false;
+        }
+
+        return true;
+    }
+
+private:
+
+    std::atomic<epoch_type> *
+    slot(cpuid_type cpuid) noexcept
+    {
+        if (cpuid == driver)
+            return &m_slots.back();
+
+        if (cpuid >= MAX_NUM_CPUS)
+            return nullptr;
+
+        return &gsl::at(m_slots, cpuid);
+    }
+
+private:
+
+    std::atomic<epoch_type> m_epoch;
+    std::atomic<uint64_t> m_overflow;
+    std::array<std::atomic<epoch_type>, MAX_NUM_CPUS + 1> m_slots;
+
+public:
+
+    grace_period(const grace_period &) = delete;
+    grace_period &operator=(const grace_period &) = delete;
+    grace_period(grace_period &&) noexcept = delete;
+    grace_period &operator=(grace_period &&) noexcept = delete;
+};
+
+///
+/// *INDENT-ON*
+///
+
+#endif
@@ -0,0 +1,266 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#ifndef GUEST_COPY_X64_H
+#define GUEST_COPY_X64_H
+
+#include <memory>
+
+#include <memory_manager/page_walk_cache_x64.h>
+
+// -----------------------------------------------------------------------------
+// Definition
+// -----------------------------------------------------------------------------
+
+namespace bfn
+{
+
+/// Guest Scatter / Gather Iterator
+///
+/// Walks the guest physical memory backing a range of guest virtual
+/// memory, one physically contiguous segment at a time. Pages are only
+/// translated once the iterator reaches them, a single translation covers
+/// all of a large guest page (2m / 1g), and pages that are physically
+/// contiguous, and have the same memory type, are merged into the same
+/// segment. Nothing is mapped into the VMM other than the guest's page
+/// tables (see page_walk_cache_x64).
+///
+/// @b Example: @n
+/// @code
+/// auto &&cr3 = vmcs::guest_cr3::get();
+/// auto &&pat = vmcs::guest_ia32_pat::get();
+///
+/// bfn::guest_sg_iterator_x64 iter(virt, cr3, size, pat);
+/// bfn::guest_sg_iterator_x64::segment_type segment;
+///
+/// while (iter.next(segment))
+///     std::cout << view_as_pointer(segment.phys) << " " << segment.size << '\n';
+/// @endcode
+///
+/// This class is not thread safe.
+///
+class guest_sg_iterator_x64
+{
+public:
+
+    using integer_pointer = uintptr_t;
+    using size_type = size_t;
+    using attr_type = x64::memory_attr::attr_type;
+
+    /// Segment
+    ///
+    /// phys is the guest physical address of the segment, size is the
+    /// number of bytes that are physically contiguous starting at phys,
+    /// and attr describes how the segment should be mapped into the VMM.
+    /// writable is true if the guest's page tables allow the segment to be
+    /// written (a segment never mixes writable and read-only pages).
+    ///
+    struct segment_type
+    {
+        integer_pointer phys;
+        size_type size;
+        attr_type attr;
+        bool writable;
+    };
+
+    /// Constructor
+    ///
+    /// Translates the range using a page walk cache owned by the
+    /// iterator. Since the cache is empty, each page table that is walked
+    /// has to be mapped into the VMM, so if the caller has a page walk
+    /// cache (i.e. a vCPU's), the constructor below should be used instead.
+    ///
+    /// @expects virt != 0
+    /// @expects cr3 != 0
+    /// @expects cr3 & (x64::page_size - 1) == 0
+    /// @ensures none
+    ///
+    /// @param virt the guest virtual address of the range
+    /// @param cr3 the guest's CR3
+    /// @param size the number of bytes in the range
+    /// @param pat the pat msr associated with the provided cr3
+    ///
+    guest_sg_iterator_x64(integer_pointer virt, integer_pointer cr3, size_type size, x64::msrs::value_type pat);
+
+    /// Constructor (Page Walk Cache)
+    ///
+    /// @expects virt != 0
+    /// @expects cr3 != 0
+    /// @expects cr3 & (x64::page_size - 1) == 0
+    /// @ensures none
+    ///
+    /// @param virt the guest virtual address of the range
+    /// @param cr3 the guest's CR3
+    /// @param size the number of bytes in the range
+    /// @param pat the pat msr associated with the provided cr3
+    /// @param cache the page walk cache used to translate the range
+    ///
+    guest_sg_iterator_x64(integer_pointer virt, integer_pointer cr3, size_type size, x64::msrs::value_type pat,
+                          page_walk_cache_x64 &cache);
+
+    /// Destructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    virtual ~guest_sg_iterator_x64() = default;
+
+    /// Next
+    ///
+    /// Returns the next physically contiguous segment of the range. To
+    /// tell where a segment ends, the page that follows it is translated
+    /// as well, and is kept for the next call.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param segment where the next segment is returned
+    /// @return false if there are no segments left, true otherwise
+    ///
+    virtual bool next(segment_type &segment);
+
+    /// Remaining
+    ///
+    /// @return the number of bytes that have not been returned by next
+    ///
+    size_type remaining() const noexcept
+    { return m_pending ? m_size + m_next.size : m_size; }
+
+private:
+
+    segment_type translate();
+
+private:
+
+    integer_pointer m_virt;
+    integer_pointer m_cr3;
+    size_type m_size;
+    x64::msrs::value_type m_pat;
+
+    std::unique_ptr<page_walk_cache_x64> m_local;
+    page_walk_cache_x64 *m_cache;
+
+    bool m_pending;
+    segment_type m_next;
+
+public:
+
+    guest_sg_iterator_x64(guest_sg_iterator_x64 &&) noexcept = default;
+    guest_sg_iterator_x64 &operator=(guest_sg_iterator_x64 &&) noexcept = default;
+
+    guest_sg_iterator_x64(const guest_sg_iterator_x64 &) = delete;
+    guest_sg_iterator_x64 &operator=(const guest_sg_iterator_x64 &) = delete;
+};
+
+/// Copy From Guest
+///
+/// Copies len bytes of guest memory, starting at the guest virtual address
+/// gva, to dst. Unlike make_unique_map_x64(virt, cr3, size, pat), which
+/// allocates and maps virtual memory for the whole range before anything
+/// can be read, the range is walked using a guest_sg_iterator_x64, and each
+/// segment is copied using a single memcpy from the VMM's direct map when
+/// it can be, or one page at a time otherwise. These pages are mapped using
+/// make_unique_map_x64, so a temporary map slot is used when the current CPU
+/// has one free (which is never the case outside of VMX root), and a single
+/// page from the memory map pool is used if not.
+///
+/// @expects cr3 != 0
+/// @expects cr3 & (x64::page_size - 1) == 0
+/// @expects gva != 0
+/// @expects dst != nullptr
+/// @ensures none
+///
+/// @param cr3 the guest's CR3
+/// @param gva the guest virtual address to copy from
+/// @param dst the buffer to copy to
+/// @param len the number of bytes to copy
+/// @param pat the pat msr associated with the provided cr3
+///
+void copy_from_guest(uintptr_t cr3, uintptr_t gva, void *dst, size_t len, x64::msrs::value_type pat);
+
+/// Copy From Guest (Page Walk Cache)
+///
+/// Same as the copy_from_guest above, but the range is translated using
+/// the provided page walk cache.
+///
+/// @expects cr3 != 0
+/// @expects cr3 & (x64::page_size - 1) == 0
+/// @expects gva != 0
+/// @expects dst != nullptr
+/// @ensures none
+///
+/// @param cr3 the guest's CR3
+/// @param gva the guest virtual address to copy from
+/// @param dst the buffer to copy to
+/// @param len the number of bytes to copy
+/// @param pat the pat msr associated with the provided cr3
+/// @param cache the page walk cache used to translate gva
+///
+void copy_from_guest(uintptr_t cr3, uintptr_t gva, void *dst, size_t len, x64::msrs::value_type pat,
+                     page_walk_cache_x64 &cache);
+
+/// Copy To Guest
+///
+/// Copies len bytes from src to guest memory, starting at the guest
+/// virtual address gva (see copy_from_guest). The whole range is checked
+/// before anything is written, and if the guest's page tables do not allow
+/// one of its pages to be written (e.g. a read-only or copy-on-write page,
+/// which may be shared with other processes), nothing is copied, and
+/// std::runtime_error is thrown.
+///
+/// @expects cr3 != 0
+/// @expects cr3 & (x64::page_size - 1) == 0
+/// @expects gva != 0
+/// @expects src != nullptr
+/// @ensures none
+///
+/// @param cr3 the guest's CR3
+/// @param gva the guest virtual address to copy to
+/// @param src the buffer to copy from
+/// @param len the number of bytes to copy
+/// @param pat the pat msr associated with the provided cr3
+///
+void copy_to_guest(uintptr_t cr3, uintptr_t gva, const void *src, size_t len, x64::msrs::value_type pat);
+
+/// Copy To Guest (Page Walk Cache)
+///
+/// Same as the copy_to_guest above, but the range is translated using
+/// the provided page walk cache.
+///
+/// @expects cr3 != 0
+/// @expects cr3 & (x64::page_size - 1) == 0
+/// @expects gva != 0
+/// @expects src != nullptr
+/// @ensures none
+///
+/// @param cr3 the guest's CR3
+/// @param gva the guest virtual address to copy to
+/// @param src the buffer to copy from
+/// @param len the number of bytes to copy
+/// @param pat the pat msr associated with the provided cr3
+/// @param cache the page walk cache used to translate gva
+///
+void copy_to_guest(uintptr_t cr3, uintptr_t gva, const void *src, size_t len, x64::msrs::value_type pat,
+                   page_walk_cache_x64 &cache);
+
+}
+
+#endif
@@ -30,11 +30,13 @@
 #include <type_traits>
 
 #include <memory.h>
+#include <constants.h>
 #include <upper_lower.h>
 #include <guard_exceptions.h>
 
 #include <memory_manager/pat_x64.h>
 #include <memory_manager/mem_attr_x64.h>
+#include <memory_manager/temp_map_x64.h>
 #include <memory_manager/memory_manager_x64.h>
 #include <memory_manager/root_page_table_x64.h>
 
@@ -53,10 +55,126 @@ namespace bfn
 template <class T>
 class unique_map_ptr_x64;
 
+class page_walk_cache_x64;
+
+/// Direct Map Address
+///
+/// Returns the address at which the VMM can access the physical page at
+/// phys through its direct map (see root_page_table_x64::setup_direct_map),
+/// which is always mapped read / write and write-back.
+///
+/// @expects none
+/// @ensures none
+///
+/// @param phys the physical address of the page to access
+/// @return DIRECT_MAP_START + phys if phys is a non-zero, page aligned
+///     address covered by the direct map, 0 otherwise
+///
+inline uintptr_t direct_map_addr(uintptr_t phys) noexcept
+{
+    if (phys == 0 || lower(phys) != 0 || phys >= direct_map_size())
+        return 0;
+
+    return DIRECT_MAP_START + phys;
+}
+
+/// Is Direct Map Address
+///
+/// @expects none
+/// @ensures none
+///
+/// @param virt the virtual address to check
+/// @return true if virt is an address in the VMM's direct map
+///
+inline bool is_direct_map_addr(uintptr_t virt) noexcept
+{ return virt >= DIRECT_MAP_START && virt - DIRECT_MAP_START < direct_map_size(); }
+
+/// Can Map 2M
+///
+/// Memory that is physically contiguous in 2m aligned chunks (e.g. memory
+/// that the guest maps using large pages) can be mapped by the VMM using
+/// 2m pages, which uses a single page table entry (and TLB entry) per 2m
+/// instead of 512.
+///
+/// @expects none
+/// @ensures none
+///
+/// @param vmap the VMM virtual address the memory is mapped to
+/// @param addr the (page aligned) address of the memory being mapped,
+///     i.e. a guest virtual address, or a physical address
+/// @param contiguous the number of bytes that are physically contiguous
+///     starting at addr (or the size of the guest page containing addr)
+/// @param remaining the number of bytes left to map, starting at vmap
+/// @return true if vmap and addr are both 2m aligned, and at least 2m
+///     are physically contiguous, and remain to be mapped
+///
+inline bool can_map_2m(uintptr_t vmap, uintptr_t addr, size_t contiguous, size_t remaining) noexcept
+{
+    constexpr const auto from = x64::page_table::pd::from;
+    constexpr const auto size = x64::page_table::pd::size_bytes;
+
+    return contiguous >= size && remaining >= size && lower(vmap, from) == 0 && lower(addr, from) == 0;
+}
+
+/// Allocate Large Map
+///
+/// Allocates the virtual memory used to map size bytes of memory starting
+/// at addr (a guest virtual address, or a physical address). If the range
+/// could contain a 2m page, the memory is allocated at the same offset
+/// into a 2m page as addr, so that its 2m aligned, physically contiguous
+/// parts can be mapped using 2m pages (see can_map_2m). Otherwise, or if
+/// no such memory is free, this is the same as alloc_map.
+///
+/// @expects none
+/// @ensures none
+///
+/// @param addr the address of the memory that will be mapped
+/// @param size the number of bytes to allocate
+/// @return a pointer to the memory allocated, or nullptr on error
+///
+inline void *alloc_large_map(uintptr_t addr, size_t size) noexcept
+{
+    constexpr const auto from = x64::page_table::pd::from;
+    constexpr const auto large = x64::page_table::pd::size_bytes;
+
+    if (size >= large)
+    {
+        if (auto &&vmap = g_mm->alloc_map_aligned(size, large, lower(upper(addr), from)))
+            return vmap;
+    }
+
+    return g_mm->alloc_map(size);
+}
+
+/// Temporary Map Address
+///
+/// Maps the physical page at phys into one of the current CPU's temporary
+/// map slots (see temp_map_x64).
+///
+/// @expects none
+/// @ensures none
+///
+/// @param phys the physical address of the page to map
+/// @param attr describes how to map the page
+/// @return the address of the slot if phys is a non-zero, page aligned
+///     address, and the current CPU has a free slot, 0 otherwise
+///
+inline uintptr_t temp_map_addr(uintptr_t phys, x64::memory_attr::attr_type attr) noexcept
+{
+    if (phys == 0 || lower(phys) != 0)
+        return 0;
+
+    return g_temp_maps->map(phys, attr);
+}
+
 /// Make Unique Map (Single Page)
 ///
 /// This function can be used to map a single virtual memory page to
-/// a single physical memory page.
+/// a single physical memory page. If the page is covered by the VMM's
+/// direct map and attr is rw_wb, the direct map is used instead, and no
+/// memory is mapped (or unmapped when the map is released). Otherwise, the
+/// page is mapped into one of the current CPU's temporary map slots if
+/// one is free (see temp_map_x64), and using the memory map pool if not.
 ///
 /// @b Example: @n
 /// @code
@@ -75,6 +193,16 @@ template<class T>
 auto make_unique_map_x64(typename unique_map_ptr_x64<T>::pointer phys,
                          x64::memory_attr::attr_type attr = x64::memory_attr::rw_wb)
 {
+    auto &&addr = direct_map_addr(reinterpret_cast<uintptr_t>(phys));
+
+    if (addr != 0 && attr == x64::memory_attr::rw_wb)
+        return unique_map_ptr_x64<T>(addr, x64::page_size);
+
+    auto &&slot = temp_map_addr(reinterpret_cast<uintptr_t>(phys), attr);
+
+    if (slot != 0)
+        return unique_map_ptr_x64<T>(slot, x64::page_size);
+
     auto &&vmap = g_mm->alloc_map(x64::page_size);
 
     try
@@ -93,7 +221,11 @@ auto make_unique_map_x64(typename unique_map_ptr_x64<T>::pointer phys,
 /// Make Unique Map (Single Page)
 ///
 /// This function can be used to map a single virtual memory page to
-/// a single physical memory page.
+/// a single physical memory page. If the page is covered by the VMM's
+/// direct map and attr is rw_wb, the direct map is used instead, and no
+/// memory is mapped (or unmapped when the map is released). Otherwise, the
+/// page is mapped into one of the current CPU's temporary map slots if
+/// one is free (see temp_map_x64), and using the memory map pool if not.
 ///
 /// @b Example: @n
 /// @code
@@ -112,6 +244,16 @@ template<class T>
 auto make_unique_map_x64(typename unique_map_ptr_x64<T>::integer_pointer phys,
                          x64::memory_attr::attr_type attr = x64::memory_attr::rw_wb)
 {
+    auto &&addr = direct_map_addr(phys);
+
+    if (addr != 0 && attr == x64::memory_attr::rw_wb)
+        return unique_map_ptr_x64<T>(addr, x64::page_size);
+
+    auto &&slot = temp_map_addr(phys, attr);
+
+    if (slot != 0)
+        return unique_map_ptr_x64<T>(slot, x64::page_size);
+
     auto &&vmap = g_mm->alloc_map(x64::page_size);
 
     try
@@ -173,7 +315,7 @@ auto make_unique_map_x64(const std::vector<std::pair<typename unique_map_ptr_x64
     for (const auto &p : list)
         size += p.second;
 
-    auto &&vmap = g_mm->alloc_map(size);
+    auto &&vmap = alloc_large_map(list.front().first, size);
 
     try
     {
@@ -201,6 +343,9 @@ auto make_unique_map_x64(const std::vector<std::pair<typename unique_map_ptr_x64
 ///     function is very expensive, and should not be used in time
 ///     critical operations.
 ///
+/// @note to read or write a guest structure, copy_from_guest and
+///     copy_to_guest (see guest_copy_x64.h) do not need to map the range.
+///
 /// @b Example: @n
 /// @code
 /// std::cout << bfn::make_unique_map_x64<char>(virt, vmcs::guest_cr3::get(), size) << '\n';
@@ -224,7 +369,7 @@ auto make_unique_map_x64(typename unique_map_ptr_x64<T>::integer_pointer virt,
                          typename unique_map_ptr_x64<T>::size_type size,
                          x64::msrs::value_type pat)
 {
-    auto &&vmap = g_mm->alloc_map(size + lower(virt));
+    auto &&vmap = alloc_large_map(virt, size + lower(virt));
 
 #ifdef MAP_PTR_TESTING
 
@@ -250,6 +395,62 @@ auto make_unique_map_x64(typename unique_map_ptr_x64<T>::integer_pointer virt,
 #endif
 }
 
+/// Make Unique Map (Physically Contiguous / Non-Contiguous Range With CR3
+/// and Page Walk Cache)
+///
+/// Same as the make_unique_map_x64 above, but the guest's page tables are
+/// walked using the provided page walk cache, so pages that have already
+/// been translated, and page tables that are already mapped, do not need
+/// to be mapped into the VMM again. This is the version that should be
+/// used when mapping guest memory on the exit path.
+///
+/// @expects virt != 0
+/// @expects cr3 != 0
+/// @expects size != 0
+/// @ensures get() != nullptr
+///
+/// @param virt the virtual address containing the existing mapping
+/// @param cr3 the root page table containing the existing virtual to
+///     physical memory mappings
+/// @param size the number of bytes to map
+/// @param pat the pat msr associated with the provided cr3
+/// @param cache the page walk cache used to translate virt
+/// @return resulting unique_map_ptr_x64
+///
+template<class T>
+auto make_unique_map_x64(typename unique_map_ptr_x64<T>::integer_pointer virt,
+                         typename unique_map_ptr_x64<T>::integer_pointer cr3,
+                         typename unique_map_ptr_x64<T>::size_type size,
+                         x64::msrs::value_type pat,
+                         page_walk_cache_x64 &cache)
+{
+    auto &&vmap = alloc_large_map(virt, size + lower(virt));
+
+#ifdef MAP_PTR_TESTING
+
+    (void) cr3;
+    (void) pat;
+    (void) cache;
+
+    expects(virt != 0xDEADBEEF);
+    return unique_map_ptr_x64<T> {reinterpret_cast<typename unique_map_ptr_x64<T>::integer_pointer>(vmap), size};
+
+#else
+
+    try
+    {
+        return unique_map_ptr_x64<T>(reinterpret_cast<typename unique_map_ptr_x64<T>::integer_pointer>(vmap),
+                                     virt, cr3, size, pat, cache);
+    }
+    catch (...)
+    {
+        g_mm->free_map(vmap);
+        throw;
+    }
+
+#endif
+}
+
 /// Virt to Phys with CR3
 ///
 /// Converts a virtual address to a physical address given the
@@ -311,12 +512,41 @@ uintptr_t virt_to_phys_with_cr3(uintptr_t virt, uintptr_t cr3);
 ///
 void map_with_cr3(uintptr_t vmap, uintptr_t virt, uintptr_t cr3, size_t size, x64::msrs::value_type pat);
 
+/// Map Physically Contiguous / Non-Contiguous Range With CR3 and Page Walk
+/// Cache
+///
+/// Same as the map_with_cr3 above, but each page is translated using the
+/// provided page walk cache instead of walking (and mapping) the guest's
+/// page tables from scratch.
+///
+/// @expects vmap != 0
+/// @expects vmap & (x64::page_size - 1) == 0
+/// @expects virt != 0
+/// @expects cr3 != 0
+/// @expects cr3 & (x64::page_size - 1) == 0
+/// @expects size != 0
+/// @ensures none
+///
+/// @param vmap the virtual address to map the range to
+/// @param virt the virtual address containing the existing mapping
+/// @param cr3 the root page table containing the existing virtual to
+///     physical memory mappings
+/// @param size the number of bytes to map
+/// @param pat the pat msr associated with the provided cr3
+/// @param cache the page walk cache used to translate virt
+///
+void map_with_cr3(uintptr_t vmap, uintptr_t virt, uintptr_t cr3, size_t size, x64::msrs::value_type pat,
+                  page_walk_cache_x64 &cache);
+
 /// Unique Map
 ///
 /// Like std::unique_ptr, unique_map_ptr_x64 is a smart map that owns and
 /// manages the mapping between virtual and physical memory. Memory is mapped
 /// when the unique_map_ptr_x64 is first created, and unmapped when the
-/// unique_map_ptr_x64 is destroyed.
+/// unique_map_ptr_x64 is destroyed. Unmapping is deferred, and done in
+/// batches by the memory manager (see memory_manager_x64::free_map_deferred),
+/// except for maps in a temporary map slot, which are unmapped right away
+/// (see temp_map_x64).
 ///
 /// Although this class can be used directly, it should be created using
 /// make_unique_map_x64, which allocates the virtual memory for you as shown
@@ -497,8 +727,23 @@ public:
             auto &&phys = upper(p.first);
             auto &&size = p.second;
 
-            for (poff = 0; poff < size; poff += x64::page_size, voff += x64::page_size)
-                g_pt->map_4k(vmap + voff, phys + poff, attr);
+            for (poff = 0; poff < size;)
+            {
+                auto page = x64::page_size;
+
+                if (can_map_2m(vmap + voff, phys + poff, size - poff, size - poff))
+                {
+                    page = x64::page_table::pd::size_bytes;
+                    g_pt->map_2m(vmap + voff, phys + poff, attr);
+                }
+                else
+                {
+                    g_pt->map_4k(vmap + voff, phys + poff, attr);
+                }
+
+                poff += page;
+                voff += page;
+            }
         }
 
         flush();
@@ -556,6 +801,46 @@ public:
         flush();
     }
 
+    /// Map Physically Contiguous / Non-Contiguous Range With CR3 and Page
+    /// Walk Cache
+    ///
+    /// Same as the constructor above, but the guest's page tables are
+    /// walked using the provided page walk cache.
+    ///
+    /// @expects vmap != 0
+    /// @expects vmap & (x64::page_size - 1) == 0
+    /// @expects virt != 0
+    /// @expects cr3 != 0
+    /// @expects cr3 & (x64::page_size - 1) == 0
+    /// @expects size != 0
+    /// @ensures get() != nullptr
+    ///
+    /// @param vmap the virtual address to map the range to
+    /// @param virt the virtual address containing the existing mapping
+    /// @param cr3 the root page table containing the existing virtual to
+    ///     physical memory mappings
+    /// @param size the number of bytes to map
+    /// @param pat the pat msr associated with the provided cr3
+    /// @param cache the page walk cache used to translate virt
+    ///
+    unique_map_ptr_x64(integer_pointer vmap, integer_pointer virt, integer_pointer cr3, size_type size, x64::msrs::value_type pat,
+                       page_walk_cache_x64 &cache) :
+        m_virt(0),
+        m_size(size),
+        m_unaligned_size(size)
+    {
+        // [[ensures: get() != nullptr]]
+
+        m_virt |= lower(virt);
+        m_virt |= upper(vmap);
+
+        m_unaligned_size += lower(virt);
+
+        map_with_cr3(vmap, virt, cr3, m_unaligned_size, pat, cache);
+
+        flush();
+    }
+
     /// Move Constructor
     ///
     /// Like std::unique_ptr, this is equivalent to
@@ -818,16 +1103,18 @@ public:
     /// Flushes the TLB entries associated with the virtual address ranges
     /// this unique_map_ptr_x64 holds. This is done automatically when
     /// mapping memory, but might be needed if this map is shared with
-    /// another core whose TLB has not been properly flushed.
+    /// another core whose TLB has not been properly flushed. Large maps
+    /// flush the entire TLB instead (see x64::tlb::invlpg_range).
     ///
     /// @expects none
     /// @ensures none
     ///
     void flush() noexcept
     {
-        auto &&vmap = upper(m_virt);
-        for (auto vadr = vmap; vadr < vmap + m_unaligned_size; vadr += x64::page_size)
-            x64::tlb::invlpg(reinterpret_cast<pointer>(vadr));
+        if (is_direct_map_addr(m_virt))
+            return;
+
+        x64::tlb::invlpg_range(upper(m_virt), m_unaligned_size);
     }
 
     /// Cache Flush
@@ -850,14 +1137,17 @@ private:
 
     void cleanup(integer_pointer virt, size_type size) noexcept
     {
-        if (virt != 0 && size != 0)
-        {
-            auto &&vmap = upper(virt);
-            for (auto vadr = vmap; vadr < vmap + size; vadr += x64::page_size)
-                g_pt->unmap(vadr);
+        if (is_direct_map_addr(virt))
+            return;
 
-            g_mm->free_map(reinterpret_cast<pointer>(vmap));
+        if (temp_map_x64::contains(virt))
+        {
+            g_temp_maps->unmap(upper(virt));
+            return;
         }
+
+        if (virt != 0 && size != 0)
+            g_mm->free_map_deferred(reinterpret_cast<pointer>(upper(virt)), size);
     }
 
 private:
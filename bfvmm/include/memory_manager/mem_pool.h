@@ -26,6 +26,7 @@
 
 #include <mutex>
 #include <array>
+#include <atomic>
 
 #include <constants.h>
 
@@ -47,6 +48,9 @@
 
 constexpr const auto mem_pool_used_index = 0xFFFFFFFFFFFFFFFEUL;
 constexpr const auto mem_pool_free_index = 0xFFFFFFFFFFFFFFFFUL;
+constexpr const auto mem_pool_word_bits = 64UL;
+constexpr const auto mem_pool_chunk_bits = 16UL;
+constexpr const auto mem_pool_chunks_per_word = mem_pool_word_bits / mem_pool_chunk_bits;
 
 // -----------------------------------------------------------------------------
 // Definition
@@ -74,6 +78,32 @@ constexpr const auto mem_pool_free_index = 0xFFFFFFFFFFFFFFFFUL;
 /// done using custom new / delete operators at the class level if needed
 /// until we can provide a more complicated algorithm.
 ///
+/// The state of each block is stored in two bitmaps. The first marks which
+/// blocks are in use, and the second marks which blocks start an
+/// allocation, so the size of an allocation is the distance from its start
+/// to the next block that is either free, or starts another allocation.
+/// This is 2 bits of metadata per block instead of a full integer, and it
+/// allows free runs to be located a word at a time using tzcnt.
+///
+/// On top of the bitmaps, two summary bitmaps are kept. The first holds one
+/// bit per word of the used bitmap, and marks the words whose blocks are
+/// all used. The second holds one bit per chunk of 16 blocks, and marks the
+/// chunks whose blocks are all free. Runs of fully used words (or fully free
+/// chunks) are skipped 64 at a time using these. A free run of at least 31
+/// blocks always covers a fully free chunk, so allocations of that size
+/// only have to look at the runs of fully free chunks (and the free blocks
+/// on either side of them) instead of walking every free run in between,
+/// which keeps them close to constant time no matter how fragmented the
+/// pool is. With 64 byte blocks, this is every allocation that is too large
+/// for the slab pool.
+///
+/// Most allocations are untagged (see mem_tag.h), so instead of reserving
+/// room for a tag in every block, a tagged allocation is given one extra
+/// block in front of it that holds its tag. A third bitmap marks the
+/// allocations that start with such a header. Note that this is the only
+/// time the pool touches the memory it manages, so pools that are not
+/// backed by memory must not be given tags.
+///
 /// @param total_size total size in bytes of the memory pool
 /// @param block_shift block size in bit shifts (i.e. 8 bytes == 3 bits)
 ///
@@ -89,6 +119,10 @@ public:
     using size_type = size_t;
     using shift_type = size_t;
     using integer_pointer = uintptr_t;
+    using tag_type = uint8_t;
+    using bitmap_type = std::array < integer_pointer, ((total_size >> block_shift) + mem_pool_word_bits - 1) / mem_pool_word_bits >;
+    using full_type = std::array < integer_pointer, (std::tuple_size<bitmap_type>::value + mem_pool_word_bits - 1) / mem_pool_word_bits >;
+    using empty_type = std::array < integer_pointer, (std::tuple_size<bitmap_type>::value * mem_pool_chunks_per_word + mem_pool_word_bits - 1) / mem_pool_word_bits >;
 
     /// Constructor
     ///
@@ -100,7 +134,8 @@ public:
     /// @param addr the starting address of the memory pool
     mem_pool(integer_pointer addr) noexcept_testing :
         m_addr(addr),
-        m_size(total_size >> block_shift)
+        m_size(total_size >> block_shift),
+        m_region(nullptr)
     {
         if (addr == 0)
             static_construction_error();
@@ -124,33 +159,104 @@ public:
     /// equal to block_shift plus the starting address provided when creating
     /// the memory pool. For this reason, if a specific alignment is needed,
     /// ensure the start address has this same alignment when creating the
-    /// memory pool
+    /// memory pool. If this pool's own region is full, the regions that
+    /// have been added using add_region are tried in turn.
     ///
     /// @expects size > 0
     /// @expects size <= total_size
     /// @ensures ret != nullptr
     ///
     /// @param size the number of bytes to allocate
+    /// @param tag the tag to record for the allocation
     /// @return the starting address of the
     ///
     integer_pointer
-    alloc(size_type size)
+    alloc(size_type size, tag_type tag = 0)
     {
         // [[ensures ret: ret != 0]]
         expects(size > 0);
         expects(size <= total_size);
 
-        std::lock_guard<std::mutex> lock(m_mutex);
-
-        integer_pointer start = 0;
-        integer_pointer total = total_blocks(size);
+        auto &&total = total_blocks(size) + header_blocks(tag);
 
-        if ((start = next_search(m_next, total)) != mem_pool_used_index)
+        for (auto pool = this; pool != nullptr; pool = pool->m_region.load(std::memory_order_acquire))
         {
-            m_next = start + total;
-            gsl::at(m_allocated, start) = total;
+            if (auto &&addr = pool->region_alloc(total, tag))
+                return addr;
+        }
+
+        throw std::bad_alloc();
+    }
+
+    /// Allocate Local Memory
+    ///
+    /// Same as alloc, but the memory is only allocated from this pool's own
+    /// region, and never from the regions that have been added using
+    /// add_region. This is needed by users that keep metadata for the
+    /// pool's own region only (see slab_pool).
+    ///
+    /// @expects size > 0
+    /// @expects size <= total_size
+    /// @ensures ret != nullptr
+    ///
+    /// @param size the number of bytes to allocate
+    /// @param tag the tag to record for the allocation
+    /// @return the starting address of the allocated memory
+    ///
+    integer_pointer
+    alloc_local(size_type size, tag_type tag = 0)
+    {
+        // [[ensures ret: ret != 0]]
+        expects(size > 0);
+        expects(size <= total_size);
+
+        if (auto &&addr = this->region_alloc(total_blocks(size) + header_blocks(tag), tag))
+            return addr;
+
+        throw std::bad_alloc();
+    }
+
+    /// Allocate Aligned Memory
+    ///
+    /// Same as alloc, but the address that is returned minus offset is a
+    /// multiple of align. For example, an offset of 0 returns align
+    /// aligned memory, while an offset of lower(addr, 21) returns memory
+    /// that is at the same offset into a 2 megabyte page as addr.
+    ///
+    /// @expects size > 0
+    /// @expects size <= total_size
+    /// @expects align is a power of 2, and a multiple of the block size
+    /// @expects offset < align, and offset is a multiple of the block size
+    /// @ensures ret != nullptr
+    ///
+    /// @param size the number of bytes to allocate
+    /// @param align the alignment of the memory (minus offset)
+    /// @param offset the offset of the memory from align
+    /// @param tag the tag to record for the allocation
+    /// @return the starting address of the
+    ///
+    integer_pointer
+    alloc_aligned(size_type size, size_type align, size_type offset, tag_type tag = 0)
+    {
+        // [[ensures ret: ret != 0]]
+        expects(size > 0);
+        expects(size <= total_size);
+        expects(align != 0 && (align & (align - 1)) == 0);
+        expects((align & ((1UL << block_shift) - 1)) == 0);
+        expects(offset < align);
+        expects((offset & ((1UL << block_shift) - 1)) == 0);
+
+        // The header (if any) is placed in front of the aligned block, so
+        // the search is for a block that is aligned one block earlier.
 
-            return m_addr + (start << block_shift);
+        auto &&header = header_blocks(tag);
+        auto &&total = total_blocks(size) + header;
+        auto &&start = ((offset >> block_shift) - header) & ((align >> block_shift) - 1);
+
+        for (auto pool = this; pool != nullptr; pool = pool->m_region.load(std::memory_order_acquire))
+        {
+            if (auto &&addr = pool->region_alloc_aligned(total, align >> block_shift, start, tag))
+                return addr;
         }
 
         throw std::bad_alloc();
@@ -164,28 +270,53 @@ public:
     /// @ensures none
     ///
     /// @param addr the address to free
+    /// @param tag if not nullptr, receives the tag that was recorded for
+    ///     the allocation
+    /// @return the number of bytes that were freed (0 if addr was not
+    ///     allocated from this pool)
     ///
-    void
-    free(integer_pointer addr) noexcept
+    size_type
+    free(integer_pointer addr, tag_type *tag = nullptr) noexcept
     {
-        if (addr < m_addr)
-            return;
+        if (auto &&pool = find_region(this, addr))
+            return pool->region_free(addr, tag);
 
-        integer_pointer start = (addr - m_addr) >> block_shift;
+        return 0;
+    }
 
-        if (start >= m_allocated.size())
-            return;
+    /// Resize Memory
+    ///
+    /// Attempts to change the size of previously allocated memory without
+    /// moving it. Shrinking always succeeds, and releases the blocks that
+    /// are no longer needed. Growing only succeeds if the blocks that
+    /// follow the allocation are free, in which case they are added to the
+    /// allocation. If the memory cannot be resized in place, it is left
+    /// untouched and false is returned, in which case the caller has to
+    /// allocate new memory and copy.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param addr the address of the memory to resize
+    /// @param size the new size in bytes of the memory
+    /// @return true if the memory was resized, false otherwise
+    ///
+    bool
+    resize(integer_pointer addr, size_type size) noexcept
+    {
+        if (size == 0 || size > total_size)
+            return false;
 
-        {
-            std::lock_guard<std::mutex> lock(m_mutex);
-            gsl::at(m_allocated, start) = mem_pool_free_index;
-        }
+        if (auto &&pool = find_region(this, addr))
+            return pool->region_resize(addr, total_blocks(size));
+
+        return false;
     }
 
     /// Contains Address
     ///
-    /// Returns true if this memory pool contains this address, returns
-    /// false otherwise.
+    /// Returns true if this memory pool (or one of the regions added to
+    /// it) contains this address, returns false otherwise.
     ///
     /// @expects none
     /// @ensures none
@@ -194,7 +325,7 @@ public:
     ///
     bool
     contains(integer_pointer addr) const noexcept
-    { return (addr >= m_addr && addr < m_addr + total_size); }
+    { return find_region(this, addr) != nullptr; }
 
     /// Allocation Size
     ///
@@ -210,80 +341,688 @@ public:
     size_type
     size(integer_pointer addr) const noexcept
     {
+        if (auto &&pool = find_region(this, addr))
+            return pool->region_size(addr);
+
+        return 0;
+    }
+
+    /// Allocation Tag
+    ///
+    /// Returns the tag that was recorded for previously allocated memory
+    /// from this pool. Returns 0 given invalid inputs.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param addr to lookup
+    ///
+    tag_type
+    tag(integer_pointer addr) const noexcept
+    {
+        if (auto &&pool = find_region(this, addr))
+            return pool->region_tag(addr);
+
+        return 0;
+    }
+
+    /// Add Region
+    ///
+    /// Chains another memory pool of the same type to this one. Once
+    /// added, allocations that do not fit in this pool are served by the
+    /// region, and free / size / contains work on addresses that came from
+    /// it. Regions are never removed, and the region must outlive this
+    /// pool. Adding a region is safe while other cores are allocating.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param region the memory pool to add
+    ///
+    void
+    add_region(mem_pool *region) noexcept
+    {
+        if (region == nullptr || region == this)
+            return;
+
         std::lock_guard<std::mutex> lock(m_mutex);
 
-        if (!contains(addr))
-            return 0;
+        region->m_region.store(m_region.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        m_region.store(region, std::memory_order_release);
+    }
 
-        auto size = gsl::at(m_allocated, (addr - m_addr) >> block_shift);
+    /// Allocated
+    ///
+    /// @return the number of bytes currently allocated from this pool and
+    ///     all of the regions that have been added to it
+    ///
+    size_type
+    allocated() const noexcept
+    {
+        size_type bytes = 0;
 
-        if (size == mem_pool_free_index)
-            return 0;
+        for (auto pool = this; pool != nullptr; pool = pool->m_region.load(std::memory_order_acquire))
+        {
+            std::lock_guard<std::mutex> lock(pool->m_mutex);
+            bytes += pool->m_allocated << block_shift;
+        }
+
+        return bytes;
+    }
+
+    /// High Water Mark
+    ///
+    /// @return the largest number of bytes that have been allocated from
+    ///     this pool at any one time, added together with the high water
+    ///     marks of the regions that have been added to it
+    ///
+    size_type
+    high_water() const noexcept
+    {
+        size_type bytes = 0;
+
+        for (auto pool = this; pool != nullptr; pool = pool->m_region.load(std::memory_order_acquire))
+        {
+            std::lock_guard<std::mutex> lock(pool->m_mutex);
+            bytes += pool->m_high_water << block_shift;
+        }
 
-        return size << block_shift;
+        return bytes;
+    }
+
+    /// Largest Free
+    ///
+    /// Walks the pool (and the regions that have been added to it) looking
+    /// for the largest run of free blocks, which is the largest allocation
+    /// that can currently succeed. Comparing this to the number of free
+    /// bytes shows how fragmented the pool is. This walks all of the
+    /// pool's metadata, and should not be used on a hot path.
+    ///
+    /// @return the size in bytes of the largest run of free blocks
+    ///
+    size_type
+    largest_free() const noexcept
+    {
+        size_type blocks = 0;
+
+        for (auto pool = this; pool != nullptr; pool = pool->m_region.load(std::memory_order_acquire))
+        {
+            auto &&run = pool->region_largest_free();
+            blocks = run > blocks ? run : blocks;
+        }
+
+        return blocks << block_shift;
+    }
+
+    /// Capacity
+    ///
+    /// @return the total number of bytes managed by this pool and all of
+    ///     the regions that have been added to it
+    ///
+    size_type
+    capacity() const noexcept
+    {
+        size_type bytes = 0;
+
+        for (auto pool = this; pool != nullptr; pool = pool->m_region.load(std::memory_order_acquire))
+            bytes += total_size;
+
+        return bytes;
     }
 
     /// Clear Memory Pool
     ///
     /// This is a very dangerous function, and will effectively run free() on
-    /// all memory previously allocated.
+    /// all memory previously allocated, including the memory allocated from
+    /// the regions that have been added to this pool.
     ///
     /// @expects none
     /// @ensures none
     ///
     void
     clear() noexcept
+    {
+        for (auto pool = this; pool != nullptr; pool = pool->m_region.load(std::memory_order_acquire))
+            pool->region_clear();
+    }
+
+private:
+
+    integer_pointer
+    region_alloc(integer_pointer total, tag_type tag) noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        integer_pointer start = 0;
+
+        if ((start = next_search(m_next, total)) != mem_pool_used_index)
+            return claim(start, total, tag);
+
+        return 0;
+    }
+
+    integer_pointer
+    region_alloc_aligned(integer_pointer total, integer_pointer align, integer_pointer offset, tag_type tag) noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        integer_pointer start = 0;
+
+        if ((start = search_aligned(total, align, offset)) != mem_pool_used_index)
+            return claim(start, total, tag);
+
+        return 0;
+    }
+
+    integer_pointer
+    claim(integer_pointer start, integer_pointer total, tag_type tag) noexcept
+    {
+        m_next = start + total;
+        m_allocated += total;
+
+        if (m_allocated > m_high_water)
+            m_high_water = m_allocated;
+
+        use_range(start, total);
+        set_bit(m_start, start);
+
+        auto &&addr = m_addr + (start << block_shift);
+
+        if (tag == 0)
+            return addr;
+
+        set_bit(m_tagged, start);
+        *reinterpret_cast<tag_type *>(addr) = tag;
+
+        return addr + (1UL << block_shift);
+    }
+
+    size_type
+    region_free(integer_pointer addr, tag_type *tag) noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto &&start = find_start(addr);
+        if (start == mem_pool_used_index)
+            return 0;
+
+        if (tag != nullptr)
+            *tag = start_tag(start);
+
+        auto &&header = test_bit(m_tagged, start) ? 1UL : 0UL;
+        auto &&count = next_boundary(start + 1) - start;
+        m_allocated -= count;
+
+        free_range(start, count);
+        clear_bit(m_start, start);
+        clear_bit(m_tagged, start);
+
+        return (count - header) << block_shift;
+    }
+
+    bool
+    region_resize(integer_pointer addr, integer_pointer total) noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto &&header = find_start(addr);
+        if (header == mem_pool_used_index)
+            return false;
+
+        auto &&start = header + (test_bit(m_tagged, header) ? 1UL : 0UL);
+        auto &&end = next_boundary(header + 1);
+
+        if (start + total <= end)
+        {
+            m_allocated -= end - (start + total);
+            free_range(start + total, end - (start + total));
+
+            return true;
+        }
+
+        if (start + total > m_size)
+            return false;
+
+        if (next_used(end, start + total) < start + total)
+            return false;
+
+        m_allocated += start + total - end;
+        use_range(end, start + total - end);
+
+        if (m_allocated > m_high_water)
+            m_high_water = m_allocated;
+
+        return true;
+    }
+
+    size_type
+    region_size(integer_pointer addr) const noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto &&start = find_start(addr);
+        if (start == mem_pool_used_index)
+            return 0;
+
+        auto &&header = test_bit(m_tagged, start) ? 1UL : 0UL;
+        return (next_boundary(start + 1) - start - header) << block_shift;
+    }
+
+    tag_type
+    region_tag(integer_pointer addr) const noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto &&start = find_start(addr);
+        if (start == mem_pool_used_index)
+            return 0;
+
+        return start_tag(start);
+    }
+
+    // Returns the block that starts the allocation that addr was returned
+    // for, which is the block before addr if the allocation has a header.
+    // A tagged allocation is always at least two blocks long, so addr can
+    // never be both.
+
+    integer_pointer
+    find_start(integer_pointer addr) const noexcept
+    {
+        integer_pointer block = (addr - m_addr) >> block_shift;
+
+        if (test_bit(m_start, block))
+            return test_bit(m_tagged, block) ? mem_pool_used_index : block;
+
+        if (block != 0 && test_bit(m_start, block - 1) && test_bit(m_tagged, block - 1))
+            return block - 1;
+
+        return mem_pool_used_index;
+    }
+
+    tag_type
+    start_tag(integer_pointer start) const noexcept
+    {
+        if (!test_bit(m_tagged, start))
+            return 0;
+
+        return *reinterpret_cast<const tag_type *>(m_addr + (start << block_shift));
+    }
+
+    static integer_pointer
+    header_blocks(tag_type tag) noexcept
+    { return tag != 0 ? 1UL : 0UL; }
+
+    void
+    region_clear() noexcept
     {
         std::lock_guard<std::mutex> lock(m_mutex);
 
         m_next = 0;
-        __builtin_memset(m_allocated.data(), 0xFF, sizeof(m_allocated));
+        m_allocated = 0;
+        m_high_water = 0;
+
+        m_used.fill(0);
+        m_start.fill(0);
+        m_tagged.fill(0);
+
+        // Bits past the end of the pool are marked as used so that a free
+        // run can never extend past the end of the pool.
+        //
+        if ((m_size % mem_pool_word_bits) != 0)
+            m_used.back() = ~0UL << (m_size % mem_pool_word_bits);
+
+        m_full.fill(0);
+        m_empty.fill(0);
+
+        summarize(0, m_size);
+    }
+
+    integer_pointer
+    region_largest_free() const noexcept
+    {
+        integer_pointer largest = 0;
+        integer_pointer index = 0;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        while (index < m_size)
+        {
+            auto &&start = next_free(index);
+            if (start >= m_size)
+                break;
+
+            auto &&end = next_used(start, m_size);
+            largest = end - start > largest ? end - start : largest;
+
+            index = end;
+        }
+
+        return largest;
+    }
+
+    bool
+    region_contains(integer_pointer addr) const noexcept
+    { return (addr >= m_addr && addr < m_addr + total_size); }
+
+    template<class pool_type>
+    static pool_type *
+    find_region(pool_type *pool, integer_pointer addr) noexcept
+    {
+        for (; pool != nullptr; pool = pool->m_region.load(std::memory_order_acquire))
+        {
+            if (pool->region_contains(addr))
+                return pool;
+        }
+
+        return nullptr;
     }
 
-private:
 
     integer_pointer
-    next_search(integer_pointer initial, integer_pointer total) const
+    next_search(integer_pointer initial, integer_pointer total) const noexcept
     {
-        integer_pointer check = 0;
-        integer_pointer count = 0;
-        integer_pointer start = 0;
-        integer_pointer index = initial;
+        auto start = search(initial, total);
+
+        if (start == mem_pool_used_index && initial != 0)
+            start = search(0, total);
+
+        return start;
+    }
+
+    integer_pointer
+    search(integer_pointer index, integer_pointer total) const noexcept
+    {
+        if (total >= (mem_pool_chunk_bits << 1) - 1)
+            return search_large(index, total);
 
-        while (true)
+        while (index < m_size)
         {
-            if (index >= m_size)
-            {
-                count = 0;
-                index = 0;
-            }
+            auto &&start = next_free(index);
+            if (start >= m_size)
+                break;
 
-            if (gsl::at(m_allocated, index) == mem_pool_free_index)
-            {
-                if (count == 0)
-                    start = index;
+            auto &&end = next_used(start, start + total);
+            if (end - start >= total)
+                return start;
 
-                count++;
-                index++;
-                check++;
-            }
-            else
+            index = end;
+        }
+
+        return mem_pool_used_index;
+    }
+
+    // Any free run that is at least total blocks long covers at least one
+    // chunk that is completely free, so only the runs of free chunks need
+    // to be looked at. Each of these is extended into the free blocks right
+    // before and after it, which are in the chunks on either side of it.
+
+    integer_pointer
+    search_large(integer_pointer index, integer_pointer total) const noexcept
+    {
+        auto &&chunks = num_chunks();
+        auto chunk = find_bit(m_empty, index / mem_pool_chunk_bits, chunks, true);
+
+        while (chunk < chunks)
+        {
+            auto &&last = find_bit(m_empty, chunk, chunks, false);
+
+            auto start = chunk * mem_pool_chunk_bits;
+            auto end = m_size;
+
+            if (chunk != 0)
             {
-                auto blocks = gsl::at(m_allocated, index);
+                auto &&word = (start - 1) / mem_pool_word_bits;
+                auto &&bits = gsl::at(m_used, word) & (~0UL >> (mem_pool_word_bits - 1 - ((start - 1) % mem_pool_word_bits)));
 
-                count = 0;
-                index += blocks;
-                check += blocks;
+                if (bits != 0)
+                    start = (word * mem_pool_word_bits) + mem_pool_word_bits - static_cast<integer_pointer>(__builtin_clzl(bits));
             }
 
-            if (count >= total)
+            if (last < chunks)
+                end = (last * mem_pool_chunk_bits) + static_cast<integer_pointer>(__builtin_ctzl(chunk_bits(last)));
+
+            start = start > index ? start : index;
+            end = end < m_size ? end : m_size;
+
+            if (end > start && end - start >= total)
                 return start;
 
-            if (check >= (total_size >> block_shift))
-                return mem_pool_used_index;
+            chunk = find_bit(m_empty, last, chunks, true);
+        }
+
+        return mem_pool_used_index;
+    }
+
+    integer_pointer
+    search_aligned(integer_pointer total, integer_pointer align, integer_pointer offset) const noexcept
+    {
+        integer_pointer index = 0;
+
+        while (index < m_size)
+        {
+            // Round the free block up to the next block whose address
+            // minus offset is a multiple of align (both in blocks).
+
+            auto &&free = next_free(index);
+            auto &&start = free + ((offset - (m_addr >> block_shift) - free) & (align - 1));
+
+            if (start >= m_size)
+                break;
+
+            auto &&end = next_used(start, start + total);
+            if (end - start >= total)
+                return start;
+
+            index = end > free ? end : free + 1;
+        }
+
+        return mem_pool_used_index;
+    }
+
+    integer_pointer
+    next_free(integer_pointer index) const noexcept
+    {
+        auto word = index / mem_pool_word_bits;
+        auto bits = ~gsl::at(m_used, word) & (~0UL << (index % mem_pool_word_bits));
+
+        while (bits == 0)
+        {
+            word = find_bit(m_full, word + 1, m_used.size(), false);
+
+            if (word >= m_used.size())
+                return m_size;
+
+            bits = ~gsl::at(m_used, word);
+        }
+
+        return (word * mem_pool_word_bits) + static_cast<integer_pointer>(__builtin_ctzl(bits));
+    }
+
+    integer_pointer
+    next_used(integer_pointer index, integer_pointer limit) const noexcept
+    {
+        auto word = index / mem_pool_word_bits;
+        auto bits = gsl::at(m_used, word) & (~0UL << (index % mem_pool_word_bits));
+
+        while (bits == 0)
+        {
+            if (++word >= m_used.size() || word * mem_pool_word_bits >= limit)
+                return limit < m_size ? limit : m_size;
+
+            if ((bits = gsl::at(m_used, word)) != 0)
+                break;
+
+            word = find_bit(m_empty, word * mem_pool_chunks_per_word, num_chunks(), false) / mem_pool_chunks_per_word;
+
+            if (word >= m_used.size() || word * mem_pool_word_bits >= limit)
+                return limit < m_size ? limit : m_size;
+
+            bits = gsl::at(m_used, word);
+        }
+
+        auto &&next = (word * mem_pool_word_bits) + static_cast<integer_pointer>(__builtin_ctzl(bits));
+        return next < m_size ? next : m_size;
+    }
+
+    integer_pointer
+    next_boundary(integer_pointer index) const noexcept
+    {
+        if (index >= m_size)
+            return m_size;
+
+        auto word = index / mem_pool_word_bits;
+        auto bits = (~gsl::at(m_used, word) | gsl::at(m_start, word)) & (~0UL << (index % mem_pool_word_bits));
+
+        while (bits == 0)
+        {
+            if (++word >= m_used.size())
+                return m_size;
+
+            bits = ~gsl::at(m_used, word) | gsl::at(m_start, word);
+        }
+
+        auto &&next = (word * mem_pool_word_bits) + static_cast<integer_pointer>(__builtin_ctzl(bits));
+        return next < m_size ? next : m_size;
+    }
+
+    // Returns the first bit in the provided summary, starting at index,
+    // that is equal to value, or num if there is none.
+
+    template<class S>
+    static integer_pointer
+    find_bit(const S &summary, integer_pointer index, integer_pointer num, bool value) noexcept
+    {
+        if (index >= num)
+            return num;
+
+        auto &&flip = value ? 0UL : ~0UL;
+
+        auto word = index / mem_pool_word_bits;
+        auto bits = (gsl::at(summary, word) ^ flip) & (~0UL << (index % mem_pool_word_bits));
+
+        while (bits == 0)
+        {
+            if (++word >= summary.size())
+                return num;
+
+            bits = gsl::at(summary, word) ^ flip;
+        }
+
+        auto &&next = (word * mem_pool_word_bits) + static_cast<integer_pointer>(__builtin_ctzl(bits));
+        return next < num ? next : num;
+    }
+
+    integer_pointer
+    num_chunks() const noexcept
+    { return m_used.size() * mem_pool_chunks_per_word; }
+
+    integer_pointer
+    chunk_bits(integer_pointer chunk) const noexcept
+    {
+        auto &&word = gsl::at(m_used, (chunk * mem_pool_chunk_bits) / mem_pool_word_bits);
+        return (word >> ((chunk * mem_pool_chunk_bits) % mem_pool_word_bits)) & 0xFFFFUL;
+    }
+
+    void
+    use_range(integer_pointer index, integer_pointer count) noexcept
+    {
+        set_range(m_used, index, count);
+        summarize(index, count);
+    }
+
+    void
+    free_range(integer_pointer index, integer_pointer count) noexcept
+    {
+        clear_range(m_used, index, count);
+        summarize(index, count);
+    }
+
+    void
+    summarize(integer_pointer index, integer_pointer count) noexcept
+    {
+        if (count == 0)
+            return;
+
+        auto &&last = (index + count - 1) / mem_pool_word_bits;
+
+        for (auto word = index / mem_pool_word_bits; word <= last; word++)
+        {
+            auto &&bits = gsl::at(m_used, word);
+            auto &&mask = 1UL << (word % mem_pool_word_bits);
+
+            auto &&full = gsl::at(m_full, word / mem_pool_word_bits);
+            full = bits == ~0UL ? full | mask : full & ~mask;
+
+            // Or each chunk's bits into its lowest bit, and then gather
+            // these into one bit per chunk, as the chunks of a word are next
+            // to each other in m_empty.
+
+            auto used = bits | (bits >> 8);
+            used |= used >> 4;
+            used |= used >> 2;
+            used |= used >> 1;
+            used &= 0x0001000100010001UL;
+
+            auto &&chunks = ~(used | (used >> 15) | (used >> 30) | (used >> 45)) & 0xFUL;
+            auto &&shift = (word * mem_pool_chunks_per_word) % mem_pool_word_bits;
+            auto &&empty = gsl::at(m_empty, (word * mem_pool_chunks_per_word) / mem_pool_word_bits);
+
+            empty = (empty & ~(((1UL << mem_pool_chunks_per_word) - 1) << shift)) | (chunks << shift);
         }
     }
 
+    static void
+    set_range(bitmap_type &bitmap, integer_pointer index, integer_pointer count) noexcept
+    {
+        while (count > 0)
+        {
+            auto &&num = range_bits(index, count);
+
+            gsl::at(bitmap, index / mem_pool_word_bits) |= range_mask(index, num);
+            index += num;
+            count -= num;
+        }
+    }
+
+    static void
+    clear_range(bitmap_type &bitmap, integer_pointer index, integer_pointer count) noexcept
+    {
+        while (count > 0)
+        {
+            auto &&num = range_bits(index, count);
+
+            gsl::at(bitmap, index / mem_pool_word_bits) &= ~range_mask(index, num);
+            index += num;
+            count -= num;
+        }
+    }
+
+    static integer_pointer
+    range_bits(integer_pointer index, integer_pointer count) noexcept
+    {
+        auto &&bits = mem_pool_word_bits - (index % mem_pool_word_bits);
+        return count < bits ? count : bits;
+    }
+
+    static integer_pointer
+    range_mask(integer_pointer index, integer_pointer num) noexcept
+    {
+        auto &&mask = num == mem_pool_word_bits ? ~0UL : ((1UL << num) - 1);
+        return mask << (index % mem_pool_word_bits);
+    }
+
+    static void
+    set_bit(bitmap_type &bitmap, integer_pointer index) noexcept
+    { gsl::at(bitmap, index / mem_pool_word_bits) |= (1UL << (index % mem_pool_word_bits)); }
+
+    static void
+    clear_bit(bitmap_type &bitmap, integer_pointer index) noexcept
+    { gsl::at(bitmap, index / mem_pool_word_bits) &= ~(1UL << (index % mem_pool_word_bits)); }
+
+    static bool
+    test_bit(const bitmap_type &bitmap, integer_pointer index) noexcept
+    { return (gsl::at(bitmap, index / mem_pool_word_bits) & (1UL << (index % mem_pool_word_bits))) != 0; }
+
     integer_pointer
     total_blocks(size_type size) const noexcept
     {
@@ -300,9 +1039,19 @@ private:
     integer_pointer m_next;
     integer_pointer m_addr;
     integer_pointer m_size;
+    integer_pointer m_allocated;
+    integer_pointer m_high_water;
+
+    std::atomic<mem_pool *> m_region;
 
     mutable std::mutex m_mutex;
-    std::array < integer_pointer, (total_size >> block_shift) > m_allocated;
+
+    bitmap_type m_used;
+    bitmap_type m_start;
+    bitmap_type m_tagged;
+
+    full_type m_full;
+    empty_type m_empty;
 
 public:
 
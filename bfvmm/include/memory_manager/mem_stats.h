@@ -0,0 +1,244 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#ifndef MEM_STATS_H
+#define MEM_STATS_H
+
+#include <gsl/gsl>
+
+#include <array>
+#include <atomic>
+
+#include <constants.h>
+#include <thread_context.h>
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+
+constexpr const auto mem_stats_num_buckets = 32UL;
+
+// -----------------------------------------------------------------------------
+// Definition
+// -----------------------------------------------------------------------------
+
+///
+/// *INDENT-OFF*
+///
+
+/// Memory Statistics
+///
+/// Counts the allocations, frees and failed allocations made from a memory
+/// pool, along with the number of bytes allocated / freed, and a histogram
+/// of the allocation sizes (bucket n counts the allocations whose size is
+/// in [2^n, 2^(n+1)), with the last bucket counting everything larger).
+///
+/// Each CPU has its own set of counters on its own cache lines, so
+/// recording an allocation never touches memory that another core is
+/// writing to, and no lock is needed. The counters are atomics so that
+/// a report can be taken from any core while the others keep allocating.
+/// CPUs whose id is out of range share one extra set of counters.
+///
+/// @param max_cpus the max number of CPUs that have their own counters
+///
+template<size_t max_cpus>
+class mem_stats
+{
+public:
+
+    using size_type = size_t;
+    using counter_type = uint64_t;
+
+    /// Report
+    ///
+    /// The counters of all of the CPUs added together.
+    ///
+    struct report_type
+    {
+        counter_type allocs;
+        counter_type frees;
+        counter_type failed;
+        counter_type bytes_allocated;
+        counter_type bytes_freed;
+        std::array<counter_type, mem_stats_num_buckets> histogram;
+    };
+
+    /// Constructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    mem_stats() noexcept
+    { clear(); }
+
+    /// Default Destructor
+    ///
+    ~mem_stats() = default;
+
+    /// Record Allocation
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param size the number of bytes that were requested
+    /// @param actual the number of bytes that were actually allocated
+    ///
+    void
+    record_alloc(size_type size, size_type actual) noexcept
+    {
+        auto &&counters = current();
+
+        inc(counters.allocs, 1);
+        inc(counters.bytes_allocated, actual);
+        inc(gsl::at(counters.histogram, bucket(size)), 1);
+    }
+
+    /// Record Free
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param actual the number of bytes that were freed
+    ///
+    void
+    record_free(size_type actual) noexcept
+    {
+        auto &&counters = current();
+
+        inc(counters.frees, 1);
+        inc(counters.bytes_freed, actual);
+    }
+
+    /// Record Failure
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    void
+    record_failure() noexcept
+    { inc(current().failed, 1); }
+
+    /// Report
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the counters of all of the CPUs added together
+    ///
+    report_type
+    report() const noexcept
+    {
+        report_type report = {};
+
+        for (const auto &counters : m_counters)
+        {
+            report.allocs += counters.allocs.load(std::memory_order_relaxed);
+            report.frees += counters.frees.load(std::memory_order_relaxed);
+            report.failed += counters.failed.load(std::memory_order_relaxed);
+            report.bytes_allocated += counters.bytes_allocated.load(std::memory_order_relaxed);
+            report.bytes_freed += counters.bytes_freed.load(std::memory_order_relaxed);
+
+            for (auto i = 0UL; i < mem_stats_num_buckets; i++)
+                gsl::at(report.histogram, i) += gsl::at(counters.histogram, i).load(std::memory_order_relaxed);
+        }
+
+        return report;
+    }
+
+    /// Clear
+    ///
+    /// Sets all of the counters back to 0.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    void
+    clear() noexcept
+    {
+        for (auto &&counters : m_counters)
+        {
+            counters.allocs.store(0, std::memory_order_relaxed);
+            counters.frees.store(0, std::memory_order_relaxed);
+            counters.failed.store(0, std::memory_order_relaxed);
+            counters.bytes_allocated.store(0, std::memory_order_relaxed);
+            counters.bytes_freed.store(0, std::memory_order_relaxed);
+
+            for (auto &&count : counters.histogram)
+                count.store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /// Bucket
+    ///
+    /// @param size the number of bytes requested
+    /// @return the histogram bucket that counts size
+    ///
+    static size_type
+    bucket(size_type size) noexcept
+    {
+        if (size == 0)
+            return 0;
+
+        auto &&index = 63UL - static_cast<size_type>(__builtin_clzl(size));
+        return index < mem_stats_num_buckets ? index : mem_stats_num_buckets - 1;
+    }
+
+private:
+
+    struct alignas(MAX_CACHE_LINE_SIZE) counters_type
+    {
+        std::atomic<counter_type> allocs;
+        std::atomic<counter_type> frees;
+        std::atomic<counter_type> failed;
+        std::atomic<counter_type> bytes_allocated;
+        std::atomic<counter_type> bytes_freed;
+        std::array<std::atomic<counter_type>, mem_stats_num_buckets> histogram;
+    };
+
+    counters_type &
+    current() noexcept
+    {
+        auto &&cpuid = thread_context_cpuid();
+        return gsl::at(m_counters, cpuid < max_cpus ? cpuid : max_cpus);
+    }
+
+    static void
+    inc(std::atomic<counter_type> &counter, counter_type value) noexcept
+    { counter.fetch_add(value, std::memory_order_relaxed); }
+
+private:
+
+    std::array<counters_type, max_cpus + 1> m_counters;
+
+public:
+
+    mem_stats(const mem_stats &) = delete;
+    mem_stats &operator=(const mem_stats &) = delete;
+    mem_stats(mem_stats &&) noexcept = delete;
+    mem_stats &operator=(mem_stats &&) noexcept = delete;
+};
+
+///
+/// *INDENT-ON*
+///
+
+#endif
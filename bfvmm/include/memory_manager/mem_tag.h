@@ -0,0 +1,166 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#ifndef MEM_TAG_H
+#define MEM_TAG_H
+
+#include <new>
+#include <cstddef>
+#include <cstdint>
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+
+constexpr const auto mem_tag_num_tags = 32UL;
+
+/// Memory Tags
+///
+/// Each allocation made by the memory manager is tagged with the subsystem
+/// that owns it, so that the VMM's memory footprint can be attributed. Tags
+/// from mem_tag::user up to mem_tag_num_tags - 1 are free for extensions to
+/// use for their own allocations.
+///
+/// - untagged: allocations made outside of any tag scope
+/// - vcpu_factory: the vcpus made by the vcpu_factory, and everything the
+///   factory (or an extension's factory) allocates along with them
+/// - user_data: memory allocated by a vcpu while it is being initialized or
+///   run (i.e. while it is handed the driver's user_data)
+/// - vmxon: the VMXON region
+/// - vmcs: the VMCS region, and its MSR bitmap
+/// - exit_handler_stack: the stack used by the exit handler
+/// - state_save: the state save area shared with the exit handler entry
+/// - debug_ring: the debug ring's resources
+///
+namespace mem_tag
+{
+enum type : uint8_t
+{
+    untagged = 0,
+    vcpu_factory = 1,
+    user_data = 2,
+    vmxon = 3,
+    vmcs = 4,
+    exit_handler_stack = 5,
+    state_save = 6,
+    debug_ring = 7,
+    user = 16
+};
+}
+
+// -----------------------------------------------------------------------------
+// Definition
+// -----------------------------------------------------------------------------
+
+/// Current Memory Tag
+///
+/// Each CPU has its own current tag, so a tag scope on one core does not
+/// tag the allocations that are made by the other cores. CPUs whose id is
+/// out of range share a single tag.
+///
+/// @expects none
+/// @ensures ret < mem_tag_num_tags
+///
+/// @return the tag given to allocations made on this CPU
+///
+mem_tag::type current_mem_tag() noexcept;
+
+/// Set Current Memory Tag
+///
+/// Tags outside of [0, mem_tag_num_tags) are treated as untagged.
+///
+/// @expects none
+/// @ensures none
+///
+/// @param tag the tag to give to allocations made on this CPU
+/// @return the previous tag of this CPU
+///
+mem_tag::type set_current_mem_tag(mem_tag::type tag) noexcept;
+
+/// Memory Tag Name
+///
+/// @expects none
+/// @ensures ret != nullptr
+///
+/// @param tag the tag to get the name of
+/// @return the name of the tag (extension tags are named "user")
+///
+const char *mem_tag_name(mem_tag::type tag) noexcept;
+
+/// Memory Tag Scope
+///
+/// Tags all of the memory that is allocated on this CPU for as long as the
+/// scope is alive, restoring the previous tag when the scope ends. Scopes
+/// can be nested, in which case the innermost tag wins.
+///
+class mem_tag_scope
+{
+public:
+
+    /// Constructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param tag the tag to give to allocations made in this scope
+    ///
+    mem_tag_scope(mem_tag::type tag) noexcept :
+        m_prev(set_current_mem_tag(tag))
+    { }
+
+    /// Destructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    ~mem_tag_scope()
+    { set_current_mem_tag(m_prev); }
+
+private:
+
+    mem_tag::type m_prev;
+
+public:
+
+    mem_tag_scope(const mem_tag_scope &) = delete;
+    mem_tag_scope &operator=(const mem_tag_scope &) = delete;
+    mem_tag_scope(mem_tag_scope &&) noexcept = delete;
+    mem_tag_scope &operator=(mem_tag_scope &&) noexcept = delete;
+};
+
+/// Tagged New
+///
+/// Allocates memory using the global operator new with tag as the current
+/// tag (e.g. new (mem_tag::vmcs) uint32_t[1024]). The memory is released
+/// using the normal delete.
+///
+void *operator new(std::size_t size, mem_tag::type tag);
+void *operator new[](std::size_t size, mem_tag::type tag);
+
+/// Tagged Delete
+///
+/// Only used by the compiler to release the memory allocated by a tagged
+/// new if the object's constructor throws.
+///
+void operator delete(void *ptr, mem_tag::type tag) noexcept;
+void operator delete[](void *ptr, mem_tag::type tag) noexcept;
+
+#endif
@@ -23,13 +23,48 @@
 #define MEMORY_MANAGER_X64_H
 
 #include <map>
+#include <array>
+#include <atomic>
 #include <vector>
 
 #include <memory.h>
 #include <constants.h>
 
 #include <intrinsics/x64.h>
+#include <memory_manager/mem_tag.h>
 #include <memory_manager/mem_pool.h>
+#include <memory_manager/mem_stats.h>
+#include <memory_manager/buddy_pool.h>
+#include <memory_manager/slab_pool.h>
+#include <memory_manager/slab_cache.h>
+#include <memory_manager/vmem_arena.h>
+#include <memory_manager/radix_table.h>
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+
+constexpr const auto memory_manager_virt_bits = 48UL;
+constexpr const auto memory_manager_phys_bits = 52UL;
+
+// The number of page pool blocks alloc_contiguous checks before it gives
+// up (see alloc_contiguous)
+constexpr const auto memory_manager_contiguous_tries = 32UL;
+
+namespace memory_manager_pool
+{
+enum type
+{
+    heap = 0,
+    page = 1,
+    slab = 2,
+    map = 3
+};
+}
+
+// -----------------------------------------------------------------------------
+// Definition
+// -----------------------------------------------------------------------------
 
 /// The memory manager has a couple specific functions:
 /// - alloc / free memory
@@ -37,16 +72,45 @@
 /// - map / unmap memory
 ///
 /// To support alloc / free, the memory manager is given both heap memory
-/// and a page pool. If a alloc is requested whose size is a multiple of
-/// MAX_PAGE_SIZE, the page pool is used. All other requests come from the
-/// heap.
+/// and a page pool. The heap starts out as a static region, and grows as
+/// the driver entry donates more chunks of memory using add_heap. If a
+/// alloc is requested whose size is a multiple of MAX_PAGE_SIZE, the page
+/// pool is used. The page pool is a buddy allocator,
+/// so it can also provide contiguous blocks of memory with alignments
+/// larger than a page (e.g. 2M), although only virtually (the driver entry
+/// donates memory that is only virtually contiguous, so blocks larger than
+/// a page are rarely physically contiguous). Like the heap, the page pool
+/// starts out as a static region, and grows as the driver entry donates
+/// more chunks using add_pages. Small requests (up to 2 KB) are
+/// served by a slab pool whose slabs come from the page pool. All other
+/// requests come from the heap. To keep the cores from serializing on the
+/// slab pool's lock, small requests first go through a per-CPU cache that
+/// only exchanges objects with the slab pool in batches.
 ///
-/// To support virt / phys mappings, the memory manager has an add_mdl
+/// To support virt / phys mappings, the memory manager has an add_md
 /// function that is called by the driver entry. Each time the driver entry
-/// allocates memory for an ELF module, it must call add_mdl with a list of
-/// page mappings that tells the VMM how to convert from virt to phys and back.
-/// The memory manager uses this information to provide the VMM with the needed
-/// conversions.
+/// allocates memory for an ELF module, it must call add_md with the extents
+/// (ranges of pages that are both virtually and physically contiguous) that
+/// tell the VMM how to convert from virt to phys and back. The memory manager
+/// uses this information to provide the VMM with the needed conversions. The
+/// conversions are stored in radix tables (one indexed by virtual page, and
+/// one indexed by physical page), so they can be performed on any core
+/// without taking a lock. The extents themselves are also kept (coalesced
+/// with their neighbors where possible) so that the descriptors can be
+/// handed back as ranges instead of one page at a time.
+///
+/// Each pool also keeps statistics (allocs / frees, bytes allocated, failed
+/// allocations and a histogram of the sizes requested) using per-CPU
+/// counters, along with its high water mark and largest free run, so that
+/// the pools can be sized based on what the VMM actually uses.
+///
+/// Allocations are also tagged with the subsystem that owns them (see
+/// mem_tag.h). The heap and page pools record the tag of each allocation
+/// in their metadata, and the memory manager keeps the number of live bytes
+/// of each tag. Slabs have no room for a tag per object, so tagged objects
+/// come from slabs that only hold objects of that tag, and skip the per-CPU
+/// caches. Since most of the VMM's allocations are untagged, this leaves the
+/// slab pool's fast path alone.
 ///
 /// Mapping / unmapping of virtual to physical memory is handled by providing
 /// two capabilities. First, the memory manager provides a means to alloc and
@@ -78,6 +142,30 @@ public:
     using size_type = std::size_t;
     using attr_type = decltype(memory_descriptor::type);
     using memory_descriptor_list = std::vector<memory_descriptor>;
+    using page_pool_type = buddy_pool<MAX_PAGE_POOL, x64::page_shift>;
+    using page_pool_report_type = page_pool_type::report_type;
+    using pool_type = memory_manager_pool::type;
+    using stats_type = mem_stats<MAX_NUM_CPUS>;
+    using stats_report_type = stats_type::report_type;
+    using tag_type = mem_tag::type;
+    using tag_report_type = std::array<size_type, mem_tag_num_tags>;
+
+    /// Pool Stats
+    ///
+    /// The statistics of one of the memory manager's pools. capacity is
+    /// the number of bytes the pool can hand out, high_water is the most
+    /// bytes that have been allocated from the pool at any one time, and
+    /// largest_free is the largest allocation that can currently succeed.
+    /// For the slab pool, capacity and high_water are the number of bytes
+    /// carved into slabs, and largest_free is not tracked (0).
+    ///
+    struct pool_stats_type
+    {
+        stats_report_type counters;
+        size_type capacity;
+        size_type high_water;
+        size_type largest_free;
+    };
 
     /// Default Destructor
     ///
@@ -99,8 +187,9 @@ public:
     ///
     /// Allocates memory. If the requested size is a multiple of MAX_PAGE_SIZE
     /// the page pool is used to allocate the memory which likely has more
-    /// memory, and the resulting addresses are page aligned. All other
-    /// requests come from the heap.
+    /// memory, and the resulting addresses are page aligned. Requests that
+    /// fit in a slab size class come from the slab pool. All other requests
+    /// come from the heap.
     ///
     /// @expects none
     /// @ensures none
@@ -112,11 +201,79 @@ public:
     ///
     virtual pointer alloc(size_type size) noexcept;
 
+    /// Allocate Contiguous Memory
+    ///
+    /// Allocates 2^order pages from the page pool that are both virtually
+    /// and physically contiguous. Both the virtual and the physical address
+    /// are aligned to the size of the allocation (i.e. an order of 9
+    /// returns 2M of memory that is 2M aligned). Since the page pool itself
+    /// is only virtually contiguous, blocks are checked against the
+    /// descriptors that have been added (see add_md), and blocks that are
+    /// not physically contiguous and aligned are skipped.
+    ///
+    /// The memory the driver entry donates to the page pool (add_pages) is
+    /// only virtually contiguous, so for orders larger than 0 such a block
+    /// is found by luck, if at all. Rather than checking every block in the
+    /// pool, this gives up after memory_manager_contiguous_tries blocks, so
+    /// callers must be able to handle a failure. The memory is released
+    /// using free.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param order the number of pages to allocate, in bit shifts
+    /// @return a pointer to the starting address of the memory allocated.
+    ///     Returns 0 on error
+    ///
+    virtual pointer alloc_contiguous(size_type order) noexcept;
+
+    /// Allocate Aligned Memory
+    ///
+    /// Allocates at least size bytes of contiguous memory whose starting
+    /// address is aligned to align. Small requests are served by the slab
+    /// pool (whose objects are aligned to their size class), requests with
+    /// an alignment no larger than a cache line are served by the heap, and
+    /// all other requests come from the page pool. Only the virtual address
+    /// is aligned; memory that has to be physically contiguous or aligned
+    /// comes from alloc_contiguous. The memory is released using free.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param size the number of bytes to allocate
+    /// @param align the alignment of the memory, must be a power of 2
+    /// @return a pointer to the starting address of the memory allocated.
+    ///     Returns 0 on error
+    ///
+    virtual pointer alloc_aligned(size_type size, size_type align) noexcept;
+
+    /// Reallocate Memory
+    ///
+    /// Changes the size of previously allocated memory. If possible, the
+    /// memory is resized in place: heap allocations grow into the free
+    /// blocks that follow them and shrink by releasing their tail, and slab
+    /// and page pool allocations are kept when the new size still maps to
+    /// the same size class / order. Otherwise new memory is allocated, the
+    /// contents are copied, and the old memory is freed. If ptr == nullptr
+    /// this is the same as alloc, and if size == 0 this is the same as free.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param ptr a pointer to memory previously allocated using alloc.
+    /// @param size the new size in bytes of the memory
+    /// @return a pointer to the starting address of the resized memory.
+    ///     Returns 0 on error, in which case ptr is left untouched
+    ///
+    virtual pointer realloc(pointer ptr, size_type size) noexcept;
+
     /// Allocate Map
     ///
     /// Allocates virtual memory to be used for mapping. This memory has no
     /// backing until it has been mapped, so don't attempt to dereference it
-    /// until then as that will result in undefined behavior.
+    /// until then as that will result in undefined behavior. The memory
+    /// comes from the memory map pool, which is a vmem_arena spanning
+    /// MAX_MEM_MAP_POOL bytes starting at MEM_MAP_POOL_START.
     ///
     /// @expects none
     /// @ensures none
@@ -127,6 +284,24 @@ public:
     ///
     virtual pointer alloc_map(size_type size) noexcept;
 
+    /// Allocate Aligned Map
+    ///
+    /// Same as alloc_map, but the address that is returned minus offset is
+    /// a multiple of align (see mem_pool::alloc_aligned). This is used to
+    /// give a map the same offset into a large page as the memory it maps,
+    /// so that it can be mapped using large pages.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param size the number of bytes to allocate
+    /// @param align the alignment of the memory (minus offset)
+    /// @param offset the offset of the memory from align
+    /// @return a pointer to the starting address of the memory allocated.
+    ///     Returns 0 otherwise, or on error
+    ///
+    virtual pointer alloc_map_aligned(size_type size, size_type align, size_type offset) noexcept;
+
     /// Free Memory
     ///
     /// Deallocates a block of memory previously allocated by a call to
@@ -155,6 +330,37 @@ public:
     ///
     virtual void free_map(pointer ptr) noexcept;
 
+    /// Free Map (Deferred)
+    ///
+    /// Unmaps (from the root page tables) and deallocates a block of memory
+    /// previously allocated by a call to alloc_map. Rather than doing this
+    /// right away, the map is queued, and once MAX_DEFERRED_UNMAPS maps are
+    /// queued (or the map pool runs out of memory), all of them are
+    /// unmapped, and their TLB entries are invalidated at once on this
+    /// core. Since the VMM's TLB entries survive VM exits, other cores might
+    /// still have them, so the maps are only returned to the map pool once
+    /// every core has flushed its TLB (see begin_exit). Until then, the
+    /// memory is not reused. If ptr == nullptr or size == 0, the call is
+    /// ignored.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param ptr a pointer to memory previously allocated using alloc_map.
+    /// @param size the number of bytes that were mapped at ptr
+    ///
+    virtual void free_map_deferred(pointer ptr, size_type size) noexcept;
+
+    /// Flush Deferred Maps
+    ///
+    /// Unmaps all of the maps queued by free_map_deferred, and returns the
+    /// maps that no core can have a TLB entry for to the map pool.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    virtual void flush_deferred_maps() noexcept;
+
     /// Size
     ///
     /// Returns the size of previously allocated memory. If the provided
@@ -181,6 +387,129 @@ public:
     ///
     virtual size_type size_map(pointer ptr) const noexcept;
 
+    /// Page Pool Report
+    ///
+    /// Returns a report on the fragmentation of the page pool, including
+    /// the number of free blocks of each order, and the largest block of
+    /// contiguous memory that can currently be allocated.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return page pool fragmentation report
+    ///
+    virtual page_pool_report_type page_pool_report() const noexcept;
+
+    /// Pool Stats
+    ///
+    /// Returns the statistics of one of the memory manager's pools. Note
+    /// that this walks the pool's metadata to find its largest free run,
+    /// and should not be used on a hot path.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param pool the pool to report on
+    /// @return the statistics of the pool
+    ///
+    virtual pool_stats_type pool_stats(pool_type pool) const noexcept;
+
+    /// Tag Report
+    ///
+    /// Returns the number of live bytes (allocated and not yet freed) of
+    /// each tag, indexed by tag. Memory used by the map pool is virtual
+    /// address space, and is not included. The untagged entry is whatever
+    /// the heap, page and slab pools have allocated that is not tagged.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the number of live bytes of each tag
+    ///
+    virtual tag_report_type tag_report() const noexcept;
+
+    /// Add Heap
+    ///
+    /// Adds memory donated by the driver entry to the heap. The memory is
+    /// split into chunks of MAX_HEAP_POOL bytes, each of which is chained
+    /// to the heap as another region. The memory must already be mapped
+    /// into the VMM (i.e. it must have been added using add_md), and it
+    /// must remain valid for as long as the VMM is loaded.
+    ///
+    /// @expects virt != 0
+    /// @expects virt & (page_size - 1) == 0
+    /// @expects size != 0
+    /// @expects size % MAX_HEAP_POOL == 0
+    /// @ensures none
+    ///
+    /// @param virt the starting address of the memory to add
+    /// @param size the number of bytes to add
+    ///
+    virtual void add_heap(integer_pointer virt, size_type size);
+
+    /// Heap Chunks Needed
+    ///
+    /// Returns the number of MAX_HEAP_POOL sized chunks that the heap
+    /// needs to bring its usage back below HEAP_HIGH_WATER_MARK. If the
+    /// heap's usage is below the mark, 0 is returned.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the number of heap chunks the driver entry should donate
+    ///
+    virtual size_type heap_chunks_needed() const noexcept;
+
+    /// Add Pages
+    ///
+    /// Adds memory donated by the driver entry to the page pool. The memory
+    /// is split into chunks of MAX_PAGE_POOL bytes, each of which is
+    /// chained to the page pool as another region. Slabs are only carved
+    /// from the page pool's static region, so the donated memory is only
+    /// used for page allocations. The memory must already be mapped into
+    /// the VMM, and it must remain valid for as long as the VMM is loaded.
+    ///
+    /// @expects virt != 0
+    /// @expects virt & (page_size - 1) == 0
+    /// @expects size != 0
+    /// @expects size % MAX_PAGE_POOL == 0
+    /// @ensures none
+    ///
+    /// @param virt the starting address of the memory to add
+    /// @param size the number of bytes to add
+    ///
+    virtual void add_pages(integer_pointer virt, size_type size);
+
+    /// Page Chunks Needed
+    ///
+    /// Returns the number of MAX_PAGE_POOL sized chunks that the page pool
+    /// needs to bring its usage back below HEAP_HIGH_WATER_MARK. If the
+    /// page pool's usage is below the mark, 0 is returned.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the number of page chunks the driver entry should donate
+    ///
+    virtual size_type page_chunks_needed() const noexcept;
+
+    /// Valid Heap Token
+    ///
+    /// Memory donated while the VMM is running comes in through the heap
+    /// vmcall, which any guest software that knows the magic number could
+    /// make. A token is issued when the memory manager is created (while
+    /// the VMM is being loaded), and the driver entry takes it from
+    /// g_heap_token before the VMM is started. Only heap vmcalls that
+    /// carry the token are accepted.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param token the token provided with the heap vmcall
+    /// @return true if token is the token that was issued, false otherwise
+    ///
+    virtual bool valid_heap_token(uint64_t token) const noexcept;
+
     /// Virtual Address To Physical Address
     ///
     /// Given a virtual address, returns a physical address.
@@ -318,6 +647,30 @@ public:
     ///
     virtual void add_md(integer_pointer virt, integer_pointer phys, attr_type attr);
 
+    /// Adds Memory Descriptor Range
+    ///
+    /// Adds a memory descriptor to the memory manager that covers size
+    /// bytes of memory that are both virtually and physically contiguous.
+    /// Any pages in the range that were previously added are replaced, and
+    /// the range is coalesced with neighboring ranges that are contiguous
+    /// and share the same attributes.
+    ///
+    /// @expects virt != 0
+    /// @expects phys != 0
+    /// @expects type != 0
+    /// @expects size != 0
+    /// @expects virt & (page_size - 1) == 0
+    /// @expects phys & (page_size - 1) == 0
+    /// @expects size & (page_size - 1) == 0
+    /// @ensures none
+    ///
+    /// @param virt starting virtual address to add
+    /// @param phys starting physical address mapped to virt
+    /// @param size the number of bytes to add
+    /// @param attr how the memory was mapped
+    ///
+    virtual void add_md_range(integer_pointer virt, integer_pointer phys, size_type size, attr_type attr);
+
     /// Remove Memory Descriptor
     ///
     /// Removes a memory descriptor list to the memory manager.
@@ -329,12 +682,26 @@ public:
     ///
     virtual void remove_md(integer_pointer virt) noexcept;
 
+    /// Remove Memory Descriptor Range
+    ///
+    /// Removes size bytes of memory descriptors starting at virt, as
+    /// added by add_md_range. The reverse (phys to virt) lookup of a page
+    /// is only removed if it still refers to the page being removed.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param virt starting virtual address to remove
+    /// @param size the number of bytes to remove
+    ///
+    virtual void remove_md_range(integer_pointer virt, size_type size) noexcept;
+
     /// Descriptor List
     ///
     /// Returns a list of descriptors that have been added to the
-    /// memory manager. Note that to limit the amount of memory that is
-    /// needed for lookups, this function is expensive has it has to
-    /// reconstruct the descriptors currently being stored.
+    /// memory manager, sorted by virtual address. Each descriptor is an
+    /// extent, so contiguous memory that was added one page at a time is
+    /// returned as a single descriptor.
     ///
     /// @expects none
     /// @ensures none
@@ -343,6 +710,33 @@ public:
     ///
     virtual memory_descriptor_list descriptors() const;
 
+    /// Begin Exit
+    ///
+    /// Called by the exit handler when it starts to handle a VM exit. From
+    /// here until end_exit, the current CPU may hold pointers into the
+    /// lock-free virt / phys translation tables, so the nodes that are
+    /// removed from them are not freed or reused (see grace_period).
+    ///
+    /// The VMM's TLB entries are tagged with VPID 0 and VMM_PCID, and thus
+    /// survive VM exits and entries, including the entries of maps that
+    /// another CPU has since unmapped. If any map was unmapped since this
+    /// CPU last got here, its (non-global) TLB entries are flushed.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    virtual void begin_exit() noexcept;
+
+    /// End Exit
+    ///
+    /// Called by the exit handler right before it resumes the guest (or
+    /// promotes it when the VMM is stopped).
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    virtual void end_exit() noexcept;
+
 private:
 
     memory_manager_x64() noexcept;
@@ -350,15 +744,77 @@ private:
     integer_pointer lower(integer_pointer ptr) const noexcept;
     integer_pointer upper(integer_pointer ptr) const noexcept;
 
+    integer_pointer virt_key(integer_pointer virt) const noexcept;
+    integer_pointer phys_key(integer_pointer phys) const noexcept;
+
+    void remove_extents(integer_pointer virt, size_type size);
+    bool is_phys_block(integer_pointer virt, size_type size) const;
+    void insert_extent(const memory_descriptor &md);
+
+    pointer alloc_slab(size_type size, size_type actual, tag_type tag) noexcept;
+    tag_type find_tag(integer_pointer addr) const noexcept;
+
+    pointer record_tag(pointer ptr, tag_type tag, size_type actual) noexcept;
+    void record_tag_free(uint8_t tag, size_type freed) noexcept;
+
+    struct deferred_map_type
+    {
+        integer_pointer virt;
+        size_type size;
+    };
+
+    using deferred_maps_type = std::array<deferred_map_type, MAX_DEFERRED_UNMAPS>;
+
+    void release_deferred_maps(const deferred_maps_type &maps, size_type num) noexcept;
+
+    struct retired_map_type
+    {
+        integer_pointer virt;
+        grace_period::epoch_type epoch;
+    };
+
+    using retired_maps_type = std::array<retired_map_type, MAX_RETIRED_MAPS>;
+
+    void retire_maps(const deferred_maps_type &maps, size_type num) noexcept;
+
+    template<class T> uintptr_t
+    lookup(const T &table, integer_pointer key) const noexcept;
+
 private:
 
-    std::map<integer_pointer, integer_pointer> m_virt_to_phys_map;
-    std::map<integer_pointer, integer_pointer> m_phys_to_virt_map;
-    std::map<integer_pointer, attr_type> m_virt_to_attr_map;
+    std::map<integer_pointer, memory_descriptor> m_extents;
+
+    mutable grace_period m_grace_period;
+    radix_table<memory_manager_virt_bits - x64::page_shift> m_virt_to_phys_table;
+    radix_table<memory_manager_phys_bits - x64::page_shift> m_phys_to_virt_table;
+
+    using heap_pool_type = mem_pool<MAX_HEAP_POOL, x64::cache_line_shift>;
+    using slab_pool_type = slab_pool<MAX_PAGE_POOL, x64::page_shift, page_pool_type>;
+
+    heap_pool_type g_heap_pool;
+    page_pool_type g_page_pool;
+    slab_pool_type g_slab_pool;
+    slab_cache<slab_pool_type, MAX_NUM_CPUS, SLAB_CACHE_SIZE> g_slab_cache;
+    vmem_arena<MAX_MEM_MAP_POOL, x64::page_shift, MAX_MEM_MAP_SEGMENTS> g_mem_map_pool;
+
+    stats_type m_heap_stats;
+    stats_type m_page_stats;
+    stats_type m_slab_stats;
+    stats_type m_map_stats;
 
-    mem_pool<MAX_HEAP_POOL, x64::cache_line_shift> g_heap_pool;
-    mem_pool<MAX_PAGE_POOL, x64::page_shift> g_page_pool;
-    mem_pool<MAX_MEM_MAP_POOL, x64::page_shift> g_mem_map_pool;
+    std::array<std::atomic<size_type>, mem_tag_num_tags> m_tag_bytes;
+
+    deferred_maps_type m_deferred_maps;
+    size_type m_num_deferred_maps;
+
+    retired_maps_type m_retired_maps;
+    size_type m_retired_maps_head;
+    size_type m_num_retired_maps;
+
+    std::atomic<uint64_t> m_tlb_generation;
+    std::array<uint64_t, MAX_NUM_CPUS> m_tlb_flushed;
+
+    uint64_t m_heap_token;
 
 public:
 
@@ -376,4 +832,20 @@ public:
 ///
 #define g_mm memory_manager_x64::instance()
 
+/// Pool Generation
+///
+/// Incremented every time the heap or the page pool serves an allocation.
+/// The driver entry reads this directly to decide whether it needs to ask
+/// the VMM for heap_chunks_needed / page_chunks_needed at all.
+///
+extern "C" std::atomic<uint64_t> g_pool_generation;
+
+/// Heap Token
+///
+/// Holds the token checked by valid_heap_token until the driver entry
+/// takes it, which it does by reading it and setting it to 0 while the
+/// VMM is being loaded.
+///
+extern "C" uint64_t g_heap_token;
+
 #endif
@@ -30,6 +30,36 @@
 #include <memory.h>
 #include <memory_manager/page_table_entry_x64.h>
 
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+
+constexpr const auto page_table_x64_max_free_tables = 16UL;
+
+// -----------------------------------------------------------------------------
+// Definition
+// -----------------------------------------------------------------------------
+
+/// Page Table
+///
+/// Manages a 4 level page table structure. Each page table is a single
+/// 4k hardware table, and nothing else: the entries that point to a page
+/// table are marked using one of the bits the hardware ignores (see
+/// page_table_x64::table_bit), and the page table they point to is located
+/// by converting the physical address in the entry back into a virtual
+/// address (see memory_manager_x64::physint_to_virtptr). Walking the
+/// structure is therefore a loop of array lookups. The only other
+/// bookkeeping is a single list of the page tables that are in use, which
+/// is what the destructor frees.
+///
+/// Page tables that are no longer needed are kept (up to
+/// page_table_x64_max_free_tables of them) and reused, which saves the
+/// allocation and virtual to physical conversion when memory is mapped
+/// and unmapped side by side.
+///
+/// This class is not thread safe, and should be protected by the owner
+/// (see root_page_table_x64).
+///
 class page_table_x64
 {
 public:
@@ -54,10 +84,12 @@ public:
 
     /// Destructor
     ///
+    /// Frees all of the page tables.
+    ///
     /// @expects none
     /// @ensures none
     ///
-    ~page_table_x64() = default;
+    ~page_table_x64() noexcept;
 
     /// Add Page (1g Granularity)
     ///
@@ -113,26 +145,76 @@ public:
     page_table_entry_x64 add_page_4k(integer_pointer addr)
     { return add_page(addr, x64::page_table::pml4::from, x64::page_table::pt::from); }
 
+    /// Add Pages (1g Granularity)
+    ///
+    /// Adds up to num pages, starting at addr, to the page table structure.
+    /// All of the pages are added to the same page table, so if the pages
+    /// would cross into the next page table, fewer than num pages are
+    /// added. This allows the caller to fill in the entries of a page table
+    /// in one pass, instead of walking the page table structure for each
+    /// page.
+    ///
+    /// @expects num != 0
+    /// @ensures ret.size() != 0
+    ///
+    /// @param addr the virtual address of the first page to add
+    /// @param num the number of pages to add
+    /// @return the resulting ptes. Note that these ptes are not cleared,
+    ///     and their properties (like present) should be set by the caller
+    ///
+    gsl::span<integer_pointer> add_pages_1g(integer_pointer addr, size_type num)
+    { return add_pages(addr, num, x64::page_table::pml4::from, x64::page_table::pdpt::from); }
+
+    /// Add Pages (2m Granularity)
+    ///
+    /// @see add_pages_1g
+    ///
+    /// @expects num != 0
+    /// @ensures ret.size() != 0
+    ///
+    /// @param addr the virtual address of the first page to add
+    /// @param num the number of pages to add
+    /// @return the resulting ptes
+    ///
+    gsl::span<integer_pointer> add_pages_2m(integer_pointer addr, size_type num)
+    { return add_pages(addr, num, x64::page_table::pml4::from, x64::page_table::pd::from); }
+
+    /// Add Pages (4k Granularity)
+    ///
+    /// @see add_pages_1g
+    ///
+    /// @expects num != 0
+    /// @ensures ret.size() != 0
+    ///
+    /// @param addr the virtual address of the first page to add
+    /// @param num the number of pages to add
+    /// @return the resulting ptes
+    ///
+    gsl::span<integer_pointer> add_pages_4k(integer_pointer addr, size_type num)
+    { return add_pages(addr, num, x64::page_table::pml4::from, x64::page_table::pt::from); }
+
     /// Remove Page
     ///
     /// Removes a page from the page table. Note that this function cleans
-    /// up as it goes, removing empty page tables if they are detected. For
-    /// this reason, this operation can be expensive if mapping / unmapping
-    /// occurs side by side with addresses that are similar (page tables will
-    /// be needlessly removed)
+    /// up as it goes, removing empty page tables if they are detected
+    /// (which are kept for reuse, see page_table_x64_max_free_tables).
     ///
     /// @expects none
     /// @ensures none
     ///
     /// @param addr the virtual address of the page to remove
+    /// @return the size of the page that was removed in bytes, or 0 if
+    ///     addr was not mapped
     ///
-    void remove_page(integer_pointer addr)
-    { remove_page(addr, x64::page_table::pml4::from); }
+    size_type remove_page(integer_pointer addr)
+    { return remove_page(addr, x64::page_table::pml4::from); }
 
     /// Virt to Page Table Entry
     ///
     /// Returns the PTE associated with the provided virtual address. If no
-    /// PTE exists for the virtual address provided, an exception is thrown.
+    /// PTE exists for the virtual address provided (i.e. the walk ends on
+    /// an empty entry before it reaches the last level, in a page table
+    /// that also points to other page tables), an exception is thrown.
     ///
     /// @expects none
     /// @ensures none
@@ -155,30 +237,59 @@ public:
     /// @return memory descriptor list
     ///
     memory_descriptor_list pt_to_mdl() const
-    { memory_descriptor_list mdl; return pt_to_mdl(mdl); }
+    { memory_descriptor_list mdl; pt_to_mdl(mdl, m_pt, m_phys, x64::page_table::pml4::from); return mdl; }
+
+    /// Table Bit
+    ///
+    /// The bit that marks an entry as pointing to a page table (bit 9 is
+    /// ignored by the hardware in every type of entry). Entries that map a
+    /// page never have this bit set by this class.
+    ///
+    static constexpr const integer_pointer table_bit = 1UL << 9;
 
 private:
 
     page_table_entry_x64 add_page(integer_pointer addr, integer_pointer bits, integer_pointer end);
-    void remove_page(integer_pointer addr, integer_pointer bits);
+    gsl::span<integer_pointer> add_pages(integer_pointer addr, size_type num, integer_pointer bits, integer_pointer end);
+    size_type remove_page(integer_pointer addr, integer_pointer bits);
     page_table_entry_x64 virt_to_pte(integer_pointer addr, integer_pointer bits) const;
-    memory_descriptor_list pt_to_mdl(memory_descriptor_list &mdl) const;
+    void pt_to_mdl(memory_descriptor_list &mdl, pointer table, integer_pointer phys, integer_pointer bits) const;
+
+    pointer alloc_table(integer_pointer &entry);
+    void free_table(pointer table, integer_pointer phys, integer_pointer bits) noexcept;
+    void release_free_tables() noexcept;
 
-    bool empty() const noexcept;
-    size_type global_size() const noexcept;
-    size_type global_capacity() const noexcept;
+    static pointer child(const integer_pointer &entry) noexcept;
+
+    static bool is_table(integer_pointer entry) noexcept
+    { return (entry & table_bit) != 0; }
+
+    static bool empty(pointer table) noexcept;
+
+    size_type global_size() const noexcept
+    { return global_size(m_pt, x64::page_table::pml4::from); }
+
+    size_type global_size(pointer table, integer_pointer bits) const noexcept;
+
+    size_type global_tables() const noexcept
+    { return m_tables.size(); }
 
 private:
 
     friend class memory_manager_ut;
 
-    std::unique_ptr<integer_pointer[]> m_pt;
-    std::vector<std::unique_ptr<page_table_x64>> m_pts;
+    pointer m_pt;
+    integer_pointer m_phys;
+
+    pointer m_free;
+    size_type m_num_free;
+
+    std::vector<pointer> m_tables;
 
 public:
 
-    page_table_x64(page_table_x64 &&) noexcept = default;
-    page_table_x64 &operator=(page_table_x64 &&) noexcept = default;
+    page_table_x64(page_table_x64 &&other) noexcept;
+    page_table_x64 &operator=(page_table_x64 &&other) noexcept;
 
     page_table_x64(const page_table_x64 &) = delete;
     page_table_x64 &operator=(const page_table_x64 &) = delete;
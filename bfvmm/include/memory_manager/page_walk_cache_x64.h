@@ -0,0 +1,238 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#ifndef PAGE_WALK_CACHE_X64_H
+#define PAGE_WALK_CACHE_X64_H
+
+#include <array>
+
+#include <memory_manager/map_ptr_x64.h>
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+
+constexpr const auto page_walk_cache_num_entries = 64UL;
+constexpr const auto page_walk_cache_num_tables = 8UL;
+
+// -----------------------------------------------------------------------------
+// Definition
+// -----------------------------------------------------------------------------
+
+namespace bfn
+{
+
+/// Page Walk Cache
+///
+/// virt_to_phys_with_cr3 and map_with_cr3 have to map each of the guest's
+/// page tables into the VMM as they walk them (alloc_map, map_4k, invlpg,
+/// unmap and free_map for each level), which makes translating a guest
+/// virtual address expensive. This cache is meant to be owned by a vCPU,
+/// and removes most of this cost in two ways:
+///
+/// - The guest page tables that have been walked stay mapped into the VMM
+///   (keyed by their physical address), so a walk through tables that
+///   are already mapped only reads memory. Once page_walk_cache_num_tables
+///   tables are mapped, the least recently used one is unmapped to make
+///   room. Since the tables are read each time, changes the guest makes to
+///   its page tables are always seen by a walk.
+///
+/// - The result of each walk is kept in a small direct mapped cache keyed
+///   by the guest's CR3 and the guest virtual page, so translating the
+///   same page again does not walk at all. Like a TLB, these translations
+///   are not updated when the guest changes its page tables. They are
+///   dropped when a different CR3 is used, or when flush is called, and
+///   it is up to the owner to flush when the guest may have changed its
+///   page tables (e.g. on an INVLPG, or when the exits that would tell
+///   are not trapped, when the guest says it has).
+///
+/// This class is not thread safe. Each vCPU should have its own.
+///
+class page_walk_cache_x64
+{
+public:
+
+    using integer_pointer = uintptr_t;
+    using size_type = size_t;
+
+    /// Translation
+    ///
+    /// phys is the guest physical address of the guest virtual address
+    /// that was translated, pati is the PAT index of the page that
+    /// contains it, and size is the size of that page (4k, 2m or 1g).
+    /// writable and user are the page's effective R/W and U/S bits (i.e.
+    /// set only if they are set at every level of the walk).
+    ///
+    struct translation_type
+    {
+        integer_pointer phys;
+        integer_pointer pati;
+        integer_pointer size;
+        bool writable;
+        bool user;
+    };
+
+    /// Default Constructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    page_walk_cache_x64() noexcept;
+
+    /// Destructor
+    ///
+    /// Unmaps the guest page tables that are still mapped.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    virtual ~page_walk_cache_x64() = default;
+
+    /// Translate
+    ///
+    /// Converts a guest virtual address to a guest physical address using
+    /// the page tables located at cr3, returning a cached translation if
+    /// there is one. If cr3 is not the CR3 that the cached translations
+    /// came from, they are flushed first.
+    ///
+    /// @expects virt != 0
+    /// @expects cr3 != 0
+    /// @expects cr3 & (x64::page_size - 1) == 0
+    /// @ensures none
+    ///
+    /// @param virt the guest virtual address to convert
+    /// @param cr3 the guest's CR3
+    /// @return the guest physical address, PAT index and permissions of
+    ///     virt
+    ///
+    virtual translation_type translate(integer_pointer virt, integer_pointer cr3);
+
+    /// Virt to Phys
+    ///
+    /// Same as translate, but only returns the physical address.
+    ///
+    /// @expects virt != 0
+    /// @expects cr3 != 0
+    /// @expects cr3 & (x64::page_size - 1) == 0
+    /// @ensures none
+    ///
+    /// @param virt the guest virtual address to convert
+    /// @param cr3 the guest's CR3
+    /// @return the guest physical address of virt
+    ///
+    virtual integer_pointer virt_to_phys(integer_pointer virt, integer_pointer cr3)
+    { return this->translate(virt, cr3).phys; }
+
+    /// Flush
+    ///
+    /// Drops all of the cached translations. The guest page tables stay
+    /// mapped.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    virtual void flush() noexcept;
+
+    /// Flush Page
+    ///
+    /// Drops the cached translation of the page containing virt (i.e.
+    /// what INVLPG does for the TLB).
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param virt the guest virtual address to flush
+    ///
+    virtual void flush(integer_pointer virt) noexcept;
+
+    /// Release
+    ///
+    /// Drops all of the cached translations, and unmaps the guest page
+    /// tables that are mapped.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    virtual void release() noexcept;
+
+    /// Hits
+    ///
+    /// @return the number of translations that were found in the cache
+    ///
+    size_type hits() const noexcept
+    { return m_hits; }
+
+    /// Misses
+    ///
+    /// @return the number of translations that had to walk the page tables
+    ///
+    size_type misses() const noexcept
+    { return m_misses; }
+
+private:
+
+    struct entry_type
+    {
+        bool valid;
+        integer_pointer virt;
+        integer_pointer phys;
+        integer_pointer pati;
+        integer_pointer size;
+        bool writable;
+        bool user;
+    };
+
+    struct table_type
+    {
+        integer_pointer phys;
+        size_type used;
+        unique_map_ptr_x64<uintptr_t> map;
+    };
+
+    translation_type walk(integer_pointer virt, integer_pointer cr3);
+    uintptr_t read_entry(integer_pointer table, integer_pointer virt, integer_pointer from);
+
+    static size_type entry_index(integer_pointer virt) noexcept
+    { return (virt >> x64::page_shift) % page_walk_cache_num_entries; }
+
+private:
+
+    integer_pointer m_cr3;
+    size_type m_tick;
+
+    size_type m_hits;
+    size_type m_misses;
+
+    std::array<entry_type, page_walk_cache_num_entries> m_entries;
+    std::array<table_type, page_walk_cache_num_tables> m_tables;
+
+public:
+
+    page_walk_cache_x64(page_walk_cache_x64 &&) noexcept = default;
+    page_walk_cache_x64 &operator=(page_walk_cache_x64 &&) noexcept = default;
+
+    page_walk_cache_x64(const page_walk_cache_x64 &) = delete;
+    page_walk_cache_x64 &operator=(const page_walk_cache_x64 &) = delete;
+};
+
+}
+
+#endif
@@ -0,0 +1,429 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#ifndef RADIX_TABLE_H
+#define RADIX_TABLE_H
+
+#include <gsl/gsl>
+
+#include <array>
+#include <atomic>
+
+#include <memory_manager/grace_period.h>
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+
+constexpr const auto radix_table_node_shift = 9UL;
+constexpr const auto radix_table_node_size = 1UL << radix_table_node_shift;
+
+constexpr const auto radix_table_max_retired = 32UL;
+
+// -----------------------------------------------------------------------------
+// Definition
+// -----------------------------------------------------------------------------
+
+///
+/// *INDENT-OFF*
+///
+
+/// Radix Table
+///
+/// Maps an integer key (e.g. a page number) to a non-zero integer value
+/// using a radix tree that is laid out like the x64 page tables, with
+/// 512 entries per node. Lookups never take a lock: each level is read
+/// using an atomic load. Writers on the other hand must be serialized by
+/// the caller.
+///
+/// A node that is left empty by clear is unlinked from its parent and
+/// retired. Since a reader might have loaded the node just before it was
+/// unlinked, a retired node is only reused (or freed) once the grace period
+/// given to the constructor has passed the epoch it was retired in (see
+/// grace_period). At most radix_table_max_retired nodes wait for this at a
+/// time. When the queue is full and its oldest node still has readers, an
+/// empty node is simply left linked, which is always safe. Without a grace
+/// period, empty nodes are never unlinked, and nodes are only freed when
+/// the table is destroyed.
+///
+/// The root node is stored inline so that constructing a table never
+/// allocates memory, which is needed by the memory manager as it cannot
+/// allocate memory while it is being constructed. The remaining nodes are
+/// allocated as keys are added.
+///
+/// @param key_bits the number of bits in a key
+///
+template<size_t key_bits>
+class radix_table
+{
+    static_assert(key_bits > 0 && key_bits < 64, "key_bits must be between 1 and 63");
+
+public:
+
+    using key_type = uintptr_t;
+    using value_type = uintptr_t;
+
+    /// Default Constructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param gp the grace period that the readers of this table enter and
+    ///     leave, or nullptr if empty nodes should never be unlinked
+    ///
+    explicit radix_table(grace_period *gp = nullptr) noexcept :
+        m_gp(gp),
+        m_retired(),
+        m_retired_head(0),
+        m_num_retired(0),
+        m_num_nodes(0)
+    {
+        for (auto &&entry : m_root.entries)
+            entry.store(0, std::memory_order_relaxed);
+    }
+
+    /// Destructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    ~radix_table()
+    {
+        for (auto &&entry : m_root.entries)
+            destroy(entry.load(std::memory_order_relaxed), 1);
+
+        while (m_num_retired != 0)
+            delete pop_retired().n;
+    }
+
+    /// Get
+    ///
+    /// Returns the value associated with key. This function is wait-free
+    /// and can be called while another core is modifying the table.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param key the key to look up
+    /// @return the value associated with key, or 0 if key has no value
+    ///
+    value_type
+    get(key_type key) const noexcept
+    {
+        if ((key >> key_bits) != 0)
+            return 0;
+
+        auto n = &m_root;
+
+        for (auto level = 0UL; level < num_levels - 1; level++)
+        {
+            auto &&next = entry(n, key, level).load(std::memory_order_acquire);
+
+            if (next == 0)
+                return 0;
+
+            n = reinterpret_cast<const node *>(next);
+        }
+
+        return entry(n, key, num_levels - 1).load(std::memory_order_acquire);
+    }
+
+    /// Set
+    ///
+    /// Associates value with key, allocating the nodes that are needed
+    /// to do so. Calls to set and clear must be serialized.
+    ///
+    /// @expects key fits in key_bits
+    /// @expects value != 0
+    /// @ensures get(key) == value
+    ///
+    /// @param key the key to set
+    /// @param value the value to associate with key
+    ///
+    void
+    set(key_type key, value_type value)
+    {
+        expects((key >> key_bits) == 0);
+        expects(value != 0);
+
+        auto n = &m_root;
+
+        for (auto level = 0UL; level < num_levels - 1; level++)
+        {
+            auto &&ent = entry(n, key, level);
+            auto next = ent.load(std::memory_order_relaxed);
+
+            if (next == 0)
+            {
+                next = reinterpret_cast<uintptr_t>(alloc_node());
+                ent.store(next, std::memory_order_release);
+            }
+
+            n = reinterpret_cast<node *>(next);
+        }
+
+        entry(n, key, num_levels - 1).store(value, std::memory_order_release);
+    }
+
+    /// Clear
+    ///
+    /// Removes the value associated with key. The nodes that are left
+    /// empty are retired (see above). Calls to set and clear must be
+    /// serialized.
+    ///
+    /// @expects none
+    /// @ensures get(key) == 0
+    ///
+    /// @param key the key to clear
+    ///
+    void
+    clear(key_type key) noexcept
+    {
+        if (get(key) == 0)
+            return;
+
+        std::array<node *, num_levels> path = {};
+        auto n = &m_root;
+
+        for (auto level = 0UL; level < num_levels - 1; level++)
+        {
+            gsl::at(path, level) = n;
+            n = reinterpret_cast<node *>(entry(n, key, level).load(std::memory_order_relaxed));
+        }
+
+        gsl::at(path, num_levels - 1) = n;
+        entry(n, key, num_levels - 1).store(0, std::memory_order_release);
+
+        // The empty nodes are unlinked from the bottom up. Note that the
+        // root node is never retired. The epoch of the nodes that were
+        // unlinked can only be known once all of them are unlinked.
+
+        if (m_gp == nullptr)
+            return;
+
+        auto retired = 0UL;
+
+        for (auto level = num_levels - 1; level > 0; level--)
+        {
+            auto &&child = gsl::at(path, level);
+
+            if (!empty(child) || !can_retire())
+                break;
+
+            entry(gsl::at(path, level - 1), key, level - 1).store(0, std::memory_order_release);
+            retire(child);
+
+            retired++;
+        }
+
+        if (retired == 0)
+            return;
+
+        auto &&epoch = m_gp->advance();
+
+        for (auto i = m_num_retired - retired; i < m_num_retired; i++)
+            gsl::at(m_retired, (m_retired_head + i) % radix_table_max_retired).epoch = epoch;
+    }
+
+    /// Nodes
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the number of nodes (not including the root node, or the
+    ///     nodes that have been retired) that are in use
+    ///
+    size_t
+    nodes() const noexcept
+    { return m_num_nodes; }
+
+    /// Retired
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the number of retired nodes that are waiting for their
+    ///     grace period to pass
+    ///
+    size_t
+    retired() const noexcept
+    { return m_num_retired; }
+
+    /// For Each
+    ///
+    /// Calls func(key, value) for each key that has a value, in ascending
+    /// key order. This has to visit every node in the table, and thus
+    /// should not be used on a hot path.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param func the function to call for each key / value pair
+    ///
+    template<class F> void
+    for_each(F func) const
+    { visit(&m_root, 0, 0, func); }
+
+private:
+
+    struct node
+    {
+        std::array<std::atomic<uintptr_t>, radix_table_node_size> entries;
+    };
+
+    struct retired_node
+    {
+        node *n;
+        grace_period::epoch_type epoch;
+    };
+
+    static constexpr const auto num_levels = (key_bits + radix_table_node_shift - 1) / radix_table_node_shift;
+
+    template<class N> static auto &
+    entry(N *n, key_type key, size_t level) noexcept
+    {
+        auto &&shift = (num_levels - 1 - level) * radix_table_node_shift;
+        return gsl::at(n->entries, (key >> shift) & (radix_table_node_size - 1));
+    }
+
+    template<class F> static void
+    visit(const node *n, key_type prefix, size_t level, F &func)
+    {
+        for (auto i = 0UL; i < radix_table_node_size; i++)
+        {
+            auto &&value = gsl::at(n->entries, i).load(std::memory_order_acquire);
+
+            if (value == 0)
+                continue;
+
+            auto &&key = (prefix << radix_table_node_shift) | i;
+
+            if (level == num_levels - 1)
+                func(key, value);
+            else
+                visit(reinterpret_cast<const node *>(value), key, level + 1, func);
+        }
+    }
+
+    static bool
+    empty(const node *n) noexcept
+    {
+        for (auto &&entry : n->entries)
+        {
+            if (entry.load(std::memory_order_relaxed) != 0)
+                return false;
+        }
+
+        return true;
+    }
+
+    node *
+    alloc_node()
+    {
+        node *n = nullptr;
+
+        if (m_num_retired != 0 && m_gp->passed(gsl::at(m_retired, m_retired_head).epoch))
+        {
+            n = pop_retired().n;
+        }
+        else
+        {
+            n = new node();
+
+            for (auto &&entry : n->entries)
+                entry.store(0, std::memory_order_relaxed);
+        }
+
+        m_num_nodes++;
+        return n;
+    }
+
+    bool
+    can_retire() noexcept
+    {
+        if (m_num_retired < radix_table_max_retired)
+            return true;
+
+        if (!m_gp->passed(gsl::at(m_retired, m_retired_head).epoch))
+            return false;
+
+        delete pop_retired().n;
+        return true;
+    }
+
+    void
+    retire(node *n) noexcept
+    {
+        gsl::at(m_retired, (m_retired_head + m_num_retired) % radix_table_max_retired) = {n, 0};
+
+        m_num_retired++;
+        m_num_nodes--;
+    }
+
+    retired_node
+    pop_retired() noexcept
+    {
+        auto &&rn = gsl::at(m_retired, m_retired_head);
+
+        m_retired_head = (m_retired_head + 1) % radix_table_max_retired;
+        m_num_retired--;
+
+        return rn;
+    }
+
+    static void
+    destroy(uintptr_t value, size_t level) noexcept
+    {
+        if (value == 0 || level >= num_levels)
+            return;
+
+        auto &&n = reinterpret_cast<node *>(value);
+
+        for (auto &&entry : n->entries)
+            destroy(entry.load(std::memory_order_relaxed), level + 1);
+
+        delete n;
+    }
+
+private:
+
+    node m_root;
+
+    grace_period *m_gp;
+    std::array<retired_node, radix_table_max_retired> m_retired;
+    size_t m_retired_head;
+    size_t m_num_retired;
+    size_t m_num_nodes;
+
+public:
+
+    radix_table(const radix_table &) = delete;
+    radix_table &operator=(const radix_table &) = delete;
+    radix_table(radix_table &&) noexcept = delete;
+    radix_table &operator=(radix_table &&) noexcept = delete;
+};
+
+///
+/// *INDENT-ON*
+///
+
+#endif
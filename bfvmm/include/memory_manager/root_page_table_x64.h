@@ -135,6 +135,80 @@ public:
     ///
     virtual void unmap(integer_pointer virt) noexcept;
 
+    /// Map Range
+    ///
+    /// Maps size bytes of memory in the page tables given a virtual
+    /// address, the physical address and a set of attributes. Each part of
+    /// the range is mapped using the largest page that the alignment of
+    /// virt, phys and the remaining size allow (1 gigabyte pages are only
+    /// used if the CPU supports them). The entries of each page table are
+    /// filled in one pass, and the page tables are only locked once.
+    ///
+    /// Global pages are not flushed from the TLB when CR3 is written, so
+    /// global should only be used for memory that stays mapped at the same
+    /// address for as long as these page tables are in use (e.g. the VMM's
+    /// own code and data). Note that INVLPG still invalidates a global page,
+    /// but x64::tlb::flush does not.
+    ///
+    /// @expects virt & (x64::page_size - 1) == 0
+    /// @expects phys & (x64::page_size - 1) == 0
+    /// @expects size != 0
+    /// @expects size & (x64::page_size - 1) == 0
+    /// @ensures none
+    ///
+    /// @param virt the virtual address to map
+    /// @param phys the physical address to map the virt address
+    /// @param size the number of bytes to map
+    /// @param attr describes how to map the virt address
+    /// @param global if true, the pages are mapped as global pages
+    ///
+    virtual void map_range(integer_pointer virt, integer_pointer phys, size_type size, attr_type attr,
+                           bool global = false);
+
+    /// Unmap Range
+    ///
+    /// Unmaps size bytes of memory in the page tables given a virtual
+    /// address, regardless of the size of the pages that were used to
+    /// map it.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param virt the virtual address to unmap
+    /// @param size the number of bytes to unmap
+    ///
+    virtual void unmap_range(integer_pointer virt, size_type size) noexcept;
+
+    /// Reserve (4k)
+    ///
+    /// Creates the page tables needed to map virt using a 4 kilobyte
+    /// page, and returns a pointer to its page table entry, which is left
+    /// non-present. The caller can then map (and unmap) virt by storing
+    /// to this entry directly (see pte_4k), without locking the page
+    /// tables or allocating memory. The page tables are never freed, so
+    /// virt should not be mapped or unmapped using the other functions of
+    /// this class.
+    ///
+    /// @expects virt & (x64::page_size - 1) == 0
+    /// @ensures ret != nullptr
+    ///
+    /// @param virt the virtual address to reserve
+    /// @return a pointer to the page table entry of virt
+    ///
+    virtual uintptr_t *reserve_4k(integer_pointer virt);
+
+    /// Page Table Entry (4k)
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param phys the physical address to map
+    /// @param attr describes how to map phys
+    /// @return the value of the page table entry that map_4k would use to
+    ///     map phys with attr
+    ///
+    static uintptr_t pte_4k(integer_pointer phys, attr_type attr);
+
     /// Setup Identify Map (1g Granularity)
     ///
     /// Sets up an identify map in the page tables using 1 gigabyte
@@ -213,6 +287,25 @@ public:
     ///
     void unmap_identity_map_4k(integer_pointer saddr, integer_pointer eaddr);
 
+    /// Setup Direct Map
+    ///
+    /// Maps the first size bytes of physical memory at DIRECT_MAP_START as
+    /// read / write, write-back, global memory, using 1 gigabyte pages if the CPU
+    /// supports them, and 2 megabyte pages for the remainder (or all of it
+    /// if it does not). The direct map is not
+    /// added to the memory manager's memory descriptors, and if these are
+    /// the VMM's root page tables, direct_map_size() reports size once the
+    /// map is set up, which is what enables make_unique_map_x64 to use it.
+    ///
+    /// @expects size != 0
+    /// @expects size & (x64::page_table::pd::size_bytes - 1) == 0
+    /// @expects DIRECT_MAP_START + size <= 0x800000000000
+    /// @ensures none
+    ///
+    /// @param size the number of bytes of physical memory to map
+    ///
+    void setup_direct_map(size_type size);
+
     /// Virtual Address To Page Table Entry
     ///
     /// Locates the page table entry given a virtual
@@ -247,10 +340,15 @@ public:
 private:
 
     page_table_entry_x64 add_page(integer_pointer virt, size_type size);
+    gsl::span<uintptr_t> add_pages(integer_pointer virt, size_type num, size_type size);
 
-    void map_page(integer_pointer virt, integer_pointer phys, attr_type attr, size_type size);
+    void map_page(integer_pointer virt, integer_pointer phys, attr_type attr, size_type size, bool track = true);
     void unmap_page(integer_pointer virt) noexcept;
 
+    void map_pages(integer_pointer virt, integer_pointer phys, size_type size, attr_type attr, size_type max,
+                   bool track = true, bool global = false);
+    void unmap_pages(integer_pointer virt, size_type size) noexcept;
+
 private:
 
     bool m_is_vmm;
@@ -280,6 +378,19 @@ public:
 ///
 root_page_table_x64 *root_pt() noexcept;
 
+/// Direct Map Size
+///
+/// Physical address phys (phys < direct_map_size()) can be accessed by the
+/// VMM at DIRECT_MAP_START + phys without mapping it first.
+///
+/// @expects none
+/// @ensures none
+///
+/// @return the number of bytes of physical memory mapped by the VMM's root
+///     page tables at DIRECT_MAP_START, or 0 if there is no direct map
+///
+uintptr_t direct_map_size() noexcept;
+
 /// Root Page Table Macro
 ///
 /// The following macro can be used to quickly call the root page table as
@@ -0,0 +1,252 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#ifndef SLAB_CACHE_H
+#define SLAB_CACHE_H
+
+#include <gsl/gsl>
+
+#include <array>
+
+#include <constants.h>
+#include <thread_context.h>
+#include <memory_manager/slab_pool.h>
+
+// -----------------------------------------------------------------------------
+// Definition
+// -----------------------------------------------------------------------------
+
+///
+/// *INDENT-OFF*
+///
+
+/// Slab Cache
+///
+/// The slab pool serves all of the VMM's small allocations, but it has a
+/// single lock, and when every core is taking exits at the same time, each
+/// core's allocations serialize on it. This class places a small cache of
+/// free objects (a magazine) per CPU, per size class, in front of the slab
+/// pool. Allocations and frees are served from the current CPU's magazine
+/// without taking a lock, and the slab pool is only touched when a magazine
+/// is empty (half a magazine is allocated in one batch) or full (half a
+/// magazine is freed in one batch).
+///
+/// The current CPU is identified using thread_context_cpuid(). Since the VMM
+/// does not preempt itself, only the CPU that owns a magazine will ever
+/// touch it, and thus no lock is needed. This only holds in VMX root: when
+/// the driver calls into the VMM (see thread_context_vmx_root()), the host
+/// OS can preempt the caller, and the cpuid it provides is not the core it
+/// runs on, so these calls, and CPUs whose id is out of range, use the
+/// slab pool (and its lock) directly.
+///
+/// @param pool_type the slab pool type being cached
+/// @param max_cpus the max number of CPUs that have a cache
+/// @param cache_size the number of objects each magazine can hold
+///
+template<class pool_type, size_t max_cpus, size_t cache_size>
+class slab_cache
+{
+    static_assert(cache_size >= 2 && (cache_size & 1) == 0, "cache_size must be a multiple of 2");
+
+public:
+
+    using size_type = size_t;
+    using integer_pointer = uintptr_t;
+
+    /// Constructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param pool the slab pool to cache
+    ///
+    slab_cache(pool_type &pool) noexcept :
+        m_pool(pool)
+    {
+        for (auto &&cpu : m_magazines)
+            for (auto &&mag : cpu)
+                mag.count = 0;
+    }
+
+    /// Default Destructor
+    ///
+    ~slab_cache() = default;
+
+    /// Allocate Memory
+    ///
+    /// Allocates memory from the current CPU's magazine for the size class
+    /// that fits size. If the magazine is empty, it is refilled from the
+    /// slab pool, which throws std::bad_alloc if the slab pool is out of
+    /// memory.
+    ///
+    /// @expects size > 0
+    /// @expects size <= max_size()
+    /// @ensures ret != 0
+    ///
+    /// @param size the number of bytes to allocate
+    /// @return the starting address of the allocated memory
+    ///
+    integer_pointer
+    alloc(size_type size)
+    {
+        // [[ensures ret: ret != 0]]
+        expects(size > 0);
+        expects(size <= max_size());
+
+        auto &&cpu = this->current();
+
+        if (cpu == nullptr)
+            return m_pool.alloc(size);
+
+        auto &&mag = gsl::at(*cpu, pool_type::size_to_class(size));
+
+        if (mag.count == 0)
+            mag.count = m_pool.alloc_batch(size, mag.objs.data(), cache_size / 2);
+
+        return gsl::at(mag.objs, --mag.count);
+    }
+
+    /// Free Memory
+    ///
+    /// Returns previously allocated memory to the current CPU's magazine.
+    /// If the magazine is full, half of it is returned to the slab pool
+    /// first. Addresses that do not belong to the slab pool are ignored.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param addr the address to free
+    /// @return the size of the size class that addr was freed to (0 if
+    ///     addr does not belong to the slab pool)
+    ///
+    size_type
+    free(integer_pointer addr) noexcept
+    {
+        if (!m_pool.contains(addr))
+            return 0;
+
+        auto &&size = m_pool.size(addr);
+        auto &&cpu = this->current();
+
+        if (cpu == nullptr)
+        {
+            m_pool.free(addr);
+            return size;
+        }
+
+        auto &&mag = gsl::at(*cpu, pool_type::size_to_class(size));
+
+        if (mag.count == cache_size)
+        {
+            mag.count -= cache_size / 2;
+            m_pool.free_batch(&gsl::at(mag.objs, mag.count), cache_size / 2);
+        }
+
+        gsl::at(mag.objs, mag.count++) = addr;
+        return size;
+    }
+
+    /// Flush
+    ///
+    /// Returns all of the objects cached by the current CPU to the slab
+    /// pool.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    void
+    flush() noexcept
+    {
+        auto &&cpu = this->current();
+
+        if (cpu == nullptr)
+            return;
+
+        for (auto &&mag : *cpu)
+        {
+            m_pool.free_batch(mag.objs.data(), mag.count);
+            mag.count = 0;
+        }
+    }
+
+    /// Cached
+    ///
+    /// @param size the size class to look up
+    /// @return the number of free objects cached by the current CPU for the
+    ///     size class that fits size
+    ///
+    size_type
+    cached(size_type size) const noexcept
+    {
+        auto &&cpu = this->current();
+
+        if (cpu == nullptr || size == 0 || size > max_size())
+            return 0;
+
+        return gsl::at(*cpu, pool_type::size_to_class(size)).count;
+    }
+
+    /// Max Size
+    ///
+    /// @return the largest allocation that this cache will serve
+    ///
+    static constexpr size_type
+    max_size() noexcept
+    { return pool_type::max_size(); }
+
+private:
+
+    struct alignas(MAX_CACHE_LINE_SIZE) magazine
+    {
+        size_type count;
+        std::array<integer_pointer, cache_size> objs;
+    };
+
+    using magazines_type = std::array<magazine, slab_pool_num_classes>;
+
+    magazines_type *
+    current() const noexcept
+    {
+        auto &&cpuid = thread_context_cpuid();
+
+        if (cpuid >= max_cpus || thread_context_vmx_root() == 0)
+            return nullptr;
+
+        return const_cast<magazines_type *>(&gsl::at(m_magazines, cpuid));
+    }
+
+    pool_type &m_pool;
+    std::array<magazines_type, max_cpus> m_magazines;
+
+public:
+
+    slab_cache(const slab_cache &) = delete;
+    slab_cache &operator=(const slab_cache &) = delete;
+    slab_cache(slab_cache &&) noexcept = delete;
+    slab_cache &operator=(slab_cache &&) noexcept = delete;
+};
+
+///
+/// *INDENT-ON*
+///
+
+#endif
@@ -0,0 +1,441 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#ifndef SLAB_POOL_H
+#define SLAB_POOL_H
+
+#include <gsl/gsl>
+
+#include <mutex>
+#include <array>
+
+#include <constants.h>
+#include <memory_manager/mem_tag.h>
+#include <memory_manager/mem_pool.h>
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+
+constexpr const auto slab_pool_min_shift = 4UL;
+constexpr const auto slab_pool_max_shift = 11UL;
+constexpr const auto slab_pool_num_classes = slab_pool_max_shift - slab_pool_min_shift + 1;
+
+// -----------------------------------------------------------------------------
+// Definition
+// -----------------------------------------------------------------------------
+
+///
+/// *INDENT-OFF*
+///
+
+/// Slab Pool
+///
+/// The heap's mem_pool has to search for free blocks, and the time it takes
+/// to find one grows as the heap becomes fragmented. Most of the allocations
+/// that the VMM performs however are small (std::map nodes, std::string
+/// temporaries, json objects, etc...), and for these, a segregated size
+/// class allocator is a much better fit. This pool rounds each request up to
+/// a power of two between 16 bytes and 2 KB, and serves it from a free list
+/// dedicated to that size class, so both alloc and free are O(1).
+///
+/// Slabs (pages that are carved into objects of a single size class) are
+/// allocated from the page pool provided, and the size class of each slab is
+/// stored in a side table so that free and size only need the address. Once
+/// a page has been carved into a slab, it belongs to that size class, and
+/// is not returned to the page pool. The side tables only cover the page
+/// pool's own memory, so slabs are never allocated from the regions that
+/// have been added to the page pool (see alloc_local).
+///
+/// Tagged allocations (see mem_tag.h) are served from slabs that only hold
+/// objects of that tag, each with its own free lists. The tag of each slab
+/// is stored in a second side table, so the tag of an object costs one byte
+/// per page instead of a byte per object.
+///
+/// @param total_size total size in bytes of the page pool
+/// @param page_shift page size of the page pool in bit shifts
+/// @param page_pool_type the type of the page pool
+///
+template<size_t total_size, size_t page_shift, class page_pool_type = mem_pool<total_size, page_shift>>
+class slab_pool
+{
+    static_assert(page_shift > slab_pool_max_shift, "pages must be larger than the largest size class");
+
+public:
+
+    using size_type = size_t;
+    using integer_pointer = uintptr_t;
+    using tag_type = uint8_t;
+
+    /// Constructor
+    ///
+    /// Creates a slab pool that allocates its slabs from the provided page
+    /// pool. The address provided must be the starting address of the page
+    /// pool, and must be page aligned.
+    ///
+    /// @expects addr != 0
+    /// @expects addr is page aligned
+    /// @ensures none
+    ///
+    /// @param pages the page pool to allocate slabs from
+    /// @param addr the starting address of the page pool
+    ///
+    slab_pool(page_pool_type &pages, integer_pointer addr) noexcept_testing :
+        m_addr(addr),
+        m_slabs(0),
+        m_pages(pages)
+    {
+        if (addr == 0 || (addr & ((1UL << page_shift) - 1)) != 0)
+            static_construction_error();
+
+        for (auto &&free : m_free)
+            free.fill(nullptr);
+
+        m_class.fill(0);
+        m_tag.fill(0);
+    }
+
+    /// Default Destructor
+    ///
+    ~slab_pool() = default;
+
+    /// Allocate Memory
+    ///
+    /// Allocates memory from the size class that fits size. If the size
+    /// class has no free objects of this tag, a new slab is allocated from
+    /// the page pool, which throws std::bad_alloc if the page pool is out of
+    /// memory. The resulting address is aligned to the size of its size
+    /// class.
+    ///
+    /// @expects size > 0
+    /// @expects size <= max_size()
+    /// @expects tag < mem_tag_num_tags
+    /// @ensures ret != 0
+    ///
+    /// @param size the number of bytes to allocate
+    /// @param tag the tag of the slab to allocate from
+    /// @return the starting address of the allocated memory
+    ///
+    integer_pointer
+    alloc(size_type size, tag_type tag = 0)
+    {
+        // [[ensures ret: ret != 0]]
+        expects(size > 0);
+        expects(size <= max_size());
+        expects(tag < mem_tag_num_tags);
+
+        auto &&index = size_to_class(size);
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto &&head = gsl::at(gsl::at(m_free, tag), index);
+
+        if (head == nullptr)
+            head = refill(index, tag);
+
+        auto obj = head;
+        head = obj->next;
+
+        return reinterpret_cast<integer_pointer>(obj);
+    }
+
+    /// Free Memory
+    ///
+    /// Returns previously allocated memory to the free list of its size
+    /// class (and tag). Addresses that do not belong to a slab are ignored.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param addr the address to free
+    ///
+    void
+    free(integer_pointer addr) noexcept
+    {
+        if (!contains(addr))
+            return;
+
+        auto &&index = page_class(addr) - 1;
+        auto &&obj = reinterpret_cast<free_object *>(addr);
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto &&head = gsl::at(gsl::at(m_free, page_tag(addr)), index);
+
+        obj->next = head;
+        head = obj;
+    }
+
+    /// Allocate Batch
+    ///
+    /// Allocates up to count untagged objects from the size class that fits
+    /// size, taking the pool's lock only once. This is used by the per-CPU
+    /// caches to refill themselves. If the size class runs out of free objects part
+    /// way through, fewer objects are returned instead of allocating another
+    /// slab, so a new slab is only allocated when the size class is empty.
+    ///
+    /// @expects size > 0
+    /// @expects size <= max_size()
+    /// @expects objs != nullptr
+    /// @ensures ret > 0
+    ///
+    /// @param size the number of bytes to allocate for each object
+    /// @param objs array that will receive the allocated addresses
+    /// @param count the max number of objects to allocate
+    /// @return the number of objects that were allocated
+    ///
+    size_type
+    alloc_batch(size_type size, integer_pointer *objs, size_type count)
+    {
+        // [[ensures ret: ret > 0]]
+        expects(size > 0);
+        expects(size <= max_size());
+        expects(objs != nullptr);
+
+        auto &&index = size_to_class(size);
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto &&head = gsl::at(m_free.front(), index);
+
+        auto i = 0UL;
+        for (; i < count; i++)
+        {
+            if (head == nullptr)
+            {
+                if (i != 0)
+                    break;
+
+                head = refill(index, 0);
+            }
+
+            auto obj = head;
+            head = obj->next;
+
+            objs[i] = reinterpret_cast<integer_pointer>(obj);
+        }
+
+        return i;
+    }
+
+    /// Free Batch
+    ///
+    /// Returns count objects to their size class free lists, taking the
+    /// pool's lock only once. Addresses that do not belong to a slab are
+    /// ignored.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param objs array of addresses to free
+    /// @param count the number of addresses in objs
+    ///
+    void
+    free_batch(const integer_pointer *objs, size_type count) noexcept
+    {
+        if (objs == nullptr)
+            return;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (auto i = 0UL; i < count; i++)
+        {
+            if (!contains(objs[i]))
+                continue;
+
+            auto &&index = page_class(objs[i]) - 1;
+            auto &&obj = reinterpret_cast<free_object *>(objs[i]);
+            auto &&head = gsl::at(gsl::at(m_free, page_tag(objs[i])), index);
+
+            obj->next = head;
+            head = obj;
+        }
+    }
+
+    /// Contains Address
+    ///
+    /// Returns true if the address is inside of a page that has been
+    /// carved into a slab, returns false otherwise.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param addr to lookup
+    ///
+    bool
+    contains(integer_pointer addr) const noexcept
+    {
+        if (addr < m_addr || addr >= m_addr + total_size)
+            return false;
+
+        return page_class(addr) != 0;
+    }
+
+    /// Allocation Size
+    ///
+    /// Returns the size of the size class the address was allocated from.
+    /// Returns 0 if the address does not belong to a slab.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param addr to lookup
+    ///
+    size_type
+    size(integer_pointer addr) const noexcept
+    {
+        if (!contains(addr))
+            return 0;
+
+        return class_to_size(page_class(addr) - 1);
+    }
+
+    /// Allocation Tag
+    ///
+    /// Returns the tag of the slab the address was allocated from. Returns
+    /// 0 if the address does not belong to a slab.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param addr to lookup
+    ///
+    tag_type
+    tag(integer_pointer addr) const noexcept
+    {
+        if (!contains(addr))
+            return 0;
+
+        return page_tag(addr);
+    }
+
+    /// Slab Size
+    ///
+    /// Returns the number of bytes of the page pool that have been carved
+    /// into slabs. Since slabs are never returned to the page pool, this is
+    /// also the most memory the slab pool has ever used.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the number of bytes that have been carved into slabs
+    ///
+    size_type
+    slab_size() const noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_slabs << page_shift;
+    }
+
+    /// Max Size
+    ///
+    /// @return the largest allocation that this pool will serve
+    ///
+    static constexpr size_type
+    max_size() noexcept
+    { return 1UL << slab_pool_max_shift; }
+
+    /// Size To Class
+    ///
+    /// @param size the number of bytes requested
+    /// @return the index of the size class that serves size
+    ///
+    static size_type
+    size_to_class(size_type size) noexcept
+    {
+        if (size <= (1UL << slab_pool_min_shift))
+            return 0;
+
+        auto &&shift = 64UL - static_cast<size_type>(__builtin_clzl(size - 1));
+        return shift - slab_pool_min_shift;
+    }
+
+    /// Class To Size
+    ///
+    /// @param index the index of a size class
+    /// @return the size in bytes of the objects in the size class
+    ///
+    static size_type
+    class_to_size(size_type index) noexcept
+    { return 1UL << (index + slab_pool_min_shift); }
+
+private:
+
+    struct free_object
+    {
+        free_object *next;
+    };
+
+    free_object *
+    refill(size_type index, tag_type tag)
+    {
+        constexpr const auto page_size = 1UL << page_shift;
+
+        auto &&page = m_pages.alloc_local(page_size);
+        auto &&size = class_to_size(index);
+
+        gsl::at(m_class, (page - m_addr) >> page_shift) = static_cast<uint8_t>(index + 1);
+        gsl::at(m_tag, (page - m_addr) >> page_shift) = tag;
+        m_slabs++;
+
+        free_object *head = nullptr;
+        for (auto offset = page_size; offset >= size; offset -= size)
+        {
+            auto &&obj = reinterpret_cast<free_object *>(page + offset - size);
+
+            obj->next = head;
+            head = obj;
+        }
+
+        return head;
+    }
+
+    uint8_t
+    page_class(integer_pointer addr) const noexcept
+    { return gsl::at(m_class, (addr - m_addr) >> page_shift); }
+
+    tag_type
+    page_tag(integer_pointer addr) const noexcept
+    { return gsl::at(m_tag, (addr - m_addr) >> page_shift); }
+
+private:
+
+    integer_pointer m_addr;
+    size_type m_slabs;
+    page_pool_type &m_pages;
+
+    mutable std::mutex m_mutex;
+
+    std::array<std::array<free_object *, slab_pool_num_classes>, mem_tag_num_tags> m_free;
+    std::array < uint8_t, (total_size >> page_shift) > m_class;
+    std::array < tag_type, (total_size >> page_shift) > m_tag;
+
+public:
+
+    slab_pool(const slab_pool &) = delete;
+    slab_pool &operator=(const slab_pool &) = delete;
+    slab_pool(slab_pool &&) noexcept = delete;
+    slab_pool &operator=(slab_pool &&) noexcept = delete;
+};
+
+///
+/// *INDENT-ON*
+///
+
+#endif
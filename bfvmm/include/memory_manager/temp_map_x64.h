@@ -0,0 +1,164 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#ifndef TEMP_MAP_X64_H
+#define TEMP_MAP_X64_H
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+#include <constants.h>
+#include <memory_manager/mem_attr_x64.h>
+
+static_assert(TEMP_MAP_SLOTS <= 64, "TEMP_MAP_SLOTS must fit in a 64bit mask");
+
+/// Temporary Maps
+///
+/// Mapping a single page using the memory map pool allocates virtual
+/// memory, and locks the VMM's page tables to map it, and again to unmap
+/// it. For the short lived single page maps that the VMM uses the most
+/// (e.g. the guest page tables during a page walk), this class provides
+/// each CPU with TEMP_MAP_SLOTS fixed virtual pages (slots) instead, whose
+/// page tables are created the first time the CPU uses them, and are never
+/// freed. Mapping a page is then a store to the slot's page table entry,
+/// followed by an INVLPG, which needs no locks, and no allocations, so
+/// each CPU can map pages at the same time as the others.
+///
+/// Since a slot is only invalidated in the TLB of the CPU that maps it, a
+/// temporary map should only be used by the CPU that created it (it can be
+/// released by any CPU). If the current CPU has no free slots, map returns
+/// 0, and the page should be mapped using the memory map pool instead. The
+/// same is true outside of VMX root (see thread_context_vmx_root()), where
+/// the cpuid in the thread context is not necessarily the current core.
+///
+class temp_map_x64
+{
+public:
+
+    using integer_pointer = uintptr_t;
+    using attr_type = x64::memory_attr::attr_type;
+    using size_type = size_t;
+
+    /// Get Singleton Instance
+    ///
+    /// @expects none
+    /// @ensures ret != nullptr
+    ///
+    /// @return a singleton instance of temp_map_x64
+    ///
+    static temp_map_x64 *instance() noexcept;
+
+    /// Destructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    virtual ~temp_map_x64() = default;
+
+    /// Map
+    ///
+    /// Maps the page at phys into a free slot of the current CPU.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param phys the physical address of the page to map
+    /// @param attr describes how to map the page
+    /// @return the virtual address of the slot, or 0 if the current CPU
+    ///     does not have a free slot
+    ///
+    virtual integer_pointer map(integer_pointer phys, attr_type attr) noexcept;
+
+    /// Unmap
+    ///
+    /// Unmaps the slot at virt, and makes it free again. Does nothing if
+    /// virt is not a slot.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param virt the virtual address of the slot to unmap
+    ///
+    virtual void unmap(integer_pointer virt) noexcept;
+
+    /// Contains
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param virt the virtual address to check
+    /// @return true if virt is the address of a temporary map slot
+    ///
+    static bool contains(integer_pointer virt) noexcept
+    { return virt >= TEMP_MAP_START && virt - TEMP_MAP_START < MAX_NUM_CPUS * TEMP_MAP_SLOTS * MAX_PAGE_SIZE; }
+
+    /// Slot Address
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param cpuid the CPU that owns the slot
+    /// @param slot the index of the slot
+    /// @return the virtual address of the slot
+    ///
+    static integer_pointer slot_addr(size_type cpuid, size_type slot) noexcept
+    { return TEMP_MAP_START + (((cpuid * TEMP_MAP_SLOTS) + slot) * MAX_PAGE_SIZE); }
+
+private:
+
+    temp_map_x64() noexcept;
+
+    struct cpu_type
+    {
+        std::atomic<uint64_t> used;
+        std::atomic<bool> reserved;
+        std::array<uintptr_t *, TEMP_MAP_SLOTS> ptes;
+    };
+
+    bool reserve(size_type cpuid) noexcept;
+
+private:
+
+    std::array<cpu_type, MAX_NUM_CPUS> m_cpus;
+
+public:
+
+    friend class memory_manager_ut;
+
+    temp_map_x64(temp_map_x64 &&) noexcept = delete;
+    temp_map_x64 &operator=(temp_map_x64 &&) noexcept = delete;
+
+    temp_map_x64(const temp_map_x64 &) = delete;
+    temp_map_x64 &operator=(const temp_map_x64 &) = delete;
+};
+
+/// Temporary Maps Macro
+///
+/// The following macro can be used to quickly call the temporary maps.
+///
+/// @expects none
+/// @ensures g_temp_maps != nullptr
+///
+#define g_temp_maps temp_map_x64::instance()
+
+#endif
@@ -0,0 +1,723 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#ifndef VMEM_ARENA_H
+#define VMEM_ARENA_H
+
+#include <gsl/gsl>
+
+#include <mutex>
+#include <array>
+
+#include <constants.h>
+#include <memory_manager/mem_pool.h>
+
+// -----------------------------------------------------------------------------
+// Constants
+// -----------------------------------------------------------------------------
+
+constexpr const auto vmem_arena_num_lists = 64UL;
+constexpr const auto vmem_arena_none = 0xFFFFFFFFU;
+
+constexpr const auto vmem_arena_qcache_max = 8UL;
+constexpr const auto vmem_arena_qcache_depth = 16UL;
+
+constexpr const auto vmem_arena_spare = 0U;
+constexpr const auto vmem_arena_free = 1U;
+constexpr const auto vmem_arena_used = 2U;
+constexpr const auto vmem_arena_cached = 3U;
+
+// -----------------------------------------------------------------------------
+// Definition
+// -----------------------------------------------------------------------------
+
+///
+/// *INDENT-OFF*
+///
+
+/// VMem Arena
+///
+/// Manages a range of virtual addresses that has nothing behind it (i.e.
+/// the virtual memory that is used to map memory), in the style of the
+/// vmem allocator. Unlike the mem_pool, whose metadata is a bitmap of the
+/// whole pool, the arena only stores a segment for each allocation and for
+/// each free range between them, so the range can be very large (e.g.
+/// terabytes) and sparse, and the cost of an allocation does not depend on
+/// how much of the range is in use.
+///
+/// Free segments are kept in a free list per power of 2, which gives an
+/// instant fit: a request for n quanta is served by the first segment in
+/// the list for the next power of 2 at or above n, which is found using
+/// a single bit scan. Allocated segments are located by address using a
+/// hash table, and when freed, a segment is merged with the free segments
+/// on either side of it.
+///
+/// Small allocations (up to vmem_arena_qcache_max quanta) are also served
+/// by a quantum cache per size: when freed, they are kept (up to
+/// vmem_arena_qcache_depth of them per size) and handed out again as is,
+/// without splitting or merging any segments. The caches are emptied back
+/// into the arena when an allocation would otherwise fail.
+///
+/// The segments are stored in a fixed array of max_segments entries, so
+/// the arena never allocates memory, and an allocation fails if all of
+/// the segments are in use.
+///
+/// @param total_size total size in bytes of the arena
+/// @param quantum_shift the arena's quantum (unit of allocation) in bit
+///     shifts (i.e. 4k == 12 bits)
+/// @param max_segments the maximum number of segments, must be a power
+///     of 2
+///
+template<size_t total_size, size_t quantum_shift, size_t max_segments>
+class vmem_arena
+{
+    static_assert(total_size > 0, "total size must be larger than 0");
+    static_assert(total_size % (1UL << quantum_shift) == 0, "total size must be a multiple of the quantum");
+    static_assert(max_segments > 2 && (max_segments & (max_segments - 1)) == 0, "max segments must be a power of 2");
+    static_assert(max_segments < vmem_arena_none, "max segments is too large");
+
+public:
+
+    using size_type = size_t;
+    using integer_pointer = uintptr_t;
+    using index_type = uint32_t;
+
+    /// Constructor
+    ///
+    /// Creates an arena with the starting virtual address of addr.
+    ///
+    /// @expects addr != 0
+    /// @expects addr is quantum aligned
+    /// @ensures none
+    ///
+    /// @param addr the starting address of the arena
+    ///
+    vmem_arena(integer_pointer addr) noexcept_testing :
+        m_addr(addr)
+    {
+        if (addr == 0 || (addr & (quantum() - 1)) != 0)
+            static_construction_error();
+
+        integer_pointer end;
+        if (__builtin_uaddl_overflow(m_addr, total_size, &end))
+            static_construction_error();
+
+        clear();
+    }
+
+    /// Default Destructor
+    ///
+    ~vmem_arena() = default;
+
+    /// Allocate Memory
+    ///
+    /// Allocates memory from the arena whose size is greater than or equal
+    /// to size (rounded up to the quantum). Memory allocated is always
+    /// quantum aligned.
+    ///
+    /// @expects size > 0
+    /// @expects size <= total_size
+    /// @ensures ret != 0
+    ///
+    /// @param size the number of bytes to allocate
+    /// @return the starting address of the memory
+    ///
+    integer_pointer
+    alloc(size_type size)
+    {
+        // [[ensures ret: ret != 0]]
+        expects(size > 0);
+        expects(size <= total_size);
+
+        if (auto &&addr = arena_alloc(total_quanta(size), 1, 0))
+            return addr;
+
+        throw std::bad_alloc();
+    }
+
+    /// Allocate Aligned Memory
+    ///
+    /// Same as alloc, but the address that is returned minus offset is a
+    /// multiple of align (see mem_pool::alloc_aligned).
+    ///
+    /// @expects size > 0
+    /// @expects size <= total_size
+    /// @expects align is a power of 2, and a multiple of the quantum
+    /// @expects offset < align, and offset is a multiple of the quantum
+    /// @ensures ret != 0
+    ///
+    /// @param size the number of bytes to allocate
+    /// @param align the alignment of the memory (minus offset)
+    /// @param offset the offset of the memory from align
+    /// @return the starting address of the memory
+    ///
+    integer_pointer
+    alloc_aligned(size_type size, size_type align, size_type offset)
+    {
+        // [[ensures ret: ret != 0]]
+        expects(size > 0);
+        expects(size <= total_size);
+        expects(align != 0 && (align & (align - 1)) == 0);
+        expects((align & (quantum() - 1)) == 0);
+        expects(offset < align);
+        expects((offset & (quantum() - 1)) == 0);
+
+        if (auto &&addr = arena_alloc(total_quanta(size), align >> quantum_shift, offset >> quantum_shift))
+            return addr;
+
+        throw std::bad_alloc();
+    }
+
+    /// Free Memory
+    ///
+    /// Free's previously allocated memory.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param addr the address to free
+    /// @return the number of bytes that were freed (0 if addr was not
+    ///     allocated from this arena)
+    ///
+    size_type
+    free(integer_pointer addr) noexcept
+    {
+        if (!contains(addr))
+            return 0;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto &&index = lookup(addr);
+        if (index == vmem_arena_none)
+            return 0;
+
+        auto &&seg = gsl::at(m_segs, index);
+        auto size = seg.size;
+
+        m_allocated -= size;
+
+        if (size <= vmem_arena_qcache_max)
+        {
+            auto &&cache = gsl::at(m_qcache, size - 1);
+            if (cache.num < vmem_arena_qcache_depth)
+            {
+                seg.state = vmem_arena_cached;
+                gsl::at(cache.segs, cache.num++) = index;
+
+                return size << quantum_shift;
+            }
+        }
+
+        release(index);
+        return size << quantum_shift;
+    }
+
+    /// Contains Address
+    ///
+    /// Returns true if this arena contains this address, returns false
+    /// otherwise.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param addr to lookup
+    ///
+    bool
+    contains(integer_pointer addr) const noexcept
+    { return addr >= m_addr && addr - m_addr < total_size; }
+
+    /// Allocation Size
+    ///
+    /// Locates and returns the size of previously allocated memory from
+    /// this arena. Like free, this function will not crash but instead will
+    /// return 0 given invalid inputs.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param addr to lookup
+    ///
+    size_type
+    size(integer_pointer addr) const noexcept
+    {
+        if (!contains(addr))
+            return 0;
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        auto &&index = lookup(addr);
+        if (index == vmem_arena_none)
+            return 0;
+
+        return gsl::at(m_segs, index).size << quantum_shift;
+    }
+
+    /// Allocated
+    ///
+    /// @return the number of bytes currently allocated from this arena
+    ///
+    size_type
+    allocated() const noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_allocated << quantum_shift;
+    }
+
+    /// High Water Mark
+    ///
+    /// @return the largest number of bytes that have been allocated from
+    ///     this arena at any one time
+    ///
+    size_type
+    high_water() const noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_high_water << quantum_shift;
+    }
+
+    /// Largest Free
+    ///
+    /// Walks the free list with the largest segments looking for the
+    /// largest free segment. Memory held by the quantum caches is not
+    /// included.
+    ///
+    /// @return the size in bytes of the largest free segment
+    ///
+    size_type
+    largest_free() const noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (m_lists == 0)
+            return 0;
+
+        integer_pointer largest = 0;
+        auto &&list = 63UL - static_cast<size_type>(__builtin_clzl(m_lists));
+
+        for (auto index = gsl::at(m_heads, list); index != vmem_arena_none; index = gsl::at(m_segs, index).fnext)
+        {
+            auto &&size = gsl::at(m_segs, index).size;
+            largest = size > largest ? size : largest;
+        }
+
+        return largest << quantum_shift;
+    }
+
+    /// Capacity
+    ///
+    /// @return the total number of bytes managed by this arena
+    ///
+    size_type
+    capacity() const noexcept
+    { return total_size; }
+
+    /// Clear Arena
+    ///
+    /// This is a very dangerous function, and will effectively run free() on
+    /// all memory previously allocated.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    void
+    clear() noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        m_allocated = 0;
+        m_high_water = 0;
+        m_lists = 0;
+
+        m_heads.fill(vmem_arena_none);
+        m_hash.fill(vmem_arena_none);
+
+        for (auto &cache : m_qcache)
+            cache.num = 0;
+
+        m_spare = vmem_arena_none;
+        m_num_spare = 0;
+
+        for (auto index = static_cast<index_type>(max_segments - 1); index > 0; index--)
+            put_spare(index);
+
+        auto &&seg = gsl::at(m_segs, 0);
+
+        seg.base = 0;
+        seg.size = total_size >> quantum_shift;
+        seg.prev = vmem_arena_none;
+        seg.next = vmem_arena_none;
+
+        insert_free(0);
+    }
+
+private:
+
+    static constexpr integer_pointer
+    quantum() noexcept
+    { return 1UL << quantum_shift; }
+
+    static integer_pointer
+    total_quanta(size_type size) noexcept
+    { return (size >> quantum_shift) + ((size & (quantum() - 1)) != 0 ? 1 : 0); }
+
+    static size_type
+    list_of(integer_pointer size) noexcept
+    { return 63UL - static_cast<size_type>(__builtin_clzl(size)); }
+
+    static size_type
+    hash_of(integer_pointer base) noexcept
+    { return ((base * 0x9E3779B97F4A7C15UL) >> 32) & (max_segments - 1); }
+
+    integer_pointer
+    arena_alloc(integer_pointer total, integer_pointer align, integer_pointer offset) noexcept
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        if (align == 1 && total <= vmem_arena_qcache_max)
+        {
+            auto &&cache = gsl::at(m_qcache, total - 1);
+            if (cache.num != 0)
+            {
+                auto index = gsl::at(cache.segs, --cache.num);
+                auto &&seg = gsl::at(m_segs, index);
+
+                seg.state = vmem_arena_used;
+                account(total);
+
+                return m_addr + (seg.base << quantum_shift);
+            }
+        }
+
+        // If the arena cannot serve the request, the memory (and segments)
+        // that are held by the quantum caches is given back to the arena,
+        // and the request is tried again.
+
+        if (auto &&addr = search(total, align, offset))
+            return addr;
+
+        flush_qcache();
+        return search(total, align, offset);
+    }
+
+    integer_pointer
+    search(integer_pointer total, integer_pointer align, integer_pointer offset) noexcept
+    {
+        // Instant fit: any segment in the list for the next power of 2 is
+        // large enough, so the first one is taken. Aligned requests (and
+        // requests that no larger segment can serve) walk the lists
+        // instead, starting from the list that total falls in.
+
+        auto &&first = list_of(total);
+
+        if (align == 1)
+        {
+            auto &&fit = (total & (total - 1)) == 0 ? first : first + 1;
+            auto &&lists = fit < vmem_arena_num_lists ? m_lists & (~0UL << fit) : 0UL;
+
+            if (lists != 0)
+            {
+                auto index = gsl::at(m_heads, static_cast<size_type>(__builtin_ctzl(lists)));
+                return claim(index, gsl::at(m_segs, index).base, total);
+            }
+        }
+
+        for (auto list = first; list < vmem_arena_num_lists; list++)
+        {
+            if ((m_lists & (1UL << list)) == 0)
+                continue;
+
+            for (auto index = gsl::at(m_heads, list); index != vmem_arena_none; index = gsl::at(m_segs, index).fnext)
+            {
+                const auto &seg = gsl::at(m_segs, index);
+
+                auto &&abs = (m_addr >> quantum_shift) + seg.base;
+                auto &&start = seg.base + ((offset - abs) & (align - 1));
+
+                if (start + total <= seg.base + seg.size)
+                    return claim(index, start, total);
+            }
+        }
+
+        return 0;
+    }
+
+    integer_pointer
+    claim(index_type index, integer_pointer start, integer_pointer total) noexcept
+    {
+        auto &&seg = gsl::at(m_segs, index);
+
+        auto &&lead = start - seg.base;
+        auto &&tail = seg.base + seg.size - start - total;
+
+        if (num_spare() < (lead != 0 ? 1U : 0U) + (tail != 0 ? 1U : 0U))
+            return 0;
+
+        remove_free(index);
+
+        if (lead != 0)
+            insert_free(split(seg.base, lead, seg.prev, index));
+
+        if (tail != 0)
+            insert_free(split(start + total, tail, index, seg.next));
+
+        seg.base = start;
+        seg.size = total;
+        seg.state = vmem_arena_used;
+
+        insert_hash(index);
+        account(total);
+
+        return m_addr + (start << quantum_shift);
+    }
+
+    index_type
+    split(integer_pointer base, integer_pointer size, index_type prev, index_type next) noexcept
+    {
+        auto split = get_spare();
+        auto &&seg = gsl::at(m_segs, split);
+
+        seg.base = base;
+        seg.size = size;
+        seg.prev = prev;
+        seg.next = next;
+
+        if (prev != vmem_arena_none)
+            gsl::at(m_segs, prev).next = split;
+
+        if (next != vmem_arena_none)
+            gsl::at(m_segs, next).prev = split;
+
+        return split;
+    }
+
+    void
+    release(index_type index) noexcept
+    {
+        remove_hash(index);
+
+        auto &&seg = gsl::at(m_segs, index);
+
+        if (seg.next != vmem_arena_none && gsl::at(m_segs, seg.next).state == vmem_arena_free)
+        {
+            auto next = seg.next;
+            remove_free(next);
+
+            seg.size += gsl::at(m_segs, next).size;
+            unlink(next);
+        }
+
+        if (seg.prev != vmem_arena_none && gsl::at(m_segs, seg.prev).state == vmem_arena_free)
+        {
+            auto prev = seg.prev;
+            remove_free(prev);
+
+            seg.base = gsl::at(m_segs, prev).base;
+            seg.size += gsl::at(m_segs, prev).size;
+            unlink(prev);
+        }
+
+        insert_free(index);
+    }
+
+    void
+    unlink(index_type index) noexcept
+    {
+        const auto &seg = gsl::at(m_segs, index);
+
+        if (seg.prev != vmem_arena_none)
+            gsl::at(m_segs, seg.prev).next = seg.next;
+
+        if (seg.next != vmem_arena_none)
+            gsl::at(m_segs, seg.next).prev = seg.prev;
+
+        put_spare(index);
+    }
+
+    void
+    flush_qcache() noexcept
+    {
+        for (auto &cache : m_qcache)
+        {
+            while (cache.num != 0)
+                release(gsl::at(cache.segs, --cache.num));
+        }
+    }
+
+    void
+    account(integer_pointer total) noexcept
+    {
+        m_allocated += total;
+
+        if (m_allocated > m_high_water)
+            m_high_water = m_allocated;
+    }
+
+    void
+    insert_free(index_type index) noexcept
+    {
+        auto &&seg = gsl::at(m_segs, index);
+        auto &&list = list_of(seg.size);
+        auto &&head = gsl::at(m_heads, list);
+
+        seg.state = vmem_arena_free;
+        seg.fprev = vmem_arena_none;
+        seg.fnext = head;
+
+        if (head != vmem_arena_none)
+            gsl::at(m_segs, head).fprev = index;
+
+        head = index;
+        m_lists |= 1UL << list;
+    }
+
+    void
+    remove_free(index_type index) noexcept
+    {
+        const auto &seg = gsl::at(m_segs, index);
+        auto &&list = list_of(seg.size);
+
+        if (seg.fprev != vmem_arena_none)
+            gsl::at(m_segs, seg.fprev).fnext = seg.fnext;
+        else
+            gsl::at(m_heads, list) = seg.fnext;
+
+        if (seg.fnext != vmem_arena_none)
+            gsl::at(m_segs, seg.fnext).fprev = seg.fprev;
+
+        if (gsl::at(m_heads, list) == vmem_arena_none)
+            m_lists &= ~(1UL << list);
+    }
+
+    void
+    insert_hash(index_type index) noexcept
+    {
+        auto &&seg = gsl::at(m_segs, index);
+        auto &&head = gsl::at(m_hash, hash_of(seg.base));
+
+        seg.fnext = head;
+        head = index;
+    }
+
+    void
+    remove_hash(index_type index) noexcept
+    {
+        auto &&seg = gsl::at(m_segs, index);
+        auto *link = &gsl::at(m_hash, hash_of(seg.base));
+
+        while (*link != index)
+            link = &gsl::at(m_segs, *link).fnext;
+
+        *link = seg.fnext;
+    }
+
+    index_type
+    lookup(integer_pointer addr) const noexcept
+    {
+        if ((addr & (quantum() - 1)) != 0)
+            return vmem_arena_none;
+
+        auto &&base = (addr - m_addr) >> quantum_shift;
+
+        for (auto index = gsl::at(m_hash, hash_of(base)); index != vmem_arena_none; index = gsl::at(m_segs, index).fnext)
+        {
+            const auto &seg = gsl::at(m_segs, index);
+
+            if (seg.base == base)
+                return seg.state == vmem_arena_used ? index : vmem_arena_none;
+        }
+
+        return vmem_arena_none;
+    }
+
+    index_type
+    get_spare() noexcept
+    {
+        auto index = m_spare;
+
+        m_spare = gsl::at(m_segs, index).next;
+        m_num_spare--;
+
+        return index;
+    }
+
+    void
+    put_spare(index_type index) noexcept
+    {
+        auto &&seg = gsl::at(m_segs, index);
+
+        seg.state = vmem_arena_spare;
+        seg.next = m_spare;
+
+        m_spare = index;
+        m_num_spare++;
+    }
+
+    size_type
+    num_spare() const noexcept
+    { return m_num_spare; }
+
+private:
+
+    struct segment_type
+    {
+        integer_pointer base;
+        integer_pointer size;
+        index_type prev;
+        index_type next;
+        index_type fprev;
+        index_type fnext;
+        uint32_t state;
+    };
+
+    struct qcache_type
+    {
+        size_type num;
+        std::array<index_type, vmem_arena_qcache_depth> segs;
+    };
+
+    integer_pointer m_addr;
+    integer_pointer m_allocated;
+    integer_pointer m_high_water;
+
+    integer_pointer m_lists;
+    index_type m_spare;
+    size_type m_num_spare;
+
+    mutable std::mutex m_mutex;
+
+    std::array<index_type, vmem_arena_num_lists> m_heads;
+    std::array<index_type, max_segments> m_hash;
+    std::array<qcache_type, vmem_arena_qcache_max> m_qcache;
+    std::array<segment_type, max_segments> m_segs;
+
+public:
+
+    vmem_arena(const vmem_arena &) = delete;
+    vmem_arena &operator=(const vmem_arena &) = delete;
+    vmem_arena(vmem_arena &&) noexcept = delete;
+    vmem_arena &operator=(vmem_arena &&) noexcept = delete;
+};
+
+///
+/// *INDENT-ON*
+///
+
+#endif
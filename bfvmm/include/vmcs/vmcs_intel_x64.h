@@ -25,6 +25,8 @@
 
 #include <vmcs/vmcs_intel_x64_state.h>
 #include <vmcs/vmcs_intel_x64_helpers.h>
+#include <vmcs/vmcs_intel_x64_io_bitmap.h>
+#include <vmcs/vmcs_intel_x64_msr_bitmap.h>
 #include <exit_handler/state_save_intel_x64.h>
 
 class vcpu_intel_x64;
@@ -158,6 +160,40 @@ public:
     ///
     virtual void clear();
 
+    /// MSR Bitmap
+    ///
+    /// Returns the MSR bitmap used by this VMCS, which decides which of
+    /// the guest's MSR accesses cause a VM exit (all of them are passed
+    /// through by default, see vmcs_intel_x64_msr_bitmap). The bitmap is
+    /// created the first time it is needed, so MSRs can be trapped either
+    /// before or after the VMCS is launched.
+    ///
+    /// @b Example: @n
+    /// @code
+    /// vmcs->msr_bitmap().trap_on_write(intel_x64::msrs::ia32_sysenter_cs::addr);
+    /// @endcode
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the MSR bitmap
+    ///
+    virtual vmcs_intel_x64_msr_bitmap &msr_bitmap();
+
+    /// I/O Bitmap
+    ///
+    /// Returns the I/O bitmaps used by this VMCS, which decide which of
+    /// the guest's port accesses cause a VM exit (all of them are passed
+    /// through by default, see vmcs_intel_x64_io_bitmap). Like the MSR
+    /// bitmap, the I/O bitmaps are created the first time they are needed.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the I/O bitmaps
+    ///
+    virtual vmcs_intel_x64_io_bitmap &io_bitmap();
+
 protected:
 
     virtual void write_fields(gsl::not_null<vmcs_intel_x64_state *> host_state,
@@ -195,6 +231,10 @@ protected:
     uintptr_t m_vmcs_region_phys;
     std::unique_ptr<uint32_t[]> m_vmcs_region;
 
+    uint16_t m_vpid;
+    std::unique_ptr<vmcs_intel_x64_msr_bitmap> m_msr_bitmap;
+    std::unique_ptr<vmcs_intel_x64_io_bitmap> m_io_bitmap;
+
     state_save_intel_x64 *m_state_save;
     std::unique_ptr<char[]> m_exit_handler_stack;
 
@@ -0,0 +1,164 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#ifndef VMCS_INTEL_X64_IO_BITMAP_H
+#define VMCS_INTEL_X64_IO_BITMAP_H
+
+#include <memory>
+
+#include <gsl/gsl>
+
+/// VMCS I/O Bitmap
+///
+/// The I/O bitmaps decide which of the guest's IN / OUT / INS / OUTS
+/// instructions cause a VM exit (see the Intel SDM, section 24.6.4). There
+/// are two bitmaps of one page each: bitmap A covers ports 0x0000 - 0x7FFF
+/// and bitmap B covers ports 0x8000 - 0xFFFF. An access exits if the bit of
+/// any of the ports it touches is set (a 4 byte access to port 0x3F8 checks
+/// 0x3F8 - 0x3FB), and accesses that wrap past port 0xFFFF always exit.
+///
+/// Unlike the MSR bitmap, reads and writes share the same bit. A port that
+/// only needs one direction emulated is trapped, and the other direction is
+/// executed by the exit handler on the guest's behalf (see
+/// exit_handler_intel_x64::register_io_handler).
+///
+/// The bitmaps start with every bit cleared, so all ports are passed
+/// through. The CPU reads the bitmaps on each I/O instruction, so trapping
+/// a port, or passing it through, takes effect right away.
+///
+class vmcs_intel_x64_io_bitmap
+{
+public:
+
+    using port_type = uint16_t;
+    using integer_pointer = uintptr_t;
+
+    /// Default Constructor
+    ///
+    /// Allocates both bitmaps, with every port passed through.
+    ///
+    /// @expects none
+    /// @ensures phys_a() != 0
+    /// @ensures phys_b() != 0
+    ///
+    vmcs_intel_x64_io_bitmap();
+
+    /// Destructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    virtual ~vmcs_intel_x64_io_bitmap() = default;
+
+    /// Trap On Access
+    ///
+    /// Causes the guest's reads and writes of port to exit.
+    ///
+    /// @expects none
+    /// @ensures is_trapped(port)
+    ///
+    /// @param port the port to trap
+    ///
+    virtual void trap_on_access(port_type port);
+
+    /// Pass Through Access
+    ///
+    /// Lets the guest read and write port without exiting.
+    ///
+    /// @expects none
+    /// @ensures !is_trapped(port)
+    ///
+    /// @param port the port to pass through
+    ///
+    virtual void pass_through_access(port_type port);
+
+    /// Trap On All Accesses
+    ///
+    /// Causes every I/O instruction executed by the guest to exit.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    virtual void trap_on_all_accesses() noexcept;
+
+    /// Pass Through All Accesses
+    ///
+    /// Lets the guest access every port without exiting.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    virtual void pass_through_all_accesses() noexcept;
+
+    /// Is Trapped
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param port the port to check
+    /// @return true if the guest's accesses of port exit, false otherwise
+    ///
+    bool is_trapped(port_type port) const;
+
+    /// Physical Address (Bitmap A)
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the physical address of bitmap A, which is the value of
+    ///     the VMCS's address_of_io_bitmap_a field
+    ///
+    integer_pointer phys_a() const noexcept
+    { return m_bitmap_a_phys; }
+
+    /// Physical Address (Bitmap B)
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the physical address of bitmap B, which is the value of
+    ///     the VMCS's address_of_io_bitmap_b field
+    ///
+    integer_pointer phys_b() const noexcept
+    { return m_bitmap_b_phys; }
+
+private:
+
+    gsl::span<uint8_t> bitmap(port_type port) const;
+
+private:
+
+    std::unique_ptr<uint8_t[]> m_bitmap_a;
+    std::unique_ptr<uint8_t[]> m_bitmap_b;
+
+    integer_pointer m_bitmap_a_phys;
+    integer_pointer m_bitmap_b_phys;
+
+public:
+
+    vmcs_intel_x64_io_bitmap(vmcs_intel_x64_io_bitmap &&) noexcept = default;
+    vmcs_intel_x64_io_bitmap &operator=(vmcs_intel_x64_io_bitmap &&) noexcept = default;
+
+    vmcs_intel_x64_io_bitmap(const vmcs_intel_x64_io_bitmap &) = delete;
+    vmcs_intel_x64_io_bitmap &operator=(const vmcs_intel_x64_io_bitmap &) = delete;
+};
+
+#endif
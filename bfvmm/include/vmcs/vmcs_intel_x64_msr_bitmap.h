@@ -0,0 +1,211 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#ifndef VMCS_INTEL_X64_MSR_BITMAP_H
+#define VMCS_INTEL_X64_MSR_BITMAP_H
+
+#include <memory>
+
+#include <gsl/gsl>
+
+/// VMCS MSR Bitmap
+///
+/// The MSR bitmap decides which of the guest's RDMSR / WRMSR instructions
+/// cause a VM exit (see the Intel SDM, section 24.6.9). It is a single
+/// page containing four bitmaps of 1024 bytes each: reads of the low MSRs
+/// (0x00000000 - 0x00001FFF), reads of the high MSRs (0xC0000000 -
+/// 0xC0001FFF), writes of the low MSRs, and writes of the high MSRs.
+/// Accessing an MSR whose bit is cleared does not exit. Accessing an MSR
+/// outside of these ranges always exits.
+///
+/// The bitmap starts with every bit cleared, so all MSRs are passed
+/// through. The CPU reads the bitmap each time the guest accesses an MSR,
+/// so trapping an MSR, or passing it through, takes effect right away, and
+/// no VMCS field has to be written.
+///
+/// @note when an MSR is passed through, its value is not seen by the
+///     exit handler's handle_rdmsr / handle_wrmsr. This is only correct
+///     for MSRs that the VMM does not use, and MSRs that the CPU saves in
+///     the guest state area on each VM exit.
+///
+class vmcs_intel_x64_msr_bitmap
+{
+public:
+
+    using msr_type = uint32_t;
+    using integer_pointer = uintptr_t;
+
+    /// Default Constructor
+    ///
+    /// Allocates the bitmap, with every MSR passed through.
+    ///
+    /// @expects none
+    /// @ensures phys() != 0
+    ///
+    vmcs_intel_x64_msr_bitmap();
+
+    /// Destructor
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    virtual ~vmcs_intel_x64_msr_bitmap() = default;
+
+    /// Trap On Read
+    ///
+    /// Causes the guest's RDMSR of msr to exit. MSRs outside of the ranges
+    /// covered by the bitmap always exit, so this does nothing for them.
+    ///
+    /// @expects none
+    /// @ensures is_read_trapped(msr)
+    ///
+    /// @param msr the MSR to trap
+    ///
+    virtual void trap_on_read(msr_type msr);
+
+    /// Trap On Write
+    ///
+    /// Causes the guest's WRMSR of msr to exit. MSRs outside of the ranges
+    /// covered by the bitmap always exit, so this does nothing for them.
+    ///
+    /// @expects none
+    /// @ensures is_write_trapped(msr)
+    ///
+    /// @param msr the MSR to trap
+    ///
+    virtual void trap_on_write(msr_type msr);
+
+    /// Trap On Access
+    ///
+    /// Same as calling trap_on_read and trap_on_write.
+    ///
+    /// @expects none
+    /// @ensures is_read_trapped(msr)
+    /// @ensures is_write_trapped(msr)
+    ///
+    /// @param msr the MSR to trap
+    ///
+    virtual void trap_on_access(msr_type msr);
+
+    /// Pass Through Read
+    ///
+    /// Lets the guest execute RDMSR of msr without exiting.
+    ///
+    /// @expects msr is covered by the bitmap
+    /// @ensures !is_read_trapped(msr)
+    ///
+    /// @param msr the MSR to pass through
+    ///
+    virtual void pass_through_read(msr_type msr);
+
+    /// Pass Through Write
+    ///
+    /// Lets the guest execute WRMSR of msr without exiting.
+    ///
+    /// @expects msr is covered by the bitmap
+    /// @ensures !is_write_trapped(msr)
+    ///
+    /// @param msr the MSR to pass through
+    ///
+    virtual void pass_through_write(msr_type msr);
+
+    /// Pass Through Access
+    ///
+    /// Same as calling pass_through_read and pass_through_write.
+    ///
+    /// @expects msr is covered by the bitmap
+    /// @ensures !is_read_trapped(msr)
+    /// @ensures !is_write_trapped(msr)
+    ///
+    /// @param msr the MSR to pass through
+    ///
+    virtual void pass_through_access(msr_type msr);
+
+    /// Trap On All Accesses
+    ///
+    /// Causes every RDMSR / WRMSR executed by the guest to exit.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    virtual void trap_on_all_accesses() noexcept;
+
+    /// Pass Through All Accesses
+    ///
+    /// Lets the guest access every MSR covered by the bitmap without
+    /// exiting.
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    virtual void pass_through_all_accesses() noexcept;
+
+    /// Is Read Trapped
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param msr the MSR to check
+    /// @return true if the guest's RDMSR of msr exits, false otherwise
+    ///
+    bool is_read_trapped(msr_type msr) const;
+
+    /// Is Write Trapped
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @param msr the MSR to check
+    /// @return true if the guest's WRMSR of msr exits, false otherwise
+    ///
+    bool is_write_trapped(msr_type msr) const;
+
+    /// Physical Address
+    ///
+    /// @expects none
+    /// @ensures none
+    ///
+    /// @return the physical address of the bitmap, which is the value of
+    ///     the VMCS's address_of_msr_bitmap field
+    ///
+    integer_pointer phys() const noexcept
+    { return m_bitmap_phys; }
+
+private:
+
+    void set_bit(msr_type msr, bool write, bool trap);
+    bool get_bit(msr_type msr, bool write) const;
+
+private:
+
+    std::unique_ptr<uint8_t[]> m_bitmap;
+    integer_pointer m_bitmap_phys;
+
+public:
+
+    vmcs_intel_x64_msr_bitmap(vmcs_intel_x64_msr_bitmap &&) noexcept = default;
+    vmcs_intel_x64_msr_bitmap &operator=(vmcs_intel_x64_msr_bitmap &&) noexcept = default;
+
+    vmcs_intel_x64_msr_bitmap(const vmcs_intel_x64_msr_bitmap &) = delete;
+    vmcs_intel_x64_msr_bitmap &operator=(const vmcs_intel_x64_msr_bitmap &) = delete;
+};
+
+#endif
@@ -23,6 +23,7 @@
 
 #include <map>
 #include <debug_ring/debug_ring.h>
+#include <memory_manager/mem_tag.h>
 
 // -----------------------------------------------------------------------------
 // Mutex
@@ -61,7 +62,7 @@ debug_ring::debug_ring(vcpuid::type vcpuid) noexcept
     try
     {
         m_vcpuid = vcpuid;
-        m_drr = std::make_unique<debug_ring_resources_t>();
+        m_drr = std::unique_ptr<debug_ring_resources_t>(new (mem_tag::debug_ring) debug_ring_resources_t());
 
         m_drr->epos = 0;
         m_drr->spos = 0;
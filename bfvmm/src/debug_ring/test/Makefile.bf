@@ -57,6 +57,8 @@ INCLUDE_PATHS+=%HYPER_ABS%/include/
 INCLUDE_PATHS+=%HYPER_ABS%/bfvmm/include/
 
 LIBS+=debug_ring
+LIBS+=memory_manager
+LIBS+=intrinsics
 
 LIBRARY_PATHS+=%BUILD_REL%/../bin/native/
 
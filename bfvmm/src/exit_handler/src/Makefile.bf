@@ -69,6 +69,7 @@ NATIVE_OUTDIR+=%BUILD_REL%/../bin
 # Sources
 ################################################################################
 
+SOURCES+=cpuid_cache_x64.cpp
 SOURCES+=exit_handler_intel_x64.cpp
 SOURCES+=exit_handler_intel_x64_entry.cpp
 SOURCES+=exit_handler_intel_x64_support.asm
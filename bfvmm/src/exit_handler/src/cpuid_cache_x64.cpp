@@ -0,0 +1,170 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <gsl/gsl>
+
+#include <algorithm>
+
+#include <exit_handler/cpuid_cache_x64.h>
+#include <intrinsics/crs_intel_x64.h>
+
+// leaf 0xD reports the size of the XSAVE area for the current XCR0 / XSS
+constexpr const auto cpuid_cache_xsave_leaf = 0x0000000DU;
+
+// CPUID.7.0:ECX.OSPKE
+constexpr const auto cpuid_cache_ospke_mask = 0x00000010U;
+
+// the leaves that use ECX as a subleaf. The subleaf of every other leaf is
+// ignored by the CPU, and is treated as 0
+constexpr const x64::cpuid::field_type cpuid_cache_subleaf_leaves[] =
+{
+    0x00000004U, 0x00000007U, 0x0000000BU, 0x0000000DU, 0x0000000FU, 0x00000010U,
+    0x00000012U, 0x00000014U, 0x00000017U, 0x00000018U, 0x0000001FU, 0x8000001DU
+};
+
+namespace bfn
+{
+
+cpuid_cache_x64::cpuid_cache_x64() noexcept :
+    m_hits(0),
+    m_misses(0)
+{ }
+
+static void
+apply_mask(cpuid_cache_x64::result_type &result,
+           const cpuid_cache_x64::result_type &clear,
+           const cpuid_cache_x64::result_type &set) noexcept
+{
+    result.eax = (result.eax & ~clear.eax) | set.eax;
+    result.ebx = (result.ebx & ~clear.ebx) | set.ebx;
+    result.ecx = (result.ecx & ~clear.ecx) | set.ecx;
+    result.edx = (result.edx & ~clear.edx) | set.edx;
+}
+
+cpuid_cache_x64::result_type
+cpuid_cache_x64::get(leaf_type leaf, leaf_type subleaf, cr4_type cr4)
+{
+    auto &&k = key(leaf, subleaf);
+    auto &&iter = m_results.find(k);
+
+    if (iter != m_results.end())
+    {
+        m_hits++;
+        return with_guest_bits(iter->second, leaf, cr4);
+    }
+
+    m_misses++;
+
+    auto &&entry = entry_type{this->execute(leaf, subleaf), guest_bits(leaf, subleaf)};
+
+    auto &&mask = m_masks.find(k);
+    if (mask != m_masks.end())
+    {
+        apply_mask(entry.result, mask->second.clear, mask->second.set);
+        entry.guest_ecx &= ~mask->second.clear.ecx;
+    }
+
+    if (leaf != cpuid_cache_xsave_leaf && m_results.size() < cpuid_cache_max_entries)
+        m_results[k] = entry;
+
+    return with_guest_bits(entry, leaf, cr4);
+}
+
+void
+cpuid_cache_x64::mask(leaf_type leaf, leaf_type subleaf, const result_type &clear, const result_type &set)
+{
+    m_masks[key(leaf, subleaf)] = {clear, set};
+    this->invalidate(leaf, subleaf);
+}
+
+void
+cpuid_cache_x64::set_override(leaf_type leaf, leaf_type subleaf, const result_type &result)
+{ this->mask(leaf, subleaf, {0xFFFFFFFFU, 0xFFFFFFFFU, 0xFFFFFFFFU, 0xFFFFFFFFU}, result); }
+
+void
+cpuid_cache_x64::clear_override(leaf_type leaf, leaf_type subleaf)
+{
+    m_masks.erase(key(leaf, subleaf));
+    this->invalidate(leaf, subleaf);
+}
+
+void
+cpuid_cache_x64::invalidate() noexcept
+{ m_results.clear(); }
+
+void
+cpuid_cache_x64::invalidate(leaf_type leaf, leaf_type subleaf)
+{ m_results.erase(key(leaf, subleaf)); }
+
+cpuid_cache_x64::key_type
+cpuid_cache_x64::key(leaf_type leaf, leaf_type subleaf) noexcept
+{
+    auto &&leaves = gsl::make_span(cpuid_cache_subleaf_leaves);
+
+    if (std::find(leaves.begin(), leaves.end(), leaf) == leaves.end())
+        subleaf = 0;
+
+    return (static_cast<key_type>(leaf) << 32) | subleaf;
+}
+
+cpuid_cache_x64::result_type
+cpuid_cache_x64::execute(leaf_type leaf, leaf_type subleaf) const
+{
+    auto &&ret = x64::cpuid::get(leaf, 0U, subleaf, 0U);
+    return {std::get<0>(ret), std::get<1>(ret), std::get<2>(ret), std::get<3>(ret)};
+}
+
+cpuid_cache_x64::value_type
+cpuid_cache_x64::guest_bits(leaf_type leaf, leaf_type subleaf) noexcept
+{
+    if (leaf == x64::cpuid::feature_information::addr)
+        return x64::cpuid::feature_information::ecx::osxsave::mask;
+
+    if (leaf == x64::cpuid::extended_feature_flags::addr && subleaf == 0)
+        return cpuid_cache_ospke_mask;
+
+    return 0;
+}
+
+cpuid_cache_x64::result_type
+cpuid_cache_x64::with_guest_bits(const entry_type &entry, leaf_type leaf, cr4_type cr4) noexcept
+{
+    auto result = entry.result;
+
+    if (entry.guest_ecx == 0)
+        return result;
+
+    auto &&enabled = false;
+
+    if (leaf == x64::cpuid::feature_information::addr)
+        enabled = (cr4 & intel_x64::cr4::osxsave::mask) != 0;
+    else
+        enabled = (cr4 & intel_x64::cr4::protection_key_enable_bit::mask) != 0;
+
+    result.ecx &= ~entry.guest_ecx;
+
+    if (enabled)
+        result.ecx |= entry.guest_ecx;
+
+    return result;
+}
+
+}
@@ -25,14 +25,19 @@
 #include <constants.h>
 #include <error_codes.h>
 #include <guard_exceptions.h>
+#include <memory_manager/guest_copy_x64.h>
 #include <memory_manager/memory_manager_x64.h>
+#include <memory_manager/root_page_table_x64.h>
 #include <exit_handler/exit_handler_intel_x64.h>
 #include <exit_handler/exit_handler_intel_x64_entry.h>
 #include <exit_handler/exit_handler_intel_x64_support.h>
 
 #include <intrinsics/pm_x64.h>
+#include <intrinsics/rflags_x64.h>
+#include <intrinsics/portio_x64.h>
 #include <intrinsics/cache_x64.h>
 #include <intrinsics/cpuid_x64.h>
+#include <intrinsics/rdtsc_x64.h>
 #include <intrinsics/vmx_intel_x64.h>
 
 #include <vmcs/vmcs_intel_x64_32bit_guest_state_fields.h>
@@ -49,14 +54,26 @@ using namespace intel_x64;
 #include <mutex>
 std::mutex g_unimplemented_handler_mutex;
 
+#include <atomic>
+std::atomic<uint64_t> g_guest_translations_generation(0);
+
 exit_handler_intel_x64::exit_handler_intel_x64() :
     m_vmcs(nullptr),
-    m_state_save(nullptr)
+    m_state_save(nullptr),
+    m_dispatch_table(make_default_dispatch_table()),
+    m_exit_stats(std::make_unique<exit_stats_type>()),
+    m_exit_tsc(0),
+    m_walk_cache_generation(g_guest_translations_generation.load())
 { }
 
 void
 exit_handler_intel_x64::dispatch()
-{ handle_exit(vmcs::exit_reason::basic_exit_reason::get()); }
+{
+    m_exit_tsc = x64::read_tsc::get();
+    g_mm->begin_exit();
+
+    handle_exit(vmcs::exit_reason::basic_exit_reason::get());
+}
 
 void
 exit_handler_intel_x64::halt() noexcept
@@ -99,55 +116,141 @@ exit_handler_intel_x64::halt() noexcept
     pm::stop();
 }
 
+exit_handler_intel_x64::handler_type
+exit_handler_intel_x64::register_handler(vmcs::value_type reason, handler_type handler)
+{
+    expects(reason < exit_handler_num_exit_reasons);
+
+    auto &&entry = gsl::at(*m_dispatch_table, reason);
+
+    std::swap(entry.handler, handler);
+    return handler;
+}
+
 void
-exit_handler_intel_x64::handle_exit(vmcs::value_type reason)
+exit_handler_intel_x64::register_pre_hook(vmcs::value_type reason, handler_type hook)
 {
-    switch (reason)
-    {
-        case vmcs::exit_reason::basic_exit_reason::cpuid:
-            handle_cpuid();
-            break;
+    expects(reason < exit_handler_num_exit_reasons);
+    expects(hook != nullptr);
 
-        case vmcs::exit_reason::basic_exit_reason::invd:
-            handle_invd();
-            break;
+    gsl::at(*m_dispatch_table, reason).pre_hooks.push_back(std::move(hook));
+}
 
-        case vmcs::exit_reason::basic_exit_reason::vmcall:
-            handle_vmcall();
-            break;
+void
+exit_handler_intel_x64::register_post_hook(vmcs::value_type reason, handler_type hook)
+{
+    expects(reason < exit_handler_num_exit_reasons);
+    expects(hook != nullptr);
 
-        case vmcs::exit_reason::basic_exit_reason::vmxoff:
-            handle_vmxoff();
-            break;
+    gsl::at(*m_dispatch_table, reason).post_hooks.push_back(std::move(hook));
+}
 
-        case vmcs::exit_reason::basic_exit_reason::rdmsr:
-            handle_rdmsr();
-            break;
+std::unique_ptr<exit_handler_intel_x64::dispatch_table_type>
+exit_handler_intel_x64::set_dispatch_table(std::unique_ptr<dispatch_table_type> table)
+{
+    expects(table != nullptr);
 
-        case vmcs::exit_reason::basic_exit_reason::wrmsr:
-            handle_wrmsr();
-            break;
+    std::swap(m_dispatch_table, table);
+    return table;
+}
 
-        default:
+std::unique_ptr<exit_handler_intel_x64::dispatch_table_type>
+exit_handler_intel_x64::make_default_dispatch_table()
+{
+    namespace reason = vmcs::exit_reason::basic_exit_reason;
+    auto table = std::make_unique<dispatch_table_type>();
+
+    gsl::at(*table, reason::cpuid).handler = [](exit_handler_intel_x64 & ehlr) { ehlr.handle_cpuid(); };
+    gsl::at(*table, reason::invd).handler = [](exit_handler_intel_x64 & ehlr) { ehlr.handle_invd(); };
+    gsl::at(*table, reason::vmcall).handler = [](exit_handler_intel_x64 & ehlr) { ehlr.handle_vmcall(); };
+    gsl::at(*table, reason::vmxoff).handler = [](exit_handler_intel_x64 & ehlr) { ehlr.handle_vmxoff(); };
+    gsl::at(*table, reason::rdmsr).handler = [](exit_handler_intel_x64 & ehlr) { ehlr.handle_rdmsr(); };
+    gsl::at(*table, reason::wrmsr).handler = [](exit_handler_intel_x64 & ehlr) { ehlr.handle_wrmsr(); };
+    gsl::at(*table, reason::io_instruction).handler = [](exit_handler_intel_x64 & ehlr) { ehlr.handle_io_instruction(); };
+
+    return table;
+}
+
+void
+exit_handler_intel_x64::register_io_handler(vmcs_intel_x64_io_bitmap::port_type port,
+        io_in_handler_type in, io_out_handler_type out)
+{
+    expects(in != nullptr || out != nullptr);
+
+    m_io_handlers[port] = {std::move(in), std::move(out)};
+
+    if (m_vmcs != nullptr)
+        m_vmcs->io_bitmap().trap_on_access(port);
+}
+
+exit_handler_intel_x64::io_instruction_type
+exit_handler_intel_x64::decode_io_instruction(vmcs::value_type qualification) noexcept
+{
+    namespace io = vmcs::exit_qualification::io_instruction;
+
+    auto &&decoded = io_instruction_type{};
+
+    decoded.port = io::port_number::get(qualification);
+    decoded.size = gsl::narrow_cast<uint32_t>(io::size_of_access::get(qualification) + 1);
+    decoded.in = io::direction_of_access::get(qualification) == io::direction_of_access::in;
+    decoded.string = io::string_instruction::get(qualification) == io::string_instruction::string;
+    decoded.rep = io::rep_prefixed::get(qualification) == io::rep_prefixed::rep;
+    decoded.immediate = io::operand_encoding::get(qualification) == io::operand_encoding::immediate;
+    decoded.address = 0;
+
+    return decoded;
+}
+
+void
+exit_handler_intel_x64::set_vmcs(gsl::not_null<vmcs_intel_x64 *> vmcs)
+{
+    m_vmcs = vmcs;
+
+    for (const auto &handlers : m_io_handlers)
+        m_vmcs->io_bitmap().trap_on_access(handlers.first);
+}
+
+void
+exit_handler_intel_x64::handle_exit(vmcs::value_type reason)
+{
+    if (reason < exit_handler_num_exit_reasons)
+    {
+        const auto &entry = gsl::at(*m_dispatch_table, reason);
+
+        for (const auto &hook : entry.pre_hooks)
+            hook(*this);
+
+        if (entry.handler)
+            entry.handler(*this);
+        else
             unimplemented_handler();
-            break;
-    };
 
+        for (const auto &hook : entry.post_hooks)
+            hook(*this);
+    }
+    else
+    {
+        unimplemented_handler();
+    }
+
+    // RDTSCP waits for the handler to complete before reading the TSC.
+    m_exit_stats->record_exit(reason, x64::read_tscp::get() - m_exit_tsc);
+
+    g_mm->end_exit();
     m_vmcs->resume();
 }
 
 void
 exit_handler_intel_x64::handle_cpuid()
 {
-    auto ret = cpuid::get(m_state_save->rax,
-                          m_state_save->rbx,
-                          m_state_save->rcx,
-                          m_state_save->rdx);
+    auto &&ret = m_cpuid_cache.get(gsl::narrow_cast<cpuid::field_type>(m_state_save->rax),
+                                   gsl::narrow_cast<cpuid::field_type>(m_state_save->rcx),
+                                   vmcs::guest_cr4::get());
 
-    m_state_save->rax = std::get<0>(ret);
-    m_state_save->rbx = std::get<1>(ret);
-    m_state_save->rcx = std::get<2>(ret);
-    m_state_save->rdx = std::get<3>(ret);
+    m_state_save->rax = ret.eax;
+    m_state_save->rbx = ret.ebx;
+    m_state_save->rcx = ret.ecx;
+    m_state_save->rdx = ret.edx;
 
     advance_rip();
 }
@@ -163,6 +266,18 @@ void
 exit_handler_intel_x64::handle_vmcall()
 {
     auto &&regs = vmcall_registers_t{};
+    auto &&start = x64::read_tsc::get();
+
+    // CR3 loads and INVLPG are not trapped, so the walk cache only drops
+    // its translations by itself when the guest's CR3 changes. Anything
+    // else the guest has to tell us about (see flush_guest_translations).
+
+    auto &&generation = g_guest_translations_generation.load();
+    if (generation != m_walk_cache_generation)
+    {
+        m_walk_cache.flush();
+        m_walk_cache_generation = generation;
+    }
 
     switch (m_state_save->rax)
     {
@@ -216,6 +331,18 @@ exit_handler_intel_x64::handle_vmcall()
                 handle_vmcall_stop(regs);
                 break;
 
+            case VMCALL_HEAP:
+                handle_vmcall_heap(regs);
+                break;
+
+            case VMCALL_STATS:
+                handle_vmcall_stats(regs);
+                break;
+
+            case VMCALL_FLUSH:
+                handle_vmcall_flush(regs);
+                break;
+
             case VMCALL_UNITTEST:
                 handle_vmcall_unittest(regs);
                 break;
@@ -226,6 +353,7 @@ exit_handler_intel_x64::handle_vmcall()
     });
 
     complete_vmcall(ret, regs);
+    m_exit_stats->record_vmcall(m_state_save->rax, x64::read_tscp::get() - start);
 }
 
 void
@@ -257,9 +385,16 @@ exit_handler_intel_x64::complete_vmcall(
     advance_rip();
 }
 
+void
+exit_handler_intel_x64::flush_guest_translations() noexcept
+{ g_guest_translations_generation++; }
+
 void
 exit_handler_intel_x64::handle_vmxoff()
-{ m_vmcs->promote(); }
+{
+    g_mm->end_exit();
+    m_vmcs->promote();
+}
 
 void
 exit_handler_intel_x64::handle_rdmsr()
@@ -387,6 +522,125 @@ exit_handler_intel_x64::handle_wrmsr()
     advance_rip();
 }
 
+void
+exit_handler_intel_x64::handle_io_instruction()
+{
+    auto &&io = decode_io_instruction(vmcs::exit_qualification::io_instruction::get());
+
+    if (!io.string)
+    {
+        auto &&mask = (1UL << (io.size * 8)) - 1;
+
+        if (io.in)
+        {
+            auto &&value = this->io_in(io);
+
+            // Like any 32bit register write, IN EAX zero extends into RAX,
+            // while IN AL and IN AX leave the upper bits untouched.
+
+            if (io.size == 4)
+                m_state_save->rax = value;
+            else
+                m_state_save->rax = (m_state_save->rax & ~mask) | (value & mask);
+        }
+        else
+        {
+            this->io_out(io, gsl::narrow_cast<io_value_type>(m_state_save->rax & mask));
+        }
+
+        advance_rip();
+        return;
+    }
+
+    // String forms are emulated one element at a time. RIP is only
+    // advanced once RCX reaches 0, so a REP prefixed INS / OUTS exits
+    // once per element. Note that a 64bit address size is assumed for
+    // RSI, RDI and RCX.
+
+    if (io.rep && m_state_save->rcx == 0)
+    {
+        advance_rip();
+        return;
+    }
+
+    io.address = vmcs::guest_linear_address::get();
+
+    auto &&cr3 = vmcs::guest_cr3::get();
+    auto &&pat = vmcs::guest_ia32_pat::get();
+    auto &&value = io_value_type{0};
+
+    m_walk_cache.flush();
+
+    if (io.in)
+    {
+        value = this->io_in(io);
+        bfn::copy_to_guest(cr3, io.address, &value, io.size, pat, m_walk_cache);
+    }
+    else
+    {
+        bfn::copy_from_guest(cr3, io.address, &value, io.size, pat, m_walk_cache);
+        this->io_out(io, value);
+    }
+
+    auto &&index = io.in ? &m_state_save->rdi : &m_state_save->rsi;
+
+    if ((vmcs::guest_rflags::get() & rflags::direction_flag::mask) == 0)
+        *index += io.size;
+    else
+        *index -= io.size;
+
+    if (io.rep && --m_state_save->rcx != 0)
+        return;
+
+    advance_rip();
+}
+
+exit_handler_intel_x64::io_value_type
+exit_handler_intel_x64::io_in(const io_instruction_type &io)
+{
+    auto &&iter = m_io_handlers.find(io.port);
+    if (iter != m_io_handlers.end() && iter->second.in)
+        return iter->second.in(*this, io);
+
+    switch (io.size)
+    {
+        case 1:
+            return portio::inb(io.port);
+
+        case 2:
+            return portio::inw(io.port);
+
+        default:
+            return portio::ind(io.port);
+    }
+}
+
+void
+exit_handler_intel_x64::io_out(const io_instruction_type &io, io_value_type value)
+{
+    auto &&iter = m_io_handlers.find(io.port);
+    if (iter != m_io_handlers.end() && iter->second.out)
+    {
+        iter->second.out(*this, io, value);
+        return;
+    }
+
+    switch (io.size)
+    {
+        case 1:
+            portio::outb(io.port, value);
+            break;
+
+        case 2:
+            portio::outw(io.port, value);
+            break;
+
+        default:
+            portio::outd(io.port, value);
+            break;
+    }
+}
+
 void
 exit_handler_intel_x64::advance_rip() noexcept
 { m_state_save->rip += vmcs::vm_exit_instruction_length::get(); }
@@ -491,8 +745,8 @@ exit_handler_intel_x64::handle_vmcall_data(vmcall_registers_t &regs)
     expects(regs.r06 <= VMCALL_IN_BUFFER_SIZE);
     expects(regs.r09 <= VMCALL_OUT_BUFFER_SIZE);
 
-    auto &&imap = bfn::make_unique_map_x64<char>(regs.r05, vmcs::guest_cr3::get(), regs.r06, vmcs::guest_ia32_pat::get());
-    auto &&omap = bfn::make_unique_map_x64<char>(regs.r08, vmcs::guest_cr3::get(), regs.r09, vmcs::guest_ia32_pat::get());
+    auto &&imap = bfn::make_unique_map_x64<char>(regs.r05, vmcs::guest_cr3::get(), regs.r06, vmcs::guest_ia32_pat::get(), m_walk_cache);
+    auto &&omap = bfn::make_unique_map_x64<char>(regs.r08, vmcs::guest_cr3::get(), regs.r09, vmcs::guest_ia32_pat::get(), m_walk_cache);
 
     switch (regs.r04)
     {
@@ -540,6 +794,208 @@ void
 exit_handler_intel_x64::handle_vmcall_stop(vmcall_registers_t &regs)
 { (void) regs; }
 
+void
+exit_handler_intel_x64::handle_vmcall_heap(vmcall_registers_t &regs)
+{
+    // Only the driver entry that loaded the VMM may grow its pools. Any
+    // other guest software that knows the magic number could otherwise
+    // donate memory it still controls, and the VMM would hand it out.
+    // The driver runs at CPL 0 (which is the DPL of SS) and took the heap
+    // token while the VMM was being loaded.
+
+    expects(vmcs::guest_ss_access_rights::dpl::get() == 0);
+    expects(g_mm->valid_heap_token(regs.r05));
+
+    if (regs.r02 == 0)
+    {
+        regs.r02 = g_mm->heap_chunks_needed();
+        regs.r03 = g_mm->page_chunks_needed();
+        return;
+    }
+
+    expects((regs.r02 & (page_size - 1)) == 0);
+    expects(regs.r03 != 0);
+
+    // Donations are rare, and the driver's chunks come from an area whose
+    // addresses are reused once a chunk is freed, so a translation from an
+    // earlier donation cannot be trusted.
+    m_walk_cache.flush();
+
+    // If add_heap / add_pages fails part way through, some of the buffer
+    // might already be in use, so the buffer is left mapped.
+
+    switch (regs.r04)
+    {
+        case VMCALL_HEAP_POOL_HEAP:
+            expects(regs.r03 % MAX_HEAP_POOL == 0);
+            g_mm->add_heap(this->map_guest_buffer(regs.r02, regs.r03), regs.r03);
+            break;
+
+        case VMCALL_HEAP_POOL_PAGE:
+            expects(regs.r03 % MAX_PAGE_POOL == 0);
+            g_mm->add_pages(this->map_guest_buffer(regs.r02, regs.r03), regs.r03);
+            break;
+
+        default:
+            throw std::runtime_error("unknown vmcall heap pool");
+    }
+}
+
+void
+exit_handler_intel_x64::handle_vmcall_stats(vmcall_registers_t &regs)
+{
+    expects(regs.r08 != 0);
+    expects(regs.r09 != 0);
+    expects(regs.r09 <= VMCALL_OUT_BUFFER_SIZE);
+
+    json ojson;
+
+    switch (regs.r02)
+    {
+        case VMCALL_STATS_MEMORY:
+            handle_vmcall_stats_memory(ojson);
+            break;
+
+        case VMCALL_STATS_EXITS:
+            handle_vmcall_stats_exits(ojson);
+            break;
+
+        default:
+            throw std::runtime_error("unknown vmcall stats index");
+    }
+
+    auto &&omap = bfn::make_unique_map_x64<char>(regs.r08, vmcs::guest_cr3::get(), regs.r09, vmcs::guest_ia32_pat::get(), m_walk_cache);
+    reply_with_json(regs, ojson, omap);
+
+    // The exit stats are only reset once they have been returned, so that
+    // a reply that does not fit in the output buffer does not lose them.
+    if (regs.r02 == VMCALL_STATS_EXITS && regs.r03 != 0)
+        m_exit_stats->clear();
+}
+
+void
+exit_handler_intel_x64::handle_vmcall_flush(vmcall_registers_t &regs)
+{
+    (void) regs;
+    flush_guest_translations();
+}
+
+static json
+pool_stats_to_json(const memory_manager_x64::pool_stats_type &stats)
+{
+    auto &&counters = stats.counters;
+    auto &&histogram = json::object();
+
+    for (auto i = 0UL; i < mem_stats_num_buckets; i++)
+    {
+        if (auto &&count = counters.histogram.at(i))
+            histogram[std::to_string(1UL << i)] = count;
+    }
+
+    return
+    {
+        {"allocs", counters.allocs},
+        {"frees", counters.frees},
+        {"failed", counters.failed},
+        {"bytes_allocated", counters.bytes_allocated},
+        {"bytes_freed", counters.bytes_freed},
+        {"bytes_live", counters.bytes_allocated - counters.bytes_freed},
+        {"capacity", stats.capacity},
+        {"high_water", stats.high_water},
+        {"largest_free", stats.largest_free},
+        {"histogram", histogram}
+    };
+}
+
+static json
+tag_report_to_json(const memory_manager_x64::tag_report_type &report)
+{
+    auto &&tags = json::object();
+
+    for (auto i = 0UL; i < mem_tag_num_tags; i++)
+    {
+        auto &&tag = static_cast<mem_tag::type>(i);
+        auto &&name = i < mem_tag::user ? std::string(mem_tag_name(tag)) : "user_" + std::to_string(i);
+
+        if (auto &&bytes = report.at(i))
+            tags[name] = bytes;
+    }
+
+    return tags;
+}
+
+void
+exit_handler_intel_x64::handle_vmcall_stats_memory(json &ojson)
+{
+    ojson["heap"] = pool_stats_to_json(g_mm->pool_stats(memory_manager_pool::heap));
+    ojson["page"] = pool_stats_to_json(g_mm->pool_stats(memory_manager_pool::page));
+    ojson["slab"] = pool_stats_to_json(g_mm->pool_stats(memory_manager_pool::slab));
+    ojson["map"] = pool_stats_to_json(g_mm->pool_stats(memory_manager_pool::map));
+    ojson["tags"] = tag_report_to_json(g_mm->tag_report());
+}
+
+static json
+exit_report_to_json(const exit_handler_intel_x64::exit_stats_type::report_type &report)
+{
+    auto &&histogram = json::object();
+
+    for (auto i = 0UL; i < exit_stats_num_buckets; i++)
+    {
+        if (auto &&count = report.histogram.at(i))
+            histogram[std::to_string(1UL << i)] = count;
+    }
+
+    return
+    {
+        {"count", report.count},
+        {"cycles", report.cycles},
+        {"histogram", histogram}
+    };
+}
+
+void
+exit_handler_intel_x64::handle_vmcall_stats_exits(json &ojson)
+{
+    auto &&exits = json::object();
+    auto &&vmcalls = json::object();
+
+    for (auto i = 0UL; i <= exit_handler_num_exit_reasons; i++)
+    {
+        auto &&report = m_exit_stats->exit_report(i);
+        if (report.count == 0)
+            continue;
+
+        if (i == exit_handler_num_exit_reasons)
+        {
+            exits["other"] = exit_report_to_json(report);
+            continue;
+        }
+
+        // reserved exit reasons are all described as "unknown"
+        std::string name = vmcs::exit_reason::basic_exit_reason::__basic_exit_reason_description(i);
+        if (name == "unknown")
+            name = std::to_string(i);
+
+        exits[name] = exit_report_to_json(report);
+    }
+
+    for (auto i = 0UL; i <= exit_handler_num_vmcall_opcodes; i++)
+    {
+        auto &&report = m_exit_stats->vmcall_report(i);
+        if (report.count == 0)
+            continue;
+
+        if (i < exit_handler_num_vmcall_opcodes)
+            vmcalls[std::to_string(i)] = exit_report_to_json(report);
+        else
+            vmcalls["other"] = exit_report_to_json(report);
+    }
+
+    ojson["vcpuid"] = m_state_save->vcpuid;
+    ojson["exits"] = exits;
+    ojson["vmcalls"] = vmcalls;
+}
+
 void
 exit_handler_intel_x64::handle_vmcall_data_string_unformatted(
     const std::string &istr, std::string &ostr)
@@ -585,8 +1041,76 @@ exit_handler_intel_x64::reply_with_json(
     auto &&dmp = str.dump();
     auto &&len = dmp.length();
 
+    if (len > omap.size())
+        throw std::out_of_range("reply_with_json: reply is larger than the output buffer");
+
     __builtin_memcpy(omap.get(), dmp.data(), len);
 
     regs.r07 = VMCALL_DATA_STRING_JSON;
     regs.r09 = len;
 }
+
+static bool
+is_phys_mapped(uintptr_t phys)
+{
+    try
+    {
+        g_mm->physint_to_virtint(phys);
+    }
+    catch (std::out_of_range &)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+uintptr_t
+exit_handler_intel_x64::map_guest_buffer(uintptr_t virt, size_t size)
+{
+    auto &&cr3 = vmcs::guest_cr3::get();
+    auto &&map = g_mm->alloc_map(size);
+
+    if (map == nullptr)
+        throw std::bad_alloc();
+
+    auto &&vmm_virt = reinterpret_cast<uintptr_t>(map);
+    auto mapped = 0UL;
+
+    auto ___ = gsl::on_failure([&]
+    {
+        root_pt()->unmap_range(vmm_virt, size);
+        g_mm->free_map(map);
+    });
+
+    // The buffer is only virtually contiguous, so it is mapped one
+    // physically contiguous run at a time. Memory that the VMM has already
+    // mapped (its own memory, or a buffer that was already donated) is
+    // rejected, otherwise the same memory would be handed out twice.
+
+    auto run_phys = 0UL;
+    auto run_size = 0UL;
+
+    for (auto offset = 0UL; offset < size; offset += page_size)
+    {
+        auto &&phys = m_walk_cache.virt_to_phys(virt + offset, cr3);
+
+        if (is_phys_mapped(phys))
+            throw std::runtime_error("map_guest_buffer: memory is already mapped by the VMM");
+
+        if (run_size != 0 && phys != run_phys + run_size)
+        {
+            root_pt()->map_range(vmm_virt + mapped, run_phys, run_size, x64::memory_attr::rw_wb);
+            mapped += run_size;
+            run_size = 0;
+        }
+
+        if (run_size == 0)
+            run_phys = phys;
+
+        run_size += page_size;
+    }
+
+    root_pt()->map_range(vmm_virt + mapped, run_phys, run_size, x64::memory_attr::rw_wb);
+    return vmm_virt;
+}
@@ -57,6 +57,8 @@ NATIVE_OUTDIR+=%BUILD_REL%/../bin
 SOURCES+=test.cpp
 SOURCES+=test_exit_handler_intel_x64.cpp
 SOURCES+=test_exit_handler_intel_x64_entry.cpp
+SOURCES+=test_cpuid_cache_x64.cpp
+SOURCES+=test_exit_stats.cpp
 
 INCLUDE_PATHS+=./
 INCLUDE_PATHS+=%HYPER_ABS%/include/
@@ -59,6 +59,17 @@ exit_handler_intel_x64_ut::list()
     this->test_vm_exit_reason_vmcall_event();
     this->test_vm_exit_reason_vmcall_start();
     this->test_vm_exit_reason_vmcall_stop();
+    this->test_vm_exit_reason_vmcall_heap_query();
+    this->test_vm_exit_reason_vmcall_heap_invalid_size();
+    this->test_vm_exit_reason_vmcall_heap_add();
+    this->test_vm_exit_reason_vmcall_heap_add_pages();
+    this->test_vm_exit_reason_vmcall_heap_invalid_pool();
+    this->test_vm_exit_reason_vmcall_heap_already_mapped();
+    this->test_vm_exit_reason_vmcall_heap_user_mode();
+    this->test_vm_exit_reason_vmcall_heap_invalid_token();
+    this->test_vm_exit_reason_vmcall_flush();
+    this->test_vm_exit_reason_vmcall_stats_unknown_index();
+    this->test_vm_exit_reason_vmcall_stats_invalid_output();
     this->test_vm_exit_reason_vmcall_data_unknown();
     this->test_vm_exit_reason_vmcall_data_string_unformatted_input_nullptr();
     this->test_vm_exit_reason_vmcall_data_string_unformatted_output_nullptr();
@@ -112,6 +123,33 @@ exit_handler_intel_x64_ut::list()
     this->test_vm_exit_reason_wrmsr_default();
     this->test_vm_exit_failure_check();
     this->test_halt();
+    this->test_dispatch_register_handler();
+    this->test_dispatch_chain_handler();
+    this->test_dispatch_hooks();
+    this->test_dispatch_invalid_args();
+    this->test_dispatch_set_table();
+    this->test_dispatch_grace_period();
+    this->test_vm_exit_reason_io_instruction_decode();
+    this->test_vm_exit_reason_io_instruction_register();
+    this->test_vm_exit_reason_io_instruction_in();
+    this->test_vm_exit_reason_io_instruction_in_dword();
+    this->test_vm_exit_reason_io_instruction_out();
+    this->test_vm_exit_reason_io_instruction_pass_through();
+    this->test_vm_exit_reason_io_instruction_string();
+    this->test_vm_exit_reason_io_instruction_string_rep_zero();
+    this->test_cpuid_cache_hit();
+    this->test_cpuid_cache_invalidate();
+    this->test_cpuid_cache_xsave_leaf();
+    this->test_cpuid_cache_max_entries();
+    this->test_cpuid_cache_mask();
+    this->test_cpuid_cache_ignored_subleaf();
+    this->test_cpuid_cache_guest_bits();
+    this->test_vm_exit_reason_cpuid_cached();
+    this->test_exit_stats_bucket();
+    this->test_exit_stats_record();
+    this->test_exit_stats_other();
+    this->test_vm_exit_reason_exit_stats();
+    this->test_vm_exit_reason_vmcall_stats_exits();
 
     return true;
 }
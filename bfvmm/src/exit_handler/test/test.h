@@ -58,6 +58,17 @@ private:
     void test_vm_exit_reason_vmcall_event();
     void test_vm_exit_reason_vmcall_start();
     void test_vm_exit_reason_vmcall_stop();
+    void test_vm_exit_reason_vmcall_heap_query();
+    void test_vm_exit_reason_vmcall_heap_invalid_size();
+    void test_vm_exit_reason_vmcall_heap_add();
+    void test_vm_exit_reason_vmcall_heap_add_pages();
+    void test_vm_exit_reason_vmcall_heap_invalid_pool();
+    void test_vm_exit_reason_vmcall_heap_already_mapped();
+    void test_vm_exit_reason_vmcall_heap_user_mode();
+    void test_vm_exit_reason_vmcall_heap_invalid_token();
+    void test_vm_exit_reason_vmcall_flush();
+    void test_vm_exit_reason_vmcall_stats_unknown_index();
+    void test_vm_exit_reason_vmcall_stats_invalid_output();
     void test_vm_exit_reason_vmcall_data_unknown();
     void test_vm_exit_reason_vmcall_data_string_unformatted_input_nullptr();
     void test_vm_exit_reason_vmcall_data_string_unformatted_output_nullptr();
@@ -111,6 +122,33 @@ private:
     void test_vm_exit_reason_wrmsr_default();
     void test_vm_exit_failure_check();
     void test_halt();
+    void test_dispatch_register_handler();
+    void test_dispatch_chain_handler();
+    void test_dispatch_hooks();
+    void test_dispatch_invalid_args();
+    void test_dispatch_set_table();
+    void test_dispatch_grace_period();
+    void test_vm_exit_reason_io_instruction_decode();
+    void test_vm_exit_reason_io_instruction_register();
+    void test_vm_exit_reason_io_instruction_in();
+    void test_vm_exit_reason_io_instruction_in_dword();
+    void test_vm_exit_reason_io_instruction_out();
+    void test_vm_exit_reason_io_instruction_pass_through();
+    void test_vm_exit_reason_io_instruction_string();
+    void test_vm_exit_reason_io_instruction_string_rep_zero();
+    void test_cpuid_cache_hit();
+    void test_cpuid_cache_invalidate();
+    void test_cpuid_cache_xsave_leaf();
+    void test_cpuid_cache_max_entries();
+    void test_cpuid_cache_mask();
+    void test_cpuid_cache_ignored_subleaf();
+    void test_cpuid_cache_guest_bits();
+    void test_vm_exit_reason_cpuid_cached();
+    void test_exit_stats_bucket();
+    void test_exit_stats_record();
+    void test_exit_stats_other();
+    void test_vm_exit_reason_exit_stats();
+    void test_vm_exit_reason_vmcall_stats_exits();
 };
 
 #endif
@@ -0,0 +1,220 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <test.h>
+
+#include <exit_handler/cpuid_cache_x64.h>
+#include <exit_handler/exit_handler_intel_x64.h>
+
+#include <intrinsics/crs_intel_x64.h>
+#include <vmcs/vmcs_intel_x64_32bit_read_only_data_fields.h>
+
+using namespace x64;
+using namespace intel_x64;
+
+extern size_t g_cpuid_calls;
+extern vmcs::value_type g_exit_reason;
+
+constexpr const auto cr4_osxsave = intel_x64::cr4::osxsave::mask;
+constexpr const auto cr4_pke = intel_x64::cr4::protection_key_enable_bit::mask;
+
+void
+exit_handler_intel_x64_ut::test_cpuid_cache_hit()
+{
+    auto &&cache = bfn::cpuid_cache_x64{};
+    g_cpuid_calls = 0;
+
+    auto &&ret1 = cache.get(0x80000001, 0, 0);
+    auto &&ret2 = cache.get(0x80000001, 0, 0);
+
+    this->expect_true(ret1.ebx == 0x80000001 && ret2.ebx == 0x80000001);
+    this->expect_true(g_cpuid_calls == 1);
+    this->expect_true(cache.hits() == 1);
+    this->expect_true(cache.misses() == 1);
+
+    auto &&ret3 = cache.get(0x8000001D, 1, 0);
+
+    this->expect_true(ret3.edx == 1);
+    this->expect_true(g_cpuid_calls == 2);
+}
+
+void
+exit_handler_intel_x64_ut::test_cpuid_cache_invalidate()
+{
+    auto &&cache = bfn::cpuid_cache_x64{};
+    g_cpuid_calls = 0;
+
+    cache.get(4, 0, 0);
+    cache.get(4, 1, 0);
+
+    cache.invalidate(4, 1);
+    cache.get(4, 0, 0);
+    cache.get(4, 1, 0);
+    this->expect_true(g_cpuid_calls == 3);
+
+    cache.invalidate();
+    cache.get(4, 0, 0);
+    cache.get(4, 1, 0);
+    this->expect_true(g_cpuid_calls == 5);
+}
+
+void
+exit_handler_intel_x64_ut::test_cpuid_cache_xsave_leaf()
+{
+    auto &&cache = bfn::cpuid_cache_x64{};
+    g_cpuid_calls = 0;
+
+    cache.get(0xD, 0, 0);
+    cache.get(0xD, 0, 0);
+
+    this->expect_true(g_cpuid_calls == 2);
+    this->expect_true(cache.hits() == 0);
+}
+
+void
+exit_handler_intel_x64_ut::test_cpuid_cache_max_entries()
+{
+    auto &&cache = bfn::cpuid_cache_x64{};
+    g_cpuid_calls = 0;
+
+    for (auto i = 0U; i < cpuid_cache_max_entries + 1; i++)
+        cache.get(4, i, 0);
+
+    cache.get(4, 0, 0);
+    cache.get(4, cpuid_cache_max_entries, 0);
+
+    this->expect_true(g_cpuid_calls == cpuid_cache_max_entries + 2);
+}
+
+void
+exit_handler_intel_x64_ut::test_cpuid_cache_mask()
+{
+    auto &&cache = bfn::cpuid_cache_x64{};
+
+    cache.get(0x80000001, 0, 0);
+    cache.mask(0x80000001, 0, {0, 0x0000FFFF, 0, 0}, {0, 0x00000042, 0, 0x00000100});
+
+    auto &&ret = cache.get(0x80000001, 0, 0);
+    this->expect_true(ret.ebx == 0x80000042);
+    this->expect_true(ret.edx == 0x00000100);
+
+    cache.set_override(0x80000001, 0, {1, 2, 3, 4});
+
+    ret = cache.get(0x80000001, 0, 0);
+    this->expect_true(ret.eax == 1 && ret.ebx == 2 && ret.ecx == 3 && ret.edx == 4);
+
+    cache.invalidate();
+
+    ret = cache.get(0x80000001, 0, 0);
+    this->expect_true(ret.eax == 1 && ret.ebx == 2 && ret.ecx == 3 && ret.edx == 4);
+
+    cache.clear_override(0x80000001, 0);
+
+    ret = cache.get(0x80000001, 0, 0);
+    this->expect_true(ret.eax == 0x80000001 && ret.ebx == 0x80000001);
+}
+
+void
+exit_handler_intel_x64_ut::test_cpuid_cache_ignored_subleaf()
+{
+    auto &&cache = bfn::cpuid_cache_x64{};
+    g_cpuid_calls = 0;
+
+    cache.mask(0x80000001, 0, {0, 0x0000FFFF, 0, 0}, {0, 0, 0, 0});
+    cache.set_override(0x40000000, 0, {0x40000001, 0x42, 0, 0});
+
+    auto &&ret1 = cache.get(0x80000001, 0x1234, 0);
+    auto &&ret2 = cache.get(0x80000001, 0, 0);
+
+    this->expect_true(ret1.ebx == 0x80000000 && ret2.ebx == 0x80000000);
+    this->expect_true(g_cpuid_calls == 1);
+
+    this->expect_true(cache.get(0x40000000, 0xFFFFFFFF, 0).ebx == 0x42);
+
+    for (auto i = 0U; i < cpuid_cache_max_entries + 1; i++)
+        cache.get(2, i, 0);
+
+    this->expect_true(g_cpuid_calls == 3);
+
+    cache.invalidate(0x80000001, 5);
+    cache.get(0x80000001, 0, 0);
+
+    this->expect_true(g_cpuid_calls == 4);
+}
+
+void
+exit_handler_intel_x64_ut::test_cpuid_cache_guest_bits()
+{
+    auto &&cache = bfn::cpuid_cache_x64{};
+    g_cpuid_calls = 0;
+
+    auto &&osxsave = cpuid::feature_information::ecx::osxsave::mask;
+
+    this->expect_true((cache.get(1, 0, 0).ecx & osxsave) == 0);
+    this->expect_true((cache.get(1, 0, cr4_osxsave).ecx & osxsave) != 0);
+    this->expect_true((cache.get(1, 0, 0).ecx & osxsave) == 0);
+
+    this->expect_true((cache.get(7, 0, 0).ecx & 0x10) == 0);
+    this->expect_true((cache.get(7, 0, cr4_pke).ecx & 0x10) != 0);
+    this->expect_true((cache.get(7, 1, 0).ecx & 0x10) != 0);
+
+    this->expect_true(g_cpuid_calls == 3);
+
+    cache.mask(1, 0, {0, 0, osxsave, 0}, {0, 0, 0, 0});
+
+    this->expect_true((cache.get(1, 0, cr4_osxsave).ecx & osxsave) == 0);
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_cpuid_cached()
+{
+    MockRepository mocks;
+    auto &&vmcs = mocks.Mock<vmcs_intel_x64>();
+
+    mocks.ExpectCall(vmcs, vmcs_intel_x64::resume);
+    mocks.ExpectCall(vmcs, vmcs_intel_x64::resume);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&state_save = state_save_intel_x64{};
+        auto &&ehlr = exit_handler_intel_x64{};
+
+        ehlr.set_vmcs(vmcs);
+        ehlr.set_state_save(&state_save);
+        ehlr.cpuid_cache().set_override(0x40000000, 0, {0x40000001, 0x42, 0, 0});
+
+        g_exit_reason = vmcs::exit_reason::basic_exit_reason::cpuid;
+        g_cpuid_calls = 0;
+
+        state_save.rax = 0x40000000;
+        state_save.rcx = 0;
+
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(state_save.rax == 0x40000001);
+        this->expect_true(state_save.rbx == 0x42);
+
+        state_save.rax = 0x40000000;
+
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(state_save.rax == 0x40000001);
+        this->expect_true(g_cpuid_calls == 1);
+    });
+}
@@ -19,6 +19,8 @@
 // License along with this library; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 
+#include <cstring>
+
 #include <test.h>
 
 #include <vmcs/vmcs_intel_x64.h>
@@ -33,6 +35,7 @@
 #include <exit_handler/exit_handler_intel_x64.h>
 #include <exit_handler/exit_handler_intel_x64_support.h>
 
+#include <memory_manager/guest_copy_x64.h>
 #include <memory_manager/memory_manager_x64.h>
 #include <memory_manager/root_page_table_x64.h>
 
@@ -49,6 +52,7 @@ vmcs::value_type g_exit_reason = 0;
 vmcs::value_type g_exit_qualification = 0;
 vmcs::value_type g_exit_instruction_length = 8;
 vmcs::value_type g_exit_instruction_information = 0;
+vmcs::value_type g_guest_ss_access_rights = 0;
 
 static std::map<intel_x64::msrs::field_type, intel_x64::msrs::value_type> g_msrs;
 
@@ -80,6 +84,9 @@ __vmread(uint64_t field, uint64_t *val) noexcept
         case vmcs::guest_physical_address::addr:
             *val = 0x0;
             break;
+        case vmcs::guest_ss_access_rights::addr:
+            *val = g_guest_ss_access_rights;
+            break;
         default:
             g_field = field;
             *val = g_value;
@@ -114,9 +121,40 @@ extern "C" void
 __wbinvd(void) noexcept
 { }
 
+extern "C" void
+__invlpg(const void *virt) noexcept
+{ (void) virt; }
+
+// The "CPU" returns the leaf in EBX and the subleaf in EDX, and sets the
+// OSXSAVE (leaf 0x1) and OSPKE (leaf 0x7) bits in ECX
+
+size_t g_cpuid_calls = 0;
+
 extern "C" void
 __cpuid(void *eax, void *ebx, void *ecx, void *edx) noexcept
-{ (void) eax; (void) ebx; (void) ecx; (void) edx; }
+{
+    const auto leaf = *static_cast<uint32_t *>(eax);
+    const auto subleaf = *static_cast<uint32_t *>(ecx);
+
+    *static_cast<uint32_t *>(ebx) = leaf;
+    *static_cast<uint32_t *>(edx) = subleaf;
+    *static_cast<uint32_t *>(ecx) = 0x08000010U;
+
+    g_cpuid_calls++;
+}
+
+// The TSC only moves when a test sets it
+
+uint64_t g_tsc = 0;
+uint64_t g_tscp = 0;
+
+extern "C" uint64_t
+__read_tsc(void) noexcept
+{ return g_tsc; }
+
+extern "C" uint64_t
+__read_tscp(void) noexcept
+{ return g_tscp; }
 
 state_save_intel_x64 g_state_save{};
 
@@ -461,6 +499,7 @@ exit_handler_intel_x64_ut::test_vm_exit_reason_vmcall_stop()
 
 auto g_msg = "{\"msg\":\"hello world\"}"_s;
 auto g_map = std::make_unique<char[]>(100);
+auto g_heap_token_value = 0x8BADF00DDEADBEEFUL;
 
 static auto
 setup_mm(MockRepository &mocks)
@@ -470,6 +509,12 @@ setup_mm(MockRepository &mocks)
 
     mocks.OnCall(mm, memory_manager_x64::alloc_map).Return(g_map.get());
     mocks.OnCall(mm, memory_manager_x64::free_map);
+    mocks.OnCall(mm, memory_manager_x64::free_map_deferred);
+    mocks.OnCall(mm, memory_manager_x64::begin_exit);
+    mocks.OnCall(mm, memory_manager_x64::end_exit);
+
+    mocks.OnCall(mm, memory_manager_x64::valid_heap_token).Do([](uint64_t token)
+    { return token == g_heap_token_value; });
 
     return mm;
 }
@@ -482,10 +527,393 @@ setup_pt(MockRepository &mocks)
 
     mocks.OnCall(pt, root_page_table_x64::map_4k);
     mocks.OnCall(pt, root_page_table_x64::unmap);
+    mocks.OnCall(pt, root_page_table_x64::map_range);
+    mocks.OnCall(pt, root_page_table_x64::unmap_range);
+
+    auto tm = mocks.Mock<temp_map_x64>();
+    mocks.OnCallFunc(temp_map_x64::instance).Return(tm);
+
+    mocks.OnCall(tm, temp_map_x64::map).Return(0);
 
     return pt;
 }
 
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_vmcall_heap_query()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::vmcall);
+    auto &&ehlr = setup_ehlr(vmcs);
+    auto &&mm = setup_mm(mocks);
+
+    mocks.OnCall(mm, memory_manager_x64::heap_chunks_needed).Return(2);
+    mocks.OnCall(mm, memory_manager_x64::page_chunks_needed).Return(3);
+
+    ehlr.m_state_save->rax = VMCALL_HEAP;                        // r00
+    ehlr.m_state_save->rdx = VMCALL_MAGIC_NUMBER;                // r01
+    ehlr.m_state_save->rcx = 0;                                  // r02
+    ehlr.m_state_save->r08 = g_heap_token_value;                 // r05
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(ehlr.m_state_save->rip == g_rip);
+        this->expect_true(ehlr.m_state_save->rcx == 2);
+        this->expect_true(ehlr.m_state_save->rbx == 3);
+        this->expect_true(ec_sign(ehlr.m_state_save->rdx) == BF_VMCALL_SUCCESS);
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_vmcall_heap_invalid_size()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::vmcall);
+    auto &&ehlr = setup_ehlr(vmcs);
+    auto &&mm = setup_mm(mocks);
+    auto &&pt = setup_pt(mocks);
+
+    mocks.NeverCall(mm, memory_manager_x64::add_heap);
+    mocks.NeverCall(pt, root_page_table_x64::map_range);
+
+    ehlr.m_state_save->rax = VMCALL_HEAP;                        // r00
+    ehlr.m_state_save->rdx = VMCALL_MAGIC_NUMBER;                // r01
+    ehlr.m_state_save->rcx = 0x1234000;                          // r02
+    ehlr.m_state_save->rbx = MAX_HEAP_POOL + 0x1000;             // r03
+    ehlr.m_state_save->rsi = VMCALL_HEAP_POOL_HEAP;              // r04
+    ehlr.m_state_save->r08 = g_heap_token_value;                 // r05
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(ehlr.m_state_save->rip == g_rip);
+        this->expect_true(ec_sign(ehlr.m_state_save->rdx) == BF_VMCALL_FAILURE);
+    });
+}
+
+// Every entry of the guest's page tables points to the same 1G page, so
+// the page walk translates the guest's buffer into one physically
+// contiguous run.
+
+alignas(0x1000) static uintptr_t g_guest_pt[0x200] = {};
+
+static void
+setup_guest_pt()
+{
+    for (auto &entry : g_guest_pt)
+        entry = 0x40000000UL | 0x83UL;
+
+    g_value = 0x1000;
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_vmcall_heap_add()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::vmcall);
+    auto &&ehlr = setup_ehlr(vmcs);
+    auto &&mm = setup_mm(mocks);
+    auto &&pt = setup_pt(mocks);
+
+    auto &&map = reinterpret_cast<uintptr_t>(g_guest_pt);
+    auto &&size = static_cast<size_t>(MAX_HEAP_POOL);
+    auto mapped = 0UL;
+    auto added = false;
+
+    mocks.OnCall(mm, memory_manager_x64::alloc_map).Return(g_guest_pt);
+    mocks.OnCall(mm, memory_manager_x64::physint_to_virtint).Throw(std::out_of_range("error"));
+
+    mocks.OnCall(pt, root_page_table_x64::map_range).With(map, 0x41234000UL, size, _, _).Do([&](uintptr_t, uintptr_t, size_t bytes, x64::memory_attr::attr_type, bool)
+    { mapped += bytes; });
+
+    mocks.OnCall(mm, memory_manager_x64::add_heap).With(map, size).Do([&](uintptr_t, size_t)
+    { added = true; });
+
+    ehlr.m_state_save->rax = VMCALL_HEAP;                        // r00
+    ehlr.m_state_save->rdx = VMCALL_MAGIC_NUMBER;                // r01
+    ehlr.m_state_save->rcx = 0x1234000;                          // r02
+    ehlr.m_state_save->rbx = MAX_HEAP_POOL;                      // r03
+    ehlr.m_state_save->rsi = VMCALL_HEAP_POOL_HEAP;              // r04
+    ehlr.m_state_save->r08 = g_heap_token_value;                 // r05
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        setup_guest_pt();
+
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_no_exception([&]{ ehlr.m_walk_cache.release(); });
+        this->expect_true(ehlr.m_state_save->rip == g_rip);
+        this->expect_true(ec_sign(ehlr.m_state_save->rdx) == BF_VMCALL_SUCCESS);
+        this->expect_true(mapped == size);
+        this->expect_true(added);
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_vmcall_heap_add_pages()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::vmcall);
+    auto &&ehlr = setup_ehlr(vmcs);
+    auto &&mm = setup_mm(mocks);
+    auto &&pt = setup_pt(mocks);
+
+    auto &&map = reinterpret_cast<uintptr_t>(g_guest_pt);
+    auto &&size = static_cast<size_t>(MAX_PAGE_POOL);
+    auto mapped = 0UL;
+    auto added = false;
+
+    mocks.OnCall(mm, memory_manager_x64::alloc_map).Return(g_guest_pt);
+    mocks.OnCall(mm, memory_manager_x64::physint_to_virtint).Throw(std::out_of_range("error"));
+    mocks.NeverCall(mm, memory_manager_x64::add_heap);
+
+    mocks.OnCall(pt, root_page_table_x64::map_range).With(map, 0x41234000UL, size, _, _).Do([&](uintptr_t, uintptr_t, size_t bytes, x64::memory_attr::attr_type, bool)
+    { mapped += bytes; });
+
+    mocks.OnCall(mm, memory_manager_x64::add_pages).With(map, size).Do([&](uintptr_t, size_t)
+    { added = true; });
+
+    ehlr.m_state_save->rax = VMCALL_HEAP;                        // r00
+    ehlr.m_state_save->rdx = VMCALL_MAGIC_NUMBER;                // r01
+    ehlr.m_state_save->rcx = 0x1234000;                          // r02
+    ehlr.m_state_save->rbx = MAX_PAGE_POOL;                      // r03
+    ehlr.m_state_save->rsi = VMCALL_HEAP_POOL_PAGE;              // r04
+    ehlr.m_state_save->r08 = g_heap_token_value;                 // r05
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        setup_guest_pt();
+
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_no_exception([&]{ ehlr.m_walk_cache.release(); });
+        this->expect_true(ehlr.m_state_save->rip == g_rip);
+        this->expect_true(ec_sign(ehlr.m_state_save->rdx) == BF_VMCALL_SUCCESS);
+        this->expect_true(mapped == size);
+        this->expect_true(added);
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_vmcall_heap_invalid_pool()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::vmcall);
+    auto &&ehlr = setup_ehlr(vmcs);
+    auto &&mm = setup_mm(mocks);
+    auto &&pt = setup_pt(mocks);
+
+    mocks.NeverCall(mm, memory_manager_x64::add_heap);
+    mocks.NeverCall(mm, memory_manager_x64::add_pages);
+    mocks.NeverCall(pt, root_page_table_x64::map_range);
+
+    ehlr.m_state_save->rax = VMCALL_HEAP;                        // r00
+    ehlr.m_state_save->rdx = VMCALL_MAGIC_NUMBER;                // r01
+    ehlr.m_state_save->rcx = 0x1234000;                          // r02
+    ehlr.m_state_save->rbx = MAX_PAGE_POOL;                      // r03
+    ehlr.m_state_save->rsi = 0x1234;                             // r04
+    ehlr.m_state_save->r08 = g_heap_token_value;                 // r05
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(ehlr.m_state_save->rip == g_rip);
+        this->expect_true(ec_sign(ehlr.m_state_save->rdx) == BF_VMCALL_FAILURE);
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_vmcall_heap_already_mapped()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::vmcall);
+    auto &&ehlr = setup_ehlr(vmcs);
+    auto &&mm = setup_mm(mocks);
+    auto &&pt = setup_pt(mocks);
+
+    auto &&map = reinterpret_cast<uintptr_t>(g_guest_pt);
+    auto &&size = static_cast<size_t>(MAX_HEAP_POOL);
+    auto unmapped = false;
+
+    mocks.OnCall(mm, memory_manager_x64::alloc_map).Return(g_guest_pt);
+    mocks.OnCall(mm, memory_manager_x64::physint_to_virtint).Return(0x1234000);
+    mocks.NeverCall(pt, root_page_table_x64::map_range);
+    mocks.NeverCall(mm, memory_manager_x64::add_heap);
+
+    mocks.OnCall(pt, root_page_table_x64::unmap_range).With(map, size).Do([&](uintptr_t, size_t)
+    { unmapped = true; });
+
+    ehlr.m_state_save->rax = VMCALL_HEAP;                        // r00
+    ehlr.m_state_save->rdx = VMCALL_MAGIC_NUMBER;                // r01
+    ehlr.m_state_save->rcx = 0x1234000;                          // r02
+    ehlr.m_state_save->rbx = MAX_HEAP_POOL;                      // r03
+    ehlr.m_state_save->rsi = VMCALL_HEAP_POOL_HEAP;              // r04
+    ehlr.m_state_save->r08 = g_heap_token_value;                 // r05
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        setup_guest_pt();
+
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_no_exception([&]{ ehlr.m_walk_cache.release(); });
+        this->expect_true(ehlr.m_state_save->rip == g_rip);
+        this->expect_true(ec_sign(ehlr.m_state_save->rdx) == BF_VMCALL_FAILURE);
+        this->expect_true(unmapped);
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_vmcall_heap_user_mode()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::vmcall);
+    auto &&ehlr = setup_ehlr(vmcs);
+    auto &&mm = setup_mm(mocks);
+    auto &&pt = setup_pt(mocks);
+
+    mocks.NeverCall(mm, memory_manager_x64::heap_chunks_needed);
+    mocks.NeverCall(mm, memory_manager_x64::add_heap);
+    mocks.NeverCall(pt, root_page_table_x64::map_range);
+
+    ehlr.m_state_save->rax = VMCALL_HEAP;                        // r00
+    ehlr.m_state_save->rdx = VMCALL_MAGIC_NUMBER;                // r01
+    ehlr.m_state_save->rcx = 0x1234000;                          // r02
+    ehlr.m_state_save->rbx = MAX_HEAP_POOL;                      // r03
+    ehlr.m_state_save->rsi = VMCALL_HEAP_POOL_HEAP;              // r04
+    ehlr.m_state_save->r08 = g_heap_token_value;                 // r05
+
+    g_guest_ss_access_rights = 0x60;
+    auto ___ = gsl::finally([&] { g_guest_ss_access_rights = 0; });
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(ehlr.m_state_save->rip == g_rip);
+        this->expect_true(ec_sign(ehlr.m_state_save->rdx) == BF_VMCALL_FAILURE);
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_vmcall_heap_invalid_token()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::vmcall);
+    auto &&ehlr = setup_ehlr(vmcs);
+    auto &&mm = setup_mm(mocks);
+    auto &&pt = setup_pt(mocks);
+
+    mocks.NeverCall(mm, memory_manager_x64::heap_chunks_needed);
+    mocks.NeverCall(mm, memory_manager_x64::add_heap);
+    mocks.NeverCall(pt, root_page_table_x64::map_range);
+
+    ehlr.m_state_save->rax = VMCALL_HEAP;                        // r00
+    ehlr.m_state_save->rdx = VMCALL_MAGIC_NUMBER;                // r01
+    ehlr.m_state_save->rcx = 0x1234000;                          // r02
+    ehlr.m_state_save->rbx = MAX_HEAP_POOL;                      // r03
+    ehlr.m_state_save->rsi = VMCALL_HEAP_POOL_HEAP;              // r04
+    ehlr.m_state_save->r08 = 0;                                  // r05
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(ehlr.m_state_save->rip == g_rip);
+        this->expect_true(ec_sign(ehlr.m_state_save->rdx) == BF_VMCALL_FAILURE);
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_vmcall_flush()
+{
+    MockRepository mocks;
+    auto &&vmcs = mocks.Mock<vmcs_intel_x64>();
+    auto &&ehlr = setup_ehlr(vmcs);
+    auto &&mm = setup_mm(mocks);
+    setup_pt(mocks);
+
+    mocks.OnCall(vmcs, vmcs_intel_x64::resume);
+    mocks.OnCall(mm, memory_manager_x64::alloc_map).Return(g_guest_pt);
+
+    g_exit_reason = exit_reason::basic_exit_reason::vmcall;
+
+    auto &&vmcall = [&](auto opcode)
+    {
+        ehlr.m_state_save->rax = opcode;
+        ehlr.m_state_save->rdx = VMCALL_MAGIC_NUMBER;
+        ehlr.m_state_save->rcx = VMCALL_VERSION_PROTOCOL;
+
+        ehlr.dispatch();
+        return ec_sign(ehlr.m_state_save->rdx);
+    };
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        setup_guest_pt();
+
+        this->expect_true(ehlr.m_walk_cache.virt_to_phys(0x1234000, 0x1000) == 0x41234000);
+        this->expect_true(vmcall(VMCALL_VERSIONS) == BF_VMCALL_SUCCESS);
+        this->expect_true(ehlr.m_walk_cache.virt_to_phys(0x1234000, 0x1000) == 0x41234000);
+        this->expect_true(ehlr.m_walk_cache.hits() == 1);
+        this->expect_true(ehlr.m_walk_cache.misses() == 1);
+
+        this->expect_true(vmcall(VMCALL_FLUSH) == BF_VMCALL_SUCCESS);
+        this->expect_true(vmcall(VMCALL_VERSIONS) == BF_VMCALL_SUCCESS);
+        this->expect_true(ehlr.m_walk_cache.virt_to_phys(0x1234000, 0x1000) == 0x41234000);
+        this->expect_true(ehlr.m_walk_cache.hits() == 1);
+        this->expect_true(ehlr.m_walk_cache.misses() == 2);
+
+        this->expect_no_exception([&]{ ehlr.m_walk_cache.release(); });
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_vmcall_stats_unknown_index()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::vmcall);
+    auto &&ehlr = setup_ehlr(vmcs);
+    auto &&mm = setup_mm(mocks);
+    setup_pt(mocks);
+
+    mocks.NeverCall(mm, memory_manager_x64::pool_stats);
+
+    ehlr.m_state_save->rax = VMCALL_STATS;                       // r00
+    ehlr.m_state_save->rdx = VMCALL_MAGIC_NUMBER;                // r01
+    ehlr.m_state_save->rcx = 0x1234U;                            // r02
+    ehlr.m_state_save->r11 = 0x1234U;                            // r08
+    ehlr.m_state_save->r12 = 100;                                // r09
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(ehlr.m_state_save->rip == g_rip);
+        this->expect_true(ec_sign(ehlr.m_state_save->rdx) == BF_VMCALL_FAILURE);
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_vmcall_stats_invalid_output()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::vmcall);
+    auto &&ehlr = setup_ehlr(vmcs);
+    auto &&mm = setup_mm(mocks);
+    setup_pt(mocks);
+
+    mocks.NeverCall(mm, memory_manager_x64::pool_stats);
+
+    ehlr.m_state_save->rax = VMCALL_STATS;                       // r00
+    ehlr.m_state_save->rdx = VMCALL_MAGIC_NUMBER;                // r01
+    ehlr.m_state_save->rcx = VMCALL_STATS_MEMORY;                // r02
+    ehlr.m_state_save->r11 = 0x1234U;                            // r08
+    ehlr.m_state_save->r12 = VMCALL_OUT_BUFFER_SIZE + 1;         // r09
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(ehlr.m_state_save->rip == g_rip);
+        this->expect_true(ec_sign(ehlr.m_state_save->rdx) == BF_VMCALL_FAILURE);
+    });
+}
+
 void
 exit_handler_intel_x64_ut::test_vm_exit_reason_vmcall_data_unknown()
 {
@@ -1705,3 +2133,375 @@ exit_handler_intel_x64_ut::test_halt()
         this->expect_no_exception([&]{ ehlr.halt(); });
     });
 }
+
+void
+exit_handler_intel_x64_ut::test_dispatch_register_handler()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::hlt);
+    auto &&ehlr = setup_ehlr(vmcs);
+
+    auto &&called = false;
+
+    auto &&prev = ehlr.register_handler(exit_reason::basic_exit_reason::hlt, [&](exit_handler_intel_x64 &)
+    { called = true; });
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_true(prev == nullptr);
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(called);
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_dispatch_chain_handler()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::cpuid);
+    auto &&ehlr = setup_ehlr(vmcs);
+
+    auto &&count = 0;
+    auto &&prev = ehlr.register_handler(exit_reason::basic_exit_reason::cpuid, nullptr);
+
+    ehlr.register_handler(exit_reason::basic_exit_reason::cpuid, [&](exit_handler_intel_x64 & e)
+    {
+        count++;
+        prev(e);
+    });
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(count == 1);
+        this->expect_true(ehlr.m_state_save->rip == g_rip);
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_dispatch_hooks()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::invd);
+    auto &&ehlr = setup_ehlr(vmcs);
+
+    auto &&order = std::vector<int>{};
+
+    ehlr.register_pre_hook(exit_reason::basic_exit_reason::invd, [&](exit_handler_intel_x64 &) { order.push_back(1); });
+    ehlr.register_pre_hook(exit_reason::basic_exit_reason::invd, [&](exit_handler_intel_x64 &) { order.push_back(2); });
+    ehlr.register_post_hook(exit_reason::basic_exit_reason::invd, [&](exit_handler_intel_x64 &) { order.push_back(4); });
+
+    auto &&prev = ehlr.register_handler(exit_reason::basic_exit_reason::invd, nullptr);
+
+    ehlr.register_handler(exit_reason::basic_exit_reason::invd, [&](exit_handler_intel_x64 & e)
+    {
+        order.push_back(3);
+        prev(e);
+    });
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(order == std::vector<int>({1, 2, 3, 4}));
+        this->expect_true(ehlr.m_state_save->rip == g_rip);
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_dispatch_invalid_args()
+{
+    auto &&ehlr = exit_handler_intel_x64{};
+    auto &&hook = [](exit_handler_intel_x64 &) { };
+
+    this->expect_exception([&] { ehlr.register_handler(exit_handler_num_exit_reasons, hook); }, ""_ut_ffe);
+    this->expect_exception([&] { ehlr.register_pre_hook(exit_handler_num_exit_reasons, hook); }, ""_ut_ffe);
+    this->expect_exception([&] { ehlr.register_post_hook(exit_handler_num_exit_reasons, hook); }, ""_ut_ffe);
+    this->expect_exception([&] { ehlr.register_pre_hook(exit_reason::basic_exit_reason::cpuid, nullptr); }, ""_ut_ffe);
+    this->expect_exception([&] { ehlr.register_post_hook(exit_reason::basic_exit_reason::cpuid, nullptr); }, ""_ut_ffe);
+    this->expect_exception([&] { ehlr.set_dispatch_table(nullptr); }, ""_ut_ffe);
+}
+
+void
+exit_handler_intel_x64_ut::test_dispatch_set_table()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_unhandled(mocks, exit_reason::basic_exit_reason::cpuid);
+    auto &&ehlr = setup_ehlr(vmcs);
+
+    auto &&rip = ehlr.m_state_save->rip;
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&old = ehlr.set_dispatch_table(std::make_unique<exit_handler_intel_x64::dispatch_table_type>());
+
+        this->expect_true(old != nullptr);
+        this->expect_true(gsl::at(*old, exit_reason::basic_exit_reason::cpuid).handler != nullptr);
+        this->expect_true(gsl::at(ehlr.dispatch_table(), exit_reason::basic_exit_reason::cpuid).handler == nullptr);
+
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(ehlr.m_state_save->rip == rip);
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_dispatch_grace_period()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::cpuid);
+    auto &&ehlr = setup_ehlr(vmcs);
+
+    auto mm = mocks.Mock<memory_manager_x64>();
+    mocks.OnCallFunc(memory_manager_x64::instance).Return(mm);
+
+    auto entered = false;
+    auto left = false;
+
+    mocks.OnCall(mm, memory_manager_x64::begin_exit).Do([&] { entered = !left; });
+    mocks.OnCall(mm, memory_manager_x64::end_exit).Do([&] { left = entered; });
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+
+        this->expect_true(entered);
+        this->expect_true(left);
+    });
+}
+
+static uint16_t g_port = 0;
+static uint32_t g_port_value = 0;
+
+extern "C" uint8_t
+__inb(uint16_t port) noexcept
+{ g_port = port; return static_cast<uint8_t>(g_port_value); }
+
+extern "C" uint16_t
+__inw(uint16_t port) noexcept
+{ g_port = port; return static_cast<uint16_t>(g_port_value); }
+
+extern "C" uint32_t
+__ind(uint16_t port) noexcept
+{ g_port = port; return g_port_value; }
+
+extern "C" void
+__outb(uint16_t port, uint8_t val) noexcept
+{ g_port = port; g_port_value = val; }
+
+extern "C" void
+__outw(uint16_t port, uint16_t val) noexcept
+{ g_port = port; g_port_value = val; }
+
+extern "C" void
+__outd(uint16_t port, uint32_t val) noexcept
+{ g_port = port; g_port_value = val; }
+
+using copy_from_guest_type = void(*)(uintptr_t, uintptr_t, void *, size_t, x64::msrs::value_type,
+                                     bfn::page_walk_cache_x64 &);
+
+static void
+copy_from_guest_io(uintptr_t cr3, uintptr_t gva, void *dst, size_t len, x64::msrs::value_type pat,
+                   bfn::page_walk_cache_x64 &cache)
+{
+    (void) cr3;
+    (void) gva;
+    (void) pat;
+    (void) cache;
+
+    std::memset(dst, 0x42, len);
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_io_instruction_decode()
+{
+    auto &&io = exit_handler_intel_x64::decode_io_instruction(0x03F80000UL);
+
+    this->expect_true(io.port == 0x3F8);
+    this->expect_true(io.size == 1);
+    this->expect_false(io.in);
+    this->expect_false(io.string);
+    this->expect_false(io.rep);
+    this->expect_false(io.immediate);
+    this->expect_true(io.address == 0);
+
+    io = exit_handler_intel_x64::decode_io_instruction(0x00600049UL);
+
+    this->expect_true(io.port == 0x60);
+    this->expect_true(io.size == 2);
+    this->expect_true(io.in);
+    this->expect_false(io.string);
+    this->expect_true(io.immediate);
+
+    io = exit_handler_intel_x64::decode_io_instruction(0x0CFC003BUL);
+
+    this->expect_true(io.port == 0xCFC);
+    this->expect_true(io.size == 4);
+    this->expect_true(io.in);
+    this->expect_true(io.string);
+    this->expect_true(io.rep);
+    this->expect_false(io.immediate);
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_io_instruction_register()
+{
+    MockRepository mocks;
+    auto &&vmcs = mocks.Mock<vmcs_intel_x64>();
+    auto &&bitmap = mocks.Mock<vmcs_intel_x64_io_bitmap>();
+
+    mocks.OnCall(vmcs, vmcs_intel_x64::io_bitmap).Do([&]() -> vmcs_intel_x64_io_bitmap & { return *bitmap; });
+    mocks.ExpectCall(bitmap, vmcs_intel_x64_io_bitmap::trap_on_access).With(0x3F8);
+    mocks.ExpectCall(bitmap, vmcs_intel_x64_io_bitmap::trap_on_access).With(0x2F8);
+
+    auto &&out = [](exit_handler_intel_x64 &, const exit_handler_intel_x64::io_instruction_type &, uint32_t) { };
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&ehlr = exit_handler_intel_x64{};
+
+        this->expect_exception([&] { ehlr.register_io_handler(0x3F8, nullptr, nullptr); }, ""_ut_ffe);
+
+        ehlr.register_io_handler(0x3F8, nullptr, out);
+        ehlr.set_vmcs(vmcs);
+        ehlr.register_io_handler(0x2F8, nullptr, out);
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_io_instruction_in()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::io_instruction);
+    auto &&ehlr = setup_ehlr(vmcs);
+
+    ehlr.m_io_handlers[0x60].in = [](exit_handler_intel_x64 &, const exit_handler_intel_x64::io_instruction_type & io)
+    { return io.port == 0x60 && io.size == 1 ? 0xABCDU : 0U; };
+
+    g_exit_qualification = 0x00600048UL;
+    g_state_save.rax = 0x1111111111111111UL;
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(ehlr.m_state_save->rax == 0x11111111111111CDUL);
+        this->expect_true(ehlr.m_state_save->rip == g_rip);
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_io_instruction_in_dword()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::io_instruction);
+    auto &&ehlr = setup_ehlr(vmcs);
+
+    g_exit_qualification = 0x0CFC000BUL;
+    g_state_save.rax = 0x1111111111111111UL;
+    g_port_value = 0x12345678;
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(g_port == 0xCFC);
+        this->expect_true(ehlr.m_state_save->rax == 0x12345678UL);
+        this->expect_true(ehlr.m_state_save->rip == g_rip);
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_io_instruction_out()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::io_instruction);
+    auto &&ehlr = setup_ehlr(vmcs);
+
+    auto &&written = 0U;
+
+    ehlr.m_io_handlers[0x3F8].out = [&](exit_handler_intel_x64 &, const exit_handler_intel_x64::io_instruction_type &, uint32_t value)
+    { written = value; };
+
+    g_exit_qualification = 0x03F80001UL;
+    g_state_save.rax = 0x1111111111112233UL;
+    g_port = 0;
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(written == 0x2233);
+        this->expect_true(g_port == 0);
+        this->expect_true(ehlr.m_state_save->rip == g_rip);
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_io_instruction_pass_through()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::io_instruction);
+    auto &&ehlr = setup_ehlr(vmcs);
+
+    ehlr.m_io_handlers[0x3F8].in = [](exit_handler_intel_x64 &, const exit_handler_intel_x64::io_instruction_type &)
+    { return 0U; };
+
+    g_exit_qualification = 0x03F80000UL;
+    g_state_save.rax = 0x1111111111112233UL;
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(g_port == 0x3F8);
+        this->expect_true(g_port_value == 0x33);
+        this->expect_true(ehlr.m_state_save->rip == g_rip);
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_io_instruction_string()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::io_instruction);
+    auto &&ehlr = setup_ehlr(vmcs);
+
+    mocks.OnCallFuncOverload(static_cast<copy_from_guest_type>(bfn::copy_from_guest)).Do(copy_from_guest_io);
+
+    auto &&written = 0U;
+
+    ehlr.m_io_handlers[0x3F8].out = [&](exit_handler_intel_x64 &, const exit_handler_intel_x64::io_instruction_type &, uint32_t value)
+    { written = value; };
+
+    auto &&rip = ehlr.m_state_save->rip;
+
+    g_exit_qualification = 0x03F80031UL;
+    g_value = 0;
+    g_state_save.rcx = 2;
+    g_state_save.rsi = 0x1000;
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(written == 0x4242);
+        this->expect_true(ehlr.m_state_save->rsi == 0x1002);
+        this->expect_true(ehlr.m_state_save->rcx == 1);
+        this->expect_true(ehlr.m_state_save->rip == rip);
+    });
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_io_instruction_string_rep_zero()
+{
+    MockRepository mocks;
+    auto &&vmcs = setup_vmcs_handled(mocks, exit_reason::basic_exit_reason::io_instruction);
+    auto &&ehlr = setup_ehlr(vmcs);
+
+    mocks.NeverCallFuncOverload(static_cast<copy_from_guest_type>(bfn::copy_from_guest));
+
+    g_exit_qualification = 0x03F80030UL;
+    g_state_save.rcx = 0;
+    g_state_save.rsi = 0x1000;
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(ehlr.m_state_save->rsi == 0x1000);
+        this->expect_true(ehlr.m_state_save->rip == g_rip);
+    });
+}
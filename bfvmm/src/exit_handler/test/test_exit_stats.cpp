@@ -0,0 +1,208 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <test.h>
+
+#include <exit_handler/exit_stats.h>
+#include <exit_handler/exit_handler_intel_x64.h>
+
+#include <memory_manager/memory_manager_x64.h>
+#include <memory_manager/root_page_table_x64.h>
+#include <vmcs/vmcs_intel_x64_32bit_read_only_data_fields.h>
+
+using namespace x64;
+using namespace intel_x64;
+
+extern uint64_t g_tsc;
+extern uint64_t g_tscp;
+extern vmcs::value_type g_exit_reason;
+
+void
+exit_handler_intel_x64_ut::test_exit_stats_bucket()
+{
+    using stats_type = exit_stats<4, 2>;
+
+    this->expect_true(stats_type::bucket(0) == 0);
+    this->expect_true(stats_type::bucket(1) == 0);
+    this->expect_true(stats_type::bucket(2) == 1);
+    this->expect_true(stats_type::bucket(3) == 1);
+    this->expect_true(stats_type::bucket(1023) == 9);
+    this->expect_true(stats_type::bucket(1024) == 10);
+    this->expect_true(stats_type::bucket(0xFFFFFFFFFFFFFFFFUL) == exit_stats_num_buckets - 1);
+}
+
+void
+exit_handler_intel_x64_ut::test_exit_stats_record()
+{
+    auto &&stats = std::make_unique<exit_stats<4, 2>>();
+
+    stats->record_exit(1, 300);
+    stats->record_exit(1, 260);
+    stats->record_exit(2, 5000);
+    stats->record_vmcall(0, 10);
+
+    auto &&report1 = stats->exit_report(1);
+    this->expect_true(report1.count == 2);
+    this->expect_true(report1.cycles == 560);
+    this->expect_true(report1.histogram.at(8) == 2);
+
+    auto &&report2 = stats->exit_report(2);
+    this->expect_true(report2.count == 1);
+    this->expect_true(report2.histogram.at(12) == 1);
+
+    this->expect_true(stats->exit_report(0).count == 0);
+    this->expect_true(stats->vmcall_report(0).count == 1);
+    this->expect_true(stats->vmcall_report(0).histogram.at(3) == 1);
+
+    stats->clear();
+
+    this->expect_true(stats->exit_report(1).count == 0);
+    this->expect_true(stats->exit_report(1).cycles == 0);
+    this->expect_true(stats->exit_report(1).histogram.at(8) == 0);
+    this->expect_true(stats->vmcall_report(0).count == 0);
+}
+
+void
+exit_handler_intel_x64_ut::test_exit_stats_other()
+{
+    auto &&stats = std::make_unique<exit_stats<4, 2>>();
+
+    stats->record_exit(4, 1);
+    stats->record_exit(0xBEEF, 1);
+    stats->record_vmcall(0xBEEF, 1);
+
+    this->expect_true(stats->exit_report(4).count == 2);
+    this->expect_true(stats->exit_report(0xBEEF).count == 2);
+    this->expect_true(stats->vmcall_report(2).count == 1);
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_exit_stats()
+{
+    MockRepository mocks;
+    auto &&vmcs = mocks.Mock<vmcs_intel_x64>();
+
+    mocks.ExpectCall(vmcs, vmcs_intel_x64::resume);
+    mocks.ExpectCall(vmcs, vmcs_intel_x64::resume);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&state_save = state_save_intel_x64{};
+        auto &&ehlr = exit_handler_intel_x64{};
+
+        ehlr.set_vmcs(vmcs);
+        ehlr.set_state_save(&state_save);
+
+        g_tsc = 1000;
+        g_tscp = 1300;
+
+        g_exit_reason = vmcs::exit_reason::basic_exit_reason::cpuid;
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+
+        g_exit_reason = 0x0000BEEF;
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+
+        auto &&report = ehlr.stats().exit_report(vmcs::exit_reason::basic_exit_reason::cpuid);
+        this->expect_true(report.count == 1);
+        this->expect_true(report.cycles == 300);
+        this->expect_true(report.histogram.at(8) == 1);
+
+        this->expect_true(ehlr.stats().exit_report(exit_handler_num_exit_reasons).count == 1);
+    });
+}
+
+alignas(0x1000) static char g_stats_map[0x1000] = {};
+
+static void
+setup_stats_mm(MockRepository &mocks)
+{
+    auto mm = mocks.Mock<memory_manager_x64>();
+    mocks.OnCallFunc(memory_manager_x64::instance).Return(mm);
+
+    mocks.OnCall(mm, memory_manager_x64::alloc_map).Return(g_stats_map);
+    mocks.OnCall(mm, memory_manager_x64::free_map);
+    mocks.OnCall(mm, memory_manager_x64::free_map_deferred);
+    mocks.OnCall(mm, memory_manager_x64::begin_exit);
+    mocks.OnCall(mm, memory_manager_x64::end_exit);
+
+    auto pt = mocks.Mock<root_page_table_x64>();
+    mocks.OnCallFunc(root_pt).Return(pt);
+
+    mocks.OnCall(pt, root_page_table_x64::map_4k);
+    mocks.OnCall(pt, root_page_table_x64::unmap);
+}
+
+void
+exit_handler_intel_x64_ut::test_vm_exit_reason_vmcall_stats_exits()
+{
+    MockRepository mocks;
+    auto &&vmcs = mocks.Mock<vmcs_intel_x64>();
+
+    setup_stats_mm(mocks);
+    mocks.ExpectCall(vmcs, vmcs_intel_x64::resume);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&state_save = state_save_intel_x64{};
+        auto &&ehlr = exit_handler_intel_x64{};
+
+        ehlr.set_vmcs(vmcs);
+        ehlr.set_state_save(&state_save);
+
+        ehlr.stats().record_exit(vmcs::exit_reason::basic_exit_reason::cpuid, 300);
+        ehlr.stats().record_exit(vmcs::exit_reason::basic_exit_reason::cpuid, 600);
+        ehlr.stats().record_exit(35, 10);
+        ehlr.stats().record_vmcall(VMCALL_DATA, 2000);
+
+        g_tsc = 1000;
+        g_tscp = 1300;
+        g_exit_reason = vmcs::exit_reason::basic_exit_reason::vmcall;
+
+        state_save.vcpuid = 2;
+        state_save.rax = VMCALL_STATS;                              // r00
+        state_save.rdx = VMCALL_MAGIC_NUMBER;                       // r01
+        state_save.rcx = VMCALL_STATS_EXITS;                        // r02
+        state_save.rbx = 1;                                         // r03
+        state_save.r11 = 0x1234U;                                   // r08
+        state_save.r12 = 0x1000;                                    // r09
+
+        this->expect_no_exception([&]{ ehlr.dispatch(); });
+        this->expect_true(ec_sign(state_save.rdx) == BF_VMCALL_SUCCESS);
+        this->expect_true(state_save.r10 == VMCALL_DATA_STRING_JSON);
+
+        auto &&ojson = json::parse(std::string(g_stats_map, state_save.r12));
+
+        this->expect_true(ojson["vcpuid"].get<uint64_t>() == 2);
+        this->expect_true(ojson["exits"]["cpuid"]["count"].get<uint64_t>() == 2);
+        this->expect_true(ojson["exits"]["cpuid"]["cycles"].get<uint64_t>() == 900);
+        this->expect_true(ojson["exits"]["cpuid"]["histogram"]["256"].get<uint64_t>() == 1);
+        this->expect_true(ojson["exits"]["cpuid"]["histogram"]["512"].get<uint64_t>() == 1);
+        this->expect_true(ojson["exits"]["35"]["count"].get<uint64_t>() == 1);
+        this->expect_true(ojson["vmcalls"][std::to_string(VMCALL_DATA)]["count"].get<uint64_t>() == 1);
+        this->expect_true(ojson["exits"].count("vmcall") == 0);
+
+        // reset, and then count the stats vmcall itself
+        this->expect_true(ehlr.stats().exit_report(vmcs::exit_reason::basic_exit_reason::cpuid).count == 0);
+        this->expect_true(ehlr.stats().exit_report(vmcs::exit_reason::basic_exit_reason::vmcall).count == 1);
+        this->expect_true(ehlr.stats().vmcall_report(VMCALL_STATS).count == 1);
+        this->expect_true(ehlr.stats().vmcall_report(VMCALL_DATA).count == 0);
+    });
+}
@@ -28,3 +28,8 @@ __attribute__((weak)) thread_context_cpuid(void)
 extern "C" uint64_t
 __attribute__((weak)) thread_context_tlsptr(void)
 { return 0; }
+
+// The unit tests run as if they were in VMX root
+extern "C" uint64_t
+__attribute__((weak)) thread_context_vmx_root(void)
+{ return 1; }
@@ -28,3 +28,9 @@ global __invlpg:function
 __invlpg:
     invlpg [rdi]
     ret
+
+global __flush_tlb:function
+__flush_tlb:
+    mov rax, cr3
+    mov cr3, rax
+    ret
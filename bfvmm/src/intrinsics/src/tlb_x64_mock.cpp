@@ -30,3 +30,10 @@ __attribute__((weak)) __invlpg(const void *virt) noexcept
     std::cerr << __FUNC__ << " called" << '\n';
     abort();
 }
+
+extern "C" void
+__attribute__((weak)) __flush_tlb(void) noexcept
+{
+    std::cerr << __FUNC__ << " called" << '\n';
+    abort();
+}
@@ -374,6 +374,7 @@ intrinsics_ut::list()
     this->test_cpuid_x64_cpuid_edx();
     this->test_cpuid_x64_cpuid_addr_size_phys();
     this->test_cpuid_x64_cpuid_addr_size_linear();
+    this->test_cpuid_x64_cpuid_extended_processor_information_edx_pdpe1gb();
     this->test_cpuid_x64_cpuid_feature_information_ecx_sse3();
     this->test_cpuid_x64_cpuid_feature_information_ecx_pclmulqdq();
     this->test_cpuid_x64_cpuid_feature_information_ecx_dtes64();
@@ -451,6 +452,8 @@ intrinsics_ut::list()
     this->test_cache_x64_clflush();
 
     this->test_tlb_x64_invlpg();
+    this->test_tlb_x64_flush();
+    this->test_tlb_x64_invlpg_range();
 
     this->test_debug_x64_dr7();
 
@@ -373,6 +373,7 @@ private:
     void test_cpuid_x64_cpuid_edx();
     void test_cpuid_x64_cpuid_addr_size_phys();
     void test_cpuid_x64_cpuid_addr_size_linear();
+    void test_cpuid_x64_cpuid_extended_processor_information_edx_pdpe1gb();
     void test_cpuid_x64_cpuid_feature_information_ecx_sse3();
     void test_cpuid_x64_cpuid_feature_information_ecx_pclmulqdq();
     void test_cpuid_x64_cpuid_feature_information_ecx_dtes64();
@@ -450,6 +451,8 @@ private:
     void test_cache_x64_clflush();
 
     void test_tlb_x64_invlpg();
+    void test_tlb_x64_flush();
+    void test_tlb_x64_invlpg_range();
 
     void test_debug_x64_dr7();
 
@@ -132,6 +132,16 @@ intrinsics_ut::test_cpuid_x64_cpuid_addr_size_linear()
     this->expect_true(cpuid::addr_size::linear::get() == 0x10);
 }
 
+void
+intrinsics_ut::test_cpuid_x64_cpuid_extended_processor_information_edx_pdpe1gb()
+{
+    g_edx_cpuid[cpuid::extended_processor_information::addr] = 0x1U << 26;
+    this->expect_true(cpuid::extended_processor_information::edx::pdpe1gb::get());
+
+    g_edx_cpuid[cpuid::extended_processor_information::addr] = ~(0x1U << 26);
+    this->expect_false(cpuid::extended_processor_information::edx::pdpe1gb::get());
+}
+
 void
 intrinsics_ut::test_cpuid_x64_cpuid_feature_information_ecx_sse3()
 {
@@ -385,7 +395,7 @@ intrinsics_ut::test_cpuid_x64_cpuid_feature_information_ecx_aesni()
 void
 intrinsics_ut::test_cpuid_x64_cpuid_feature_information_ecx_xsave()
 {
-    g_ecx_cpuid[cpuid::feature_information::addr] = 0x1UL << 26;
+    g_ecx_cpuid[cpuid::feature_information::addr] = 0x1U << 26;
     this->expect_true(cpuid::feature_information::ecx::xsave::get());
 
     g_ecx_cpuid[cpuid::feature_information::addr] = ~(0x1U << 26);
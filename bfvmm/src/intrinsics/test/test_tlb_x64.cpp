@@ -24,12 +24,51 @@
 
 using namespace x64;
 
+auto g_invlpg_count = 0UL;
+auto g_flush_count = 0UL;
+
 extern "C" void
 __invlpg(const void *virt) noexcept
-{ (void) virt; }
+{ (void) virt; g_invlpg_count++; }
+
+extern "C" void
+__flush_tlb(void) noexcept
+{ g_flush_count++; }
 
 void
 intrinsics_ut::test_tlb_x64_invlpg()
 {
     this->expect_no_exception([&] { tlb::invlpg(this); });
 }
+
+void
+intrinsics_ut::test_tlb_x64_flush()
+{
+    g_flush_count = 0;
+
+    this->expect_no_exception([&] { tlb::flush(); });
+    this->expect_true(g_flush_count == 1);
+}
+
+void
+intrinsics_ut::test_tlb_x64_invlpg_range()
+{
+    g_invlpg_count = 0;
+    g_flush_count = 0;
+
+    tlb::invlpg_range(0x1010, 0x1000);
+    this->expect_true(g_invlpg_count == 2);
+    this->expect_true(g_flush_count == 0);
+
+    g_invlpg_count = 0;
+
+    tlb::invlpg_range(0x1000, TLB_FLUSH_RANGE_THRESHOLD * 0x1000);
+    this->expect_true(g_invlpg_count == TLB_FLUSH_RANGE_THRESHOLD);
+    this->expect_true(g_flush_count == 0);
+
+    g_invlpg_count = 0;
+
+    tlb::invlpg_range(0x1000, (TLB_FLUSH_RANGE_THRESHOLD + 1) * 0x1000);
+    this->expect_true(g_invlpg_count == 0);
+    this->expect_true(g_flush_count == 1);
+}
@@ -26,6 +26,7 @@
 SUBDIRS += src
 SUBDIRS += bin
 SUBDIRS += test
+SUBDIRS += bench
 
 ################################################################################
 # Common
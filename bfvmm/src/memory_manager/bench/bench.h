@@ -0,0 +1,54 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#ifndef BENCH_H
+#define BENCH_H
+
+/// Memory Pool Benchmark
+///
+/// Compares alloc / free latency of the mem_pool and slab_pool on a
+/// fragmented heap.
+///
+void bench_mem_pool();
+
+/// Translation Benchmark
+///
+/// Compares concurrent virt to phys lookup throughput of a mutex protected
+/// std::map with a radix_table.
+///
+void bench_translation();
+
+/// Direct Map Benchmark
+///
+/// Compares map heavy workloads (guest page walks and page copies) when
+/// each physical access maps a window, and when using a direct map.
+///
+void bench_direct_map();
+
+/// TLB Benchmark
+///
+/// Compares the dTLB misses and latency of the VM exit path when the TLB
+/// is flushed on every exit, and when the VMM's entries are tagged.
+///
+void bench_tlb();
+
+#endif
@@ -0,0 +1,199 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <chrono>
+#include <random>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include <bench.h>
+#include <constants.h>
+
+// -----------------------------------------------------------------------------
+// Benchmark
+// -----------------------------------------------------------------------------
+
+// This benchmark compares the two ways the VMM can access physical memory:
+// mapping a window for each access (make_unique_map_x64 without a direct
+// map), and the direct map, where physical memory is mapped once, and an
+// access is pointer arithmetic. Since the VMM's page tables cannot be used
+// from a native process, "physical memory" is a temporary file, a window is
+// an mmap / munmap of one page of that file (which, like the VMM, has to
+// update the page tables and invalidate the TLB entry), and the direct map
+// is a single mmap of the whole file.
+//
+// Two map heavy workloads are measured:
+// - walk: a 4 level guest page walk (4 table reads, and a read of the
+//   resulting page), which is what every guest virtual address translation
+//   does
+// - copy: copying a random page into a buffer, which is what the vmcall
+//   handlers do with their input / output buffers
+
+constexpr const auto bench_num_tables = 8UL;
+constexpr const auto bench_num_data = bench_num_tables * 512UL;
+constexpr const auto bench_num_pages = 3UL + bench_num_tables + bench_num_data;
+constexpr const auto bench_size = bench_num_pages << MAX_PAGE_SHIFT;
+constexpr const auto bench_data = (3UL + bench_num_tables) << MAX_PAGE_SHIFT;
+constexpr const auto bench_iterations = 100000UL;
+
+static volatile uint64_t g_sink;
+
+class bench_phys_mem
+{
+public:
+
+    bench_phys_mem() :
+        m_file(std::tmpfile())
+    {
+        if (m_file == nullptr)
+            throw std::runtime_error("tmpfile failed");
+
+        if (ftruncate(fileno(m_file), bench_size) != 0)
+            throw std::runtime_error("ftruncate failed");
+
+        m_direct = static_cast<uint64_t *>(map(nullptr, 0, bench_size));
+        m_window = mmap(nullptr, MAX_PAGE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (m_window == MAP_FAILED)
+            throw std::runtime_error("mmap failed");
+
+        // pml4 (page 0) -> pdpt (page 1) -> pd (page 2) -> pts (page 3...)
+        // -> data. The low bits of each entry are the present / rw bits.
+
+        m_direct[0] = (1UL << MAX_PAGE_SHIFT) | 3;
+        m_direct[512] = (2UL << MAX_PAGE_SHIFT) | 3;
+
+        for (auto i = 0UL; i < bench_num_tables; i++)
+            m_direct[1024 + i] = ((3UL + i) << MAX_PAGE_SHIFT) | 3;
+
+        for (auto i = 0UL; i < bench_num_data; i++)
+            m_direct[1536 + i] = (bench_data + (i << MAX_PAGE_SHIFT)) | 3;
+
+        for (auto i = 0UL; i < bench_num_data; i++)
+            m_direct[(bench_data >> 3) + (i << 9)] = i;
+    }
+
+    ~bench_phys_mem()
+    {
+        munmap(m_window, MAX_PAGE_SIZE);
+        munmap(m_direct, bench_size);
+        std::fclose(m_file);
+    }
+
+    // Windowed: map the page, access it, unmap it
+    template<class F>
+    auto window(uintptr_t phys, F func)
+    {
+        auto &&page = map(m_window, phys & ~(MAX_PAGE_SIZE - 1), MAX_PAGE_SIZE);
+        auto &&ret = func(static_cast<uint8_t *>(page) + (phys & (MAX_PAGE_SIZE - 1)));
+
+        mmap(m_window, MAX_PAGE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        return ret;
+    }
+
+    // Direct: pointer arithmetic
+    template<class F>
+    auto direct(uintptr_t phys, F func)
+    { return func(reinterpret_cast<uint8_t *>(m_direct) + phys); }
+
+private:
+
+    void *map(void *addr, uintptr_t phys, size_t size)
+    {
+        auto &&flags = MAP_SHARED | (addr != nullptr ? MAP_FIXED : 0);
+        auto &&ptr = mmap(addr, size, PROT_READ | PROT_WRITE, flags, fileno(m_file), static_cast<off_t>(phys));
+
+        if (ptr == MAP_FAILED)
+            throw std::runtime_error("mmap failed");
+
+        return ptr;
+    }
+
+private:
+
+    std::FILE *m_file;
+    uint64_t *m_direct;
+    void *m_window;
+};
+
+template<class A>
+static uint64_t
+walk(A access, uintptr_t index)
+{
+    auto &&read = [](auto offset) { return [offset](uint8_t * ptr) { return *reinterpret_cast<uint64_t *>(ptr + offset); }; };
+
+    auto &&pml4e = access(0, read(0));
+    auto &&pdpte = access(pml4e & ~0xFFFUL, read(0));
+    auto &&pde = access(pdpte & ~0xFFFUL, read((index >> 9) << 3));
+    auto &&pte = access(pde & ~0xFFFUL, read((index & 511) << 3));
+
+    return access(pte & ~0xFFFUL, read(0));
+}
+
+template<class F>
+static double
+measure(F func)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<uintptr_t> dist(0, bench_num_data - 1);
+
+    auto sum = 0UL;
+    auto &&start = std::chrono::high_resolution_clock::now();
+
+    for (auto i = 0UL; i < bench_iterations; i++)
+        sum += func(dist(rng));
+
+    auto &&end = std::chrono::high_resolution_clock::now();
+    auto &&ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    g_sink = sum;
+    return static_cast<double>(ns) / static_cast<double>(bench_iterations);
+}
+
+void
+bench_direct_map()
+{
+    bench_phys_mem mem;
+    alignas(MAX_PAGE_SIZE) static uint8_t buffer[MAX_PAGE_SIZE];
+
+    auto &&windowed = [&](auto phys, auto func) { return mem.window(phys, func); };
+    auto &&direct = [&](auto phys, auto func) { return mem.direct(phys, func); };
+
+    auto &&copy = [](uint8_t * ptr) { std::memcpy(buffer, ptr, MAX_PAGE_SIZE); return uint64_t{buffer[0]} + 1; };
+
+    std::cout << "physical memory access latency (ns)\n";
+    std::cout << "workload\twindowed\tdirect\n";
+
+    std::cout << "walk\t";
+    std::cout << measure([&](auto i) { return walk(windowed, i); }) << '\t';
+    std::cout << measure([&](auto i) { return walk(direct, i); }) << '\n';
+
+    std::cout << "copy\t";
+    std::cout << measure([&](auto i) { return mem.window(bench_data + (i << MAX_PAGE_SHIFT), copy); }) << '\t';
+    std::cout << measure([&](auto i) { return mem.direct(bench_data + (i << MAX_PAGE_SHIFT), copy); }) << '\n';
+
+    std::cout << '\n';
+}
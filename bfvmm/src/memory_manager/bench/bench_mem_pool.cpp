@@ -0,0 +1,122 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <chrono>
+#include <random>
+#include <vector>
+#include <iostream>
+
+#include <bench.h>
+#include <memory_manager/mem_pool.h>
+#include <memory_manager/slab_pool.h>
+
+// -----------------------------------------------------------------------------
+// Benchmark
+// -----------------------------------------------------------------------------
+
+// This benchmark compares the heap's mem_pool with the slab_pool for the
+// small allocations that the VMM performs the most. Both pools are first
+// fragmented by filling most of the heap with allocations of random size and
+// then freeing every other allocation. The latency of an alloc / free pair is
+// then measured for each size class, which, for the mem_pool, eventually
+// wraps around and has to search through the fragmented part of the heap.
+// The same is then measured for allocations too large for the slab_pool,
+// which only the mem_pool can serve.
+// Note that mem_pool never touches the memory of untagged allocations, but
+// the slab_pool does, so the page pool is backed by real memory that is
+// touched before the benchmark starts.
+
+constexpr const auto bench_heap_size = MAX_HEAP_POOL;
+constexpr const auto bench_page_size = MAX_PAGE_POOL;
+constexpr const auto bench_iterations = 10000UL;
+constexpr const auto bench_fragments = 24000UL;
+constexpr const auto bench_large_size = 0x40000UL;
+
+using heap_pool_type = mem_pool<bench_heap_size, MAX_CACHE_LINE_SHIFT>;
+using page_pool_type = mem_pool<bench_page_size, MAX_PAGE_SHIFT>;
+using slab_pool_type = slab_pool<bench_page_size, MAX_PAGE_SHIFT>;
+
+alignas(MAX_PAGE_SIZE) static uint8_t g_page_pool_owner[bench_page_size];
+
+template<class P>
+static void
+fragment(P &pool, std::vector<uintptr_t> &addrs)
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> dist(16, 512);
+
+    for (auto i = 0UL; i < bench_fragments; i++)
+        addrs.push_back(pool.alloc(dist(rng)));
+
+    for (auto i = 0UL; i < addrs.size(); i += 2)
+        pool.free(addrs[i]);
+}
+
+template<class P>
+static double
+measure(P &pool, size_t size)
+{
+    auto &&start = std::chrono::high_resolution_clock::now();
+
+    for (auto i = 0UL; i < bench_iterations; i++)
+        pool.free(pool.alloc(size));
+
+    auto &&end = std::chrono::high_resolution_clock::now();
+    auto &&ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    return static_cast<double>(ns) / static_cast<double>(bench_iterations);
+}
+
+void
+bench_mem_pool()
+{
+    __builtin_memset(g_page_pool_owner, 0, sizeof(g_page_pool_owner));
+
+    auto &&heap_pool = std::make_unique<heap_pool_type>(MAX_PAGE_SIZE);
+    auto &&page_pool = std::make_unique<page_pool_type>(reinterpret_cast<uintptr_t>(g_page_pool_owner));
+    auto &&slab_pool = std::make_unique<slab_pool_type>(*page_pool, reinterpret_cast<uintptr_t>(g_page_pool_owner));
+
+    std::vector<uintptr_t> heap_addrs;
+    std::vector<uintptr_t> slab_addrs;
+
+    fragment(*heap_pool, heap_addrs);
+    fragment(*slab_pool, slab_addrs);
+
+    std::cout << "alloc / free latency (ns) on a fragmented heap\n";
+    std::cout << "size\tmem_pool\tslab_pool\n";
+
+    for (auto size = 16UL; size <= slab_pool_type::max_size(); size <<= 1)
+    {
+        std::cout << size << '\t';
+        std::cout << measure(*heap_pool, size) << '\t';
+        std::cout << measure(*slab_pool, size) << '\n';
+    }
+
+    std::cout << '\n';
+
+    std::cout << "alloc / free latency (ns) of large allocations on a fragmented heap\n";
+    std::cout << "size\tmem_pool\n";
+
+    for (auto size = slab_pool_type::max_size() << 1; size <= bench_large_size; size <<= 1)
+        std::cout << size << '\t' << measure(*heap_pool, size) << '\n';
+
+    std::cout << '\n';
+}
@@ -0,0 +1,215 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <chrono>
+#include <random>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include <bench.h>
+#include <constants.h>
+
+// -----------------------------------------------------------------------------
+// Benchmark
+// -----------------------------------------------------------------------------
+
+// This benchmark models the TLB behaviour of the VM exit path. On each exit,
+// the VMM touches the same small set of pages (its code, the exit handler's
+// stack, the state save area, the vCPU's objects on the heap, ...), and
+// between exits, the guest touches its own memory.
+//
+// Without VPIDs, PCIDs and global pages, every VM exit and entry discards
+// the TLB, so each exit starts with a cold TLB, and the VMM's pages have to
+// be walked again. With them, the VMM's entries are still there on the next
+// exit (unless the guest evicted them). Since the VMM's page tables cannot
+// be used from a native process, a VM exit / entry is modelled as a full
+// flush of this process' TLB entries, which Linux does when the protection
+// of more than a few dozen pages is changed (tlb_single_page_flush_ceiling),
+// and the tagged case simply does not flush.
+//
+// The dTLB load misses of the exit path are counted using perf when it is
+// available (perf_event_paranoid permitting), and the latency of the exit
+// path is always reported.
+
+constexpr const auto bench_exit_pages = 24UL;
+constexpr const auto bench_guest_pages = 4096UL;
+constexpr const auto bench_guest_touches = 64UL;
+constexpr const auto bench_flush_pages = 64UL;
+constexpr const auto bench_exits = 100000UL;
+
+static volatile uint64_t g_sink;
+
+class bench_pages
+{
+public:
+
+    bench_pages(size_t num) :
+        m_size(num << MAX_PAGE_SHIFT)
+    {
+        m_mem = mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+        if (m_mem == MAP_FAILED)
+            throw std::runtime_error("mmap failed");
+
+        // Each page has to use its own TLB entry
+
+        madvise(m_mem, m_size, MADV_NOHUGEPAGE);
+        std::memset(m_mem, 1, m_size);
+    }
+
+    ~bench_pages()
+    { munmap(m_mem, m_size); }
+
+    uint64_t &at(size_t page, size_t offset)
+    { return static_cast<uint64_t *>(m_mem)[(page << (MAX_PAGE_SHIFT - 3)) + offset]; }
+
+    void flush()
+    {
+        if (mprotect(m_mem, m_size, PROT_READ) != 0 || mprotect(m_mem, m_size, PROT_READ | PROT_WRITE) != 0)
+            throw std::runtime_error("mprotect failed");
+    }
+
+private:
+
+    void *m_mem;
+    size_t m_size;
+};
+
+class bench_dtlb_misses
+{
+public:
+
+    bench_dtlb_misses()
+    {
+        perf_event_attr attr{};
+
+        attr.type = PERF_TYPE_HW_CACHE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                      (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        m_fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+
+    ~bench_dtlb_misses()
+    {
+        if (m_fd >= 0)
+            close(m_fd);
+    }
+
+    bool valid() const
+    { return m_fd >= 0; }
+
+    void start()
+    {
+        if (m_fd >= 0)
+            ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+
+    void stop()
+    {
+        if (m_fd >= 0)
+            ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+
+    uint64_t get()
+    {
+        uint64_t count = 0;
+
+        if (m_fd >= 0 && read(m_fd, &count, sizeof(count)) != sizeof(count))
+            count = 0;
+
+        return count;
+    }
+
+private:
+
+    int m_fd;
+};
+
+static void
+measure(const char *name, bool flush)
+{
+    bench_pages vmm(bench_exit_pages);
+    bench_pages guest(bench_guest_pages);
+    bench_pages flusher(bench_flush_pages);
+    bench_dtlb_misses misses;
+
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> dist(0, bench_guest_pages - 1);
+
+    auto sum = 0UL;
+    auto ns = 0L;
+
+    for (auto i = 0UL; i < bench_exits; i++)
+    {
+        for (auto j = 0UL; j < bench_guest_touches; j++)
+            sum += guest.at(dist(rng), j)++;
+
+        if (flush)
+            flusher.flush();
+
+        misses.start();
+        auto &&start = std::chrono::high_resolution_clock::now();
+
+        for (auto page = 0UL; page < bench_exit_pages; page++)
+            sum += vmm.at(page, (i + page) & 511)++;
+
+        auto &&end = std::chrono::high_resolution_clock::now();
+        misses.stop();
+
+        ns += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    }
+
+    g_sink = sum;
+
+    std::cout << name << '\t';
+
+    if (misses.valid())
+        std::cout << static_cast<double>(misses.get()) / static_cast<double>(bench_exits) << '\t';
+    else
+        std::cout << "n/a" << '\t';
+
+    std::cout << static_cast<double>(ns) / static_cast<double>(bench_exits) << '\n';
+}
+
+void
+bench_tlb()
+{
+    std::cout << "exit path TLB misses (" << bench_exit_pages << " VMM pages per exit)\n";
+    std::cout << "mode\tdtlb misses / exit\tns / exit\n";
+
+    measure("flushed", true);
+    measure("tagged", false);
+
+    std::cout << '\n';
+}
@@ -0,0 +1,132 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#include <map>
+#include <mutex>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+#include <iostream>
+
+#include <bench.h>
+#include <constants.h>
+#include <memory_manager/radix_table.h>
+
+// -----------------------------------------------------------------------------
+// Benchmark
+// -----------------------------------------------------------------------------
+
+// This benchmark compares the virt to phys lookup throughput of the memory
+// manager's old design (a std::map protected by a mutex) with the
+// radix_table it now uses. Both are filled with one entry per page of the
+// page pool, starting at a kernel-like virtual address, and then each thread
+// performs random lookups. The benchmark is run with an increasing number of
+// threads, up to the number of cores on the system, to show how each design
+// scales as more cores perform lookups at the same time.
+
+constexpr const auto bench_num_pages = MAX_PAGE_POOL >> MAX_PAGE_SHIFT;
+constexpr const auto bench_virt_base = 0x7F0000000000UL >> MAX_PAGE_SHIFT;
+constexpr const auto bench_phys_base = 0x100000000UL;
+constexpr const auto bench_lookups = 1000000UL;
+
+class bench_map
+{
+public:
+
+    void set(uintptr_t key, uintptr_t value)
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        m_map[key] = value;
+    }
+
+    uintptr_t get(uintptr_t key) const
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        return m_map.at(key);
+    }
+
+private:
+
+    mutable std::mutex m_mutex;
+    std::map<uintptr_t, uintptr_t> m_map;
+};
+
+template<class T>
+static double
+measure(const T &table, unsigned num_threads)
+{
+    std::vector<std::thread> threads;
+    std::vector<uintptr_t> sums(num_threads);
+
+    auto &&start = std::chrono::high_resolution_clock::now();
+
+    for (auto t = 0U; t < num_threads; t++)
+    {
+        threads.emplace_back([&, t]
+        {
+            std::mt19937 rng(t);
+            std::uniform_int_distribution<uintptr_t> dist(0, bench_num_pages - 1);
+
+            auto sum = 0UL;
+            for (auto i = 0UL; i < bench_lookups; i++)
+                sum += table.get(bench_virt_base + dist(rng));
+
+            sums.at(t) = sum;
+        });
+    }
+
+    for (auto &&thread : threads)
+        thread.join();
+
+    auto &&end = std::chrono::high_resolution_clock::now();
+    auto &&ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+
+    return static_cast<double>(bench_lookups * num_threads) * 1000.0 / static_cast<double>(ns);
+}
+
+void
+bench_translation()
+{
+    auto &&map = std::make_unique<bench_map>();
+    auto &&table = std::make_unique<radix_table<36>>();
+
+    for (auto i = 0UL; i < bench_num_pages; i++)
+    {
+        map->set(bench_virt_base + i, bench_phys_base + (i << MAX_PAGE_SHIFT));
+        table->set(bench_virt_base + i, bench_phys_base + (i << MAX_PAGE_SHIFT));
+    }
+
+    auto &&max_threads = std::thread::hardware_concurrency();
+
+    std::cout << "virt to phys lookups (millions / sec)\n";
+    std::cout << "threads\tstd::map\tradix_table\n";
+
+    for (auto num_threads = 1U; num_threads <= max_threads; num_threads <<= 1)
+    {
+        std::cout << num_threads << '\t';
+        std::cout << measure(*map, num_threads) << '\t';
+        std::cout << measure(*table, num_threads) << '\n';
+    }
+
+    std::cout << '\n';
+}
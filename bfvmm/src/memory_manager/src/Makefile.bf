@@ -64,11 +64,15 @@ NATIVE_OUTDIR+=%BUILD_REL%/../bin
 # Sources
 ################################################################################
 
+SOURCES+=guest_copy_x64.cpp
 SOURCES+=map_ptr_x64.cpp
+SOURCES+=mem_tag.cpp
 SOURCES+=memory_manager_x64.cpp
 SOURCES+=page_table_x64.cpp
 SOURCES+=page_table_entry_x64.cpp
+SOURCES+=page_walk_cache_x64.cpp
 SOURCES+=root_page_table_x64.cpp
+SOURCES+=temp_map_x64.cpp
 HEADERS=
 
 INCLUDE_PATHS+=./
@@ -0,0 +1,223 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <gsl/gsl>
+
+#include <algorithm>
+#include <cstring>
+
+#include <memory_manager/guest_copy_x64.h>
+
+namespace bfn
+{
+
+guest_sg_iterator_x64::guest_sg_iterator_x64(
+    integer_pointer virt, integer_pointer cr3, size_type size, x64::msrs::value_type pat) :
+
+    m_virt(virt),
+    m_cr3(cr3),
+    m_size(size),
+    m_pat(pat),
+    m_local(std::make_unique<page_walk_cache_x64>()),
+    m_cache(m_local.get()),
+    m_pending(false),
+    m_next{}
+{
+    expects(virt != 0);
+    expects(cr3 != 0);
+    expects(lower(cr3) == 0);
+}
+
+guest_sg_iterator_x64::guest_sg_iterator_x64(
+    integer_pointer virt, integer_pointer cr3, size_type size, x64::msrs::value_type pat,
+    page_walk_cache_x64 &cache) :
+
+    m_virt(virt),
+    m_cr3(cr3),
+    m_size(size),
+    m_pat(pat),
+    m_cache(&cache),
+    m_pending(false),
+    m_next{}
+{
+    expects(virt != 0);
+    expects(cr3 != 0);
+    expects(lower(cr3) == 0);
+}
+
+bool
+guest_sg_iterator_x64::next(segment_type &segment)
+{
+    if (m_pending)
+    {
+        segment = m_next;
+        m_pending = false;
+    }
+    else
+    {
+        if (m_size == 0)
+            return false;
+
+        segment = this->translate();
+    }
+
+    while (m_size != 0)
+    {
+        m_next = this->translate();
+
+        if (m_next.phys != segment.phys + segment.size || m_next.attr != segment.attr ||
+            m_next.writable != segment.writable)
+        {
+            m_pending = true;
+            break;
+        }
+
+        segment.size += m_next.size;
+    }
+
+    return true;
+}
+
+guest_sg_iterator_x64::segment_type
+guest_sg_iterator_x64::translate()
+{
+    auto &&result = m_cache->translate(m_virt, m_cr3);
+
+    auto &&perm = x64::memory_attr::rw;
+    auto &&type = x64::msrs::ia32_pat::pa(m_pat, result.pati);
+
+    auto size = std::min(m_size, result.size - (m_virt & (result.size - 1)));
+
+    m_virt += size;
+    m_size -= size;
+
+    return {result.phys, size, x64::memory_attr::mem_type_to_attr(perm, type), result.writable};
+}
+
+template<class F> static void
+copy_segments(guest_sg_iterator_x64 &iter, F func)
+{
+    guest_sg_iterator_x64::segment_type segment;
+
+    while (iter.next(segment))
+    {
+        // Memory that is write-back, and covered by the direct map, is
+        // already mapped, so the whole segment can be copied at once.
+
+        if (segment.attr == x64::memory_attr::rw_wb && segment.phys + segment.size <= direct_map_size())
+        {
+            if (auto &&addr = direct_map_addr(upper(segment.phys)))
+            {
+                func(reinterpret_cast<uint8_t *>(addr + lower(segment.phys)), segment.size);
+                continue;
+            }
+        }
+
+        for (auto offset = 0UL; offset < segment.size;)
+        {
+            auto &&phys = segment.phys + offset;
+            auto size = std::min(segment.size - offset, x64::page_size - lower(phys));
+
+            auto &&map = make_unique_map_x64<uint8_t>(upper(phys), segment.attr);
+            func(map.get() + lower(phys), size);
+
+            offset += size;
+        }
+    }
+}
+
+static void
+copy_from(guest_sg_iterator_x64 &iter, void *dst)
+{
+    expects(dst != nullptr);
+
+    auto out = static_cast<uint8_t *>(dst);
+
+    copy_segments(iter, [&](const uint8_t *ptr, size_t size)
+    {
+        std::memcpy(out, ptr, size);
+        out += size;
+    });
+}
+
+static void
+check_writable(guest_sg_iterator_x64 &iter)
+{
+    guest_sg_iterator_x64::segment_type segment;
+
+    while (iter.next(segment))
+    {
+        if (!segment.writable)
+            throw std::runtime_error("copy_to_guest: guest page is not writable");
+    }
+}
+
+static void
+copy_to(guest_sg_iterator_x64 &iter, const void *src)
+{
+    expects(src != nullptr);
+
+    auto in = static_cast<const uint8_t *>(src);
+
+    copy_segments(iter, [&](uint8_t *ptr, size_t size)
+    {
+        std::memcpy(ptr, in, size);
+        in += size;
+    });
+}
+
+void
+copy_from_guest(uintptr_t cr3, uintptr_t gva, void *dst, size_t len, x64::msrs::value_type pat)
+{
+    guest_sg_iterator_x64 iter(gva, cr3, len, pat);
+    copy_from(iter, dst);
+}
+
+void
+copy_from_guest(uintptr_t cr3, uintptr_t gva, void *dst, size_t len, x64::msrs::value_type pat,
+                page_walk_cache_x64 &cache)
+{
+    guest_sg_iterator_x64 iter(gva, cr3, len, pat, cache);
+    copy_from(iter, dst);
+}
+
+void
+copy_to_guest(uintptr_t cr3, uintptr_t gva, const void *src, size_t len, x64::msrs::value_type pat)
+{
+    // the range is walked twice, so the walk has to be cached
+    auto &&cache = std::make_unique<page_walk_cache_x64>();
+    copy_to_guest(cr3, gva, src, len, pat, *cache);
+}
+
+void
+copy_to_guest(uintptr_t cr3, uintptr_t gva, const void *src, size_t len, x64::msrs::value_type pat,
+              page_walk_cache_x64 &cache)
+{
+    expects(src != nullptr);
+
+    guest_sg_iterator_x64 check(gva, cr3, len, pat, cache);
+    check_writable(check);
+
+    guest_sg_iterator_x64 iter(gva, cr3, len, pat, cache);
+    copy_to(iter, src);
+}
+
+}
@@ -42,7 +42,7 @@ __attribute__((weak)) map_with_cr3(
     expects(lower(cr3) == 0);
     expects(size != 0);
 
-    for (auto offset = 0UL; offset < size; offset += x64::page_size)
+    for (auto offset = 0UL; offset < size;)
     {
         uintptr_t from;
         uintptr_t phys;
@@ -107,8 +107,18 @@ __attribute__((weak)) map_with_cr3(
 
         auto &&perm = x64::memory_attr::rw;
         auto &&type = x64::msrs::ia32_pat::pa(pat, pati);
+        auto &&attr = x64::memory_attr::mem_type_to_attr(perm, type);
 
-        g_pt->map_4k(vadr, upper(padr), x64::memory_attr::mem_type_to_attr(perm, type));
+        if (can_map_2m(vadr, upper(current_virt), 1UL << from, size - offset))
+        {
+            g_pt->map_2m(vadr, upper(padr, x64::page_table::pd::from), attr);
+            offset += x64::page_table::pd::size_bytes;
+        }
+        else
+        {
+            g_pt->map_4k(vadr, upper(padr), attr);
+            offset += x64::page_size;
+        }
     }
 }
 
@@ -0,0 +1,119 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <gsl/gsl>
+
+#include <array>
+#include <atomic>
+
+#include <constants.h>
+#include <thread_context.h>
+#include <memory_manager/mem_tag.h>
+
+// -----------------------------------------------------------------------------
+// Global Memory
+// -----------------------------------------------------------------------------
+
+static std::array<std::atomic<uint8_t>, MAX_NUM_CPUS + 1> g_mem_tags = {};
+
+// -----------------------------------------------------------------------------
+// Implementation
+// -----------------------------------------------------------------------------
+
+static std::atomic<uint8_t> &
+mem_tag_slot() noexcept
+{
+    auto &&cpuid = thread_context_cpuid();
+    return gsl::at(g_mem_tags, cpuid < MAX_NUM_CPUS ? cpuid : MAX_NUM_CPUS);
+}
+
+mem_tag::type
+current_mem_tag() noexcept
+{ return static_cast<mem_tag::type>(mem_tag_slot().load(std::memory_order_relaxed)); }
+
+mem_tag::type
+set_current_mem_tag(mem_tag::type tag) noexcept
+{
+    uint8_t value = static_cast<uint64_t>(tag) < mem_tag_num_tags ? static_cast<uint8_t>(tag) : uint8_t{0};
+    return static_cast<mem_tag::type>(mem_tag_slot().exchange(value, std::memory_order_relaxed));
+}
+
+const char *
+mem_tag_name(mem_tag::type tag) noexcept
+{
+    switch (tag)
+    {
+        case mem_tag::untagged:
+            return "untagged";
+
+        case mem_tag::vcpu_factory:
+            return "vcpu_factory";
+
+        case mem_tag::user_data:
+            return "user_data";
+
+        case mem_tag::vmxon:
+            return "vmxon";
+
+        case mem_tag::vmcs:
+            return "vmcs";
+
+        case mem_tag::exit_handler_stack:
+            return "exit_handler_stack";
+
+        case mem_tag::state_save:
+            return "state_save";
+
+        case mem_tag::debug_ring:
+            return "debug_ring";
+
+        default:
+            return "user";
+    }
+}
+
+void *
+operator new(std::size_t size, mem_tag::type tag)
+{
+    mem_tag_scope scope(tag);
+    return ::operator new(size);
+}
+
+void *
+operator new[](std::size_t size, mem_tag::type tag)
+{
+    mem_tag_scope scope(tag);
+    return ::operator new[](size);
+}
+
+void
+operator delete(void *ptr, mem_tag::type tag) noexcept
+{
+    (void) tag;
+    ::operator delete(ptr);
+}
+
+void
+operator delete[](void *ptr, mem_tag::type tag) noexcept
+{
+    (void) tag;
+    ::operator delete[](ptr);
+}
@@ -21,6 +21,8 @@
 
 #include <gsl/gsl>
 
+#include <new>
+
 #include <constants.h>
 #include <guard_exceptions.h>
 #include <memory_manager/mem_pool.h>
@@ -29,6 +31,8 @@
 #include <memory_manager/memory_manager_x64.h>
 
 #include <intrinsics/x64.h>
+#include <intrinsics/tlb_x64.h>
+#include <intrinsics/rdtsc_x64.h>
 using namespace x64;
 
 // -----------------------------------------------------------------------------
@@ -42,12 +46,47 @@ uint8_t g_page_pool_owner[MAX_PAGE_POOL] __attribute__((aligned(page_size))) = {
 
 /// \endcond
 
+// -----------------------------------------------------------------------------
+// Pool Generation
+// -----------------------------------------------------------------------------
+
+// Usage can only cross HEAP_HIGH_WATER_MARK on an allocation, so the driver
+// entry only needs to ask how many chunks are needed when this has changed.
+
+std::atomic<uint64_t> g_pool_generation{0};
+
+// -----------------------------------------------------------------------------
+// Heap Token
+// -----------------------------------------------------------------------------
+
+// There is no entropy source that every CPU the VMM runs on provides, so
+// the token is the TSC at load mixed with the address of the token
+// (splitmix64's finalizer). It only has to keep guest software that cannot
+// read the VMM's memory from guessing it. 0 is never issued, as that is
+// what is left behind once the driver entry has taken the token.
+
+uint64_t g_heap_token = 0;
+
+static uint64_t
+make_heap_token() noexcept
+{
+    auto token = x64::read_tsc::get() ^ reinterpret_cast<uint64_t>(&g_heap_token);
+
+    token = (token ^ (token >> 30)) * 0xBF58476D1CE4E5B9UL;
+    token = (token ^ (token >> 27)) * 0x94D049BB133111EBUL;
+    token = token ^ (token >> 31);
+
+    return token != 0 ? token : 1;
+}
+
 // -----------------------------------------------------------------------------
 // Mutexes
 // -----------------------------------------------------------------------------
 
 #include <mutex>
 std::mutex g_add_md_mutex;
+std::mutex g_deferred_map_mutex;
+std::mutex g_retired_map_mutex;
 
 // -----------------------------------------------------------------------------
 // Implementation
@@ -62,51 +101,296 @@ memory_manager_x64::instance() noexcept
     return &self;
 }
 
+template<class alloc_type>
+static memory_manager_x64::pointer
+record_alloc(memory_manager_x64::stats_type &stats,
+             memory_manager_x64::size_type size,
+             memory_manager_x64::size_type actual,
+             alloc_type alloc) noexcept
+{
+    try
+    {
+        auto &&addr = alloc();
+        stats.record_alloc(size, actual);
+
+        return reinterpret_cast<memory_manager_x64::pointer>(addr);
+    }
+    catch (...)
+    { }
+
+    stats.record_failure();
+    return nullptr;
+}
+
+template<class alloc_type>
+static memory_manager_x64::pointer
+record_pool_alloc(memory_manager_x64::stats_type &stats,
+                  memory_manager_x64::size_type size,
+                  memory_manager_x64::size_type actual,
+                  alloc_type alloc) noexcept
+{
+    auto &&ptr = record_alloc(stats, size, actual, alloc);
+
+    if (ptr != nullptr)
+        g_pool_generation.fetch_add(1, std::memory_order_relaxed);
+
+    return ptr;
+}
+
+static void
+record_free(memory_manager_x64::stats_type &stats,
+            memory_manager_x64::size_type freed) noexcept
+{
+    if (freed != 0)
+        stats.record_free(freed);
+}
+
+static memory_manager_x64::size_type
+live_bytes(const memory_manager_x64::stats_type &stats) noexcept
+{
+    auto &&counters = stats.report();
+    return counters.bytes_allocated - counters.bytes_freed;
+}
+
+static memory_manager_x64::size_type
+round_up(memory_manager_x64::size_type size, memory_manager_x64::size_type align) noexcept
+{ return (size + align - 1) & ~(align - 1); }
+
 memory_manager_x64::pointer
 memory_manager_x64::alloc(size_type size) noexcept
 {
     if (size == 0)
         return nullptr;
 
-    try
+    auto &&tag = current_mem_tag();
+
+    if (lower(size) == 0)
     {
-        if (lower(size) == 0)
-            return reinterpret_cast<pointer>(g_page_pool.alloc(size));
+        auto &&actual = page_size << page_pool_type::size_to_order(size);
+        auto &&ptr = record_pool_alloc(m_page_stats, size, actual, [&] { return g_page_pool.alloc(size, tag); });
 
-        return reinterpret_cast<pointer>(g_heap_pool.alloc(size));
+        return record_tag(ptr, tag, actual);
     }
-    catch (...)
-    { }
 
-    return nullptr;
+    if (size <= g_slab_cache.max_size())
+    {
+        auto &&actual = slab_pool_type::class_to_size(slab_pool_type::size_to_class(size));
+        return this->alloc_slab(size, actual, tag);
+    }
+
+    auto &&actual = round_up(size, cache_line_size);
+    auto &&ptr = record_pool_alloc(m_heap_stats, size, actual, [&] { return g_heap_pool.alloc(size, tag); });
+
+    return record_tag(ptr, tag, actual);
 }
 
 memory_manager_x64::pointer
-memory_manager_x64::alloc_map(size_type size) noexcept
+memory_manager_x64::alloc_contiguous(size_type order) noexcept
+{
+    auto &&tag = current_mem_tag();
+    auto &&size = page_size << order;
+    auto &&ptr = record_pool_alloc(m_page_stats, size, size, [&]
+    {
+        // The page pool is only virtually contiguous, so a block that is not
+        // also physically contiguous and aligned is held on to (so that the
+        // pool does not hand it out again) until a block that is has been
+        // found, or too many blocks have been tried. The blocks that are held
+        // on to are linked together using their first word.
+
+        integer_pointer skipped = 0;
+
+        auto ___ = gsl::finally([&]
+        {
+            while (skipped != 0)
+            {
+                auto next = *reinterpret_cast<integer_pointer *>(skipped);
+
+                g_page_pool.free(skipped);
+                skipped = next;
+            }
+        });
+
+        for (auto i = 0UL; i < memory_manager_contiguous_tries; i++)
+        {
+            auto &&addr = g_page_pool.alloc_contiguous(order, tag);
+
+            if (this->is_phys_block(addr, size))
+                return addr;
+
+            *reinterpret_cast<integer_pointer *>(addr) = skipped;
+            skipped = addr;
+        }
+
+        throw std::bad_alloc();
+    });
+
+    return record_tag(ptr, tag, size);
+}
+
+memory_manager_x64::pointer
+memory_manager_x64::alloc_aligned(size_type size, size_type align) noexcept
 {
+    if (size == 0 || align == 0 || (align & (align - 1)) != 0)
+        return nullptr;
+
+    auto &&tag = current_mem_tag();
+
+    if (size <= g_slab_cache.max_size() && align <= g_slab_cache.max_size())
+    {
+        auto &&slab_size = size > align ? size : align;
+        auto &&actual = slab_pool_type::class_to_size(slab_pool_type::size_to_class(slab_size));
+
+        return this->alloc_slab(slab_size, actual, tag);
+    }
+
+    if (align <= cache_line_size && lower(size) != 0)
+    {
+        auto &&actual = round_up(size, cache_line_size);
+        auto &&ptr = record_pool_alloc(m_heap_stats, size, actual, [&] { return g_heap_pool.alloc(size, tag); });
+
+        return record_tag(ptr, tag, actual);
+    }
+
+    auto &&actual = page_size << page_pool_type::size_to_order(size);
+    auto &&ptr = record_pool_alloc(m_page_stats, size, actual, [&] { return g_page_pool.alloc_aligned(size, align, tag); });
+
+    return record_tag(ptr, tag, actual);
+}
+
+memory_manager_x64::pointer
+memory_manager_x64::realloc(pointer ptr, size_type size) noexcept
+{
+    if (ptr == nullptr)
+        return this->alloc(size);
+
     if (size == 0)
+    {
+        this->free(ptr);
         return nullptr;
+    }
 
-    try
+    auto &&uintptr = reinterpret_cast<integer_pointer>(ptr);
+    auto &&old_size = this->size(ptr);
+
+    if (old_size == 0)
+        return nullptr;
+
+    auto &&heap = g_heap_pool.contains(uintptr);
+    auto &&tag = this->find_tag(uintptr);
+
+    if (heap)
     {
-        return reinterpret_cast<pointer>(g_mem_map_pool.alloc(size));
+        if (g_heap_pool.resize(uintptr, size))
+        {
+            auto &&actual = round_up(size, cache_line_size);
+
+            m_heap_stats.record_free(old_size);
+            m_heap_stats.record_alloc(size, actual);
+            g_pool_generation.fetch_add(1, std::memory_order_relaxed);
+
+            record_tag_free(tag, old_size);
+            return record_tag(ptr, tag, actual);
+        }
+    }
+    else
+    {
+        if (size <= old_size && size > (old_size >> 1))
+            return ptr;
     }
-    catch (...)
-    { }
 
-    return nullptr;
+    mem_tag_scope scope(tag);
+    auto &&new_ptr = this->alloc(size);
+
+    if (new_ptr == nullptr)
+        return nullptr;
+
+    __builtin_memcpy(new_ptr, ptr, size < old_size ? size : old_size);
+    this->free(ptr);
+
+    return new_ptr;
+}
+
+memory_manager_x64::pointer
+memory_manager_x64::alloc_map(size_type size) noexcept
+{
+    if (size == 0)
+        return nullptr;
+
+    auto &&actual = round_up(size, page_size);
+    return record_alloc(m_map_stats, size, actual, [&]
+    {
+        try
+        {
+            return g_mem_map_pool.alloc(size);
+        }
+        catch (...)
+        {
+            // Some of the map pool might only be waiting on a deferred unmap
+
+            this->flush_deferred_maps();
+        }
+
+        return g_mem_map_pool.alloc(size);
+    });
+}
+
+memory_manager_x64::pointer
+memory_manager_x64::alloc_map_aligned(size_type size, size_type align, size_type offset) noexcept
+{
+    if (size == 0)
+        return nullptr;
+
+    auto &&actual = round_up(size, page_size);
+    return record_alloc(m_map_stats, size, actual, [&]
+    {
+        try
+        {
+            return g_mem_map_pool.alloc_aligned(size, align, offset);
+        }
+        catch (...)
+        {
+            this->flush_deferred_maps();
+        }
+
+        return g_mem_map_pool.alloc_aligned(size, align, offset);
+    });
 }
 
 void
 memory_manager_x64::free(pointer ptr) noexcept
 {
     auto uintptr = reinterpret_cast<integer_pointer>(ptr);
+    uint8_t tag = mem_tag::untagged;
 
     if (g_heap_pool.contains(uintptr))
-        return g_heap_pool.free(uintptr);
+    {
+        auto &&freed = g_heap_pool.free(uintptr, &tag);
+
+        record_tag_free(tag, freed);
+        return record_free(m_heap_stats, freed);
+    }
+
+    if (g_slab_pool.contains(uintptr))
+    {
+        tag = g_slab_pool.tag(uintptr);
+
+        if (tag == mem_tag::untagged)
+            return record_free(m_slab_stats, g_slab_cache.free(uintptr));
+
+        auto &&freed = g_slab_pool.size(uintptr);
+        g_slab_pool.free(uintptr);
+
+        record_tag_free(tag, freed);
+        return record_free(m_slab_stats, freed);
+    }
 
     if (g_page_pool.contains(uintptr))
-        return g_page_pool.free(uintptr);
+    {
+        auto &&freed = g_page_pool.free(uintptr, &tag);
+
+        record_tag_free(tag, freed);
+        return record_free(m_page_stats, freed);
+    }
 }
 
 void
@@ -115,7 +399,48 @@ memory_manager_x64::free_map(pointer ptr) noexcept
     auto uintptr = reinterpret_cast<integer_pointer>(ptr);
 
     if (g_mem_map_pool.contains(uintptr))
-        return g_mem_map_pool.free(uintptr);
+        return record_free(m_map_stats, g_mem_map_pool.free(uintptr));
+}
+
+void
+memory_manager_x64::free_map_deferred(pointer ptr, size_type size) noexcept
+{
+    deferred_maps_type maps;
+    auto num = 0UL;
+
+    if (ptr == nullptr || size == 0)
+        return;
+
+    {
+        std::lock_guard<std::mutex> guard(g_deferred_map_mutex);
+
+        gsl::at(m_deferred_maps, m_num_deferred_maps++) = {reinterpret_cast<integer_pointer>(ptr), size};
+        if (m_num_deferred_maps < MAX_DEFERRED_UNMAPS)
+            return;
+
+        maps = m_deferred_maps;
+        num = m_num_deferred_maps;
+        m_num_deferred_maps = 0;
+    }
+
+    release_deferred_maps(maps, num);
+}
+
+void
+memory_manager_x64::flush_deferred_maps() noexcept
+{
+    deferred_maps_type maps;
+    auto num = 0UL;
+
+    {
+        std::lock_guard<std::mutex> guard(g_deferred_map_mutex);
+
+        maps = m_deferred_maps;
+        num = m_num_deferred_maps;
+        m_num_deferred_maps = 0;
+    }
+
+    release_deferred_maps(maps, num);
 }
 
 memory_manager_x64::size_type
@@ -126,6 +451,9 @@ memory_manager_x64::size(pointer ptr) const noexcept
     if (g_heap_pool.contains(uintptr))
         return g_heap_pool.size(uintptr);
 
+    if (g_slab_pool.contains(uintptr))
+        return g_slab_pool.size(uintptr);
+
     if (g_page_pool.contains(uintptr))
         return g_page_pool.size(uintptr);
 
@@ -143,14 +471,150 @@ memory_manager_x64::size_map(pointer ptr) const noexcept
     return 0;
 }
 
+memory_manager_x64::page_pool_report_type
+memory_manager_x64::page_pool_report() const noexcept
+{ return g_page_pool.report(); }
+
+memory_manager_x64::pool_stats_type
+memory_manager_x64::pool_stats(pool_type pool) const noexcept
+{
+    pool_stats_type stats = {};
+
+    switch (pool)
+    {
+        case memory_manager_pool::heap:
+            stats.counters = m_heap_stats.report();
+            stats.capacity = g_heap_pool.capacity();
+            stats.high_water = g_heap_pool.high_water();
+            stats.largest_free = g_heap_pool.largest_free();
+            break;
+
+        case memory_manager_pool::page:
+        {
+            auto &&report = g_page_pool.report();
+
+            stats.counters = m_page_stats.report();
+            stats.capacity = report.pool_size;
+            stats.high_water = report.high_water;
+            stats.largest_free = report.largest_free;
+            break;
+        }
+
+        case memory_manager_pool::slab:
+            stats.counters = m_slab_stats.report();
+            stats.capacity = g_slab_pool.slab_size();
+            stats.high_water = stats.capacity;
+            break;
+
+        case memory_manager_pool::map:
+            stats.counters = m_map_stats.report();
+            stats.capacity = MAX_MEM_MAP_POOL;
+            stats.high_water = g_mem_map_pool.high_water();
+            stats.largest_free = g_mem_map_pool.largest_free();
+            break;
+    }
+
+    return stats;
+}
+
+memory_manager_x64::tag_report_type
+memory_manager_x64::tag_report() const noexcept
+{
+    tag_report_type report = {};
+    size_type tagged = 0;
+
+    for (auto tag = 1UL; tag < mem_tag_num_tags; tag++)
+    {
+        auto &&bytes = gsl::at(m_tag_bytes, tag).load(std::memory_order_relaxed);
+
+        gsl::at(report, tag) = bytes;
+        tagged += bytes;
+    }
+
+    auto &&live = live_bytes(m_heap_stats) + live_bytes(m_page_stats) + live_bytes(m_slab_stats);
+    report.front() = live > tagged ? live - tagged : 0;
+
+    return report;
+}
+
+void
+memory_manager_x64::add_heap(integer_pointer virt, size_type size)
+{
+    expects(virt != 0);
+    expects(lower(virt) == 0);
+    expects(size != 0);
+    expects(size % MAX_HEAP_POOL == 0);
+
+    constexpr const auto region_size = (sizeof(heap_pool_type) + page_size - 1) & ~(page_size - 1);
+
+    for (auto offset = 0UL; offset < size; offset += MAX_HEAP_POOL)
+    {
+        auto &&region = reinterpret_cast<void *>(g_page_pool.alloc(region_size));
+        m_page_stats.record_alloc(region_size, page_size << page_pool_type::size_to_order(region_size));
+
+        g_heap_pool.add_region(new (region) heap_pool_type(virt + offset));
+    }
+}
+
+memory_manager_x64::size_type
+memory_manager_x64::heap_chunks_needed() const noexcept
+{
+    auto &&capacity = g_heap_pool.capacity();
+    auto &&target = g_heap_pool.allocated() * 100 / HEAP_HIGH_WATER_MARK;
+
+    if (target <= capacity)
+        return 0;
+
+    return (target - capacity + MAX_HEAP_POOL - 1) / MAX_HEAP_POOL;
+}
+
+void
+memory_manager_x64::add_pages(integer_pointer virt, size_type size)
+{
+    expects(virt != 0);
+    expects(lower(virt) == 0);
+    expects(size != 0);
+    expects(size % MAX_PAGE_POOL == 0);
+
+    constexpr const auto region_size = sizeof(page_pool_type);
+
+    for (auto offset = 0UL; offset < size; offset += MAX_PAGE_POOL)
+    {
+        auto &&region = reinterpret_cast<void *>(g_heap_pool.alloc(region_size));
+        m_heap_stats.record_alloc(region_size, round_up(region_size, cache_line_size));
+
+        g_page_pool.add_region(new (region) page_pool_type(virt + offset));
+    }
+}
+
+memory_manager_x64::size_type
+memory_manager_x64::page_chunks_needed() const noexcept
+{
+    auto &&report = g_page_pool.report();
+    auto &&target = (report.pool_size - report.free_size) * 100 / HEAP_HIGH_WATER_MARK;
+
+    if (target <= report.pool_size)
+        return 0;
+
+    return (target - report.pool_size + MAX_PAGE_POOL - 1) / MAX_PAGE_POOL;
+}
+
+bool
+memory_manager_x64::valid_heap_token(uint64_t token) const noexcept
+{ return token == m_heap_token; }
+
 memory_manager_x64::integer_pointer
 memory_manager_x64::virtint_to_physint(integer_pointer virt) const
 {
     // [[ensures ret: ret != 0]]
     expects(virt != 0);
 
-    std::lock_guard<std::mutex> guard(g_add_md_mutex);
-    return upper(m_virt_to_phys_map.at(upper(virt))) | lower(virt);
+    auto &&value = this->lookup(m_virt_to_phys_table, virt_key(virt));
+
+    if (value == 0)
+        throw std::out_of_range("virtint_to_physint: virt has not been added");
+
+    return upper(value) | lower(virt);
 }
 
 memory_manager_x64::integer_pointer
@@ -171,8 +635,12 @@ memory_manager_x64::physint_to_virtint(integer_pointer phys) const
     // [[ensures ret: ret != 0]]
     expects(phys != 0);
 
-    std::lock_guard<std::mutex> guard(g_add_md_mutex);
-    return upper(m_phys_to_virt_map.at(upper(phys))) | lower(phys);
+    auto &&value = this->lookup(m_phys_to_virt_table, phys_key(phys));
+
+    if (value == 0)
+        throw std::out_of_range("physint_to_virtint: phys has not been added");
+
+    return upper(value) | lower(phys);
 }
 
 memory_manager_x64::integer_pointer
@@ -192,8 +660,12 @@ memory_manager_x64::virtint_to_attrint(integer_pointer virt) const
 {
     expects(virt != 0);
 
-    std::lock_guard<std::mutex> guard(g_add_md_mutex);
-    return m_virt_to_attr_map.at(upper(virt));
+    auto &&value = this->lookup(m_virt_to_phys_table, virt_key(virt));
+
+    if (value == 0)
+        throw std::out_of_range("virtint_to_attrint: virt has not been added");
+
+    return lower(value);
 }
 
 memory_manager_x64::attr_type
@@ -202,54 +674,92 @@ memory_manager_x64::virtptr_to_attrint(pointer virt) const
 
 void
 memory_manager_x64::add_md(integer_pointer virt, integer_pointer phys, attr_type attr)
+{ this->add_md_range(virt, phys, page_size, attr); }
+
+void
+memory_manager_x64::add_md_range(integer_pointer virt, integer_pointer phys, size_type size, attr_type attr)
 {
+    expects(attr != 0);
+    expects(lower(attr) == attr);
+    expects(size != 0);
+    expects(lower(size) == 0);
+    expects(lower(virt) == 0);
+    expects(lower(phys) == 0);
+
     auto ___ = gsl::on_failure([&]
     {
         std::lock_guard<std::mutex> guard(g_add_md_mutex);
 
-        m_virt_to_phys_map.erase(virt);
-        m_phys_to_virt_map.erase(phys);
-        m_virt_to_attr_map.erase(virt);
-    });
+        for (auto offset = 0UL; offset < size; offset += page_size)
+        {
+            m_virt_to_phys_table.clear(virt_key(virt + offset));
+            m_phys_to_virt_table.clear(phys_key(phys + offset));
+        }
 
-    expects(attr != 0);
-    expects(lower(virt) == 0);
-    expects(lower(phys) == 0);
+        guard_exceptions([&]
+        { remove_extents(virt, size); });
+    });
 
     {
         std::lock_guard<std::mutex> guard(g_add_md_mutex);
 
-        m_virt_to_phys_map[virt] = phys;
-        m_phys_to_virt_map[phys] = virt;
-        m_virt_to_attr_map[virt] = attr;
+        for (auto offset = 0UL; offset < size; offset += page_size)
+        {
+            auto &&page_virt = virt + offset;
+            auto &&page_phys = phys + offset;
+
+            if (auto &&old = m_virt_to_phys_table.get(virt_key(page_virt)))
+            {
+                if (m_phys_to_virt_table.get(phys_key(upper(old))) == (page_virt | 1))
+                    m_phys_to_virt_table.clear(phys_key(upper(old)));
+            }
+
+            m_virt_to_phys_table.set(virt_key(page_virt), page_phys | attr);
+            m_phys_to_virt_table.set(phys_key(page_phys), page_virt | 1);
+        }
+
+        remove_extents(virt, size);
+        insert_extent({phys, virt, attr, size});
     }
 }
 
 void
 memory_manager_x64::remove_md(integer_pointer virt) noexcept
-{
-    integer_pointer phys;
+{ this->remove_md_range(virt, page_size); }
 
+void
+memory_manager_x64::remove_md_range(integer_pointer virt, size_type size) noexcept
+{
     if (virt == 0)
     {
-        bferror << "remove_md: virt == 0" << bfendl;
+        bferror << "remove_md_range: virt == 0" << bfendl;
         return;
     }
 
-    if (lower(virt) != 0)
+    if (lower(virt) != 0 || lower(size) != 0)
     {
-        bferror << "remove_md: lower(virt) != 0" << bfendl;
+        bferror << "remove_md_range: range is not page aligned" << bfendl;
         return;
     }
 
     guard_exceptions([&]
     {
-        phys = virtint_to_physint(virt);
         std::lock_guard<std::mutex> guard(g_add_md_mutex);
 
-        m_virt_to_phys_map.erase(virt);
-        m_phys_to_virt_map.erase(phys);
-        m_virt_to_attr_map.erase(virt);
+        for (auto offset = 0UL; offset < size; offset += page_size)
+        {
+            auto &&page_virt = virt + offset;
+
+            if (auto &&old = m_virt_to_phys_table.get(virt_key(page_virt)))
+            {
+                if (m_phys_to_virt_table.get(phys_key(upper(old))) == (page_virt | 1))
+                    m_phys_to_virt_table.clear(phys_key(upper(old)));
+
+                m_virt_to_phys_table.clear(virt_key(page_virt));
+            }
+        }
+
+        remove_extents(virt, size);
     });
 }
 
@@ -259,23 +769,201 @@ memory_manager_x64::descriptors() const
     memory_descriptor_list list;
     std::lock_guard<std::mutex> guard(g_add_md_mutex);
 
-    for (const auto &p : m_virt_to_phys_map)
-    {
-        auto virt = p.first;
-        auto phys = p.second;
-        auto attr = m_virt_to_attr_map.at(virt);
+    list.reserve(m_extents.size());
 
-        list.push_back({phys, virt, attr});
-    }
+    for (const auto &extent : m_extents)
+        list.push_back(extent.second);
 
     return list;
 }
 
+void
+memory_manager_x64::begin_exit() noexcept
+{
+    auto &&cpuid = thread_context_cpuid();
+    m_grace_period.enter(cpuid);
+
+    // The generation is read after entering the grace period, so that a
+    // map that is retired after this read cannot be reused until this CPU
+    // leaves again (see retire_maps). CPUs without a slot of their own
+    // cannot tell, and always flush.
+
+    auto &&generation = m_tlb_generation.load(std::memory_order_relaxed);
+
+    if (cpuid >= MAX_NUM_CPUS)
+    {
+        x64::tlb::flush();
+        return;
+    }
+
+    auto &&flushed = gsl::at(m_tlb_flushed, cpuid);
+
+    if (flushed != generation)
+    {
+        x64::tlb::flush();
+        flushed = generation;
+    }
+}
+
+void
+memory_manager_x64::end_exit() noexcept
+{ m_grace_period.leave(thread_context_cpuid()); }
+
 memory_manager_x64::memory_manager_x64() noexcept :
+    m_virt_to_phys_table(&m_grace_period),
+    m_phys_to_virt_table(&m_grace_period),
     g_heap_pool(reinterpret_cast<uintptr_t>(g_heap_pool_owner)),
     g_page_pool(reinterpret_cast<uintptr_t>(g_page_pool_owner)),
-    g_mem_map_pool(MEM_MAP_POOL_START)
-{ }
+    g_slab_pool(g_page_pool, reinterpret_cast<uintptr_t>(g_page_pool_owner)),
+    g_slab_cache(g_slab_pool),
+    g_mem_map_pool(MEM_MAP_POOL_START),
+    m_deferred_maps(),
+    m_num_deferred_maps(0),
+    m_retired_maps(),
+    m_retired_maps_head(0),
+    m_num_retired_maps(0),
+    m_tlb_generation(0),
+    m_tlb_flushed(),
+    m_heap_token(make_heap_token())
+{
+    for (auto &&bytes : m_tag_bytes)
+        bytes = 0;
+
+    g_heap_token = m_heap_token;
+}
+
+void
+memory_manager_x64::release_deferred_maps(const deferred_maps_type &maps, size_type num) noexcept
+{
+    auto total = 0UL;
+    auto &&view = gsl::make_span(maps).first(static_cast<std::ptrdiff_t>(num));
+
+    for (const auto &map : view)
+    {
+        g_pt->unmap_range(map.virt, map.size);
+        total += map.size;
+    }
+
+    if (total > TLB_FLUSH_RANGE_THRESHOLD * page_size)
+    {
+        x64::tlb::flush();
+    }
+    else
+    {
+        for (const auto &map : view)
+            x64::tlb::invlpg_range(map.virt, map.size);
+    }
+
+    this->retire_maps(maps, num);
+}
+
+void
+memory_manager_x64::retire_maps(const deferred_maps_type &maps, size_type num) noexcept
+{
+    std::lock_guard<std::mutex> guard(g_retired_map_mutex);
+
+    // The maps are only invalid in this CPU's TLB. Bumping the generation
+    // makes every other CPU flush its TLB the next time it starts to handle
+    // a VM exit, and once the grace period has passed, every CPU that was
+    // in the VMM when the maps were unmapped has done so, while the other
+    // CPUs will do so before they can touch a map again.
+
+    if (num != 0)
+        m_tlb_generation.fetch_add(1);
+
+    auto &&epoch = m_grace_period.advance();
+
+    auto reclaim = [&]
+    {
+        while (m_num_retired_maps != 0)
+        {
+            auto &&map = gsl::at(m_retired_maps, m_retired_maps_head);
+
+            if (!m_grace_period.passed(map.epoch))
+                break;
+
+            this->free_map(reinterpret_cast<pointer>(map.virt));
+
+            m_retired_maps_head = (m_retired_maps_head + 1) % MAX_RETIRED_MAPS;
+            m_num_retired_maps--;
+        }
+    };
+
+    reclaim();
+
+    for (const auto &map : gsl::make_span(maps).first(static_cast<std::ptrdiff_t>(num)))
+    {
+        if (m_num_retired_maps == MAX_RETIRED_MAPS)
+        {
+            bferror << "retire_maps: too many retired maps, leaking: " << view_as_pointer(map.virt) << bfendl;
+            continue;
+        }
+
+        gsl::at(m_retired_maps, (m_retired_maps_head + m_num_retired_maps) % MAX_RETIRED_MAPS) = {map.virt, epoch};
+        m_num_retired_maps++;
+    }
+
+    reclaim();
+}
+
+template<class T> uintptr_t
+memory_manager_x64::lookup(const T &table, integer_pointer key) const noexcept
+{
+    // In VMX root, the exit handler has already entered the grace period
+    // (see begin_exit). The driver's calls into the VMM are not VM exits,
+    // so they enter it for the length of the lookup instead.
+
+    if (thread_context_vmx_root() != 0)
+        return table.get(key);
+
+    m_grace_period.enter(grace_period::driver);
+    auto &&value = table.get(key);
+    m_grace_period.leave(grace_period::driver);
+
+    return value;
+}
+
+memory_manager_x64::pointer
+memory_manager_x64::alloc_slab(size_type size, size_type actual, tag_type tag) noexcept
+{
+    // Tagged objects come from slabs of their own, and thus skip the per-CPU
+    // caches, which only hold untagged objects. Since most allocations are
+    // untagged, the locked path is only taken by the few that are not.
+
+    if (tag == mem_tag::untagged)
+        return record_alloc(m_slab_stats, size, actual, [&] { return g_slab_cache.alloc(size); });
+
+    auto &&ptr = record_alloc(m_slab_stats, size, actual, [&] { return g_slab_pool.alloc(size, tag); });
+    return record_tag(ptr, tag, actual);
+}
+
+memory_manager_x64::tag_type
+memory_manager_x64::find_tag(integer_pointer addr) const noexcept
+{
+    if (g_heap_pool.contains(addr))
+        return static_cast<tag_type>(g_heap_pool.tag(addr));
+
+    if (g_slab_pool.contains(addr))
+        return static_cast<tag_type>(g_slab_pool.tag(addr));
+
+    return static_cast<tag_type>(g_page_pool.tag(addr));
+}
+
+memory_manager_x64::pointer
+memory_manager_x64::record_tag(pointer ptr, tag_type tag, size_type actual) noexcept
+{
+    if (ptr != nullptr && tag != mem_tag::untagged)
+        gsl::at(m_tag_bytes, static_cast<size_type>(tag)).fetch_add(actual, std::memory_order_relaxed);
+
+    return ptr;
+}
+
+void
+memory_manager_x64::record_tag_free(uint8_t tag, size_type freed) noexcept
+{
+    if (freed != 0 && tag != mem_tag::untagged)
+        gsl::at(m_tag_bytes, tag).fetch_sub(freed, std::memory_order_relaxed);
+}
 
 memory_manager_x64::integer_pointer
 memory_manager_x64::lower(integer_pointer ptr) const noexcept
@@ -285,6 +973,135 @@ memory_manager_x64::integer_pointer
 memory_manager_x64::upper(integer_pointer ptr) const noexcept
 { return ptr & ~(page_size - 1); }
 
+memory_manager_x64::integer_pointer
+memory_manager_x64::virt_key(integer_pointer virt) const noexcept
+{
+    constexpr const auto unused_bits = 64UL - memory_manager_virt_bits;
+
+    if (static_cast<integer_pointer>(static_cast<intptr_t>(virt << unused_bits) >> unused_bits) != virt)
+        return ~0UL;
+
+    return (virt & ((1UL << memory_manager_virt_bits) - 1)) >> page_shift;
+}
+
+memory_manager_x64::integer_pointer
+memory_manager_x64::phys_key(integer_pointer phys) const noexcept
+{ return phys >> page_shift; }
+
+void
+memory_manager_x64::remove_extents(integer_pointer virt, size_type size)
+{
+    auto &&end = virt + size;
+    auto iter = m_extents.upper_bound(virt);
+
+    if (iter != m_extents.begin())
+    {
+        auto &&prev = std::prev(iter);
+
+        if (prev->second.virt + prev->second.size > virt)
+            iter = prev;
+    }
+
+    while (iter != m_extents.end() && iter->first < end)
+    {
+        auto md = iter->second;
+        auto md_end = md.virt + md.size;
+
+        if (md.virt < virt)
+        {
+            iter->second.size = virt - md.virt;
+            ++iter;
+        }
+        else
+        {
+            iter = m_extents.erase(iter);
+        }
+
+        if (md_end > end)
+        {
+            auto &&offset = end - md.virt;
+            m_extents.emplace(end, memory_descriptor{md.phys + offset, end, md.type, md_end - end});
+        }
+    }
+}
+
+bool
+memory_manager_x64::is_phys_block(integer_pointer virt, size_type size) const
+{
+    std::lock_guard<std::mutex> guard(g_add_md_mutex);
+
+    auto iter = m_extents.upper_bound(virt);
+    if (iter == m_extents.begin())
+        return false;
+
+    iter = std::prev(iter);
+
+    auto &&end = virt + size;
+    auto &&phys = iter->second.phys + (virt - iter->second.virt);
+
+    // The block is aligned to its size in the VMM's address space, and
+    // alloc_contiguous promises the same of its physical address.
+
+    if ((phys & (size - 1)) != 0)
+        return false;
+
+    // The extents are walked in order. Unlike the extents themselves, the
+    // memory type of neighboring extents does not need to match.
+
+    for (auto cur = virt; iter != m_extents.end(); ++iter)
+    {
+        const auto &md = iter->second;
+
+        if (md.virt > cur || md.virt + md.size <= cur)
+            return false;
+
+        if (md.phys + (cur - md.virt) != phys + (cur - virt))
+            return false;
+
+        cur = md.virt + md.size;
+
+        if (cur >= end)
+            return true;
+    }
+
+    return false;
+}
+
+static bool
+extents_contiguous(const memory_descriptor &lhs, const memory_descriptor &rhs) noexcept
+{
+    return lhs.virt + lhs.size == rhs.virt &&
+           lhs.phys + lhs.size == rhs.phys &&
+           lhs.type == rhs.type;
+}
+
+void
+memory_manager_x64::insert_extent(const memory_descriptor &md)
+{
+    auto iter = m_extents.emplace(md.virt, md).first;
+
+    if (iter != m_extents.begin())
+    {
+        auto &&prev = std::prev(iter);
+
+        if (extents_contiguous(prev->second, iter->second))
+        {
+            prev->second.size += iter->second.size;
+
+            m_extents.erase(iter);
+            iter = prev;
+        }
+    }
+
+    auto &&next = std::next(iter);
+
+    if (next != m_extents.end() && extents_contiguous(iter->second, next->second))
+    {
+        iter->second.size += next->second.size;
+        m_extents.erase(next);
+    }
+}
+
 extern "C" int64_t
 add_md(struct memory_descriptor *md) noexcept
 {
@@ -295,11 +1112,19 @@ add_md(struct memory_descriptor *md) noexcept
         auto &&virt = reinterpret_cast<memory_manager_x64::integer_pointer>(md->virt);
         auto &&phys = reinterpret_cast<memory_manager_x64::integer_pointer>(md->phys);
         auto &&type = reinterpret_cast<memory_manager_x64::attr_type>(md->type);
+        auto &&size = reinterpret_cast<memory_manager_x64::size_type>(md->size);
 
-        g_mm->add_md(virt, phys, type);
+        g_mm->add_md_range(virt, phys, size, type);
     });
 }
 
+extern "C" int64_t
+add_heap(uint64_t virt, uint64_t size) noexcept
+{
+    return guard_exceptions(MEMORY_MANAGER_FAILURE, [&]
+    { g_mm->add_heap(virt, size); });
+}
+
 #ifdef CROSS_COMPILED
 
 extern "C" void *
@@ -321,20 +1146,10 @@ _calloc_r(struct _reent *, size_t nmemb, size_t size)
 
 extern "C" void *
 _realloc_r(struct _reent *, void *ptr, size_t size)
-{
-    auto old_sze = g_mm->size(ptr);
-    auto new_ptr = g_mm->alloc(size);
+{ return g_mm->realloc(ptr, size); }
 
-    if (!new_ptr || old_sze == 0)
-        return nullptr;
-
-    if (ptr)
-    {
-        __builtin_memcpy(new_ptr, ptr, size > old_sze ? old_sze : size);
-        g_mm->free(ptr);
-    }
-
-    return new_ptr;
-}
+extern "C" void *
+_memalign_r(struct _reent *, size_t align, size_t size)
+{ return g_mm->alloc_aligned(size, align); }
 
 #endif
@@ -19,6 +19,12 @@
 // License along with this library; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 
+#include <array>
+#include <utility>
+#include <algorithm>
+
+#include <guard_exceptions.h>
+
 #include <memory_manager/pat_x64.h>
 #include <memory_manager/page_table_x64.h>
 #include <memory_manager/memory_manager_x64.h>
@@ -26,144 +32,345 @@
 #include <intrinsics/x64.h>
 using namespace x64;
 
-page_table_x64::page_table_x64(gsl::not_null<pointer> pte)
+constexpr const auto page_table_x64_num_levels = 4UL;
+
+// Each page table is allocated with a second half that is never seen by the
+// hardware. Entry i of the second half holds the virtual address of the page
+// table that entry i of the first half points to (if any), so that the page
+// tables can be walked without asking the memory manager to convert physical
+// addresses back into virtual addresses.
+
+constexpr const auto page_table_x64_table_entries = page_table::num_entries * 2;
+
+page_table_x64::page_table_x64(gsl::not_null<pointer> pte) :
+    m_pt(nullptr),
+    m_phys(0),
+    m_free(nullptr),
+    m_num_free(0)
 {
-    m_pt = std::make_unique<integer_pointer[]>(page_table::num_entries);
+    auto &&table = std::make_unique<integer_pointer[]>(page_table_x64_table_entries);
+    auto &&phys = g_mm->virtptr_to_physint(table.get());
 
     auto &&entry = page_table_entry_x64(pte);
     entry.clear();
-    entry.set_phys_addr(g_mm->virtptr_to_physint(m_pt.get()));
+    entry.set_phys_addr(phys);
     entry.set_present(true);
     entry.set_rw(true);
     entry.set_pat_index_4k(pat::write_back_index);
+
+    m_tables.push_back(table.get());
+
+    m_pt = table.release();
+    m_phys = phys;
+}
+
+page_table_x64::~page_table_x64() noexcept
+{
+    for (auto table : m_tables)
+        delete[] table;
+
+    release_free_tables();
+}
+
+page_table_x64::page_table_x64(page_table_x64 &&other) noexcept :
+    m_pt(other.m_pt),
+    m_phys(other.m_phys),
+    m_free(other.m_free),
+    m_num_free(other.m_num_free),
+    m_tables(std::move(other.m_tables))
+{
+    other.m_pt = nullptr;
+    other.m_free = nullptr;
+    other.m_num_free = 0;
+    other.m_tables.clear();
+}
+
+page_table_x64 &
+page_table_x64::operator=(page_table_x64 &&other) noexcept
+{
+    // The page tables that this object owned are given to other, and are
+    // freed when other is destroyed.
+
+    std::swap(m_pt, other.m_pt);
+    std::swap(m_phys, other.m_phys);
+    std::swap(m_free, other.m_free);
+    std::swap(m_num_free, other.m_num_free);
+    std::swap(m_tables, other.m_tables);
+
+    return *this;
 }
 
 page_table_entry_x64
 page_table_x64::add_page(integer_pointer addr, integer_pointer bits, integer_pointer end)
+{ return page_table_entry_x64(&add_pages(addr, 1, bits, end).at(0)); }
+
+gsl::span<page_table_x64::integer_pointer>
+page_table_x64::add_pages(integer_pointer addr, size_type num, integer_pointer bits, integer_pointer end)
 {
-    auto &&index = page_table::index(addr, bits);
+    expects(num != 0);
 
-    if (bits > end)
-    {
-        if (m_pts.empty())
-            m_pts = std::vector<std::unique_ptr<page_table_x64>>(page_table::num_entries);
+    auto table = m_pt;
 
-        auto &&iter = bfn::find(m_pts, index);
-        if (!(*iter))
-        {
-            auto &&view = gsl::make_span(m_pt, page_table::num_entries);
-            (*iter) = std::make_unique<page_table_x64>(&view.at(index));
-        }
+    for (; bits > end; bits -= page_table::pt::size)
+    {
+        auto &&view = gsl::make_span(table, page_table::num_entries);
+        auto &&entry = view.at(page_table::index(addr, bits));
 
-        return (*iter)->add_page(addr, bits - page_table::pt::size, end);
+        table = is_table(entry) ? child(entry) : alloc_table(entry);
     }
 
-    if (!m_pts.empty())
+    auto &&index = page_table::index(addr, bits);
+    auto count = std::min<size_type>(num, page_table::num_entries - index);
+
+    // A page replaces the page table that was mapping the same memory (if
+    // any), in which case the page table (and everything below it) is
+    // freed, and the entry is cleared for the caller.
+
+    auto &&view = gsl::make_span(table, page_table::num_entries);
+    auto &&entries = view.subspan(static_cast<std::ptrdiff_t>(index), static_cast<std::ptrdiff_t>(count));
+
+    if (bits != page_table::pt::from)
     {
-        m_pts.clear();
-        m_pts.shrink_to_fit();
+        for (auto &entry : entries)
+        {
+            if (is_table(entry))
+            {
+                auto &&phys = page_table_entry_x64(&entry).phys_addr();
+                free_table(child(entry), phys, bits - page_table::pt::size);
+
+                entry = 0;
+            }
+        }
     }
 
-    auto &&view = gsl::make_span(m_pt, page_table::num_entries);
-    return page_table_entry_x64(&view.at(index));
+    return entries;
 }
 
-void
+page_table_x64::size_type
 page_table_x64::remove_page(integer_pointer addr, integer_pointer bits)
 {
-    auto &&index = page_table::index(addr, bits);
+    std::array<pointer, page_table_x64_num_levels> path = {};
+    std::array<pointer, page_table_x64_num_levels> tables = {};
+
+    auto table = m_pt;
+    auto level = 0UL;
+    auto size = 0UL;
 
-    if (!m_pts.empty())
+    while (true)
     {
-        auto &&iter = bfn::find(m_pts, index);
-        if (auto pt = (*iter).get())
+        auto &&view = gsl::make_span(table, page_table::num_entries);
+        auto &&entry = &view.at(page_table::index(addr, bits));
+
+        gsl::at(tables, level) = table;
+        gsl::at(path, level) = entry;
+
+        if (!is_table(*entry))
         {
-            pt->remove_page(addr, bits - page_table::pt::size);
-            if (pt->empty())
+            if (*entry != 0)
             {
-                (*iter) = nullptr;
-
-                auto &&view = gsl::make_span(m_pt, page_table::num_entries);
-                view.at(index) = 0;
+                *entry = 0;
+                size = 1UL << bits;
             }
+
+            break;
         }
+
+        table = child(*entry);
+        bits -= page_table::pt::size;
+        level++;
     }
-    else
+
+    // Once a page is removed, the page tables that are left empty are freed
+    // from the bottom up. Note that the root page table is never freed.
+
+    for (; level > 0; level--)
     {
-        auto &&view = gsl::make_span(m_pt, page_table::num_entries);
-        view.at(index) = 0;
+        auto &&empty_table = gsl::at(tables, level);
+        if (!empty(empty_table))
+            break;
 
-        return;
+        auto &&entry = gsl::at(path, level - 1);
+        auto &&phys = page_table_entry_x64(entry).phys_addr();
+
+        free_table(empty_table, phys, bits);
+        *entry = 0;
+
+        bits += page_table::pt::size;
     }
+
+    return size;
 }
 
 page_table_entry_x64
 page_table_x64::virt_to_pte(integer_pointer addr, integer_pointer bits) const
 {
-    auto &&index = page_table::index(addr, bits);
+    auto table = m_pt;
 
-    if (!m_pts.empty())
+    for (; bits > page_table::pt::from; bits -= page_table::pt::size)
     {
-        auto &&iter = bfn::cfind(m_pts, index);
-        if (auto pt = (*iter).get())
-            return pt->virt_to_pte(addr, bits - page_table::pt::size);
+        auto &&view = gsl::make_span(table, page_table::num_entries);
+        auto &&entry = view.at(page_table::index(addr, bits));
+
+        // An empty entry is only returned if the page table it lives in
+        // holds nothing but pages (e.g. a page directory of 2m pages), as
+        // the address is then covered by a page of that size.
+
+        if (entry == 0)
+        {
+            if (table == m_pt || std::any_of(view.begin(), view.end(), is_table))
+                throw std::runtime_error("unable to locate pte. invalid address");
 
-        throw std::runtime_error("unable to locate pte. invalid address");
+            break;
+        }
+
+        if (!is_table(entry))
+            break;
+
+        table = child(entry);
     }
 
-    auto &&view = gsl::make_span(m_pt, page_table::num_entries);
-    return page_table_entry_x64(&view.at(index));
+    auto &&view = gsl::make_span(table, page_table::num_entries);
+    return page_table_entry_x64(&view.at(page_table::index(addr, bits)));
 }
 
-page_table_x64::memory_descriptor_list
-page_table_x64::pt_to_mdl(memory_descriptor_list &mdl) const
+void
+page_table_x64::pt_to_mdl(memory_descriptor_list &mdl, pointer table, integer_pointer phys, integer_pointer bits) const
 {
-    auto &&virt = reinterpret_cast<uintptr_t>(m_pt.get());
-    auto &&phys = g_mm->virtint_to_physint(virt);
+    auto &&virt = reinterpret_cast<uintptr_t>(table);
     auto &&type = MEMORY_TYPE_R | MEMORY_TYPE_W;
 
-    mdl.push_back({phys, virt, type});
+    mdl.push_back({phys, virt, type, page_size});
 
-    for (const auto &pt : m_pts)
-        if (pt != nullptr) pt->pt_to_mdl(mdl);
+    if (bits == page_table::pt::from)
+        return;
 
-    return mdl;
+    auto &&view = gsl::make_span(table, page_table::num_entries);
+    for (auto &entry : view)
+    {
+        if (is_table(entry))
+            pt_to_mdl(mdl, child(entry), page_table_entry_x64(&entry).phys_addr(), bits - page_table::pt::size);
+    }
 }
 
-bool
-page_table_x64::empty() const noexcept
+page_table_x64::pointer
+page_table_x64::alloc_table(integer_pointer &entry)
 {
-    auto size = 0UL;
+    pointer table = nullptr;
+    integer_pointer phys = 0;
 
-    auto &&view = gsl::make_span(m_pt, x64::page_table::num_entries);
-    for (auto element : view)
-        size += element != 0 ? 1U : 0U;
+    if (m_free != nullptr)
+    {
+        m_tables.push_back(m_free);
+
+        table = m_free;
+        phys = table[1];
+
+        m_free = reinterpret_cast<pointer>(table[0]);
+        m_num_free--;
+
+        std::fill(table, table + page_table_x64_table_entries, 0);
+    }
+    else
+    {
+        auto &&frame = std::make_unique<integer_pointer[]>(page_table_x64_table_entries);
+        phys = g_mm->virtptr_to_physint(frame.get());
+
+        m_tables.push_back(frame.get());
+        table = frame.release();
+    }
+
+    auto &&pte = page_table_entry_x64(&entry);
+    pte.clear();
+    pte.set_phys_addr(phys);
+    pte.set_present(true);
+    pte.set_rw(true);
+    pte.set_pat_index_4k(pat::write_back_index);
+
+    entry |= table_bit;
+    *(&entry + page_table::num_entries) = reinterpret_cast<integer_pointer>(table);
 
-    return size == 0;
+    return table;
 }
 
-page_table_x64::size_type
-page_table_x64::global_size() const noexcept
+void
+page_table_x64::free_table(pointer table, integer_pointer phys, integer_pointer bits) noexcept
 {
-    auto size = 0UL;
+    guard_exceptions([&]
+    {
+        if (bits != page_table::pt::from)
+        {
+            auto &&view = gsl::make_span(table, page_table::num_entries);
+            for (auto &entry : view)
+            {
+                if (is_table(entry))
+                    free_table(child(entry), page_table_entry_x64(&entry).phys_addr(), bits - page_table::pt::size);
+            }
+        }
+    });
 
-    auto &&view = gsl::make_span(m_pt, x64::page_table::num_entries);
-    for (auto element : view)
-        size += element != 0 ? 1U : 0U;
+    auto &&iter = std::find(m_tables.begin(), m_tables.end(), table);
+    if (iter != m_tables.end())
+    {
+        *iter = m_tables.back();
+        m_tables.pop_back();
+    }
+
+    if (m_num_free >= page_table_x64_max_free_tables)
+    {
+        delete[] table;
+        return;
+    }
 
-    for (const auto &pt : m_pts)
-        if (pt != nullptr) size += pt->global_size();
+    // Free page tables are kept on a list that is stored in the page tables
+    // themselves. The next pointer is stored in the first entry, and the
+    // physical address (so that it does not need to be looked up again) is
+    // stored in the second.
 
-    return size;
+    table[0] = reinterpret_cast<integer_pointer>(m_free);
+    table[1] = phys;
+
+    m_free = table;
+    m_num_free++;
+}
+
+void
+page_table_x64::release_free_tables() noexcept
+{
+    while (m_free != nullptr)
+    {
+        auto table = m_free;
+
+        m_free = reinterpret_cast<pointer>(table[0]);
+        delete[] table;
+    }
+
+    m_num_free = 0;
+}
+
+page_table_x64::pointer
+page_table_x64::child(const integer_pointer &entry) noexcept
+{ return reinterpret_cast<pointer>(*(&entry + page_table::num_entries)); }
+
+bool
+page_table_x64::empty(pointer table) noexcept
+{
+    auto &&view = gsl::make_span(table, page_table::num_entries);
+    return std::all_of(view.begin(), view.end(), [](auto element) { return element == 0; });
 }
 
 page_table_x64::size_type
-page_table_x64::global_capacity() const noexcept
+page_table_x64::global_size(pointer table, integer_pointer bits) const noexcept
 {
-    auto size = m_pts.capacity();
+    auto size = 0UL;
 
-    for (const auto &pt : m_pts)
-        if (pt != nullptr) size += pt->global_capacity();
+    auto &&view = gsl::make_span(table, page_table::num_entries);
+    for (auto &element : view)
+    {
+        size += element != 0 ? 1U : 0U;
+
+        if (bits != page_table::pt::from && is_table(element))
+            guard_exceptions([&] { size += global_size(child(element), bits - page_table::pt::size); });
+    }
 
     return size;
 }
@@ -0,0 +1,226 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <gsl/gsl>
+
+#include <memory_manager/page_walk_cache_x64.h>
+#include <memory_manager/root_page_table_x64.h>
+
+namespace bfn
+{
+
+page_walk_cache_x64::page_walk_cache_x64() noexcept :
+    m_cr3(0),
+    m_tick(0),
+    m_hits(0),
+    m_misses(0),
+    m_entries(),
+    m_tables()
+{ }
+
+page_walk_cache_x64::translation_type
+page_walk_cache_x64::translate(integer_pointer virt, integer_pointer cr3)
+{
+    expects(virt != 0);
+    expects(cr3 != 0);
+    expects(lower(cr3) == 0);
+
+    if (cr3 != m_cr3)
+    {
+        this->flush();
+        m_cr3 = cr3;
+    }
+
+    auto &&entry = gsl::at(m_entries, entry_index(virt));
+
+    if (entry.valid && entry.virt == upper(virt))
+    {
+        m_hits++;
+        return {entry.phys | lower(virt), entry.pati, entry.size, entry.writable, entry.user};
+    }
+
+    m_misses++;
+
+    auto &&result = this->walk(virt, cr3);
+
+    entry.valid = true;
+    entry.virt = upper(virt);
+    entry.phys = upper(result.phys);
+    entry.pati = result.pati;
+    entry.size = result.size;
+    entry.writable = result.writable;
+    entry.user = result.user;
+
+    return result;
+}
+
+void
+page_walk_cache_x64::flush() noexcept
+{
+    for (auto &entry : m_entries)
+        entry.valid = false;
+}
+
+void
+page_walk_cache_x64::flush(integer_pointer virt) noexcept
+{
+    auto &&entry = gsl::at(m_entries, entry_index(virt));
+
+    if (entry.virt == upper(virt))
+        entry.valid = false;
+}
+
+void
+page_walk_cache_x64::release() noexcept
+{
+    this->flush();
+
+    for (auto &table : m_tables)
+    {
+        table.phys = 0;
+        table.used = 0;
+        table.map.reset();
+    }
+
+    m_cr3 = 0;
+    m_tick = 0;
+}
+
+page_walk_cache_x64::translation_type
+page_walk_cache_x64::walk(integer_pointer virt, integer_pointer cr3)
+{
+    uintptr_t from;
+
+    from = x64::page_table::pml4::from;
+    auto pml4_entry = this->read_entry(cr3, virt, from);
+    auto &&pml4_pte = page_table_entry_x64{&pml4_entry};
+
+    expects(pml4_pte.present());
+    expects(pml4_pte.phys_addr() != 0);
+
+    auto writable = pml4_pte.rw();
+    auto user = pml4_pte.us();
+
+    from = x64::page_table::pdpt::from;
+    auto pdpt_entry = this->read_entry(pml4_pte.phys_addr(), virt, from);
+    auto &&pdpt_pte = page_table_entry_x64{&pdpt_entry};
+
+    expects(pdpt_pte.present());
+    expects(pdpt_pte.phys_addr() != 0);
+
+    writable = writable && pdpt_pte.rw();
+    user = user && pdpt_pte.us();
+
+    if (pdpt_pte.ps())
+        return {upper(pdpt_pte.phys_addr(), from) | lower(virt, from), pdpt_pte.pat_index_large(), x64::page_table::pdpt::size_bytes, writable, user};
+
+    from = x64::page_table::pd::from;
+    auto pd_entry = this->read_entry(pdpt_pte.phys_addr(), virt, from);
+    auto &&pd_pte = page_table_entry_x64{&pd_entry};
+
+    expects(pd_pte.present());
+    expects(pd_pte.phys_addr() != 0);
+
+    writable = writable && pd_pte.rw();
+    user = user && pd_pte.us();
+
+    if (pd_pte.ps())
+        return {upper(pd_pte.phys_addr(), from) | lower(virt, from), pd_pte.pat_index_large(), x64::page_table::pd::size_bytes, writable, user};
+
+    from = x64::page_table::pt::from;
+    auto pt_entry = this->read_entry(pd_pte.phys_addr(), virt, from);
+    auto &&pt_pte = page_table_entry_x64{&pt_entry};
+
+    expects(pt_pte.present());
+    expects(pt_pte.phys_addr() != 0);
+
+    writable = writable && pt_pte.rw();
+    user = user && pt_pte.us();
+
+    return {upper(pt_pte.phys_addr(), from) | lower(virt, from), pt_pte.pat_index_4k(), x64::page_table::pt::size_bytes, writable, user};
+}
+
+uintptr_t
+page_walk_cache_x64::read_entry(integer_pointer table, integer_pointer virt, integer_pointer from)
+{
+    auto &&index = x64::page_table::index(virt, from);
+    auto &&victim = &m_tables.front();
+
+    for (auto &slot : m_tables)
+    {
+        if (slot.phys == table && slot.map)
+        {
+            slot.used = ++m_tick;
+            return slot.map.get()[index];
+        }
+
+        if (slot.used < victim->used)
+            victim = &slot;
+    }
+
+    victim->phys = 0;
+    victim->used = 0;
+    victim->map = make_unique_map_x64<uintptr_t>(table);
+    victim->phys = table;
+    victim->used = ++m_tick;
+
+    return victim->map.get()[index];
+}
+
+void
+map_with_cr3(
+    uintptr_t vmap,
+    uintptr_t virt,
+    uintptr_t cr3,
+    size_t size,
+    x64::msrs::value_type pat,
+    page_walk_cache_x64 &cache)
+{
+    expects(vmap != 0);
+    expects(lower(vmap) == 0);
+    expects(virt != 0);
+    expects(cr3 != 0);
+    expects(lower(cr3) == 0);
+    expects(size != 0);
+
+    for (auto offset = 0UL; offset < size;)
+    {
+        auto &&current_virt = virt + offset;
+        auto &&result = cache.translate(current_virt, cr3);
+
+        auto &&perm = x64::memory_attr::rw;
+        auto &&type = x64::msrs::ia32_pat::pa(pat, result.pati);
+        auto &&attr = x64::memory_attr::mem_type_to_attr(perm, type);
+
+        if (can_map_2m(vmap + offset, upper(current_virt), result.size, size - offset))
+        {
+            g_pt->map_2m(vmap + offset, upper(result.phys, x64::page_table::pd::from), attr);
+            offset += x64::page_table::pd::size_bytes;
+        }
+        else
+        {
+            g_pt->map_4k(vmap + offset, upper(result.phys), attr);
+            offset += x64::page_size;
+        }
+    }
+}
+
+}
@@ -20,12 +20,23 @@
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 
 #include <debug.h>
+#include <constants.h>
 #include <guard_exceptions.h>
 #include <memory_manager/memory_manager_x64.h>
 #include <memory_manager/root_page_table_x64.h>
 
+#include <intrinsics/cpuid_x64.h>
+
+#include <atomic>
+
 using namespace x64;
 
+// -----------------------------------------------------------------------------
+// Global Memory
+// -----------------------------------------------------------------------------
+
+static std::atomic<uintptr_t> g_direct_map_size{0};
+
 // -----------------------------------------------------------------------------
 // Testing Seem
 // -----------------------------------------------------------------------------
@@ -48,6 +59,74 @@ void root_page_table_terminate()
 // Implementation
 // -----------------------------------------------------------------------------
 
+static void
+set_entry(page_table_entry_x64 &entry, uintptr_t phys, memory_attr::attr_type attr, size_t size, bool global = false)
+{
+    switch (size)
+    {
+        case page_table::pdpt::size_bytes:
+            entry.clear();
+            entry.set_phys_addr(phys & ~(page_table::pdpt::size_bytes - 1));
+            entry.set_present(true);
+            entry.set_ps(true);
+            entry.set_pat_index_large(pat::mem_attr_to_pat_index(attr));
+            break;
+
+        case page_table::pd::size_bytes:
+            entry.clear();
+            entry.set_phys_addr(phys & ~(page_table::pd::size_bytes - 1));
+            entry.set_present(true);
+            entry.set_ps(true);
+            entry.set_pat_index_large(pat::mem_attr_to_pat_index(attr));
+            break;
+
+        case page_table::pt::size_bytes:
+            entry.clear();
+            entry.set_phys_addr(phys & ~(page_table::pt::size_bytes - 1));
+            entry.set_present(true);
+            entry.set_pat_index_4k(pat::mem_attr_to_pat_index(attr));
+            break;
+    }
+
+    switch (attr)
+    {
+        case memory_attr::rw_uc:
+        case memory_attr::rw_wc:
+        case memory_attr::rw_wt:
+        case memory_attr::rw_wp:
+        case memory_attr::rw_wb:
+        case memory_attr::rw_uc_m:
+            entry.set_rw(true);
+            entry.set_nx(true);
+            break;
+
+        case memory_attr::re_uc:
+        case memory_attr::re_wc:
+        case memory_attr::re_wt:
+        case memory_attr::re_wp:
+        case memory_attr::re_wb:
+        case memory_attr::re_uc_m:
+            entry.set_rw(false);
+            entry.set_nx(false);
+            break;
+
+        case memory_attr::pt_uc:
+        case memory_attr::pt_wc:
+        case memory_attr::pt_wt:
+        case memory_attr::pt_wp:
+        case memory_attr::pt_wb:
+        case memory_attr::pt_uc_m:
+            entry.set_rw(true);
+            entry.set_nx(false);
+            break;
+
+        default:
+            throw std::logic_error("unsupported memory permissions");
+    }
+
+    entry.set_global(global);
+}
+
 root_page_table_x64::root_page_table_x64(bool is_vmm) :
     m_is_vmm(is_vmm),
     m_pt{std::make_unique<page_table_x64>(&m_cr3)}
@@ -64,6 +143,55 @@ root_page_table_x64::unmap(integer_pointer virt) noexcept
     unmap_page(virt);
 }
 
+void
+root_page_table_x64::map_range(
+    integer_pointer virt, integer_pointer phys, size_type size, attr_type attr, bool global)
+{
+    expects((virt & (page_table::pt::size_bytes - 1)) == 0);
+    expects((phys & (page_table::pt::size_bytes - 1)) == 0);
+    expects(size != 0);
+    expects((size & (page_table::pt::size_bytes - 1)) == 0);
+
+    auto max = page_table::pd::size_bytes;
+
+    if (size >= page_table::pdpt::size_bytes && cpuid::extended_processor_information::edx::pdpe1gb::get())
+        max = page_table::pdpt::size_bytes;
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    this->map_pages(virt, phys, size, attr, max, true, global);
+}
+
+void
+root_page_table_x64::unmap_range(integer_pointer virt, size_type size) noexcept
+{
+    std::lock_guard<std::mutex> guard(m_mutex);
+    this->unmap_pages(virt, size);
+}
+
+uintptr_t *
+root_page_table_x64::reserve_4k(integer_pointer virt)
+{
+    expects((virt & (page_table::pt::size_bytes - 1)) == 0);
+
+    std::lock_guard<std::mutex> guard(m_mutex);
+    auto &&entries = this->add_pages(virt, 1, page_table::pt::size_bytes);
+
+    auto &&entry = &entries.at(0);
+    *entry = 0;
+
+    return entry;
+}
+
+uintptr_t
+root_page_table_x64::pte_4k(integer_pointer phys, attr_type attr)
+{
+    auto value = 0UL;
+    auto &&entry = page_table_entry_x64(&value);
+
+    set_entry(entry, phys, attr, page_table::pt::size_bytes);
+    return value;
+}
+
 void
 root_page_table_x64::setup_identity_map_1g(
     integer_pointer saddr, integer_pointer eaddr)
@@ -71,8 +199,8 @@ root_page_table_x64::setup_identity_map_1g(
     expects((saddr & (page_table::pdpt::size_bytes - 1)) == 0);
     expects((eaddr & (page_table::pdpt::size_bytes - 1)) == 0);
 
-    for (auto virt = saddr; virt < eaddr; virt += page_table::pdpt::size_bytes)
-        this->map_1g(virt, virt, x64::memory_attr::pt_wb);
+    std::lock_guard<std::mutex> guard(m_mutex);
+    this->map_pages(saddr, saddr, eaddr - saddr, x64::memory_attr::pt_wb, page_table::pdpt::size_bytes);
 }
 
 void
@@ -82,8 +210,8 @@ root_page_table_x64::setup_identity_map_2m(
     expects((saddr & (page_table::pd::size_bytes - 1)) == 0);
     expects((eaddr & (page_table::pd::size_bytes - 1)) == 0);
 
-    for (auto virt = saddr; virt < eaddr; virt += page_table::pd::size_bytes)
-        this->map_2m(virt, virt, x64::memory_attr::pt_wb);
+    std::lock_guard<std::mutex> guard(m_mutex);
+    this->map_pages(saddr, saddr, eaddr - saddr, x64::memory_attr::pt_wb, page_table::pd::size_bytes);
 }
 
 void
@@ -93,8 +221,8 @@ root_page_table_x64::setup_identity_map_4k(
     expects((saddr & (page_table::pt::size_bytes - 1)) == 0);
     expects((eaddr & (page_table::pt::size_bytes - 1)) == 0);
 
-    for (auto virt = saddr; virt < eaddr; virt += page_table::pt::size_bytes)
-        this->map_4k(virt, virt, x64::memory_attr::pt_wb);
+    std::lock_guard<std::mutex> guard(m_mutex);
+    this->map_pages(saddr, saddr, eaddr - saddr, x64::memory_attr::pt_wb, page_table::pt::size_bytes);
 }
 
 void
@@ -104,8 +232,8 @@ root_page_table_x64::unmap_identity_map_1g(
     expects((saddr & (page_table::pdpt::size_bytes - 1)) == 0);
     expects((eaddr & (page_table::pdpt::size_bytes - 1)) == 0);
 
-    for (auto virt = saddr; virt < eaddr; virt += page_table::pdpt::size_bytes)
-        this->unmap(virt);
+    std::lock_guard<std::mutex> guard(m_mutex);
+    this->unmap_pages(saddr, eaddr - saddr);
 }
 
 void
@@ -115,8 +243,8 @@ root_page_table_x64::unmap_identity_map_2m(
     expects((saddr & (page_table::pd::size_bytes - 1)) == 0);
     expects((eaddr & (page_table::pd::size_bytes - 1)) == 0);
 
-    for (auto virt = saddr; virt < eaddr; virt += page_table::pd::size_bytes)
-        this->unmap(virt);
+    std::lock_guard<std::mutex> guard(m_mutex);
+    this->unmap_pages(saddr, eaddr - saddr);
 }
 
 void
@@ -126,8 +254,31 @@ root_page_table_x64::unmap_identity_map_4k(
     expects((saddr & (page_table::pt::size_bytes - 1)) == 0);
     expects((eaddr & (page_table::pt::size_bytes - 1)) == 0);
 
-    for (auto virt = saddr; virt < eaddr; virt += page_table::pt::size_bytes)
-        this->unmap(virt);
+    std::lock_guard<std::mutex> guard(m_mutex);
+    this->unmap_pages(saddr, eaddr - saddr);
+}
+
+void
+root_page_table_x64::setup_direct_map(size_type size)
+{
+    static_assert((DIRECT_MAP_START & (page_table::pdpt::size_bytes - 1)) == 0, "DIRECT_MAP_START must be 1g aligned");
+
+    expects(size != 0);
+    expects((size & (page_table::pd::size_bytes - 1)) == 0);
+    expects(size <= 0x800000000000UL - DIRECT_MAP_START);
+
+    auto max = page_table::pd::size_bytes;
+
+    if (size >= page_table::pdpt::size_bytes && cpuid::extended_processor_information::edx::pdpe1gb::get())
+        max = page_table::pdpt::size_bytes;
+
+    {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        this->map_pages(DIRECT_MAP_START, 0, size, x64::memory_attr::rw_wb, max, false, true);
+    }
+
+    if (m_is_vmm)
+        g_direct_map_size = size;
 }
 
 page_table_entry_x64
@@ -144,6 +295,25 @@ root_page_table_x64::pt_to_mdl() const
     return m_pt->pt_to_mdl();
 }
 
+gsl::span<uintptr_t>
+root_page_table_x64::add_pages(integer_pointer virt, size_type num, size_type size)
+{
+    switch (size)
+    {
+        case page_table::pdpt::size_bytes:
+            return m_pt->add_pages_1g(virt, num);
+
+        case page_table::pd::size_bytes:
+            return m_pt->add_pages_2m(virt, num);
+
+        case page_table::pt::size_bytes:
+            return m_pt->add_pages_4k(virt, num);
+
+        default:
+            throw std::logic_error("invalid pt size");
+    }
+}
+
 page_table_entry_x64
 root_page_table_x64::add_page(integer_pointer virt, size_type size)
 {
@@ -164,7 +334,7 @@ root_page_table_x64::add_page(integer_pointer virt, size_type size)
 }
 
 void
-root_page_table_x64::map_page(integer_pointer virt, integer_pointer phys, attr_type attr, size_type size)
+root_page_table_x64::map_page(integer_pointer virt, integer_pointer phys, attr_type attr, size_type size, bool track)
 {
     std::lock_guard<std::mutex> guard(m_mutex);
 
@@ -173,83 +343,83 @@ root_page_table_x64::map_page(integer_pointer virt, integer_pointer phys, attr_t
     auto ___ = gsl::on_failure([&]
     { this->unmap_page(virt); });
 
-    switch (size)
-    {
-        case page_table::pdpt::size_bytes:
-            entry.clear();
-            entry.set_phys_addr(phys & ~(page_table::pdpt::size_bytes - 1));
-            entry.set_present(true);
-            entry.set_ps(true);
-            entry.set_pat_index_large(pat::mem_attr_to_pat_index(attr));
-            break;
+    set_entry(entry, phys, attr, size);
 
-        case page_table::pd::size_bytes:
-            entry.clear();
-            entry.set_phys_addr(phys & ~(page_table::pd::size_bytes - 1));
-            entry.set_present(true);
-            entry.set_ps(true);
-            entry.set_pat_index_large(pat::mem_attr_to_pat_index(attr));
-            break;
+    if (m_is_vmm && track)
+        g_mm->add_md(virt, phys, attr);
+}
 
-        case page_table::pt::size_bytes:
-            entry.clear();
-            entry.set_phys_addr(phys & ~(page_table::pt::size_bytes - 1));
-            entry.set_present(true);
-            entry.set_pat_index_4k(pat::mem_attr_to_pat_index(attr));
-            break;
+void
+root_page_table_x64::unmap_page(integer_pointer virt) noexcept
+{
+    guard_exceptions([&]
+    { m_pt->remove_page(virt); });
+
+    if (m_is_vmm)
+    {
+        guard_exceptions([&]
+        { g_mm->remove_md(virt); });
     }
+}
 
-    switch (attr)
+void
+root_page_table_x64::map_pages(
+    integer_pointer virt, integer_pointer phys, size_type size, attr_type attr, size_type max, bool track, bool global)
+{
+    auto done = 0UL;
+
+    auto ___ = gsl::on_failure([&]
+    { this->unmap_pages(virt, size); });
+
+    while (done < size)
     {
-        case memory_attr::rw_uc:
-        case memory_attr::rw_wc:
-        case memory_attr::rw_wt:
-        case memory_attr::rw_wp:
-        case memory_attr::rw_wb:
-        case memory_attr::rw_uc_m:
-            entry.set_rw(true);
-            entry.set_nx(true);
-            break;
+        auto &&remaining = size - done;
+        auto page = page_table::pt::size_bytes;
 
-        case memory_attr::re_uc:
-        case memory_attr::re_wc:
-        case memory_attr::re_wt:
-        case memory_attr::re_wp:
-        case memory_attr::re_wb:
-        case memory_attr::re_uc_m:
-            entry.set_rw(false);
-            entry.set_nx(false);
-            break;
+        for (auto large : {page_table::pdpt::size_bytes, page_table::pd::size_bytes})
+        {
+            if (large <= max && large <= remaining && (((virt + done) | (phys + done)) & (large - 1)) == 0)
+            {
+                page = large;
+                break;
+            }
+        }
 
-        case memory_attr::pt_uc:
-        case memory_attr::pt_wc:
-        case memory_attr::pt_wt:
-        case memory_attr::pt_wp:
-        case memory_attr::pt_wb:
-        case memory_attr::pt_uc_m:
-            entry.set_rw(true);
-            entry.set_nx(false);
-            break;
+        auto &&entries = this->add_pages(virt + done, remaining / page, page);
 
-        default:
-            throw std::logic_error("unsupported memory permissions");
+        for (auto &element : entries)
+        {
+            auto &&entry = page_table_entry_x64(&element);
+
+            set_entry(entry, phys + done, attr, page, global);
+            done += page;
+        }
     }
 
-    if (m_is_vmm)
-        g_mm->add_md(virt, phys, attr);
+    if (m_is_vmm && track && size != 0)
+        g_mm->add_md_range(virt, phys, size, attr);
 }
 
 void
-root_page_table_x64::unmap_page(integer_pointer virt) noexcept
+root_page_table_x64::unmap_pages(integer_pointer virt, size_type size) noexcept
 {
-    guard_exceptions([&]
-    { m_pt->remove_page(virt); });
-
-    if (m_is_vmm)
+    for (auto offset = 0UL; offset < size;)
     {
+        auto removed = 0UL;
+
         guard_exceptions([&]
-        { g_mm->remove_md(virt); });
+        { removed = m_pt->remove_page(virt + offset); });
+
+        // virt + offset might be in the middle of a large page, in which
+        // case the next mapping starts at the end of that page, not at
+        // virt + offset + removed
+
+        auto &&step = removed != 0 ? removed : page_table::pt::size_bytes;
+        offset = (((virt + offset) & ~(step - 1)) + step) - virt;
     }
+
+    if (m_is_vmm && size != 0)
+        g_mm->remove_md_range(virt, size);
 }
 
 root_page_table_x64 *
@@ -272,8 +442,11 @@ root_pt() noexcept
                 if (md.type == (MEMORY_TYPE_R | MEMORY_TYPE_E))
                     attr = memory_attr::re_wb;
 
-                rpt->map_4k(md.virt, md.phys, attr);
+                rpt->map_range(md.virt, md.phys, md.size, attr, true);
             }
+
+            if (DIRECT_MAP_SIZE != 0)
+                rpt->setup_direct_map(DIRECT_MAP_SIZE);
         }
         catch (std::exception &e)
         {
@@ -286,3 +459,7 @@ root_pt() noexcept
 
     return rpt.get();
 }
+
+uintptr_t
+direct_map_size() noexcept
+{ return g_direct_map_size; }
@@ -0,0 +1,124 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#include <gsl/gsl>
+
+#include <guard_exceptions.h>
+#include <thread_context.h>
+
+#include <intrinsics/tlb_x64.h>
+
+#include <memory_manager/temp_map_x64.h>
+#include <memory_manager/root_page_table_x64.h>
+
+constexpr const auto temp_map_all_used =
+    TEMP_MAP_SLOTS == 64 ? ~0ULL : (1ULL << TEMP_MAP_SLOTS) - 1;
+
+temp_map_x64 *
+temp_map_x64::instance() noexcept
+{
+    static temp_map_x64 self;
+    return &self;
+}
+
+temp_map_x64::temp_map_x64() noexcept
+{
+    for (auto &cpu : m_cpus)
+    {
+        cpu.used = 0;
+        cpu.reserved = false;
+        cpu.ptes.fill(nullptr);
+    }
+}
+
+temp_map_x64::integer_pointer
+temp_map_x64::map(integer_pointer phys, attr_type attr) noexcept
+{
+    auto &&cpuid = thread_context_cpuid();
+
+    if (cpuid >= MAX_NUM_CPUS || thread_context_vmx_root() == 0)
+        return 0;
+
+    auto &&cpu = gsl::at(m_cpus, cpuid);
+
+    if (!cpu.reserved && !this->reserve(cpuid))
+        return 0;
+
+    auto pte = 0UL;
+
+    guard_exceptions([&]
+    { pte = root_page_table_x64::pte_4k(phys, attr); });
+
+    if (pte == 0)
+        return 0;
+
+    // Only this CPU sets bits in its mask (any CPU can clear them), so the
+    // free slot that is found cannot be taken before it is marked as used.
+
+    auto &&used = cpu.used.load();
+
+    if (used == temp_map_all_used)
+        return 0;
+
+    auto &&slot = static_cast<size_type>(__builtin_ctzll(~used));
+    cpu.used.fetch_or(1ULL << slot);
+
+    auto &&virt = slot_addr(cpuid, slot);
+
+    *gsl::at(cpu.ptes, slot) = pte;
+    x64::tlb::invlpg(reinterpret_cast<void *>(virt));
+
+    return virt;
+}
+
+void
+temp_map_x64::unmap(integer_pointer virt) noexcept
+{
+    if (!contains(virt))
+        return;
+
+    auto &&index = (virt - TEMP_MAP_START) / MAX_PAGE_SIZE;
+    auto &&cpu = gsl::at(m_cpus, index / TEMP_MAP_SLOTS);
+    auto &&slot = index % TEMP_MAP_SLOTS;
+
+    if (!cpu.reserved)
+        return;
+
+    *gsl::at(cpu.ptes, slot) = 0;
+    cpu.used.fetch_and(~(1ULL << slot));
+}
+
+bool
+temp_map_x64::reserve(size_type cpuid) noexcept
+{
+    auto &&cpu = gsl::at(m_cpus, cpuid);
+
+    guard_exceptions([&]
+    {
+        for (auto slot = 0UL; slot < TEMP_MAP_SLOTS; slot++)
+            gsl::at(cpu.ptes, slot) = g_pt->reserve_4k(slot_addr(cpuid, slot));
+
+        cpu.reserved = true;
+    });
+
+    return cpu.reserved;
+}
@@ -52,10 +52,21 @@ NATIVE_OUTDIR+=%BUILD_REL%/../bin
 SOURCES+=test.cpp
 SOURCES+=test_memory_manager_x64.cpp
 SOURCES+=test_mem_pool.cpp
+SOURCES+=test_buddy_pool.cpp
+SOURCES+=test_vmem_arena.cpp
+SOURCES+=test_slab_pool.cpp
+SOURCES+=test_slab_cache.cpp
+SOURCES+=test_mem_stats.cpp
+SOURCES+=test_mem_tag.cpp
+SOURCES+=test_radix_table.cpp
+SOURCES+=test_grace_period.cpp
 SOURCES+=test_page_table_x64.cpp
 SOURCES+=test_page_table_entry_x64.cpp
 SOURCES+=test_map_ptr_x64.cpp
+SOURCES+=test_page_walk_cache_x64.cpp
+SOURCES+=test_guest_copy_x64.cpp
 SOURCES+=test_root_page_table_x64.cpp
+SOURCES+=test_temp_map_x64.cpp
 SOURCES+=test_pat_x64.cpp
 SOURCES+=test_mem_attr_x64.cpp
 HEADERS=
@@ -59,16 +59,116 @@ memory_manager_ut::list()
     this->test_mem_pool_size();
     this->test_mem_pool_contains_out_of_bounds();
     this->test_mem_pool_contains();
+    this->test_mem_pool_free_not_start_of_allocation();
+    this->test_mem_pool_malloc_spans_words();
+    this->test_mem_pool_malloc_skips_used_words();
+    this->test_mem_pool_alloc_aligned_invalid();
+    this->test_mem_pool_alloc_aligned();
+    this->test_mem_pool_resize_invalid();
+    this->test_mem_pool_resize_grow();
+    this->test_mem_pool_resize_shrink();
+    this->test_mem_pool_resize_spans_words();
+    this->test_mem_pool_add_region();
+    this->test_mem_pool_high_water();
+    this->test_mem_pool_largest_free();
+    this->test_mem_pool_tag();
+    this->test_mem_pool_large_fragmented();
+    this->test_mem_pool_large_spans_chunks();
+
+    this->test_slab_pool_invalid_pool();
+    this->test_slab_pool_malloc_zero();
+    this->test_slab_pool_malloc_too_large();
+    this->test_slab_pool_size_classes();
+    this->test_slab_pool_free_reuse();
+    this->test_slab_pool_free_invalid();
+    this->test_slab_pool_out_of_memory();
+    this->test_slab_pool_contains();
+    this->test_slab_pool_alloc_batch();
+    this->test_slab_pool_free_batch();
+    this->test_slab_pool_tag();
+
+    this->test_buddy_pool_invalid_pool();
+    this->test_buddy_pool_malloc_zero();
+    this->test_buddy_pool_malloc_too_large();
+    this->test_buddy_pool_malloc_rounds_to_order();
+    this->test_buddy_pool_malloc_contiguous();
+    this->test_buddy_pool_malloc_aligned();
+    this->test_buddy_pool_unaligned_start();
+    this->test_buddy_pool_free_coalesce();
+    this->test_buddy_pool_free_invalid();
+    this->test_buddy_pool_report();
+    this->test_buddy_pool_high_water();
+    this->test_buddy_pool_tag();
+    this->test_buddy_pool_add_region();
+    this->test_vmem_arena_invalid_arena();
+    this->test_vmem_arena_malloc_invalid();
+    this->test_vmem_arena_alloc_free();
+    this->test_vmem_arena_coalesce();
+    this->test_vmem_arena_qcache();
+    this->test_vmem_arena_alloc_aligned();
+    this->test_vmem_arena_out_of_segments();
+
+    this->test_radix_table_get_empty();
+    this->test_radix_table_set_get();
+    this->test_radix_table_set_invalid();
+    this->test_radix_table_clear();
+    this->test_radix_table_for_each();
+    this->test_radix_table_single_level();
+    this->test_radix_table_clear_reclaims_nodes();
+    this->test_radix_table_clear_without_grace_period();
+    this->test_radix_table_clear_waits_for_readers();
+
+    this->test_grace_period_passed();
+    this->test_grace_period_enter_leave();
+    this->test_grace_period_out_of_range();
+
+    this->test_slab_cache_alloc();
+    this->test_slab_cache_free();
+    this->test_slab_cache_flush();
+    this->test_slab_cache_per_cpu();
+    this->test_slab_cache_driver_context();
+
+    this->test_mem_stats_record();
+    this->test_mem_stats_per_cpu();
+    this->test_mem_stats_bucket();
+
+    this->test_mem_tag_scope();
+    this->test_mem_tag_per_cpu();
+    this->test_mem_tag_name();
 
     this->test_memory_manager_x64_size_out_of_bounds();
     this->test_memory_manager_x64_malloc_out_of_memory();
     this->test_memory_manager_x64_malloc_heap();
     this->test_memory_manager_x64_malloc_page();
+    this->test_memory_manager_x64_malloc_contiguous();
+    this->test_memory_manager_x64_malloc_contiguous_tries();
+    this->test_memory_manager_x64_malloc_aligned();
+    this->test_memory_manager_x64_malloc_aligned_small();
+    this->test_memory_manager_x64_realloc_alloc_free();
+    this->test_memory_manager_x64_realloc_in_place();
+    this->test_memory_manager_x64_realloc_copy();
+    this->test_memory_manager_x64_add_heap();
+    this->test_memory_manager_x64_page_pool_report();
+    this->test_memory_manager_x64_pool_stats();
+    this->test_memory_manager_x64_tag_report();
+    this->test_memory_manager_x64_add_pages();
+    this->test_memory_manager_x64_heap_token();
+    this->test_memory_manager_x64_pool_generation();
     this->test_memory_manager_x64_malloc_map();
+    this->test_memory_manager_x64_malloc_map_aligned();
+    this->test_memory_manager_x64_free_map_deferred();
+    this->test_memory_manager_x64_free_map_deferred_other_cpu();
     this->test_memory_manager_x64_add_md();
     this->test_memory_manager_x64_add_md_invalid_type();
     this->test_memory_manager_x64_add_md_unaligned_physical();
     this->test_memory_manager_x64_add_md_unaligned_virtual();
+    this->test_memory_manager_x64_add_md_invalid_attr();
+    this->test_memory_manager_x64_add_md_non_canonical();
+    this->test_memory_manager_x64_add_md_upper_half();
+    this->test_memory_manager_x64_add_md_range();
+    this->test_memory_manager_x64_add_md_coalesce();
+    this->test_memory_manager_x64_add_md_split();
+    this->test_memory_manager_x64_remove_md_range();
     this->test_memory_manager_x64_remove_md_invalid_virt();
     this->test_memory_manager_x64_virtint_to_physint_failure();
     this->test_memory_manager_x64_physint_to_virtint_failure();
@@ -79,6 +179,8 @@ memory_manager_ut::list()
     this->test_memory_manager_x64_physint_to_virtint_nullptr();
     this->test_memory_manager_x64_virtint_to_attrint_random_address();
     this->test_memory_manager_x64_virtint_to_attrint_nullptr();
+    this->test_memory_manager_x64_translate_driver_context();
+    this->test_memory_manager_x64_begin_end_exit();
 
     this->test_page_table_x64_add_remove_page_success_without_setting();
     this->test_page_table_x64_add_remove_page_1g_success();
@@ -91,6 +193,9 @@ memory_manager_ut::list()
     this->test_page_table_x64_virt_to_pte_invalid();
     this->test_page_table_x64_virt_to_pte_success();
     this->test_page_table_x64_pt_to_mdl_success();
+    this->test_page_table_x64_add_pages_success();
+    this->test_page_table_x64_mixed_pages_success();
+    this->test_page_table_x64_reuse_tables_success();
 
     this->test_page_table_entry_x64_present();
     this->test_page_table_entry_x64_rw();
@@ -114,10 +219,12 @@ memory_manager_ut::list()
     this->test_unique_map_ptr_x64_phys_range_constructor_invalid_args();
     this->test_unique_map_ptr_x64_phys_range_constructor_mm_map_fails();
     this->test_unique_map_ptr_x64_phys_range_constructor_success();
+    this->test_unique_map_ptr_x64_phys_range_constructor_large();
     this->test_unique_map_ptr_x64_virt_cr3_constructor_invalid_args();
     this->test_unique_map_ptr_x64_virt_cr3_constructor_mm_map_fails();
     this->test_unique_map_ptr_x64_virt_cr3_constructor_success_1g();
     this->test_unique_map_ptr_x64_virt_cr3_constructor_success_2m();
+    this->test_unique_map_ptr_x64_virt_cr3_constructor_large();
     this->test_unique_map_ptr_x64_virt_cr3_constructor_success_4k();
     this->test_unique_map_ptr_x64_virt_cr3_constructor_success_4k_aligned_addr();
     this->test_unique_map_ptr_x64_virt_cr3_constructor_success_4k_aligned_size();
@@ -131,13 +238,39 @@ memory_manager_ut::list()
     this->test_unique_map_ptr_x64_reset();
     this->test_unique_map_ptr_x64_swap();
     this->test_unique_map_ptr_x64_flush();
+    this->test_unique_map_ptr_x64_flush_large();
     this->test_unique_map_ptr_x64_cache_flush();
     this->test_unique_map_ptr_x64_comparison();
     this->test_unique_map_ptr_x64_make_failure();
+    this->test_unique_map_ptr_x64_direct_map();
+    this->test_unique_map_ptr_x64_direct_map_not_covered();
+    this->test_unique_map_ptr_x64_temp_map();
     this->test_virt_to_phys_with_cr3_invalid();
     this->test_virt_to_phys_with_cr3_1g();
     this->test_virt_to_phys_with_cr3_2m();
     this->test_virt_to_phys_with_cr3_4k();
+    this->test_page_walk_cache_x64_invalid_args();
+    this->test_page_walk_cache_x64_4k();
+    this->test_page_walk_cache_x64_2m();
+    this->test_page_walk_cache_x64_1g();
+    this->test_page_walk_cache_x64_not_present();
+    this->test_page_walk_cache_x64_flush();
+    this->test_page_walk_cache_x64_cr3_change();
+    this->test_page_walk_cache_x64_table_eviction();
+    this->test_page_walk_cache_x64_release();
+    this->test_page_walk_cache_x64_map_with_cr3();
+    this->test_page_walk_cache_x64_map_with_cr3_2m();
+
+    this->test_guest_copy_x64_invalid_args();
+    this->test_guest_sg_iterator_x64_contiguous();
+    this->test_guest_sg_iterator_x64_lazy();
+    this->test_guest_sg_iterator_x64_2m();
+    this->test_guest_sg_iterator_x64_not_present();
+    this->test_guest_copy_x64_from_guest();
+    this->test_guest_copy_x64_from_guest_cross_page();
+    this->test_guest_copy_x64_to_guest();
+    this->test_guest_copy_x64_to_guest_read_only();
+    this->test_guest_copy_x64_with_cache();
 
     this->test_root_page_table_x64_init_failure();
     this->test_root_page_table_x64_init_success();
@@ -147,14 +280,34 @@ memory_manager_ut::list()
     this->test_root_page_table_x64_map_4k();
     this->test_root_page_table_x64_map_invalid();
     this->test_root_page_table_x64_map_unmap_twice_success();
+    this->test_root_page_table_x64_map_range_invalid();
+    this->test_root_page_table_x64_map_range_mixed();
+    this->test_root_page_table_x64_map_range_1g();
+    this->test_root_page_table_x64_map_range_tracked();
+    this->test_root_page_table_x64_unmap_range_inside_large_page();
+    this->test_root_page_table_x64_map_range_global();
+    this->test_root_page_table_x64_reserve_4k();
     this->test_root_page_table_x64_setup_identity_map_1g_invalid();
     this->test_root_page_table_x64_setup_identity_map_1g_valid();
     this->test_root_page_table_x64_setup_identity_map_2m_invalid();
     this->test_root_page_table_x64_setup_identity_map_2m_valid();
     this->test_root_page_table_x64_setup_identity_map_4k_invalid();
     this->test_root_page_table_x64_setup_identity_map_4k_valid();
+    this->test_root_page_table_x64_setup_direct_map_invalid();
+    this->test_root_page_table_x64_setup_direct_map_1g();
+    this->test_root_page_table_x64_setup_direct_map_2m();
+    this->test_root_page_table_x64_setup_direct_map_2m_unaligned();
     this->test_root_page_table_x64_pt_to_mdl();
 
+    this->test_temp_map_x64_contains();
+    this->test_temp_map_x64_map_success();
+    this->test_temp_map_x64_map_full();
+    this->test_temp_map_x64_map_invalid_cpuid();
+    this->test_temp_map_x64_map_driver_context();
+    this->test_temp_map_x64_map_invalid_attr();
+    this->test_temp_map_x64_map_reserve_failure();
+    this->test_temp_map_x64_unmap_other_cpu();
+
     this->test_pat_x64_mem_attr_to_pat_index();
     this->test_mem_attr_x64_mem_type_to_attr();
 
@@ -55,16 +55,116 @@ private:
     void test_mem_pool_size();
     void test_mem_pool_contains_out_of_bounds();
     void test_mem_pool_contains();
+    void test_mem_pool_free_not_start_of_allocation();
+    void test_mem_pool_malloc_spans_words();
+    void test_mem_pool_malloc_skips_used_words();
+    void test_mem_pool_alloc_aligned_invalid();
+    void test_mem_pool_alloc_aligned();
+    void test_mem_pool_resize_invalid();
+    void test_mem_pool_resize_grow();
+    void test_mem_pool_resize_shrink();
+    void test_mem_pool_resize_spans_words();
+    void test_mem_pool_add_region();
+    void test_mem_pool_high_water();
+    void test_mem_pool_largest_free();
+    void test_mem_pool_tag();
+    void test_mem_pool_large_fragmented();
+    void test_mem_pool_large_spans_chunks();
+
+    void test_slab_pool_invalid_pool();
+    void test_slab_pool_malloc_zero();
+    void test_slab_pool_malloc_too_large();
+    void test_slab_pool_size_classes();
+    void test_slab_pool_free_reuse();
+    void test_slab_pool_free_invalid();
+    void test_slab_pool_out_of_memory();
+    void test_slab_pool_contains();
+    void test_slab_pool_alloc_batch();
+    void test_slab_pool_free_batch();
+    void test_slab_pool_tag();
+
+    void test_buddy_pool_invalid_pool();
+    void test_buddy_pool_malloc_zero();
+    void test_buddy_pool_malloc_too_large();
+    void test_buddy_pool_malloc_rounds_to_order();
+    void test_buddy_pool_malloc_contiguous();
+    void test_buddy_pool_malloc_aligned();
+    void test_buddy_pool_unaligned_start();
+    void test_buddy_pool_free_coalesce();
+    void test_buddy_pool_free_invalid();
+    void test_buddy_pool_report();
+    void test_buddy_pool_high_water();
+    void test_buddy_pool_tag();
+    void test_buddy_pool_add_region();
+    void test_vmem_arena_invalid_arena();
+    void test_vmem_arena_malloc_invalid();
+    void test_vmem_arena_alloc_free();
+    void test_vmem_arena_coalesce();
+    void test_vmem_arena_qcache();
+    void test_vmem_arena_alloc_aligned();
+    void test_vmem_arena_out_of_segments();
+
+    void test_radix_table_get_empty();
+    void test_radix_table_set_get();
+    void test_radix_table_set_invalid();
+    void test_radix_table_clear();
+    void test_radix_table_for_each();
+    void test_radix_table_single_level();
+    void test_radix_table_clear_reclaims_nodes();
+    void test_radix_table_clear_without_grace_period();
+    void test_radix_table_clear_waits_for_readers();
+
+    void test_grace_period_passed();
+    void test_grace_period_enter_leave();
+    void test_grace_period_out_of_range();
+
+    void test_slab_cache_alloc();
+    void test_slab_cache_free();
+    void test_slab_cache_flush();
+    void test_slab_cache_per_cpu();
+    void test_slab_cache_driver_context();
+
+    void test_mem_stats_record();
+    void test_mem_stats_per_cpu();
+    void test_mem_stats_bucket();
+
+    void test_mem_tag_scope();
+    void test_mem_tag_per_cpu();
+    void test_mem_tag_name();
 
     void test_memory_manager_x64_size_out_of_bounds();
     void test_memory_manager_x64_malloc_out_of_memory();
     void test_memory_manager_x64_malloc_heap();
     void test_memory_manager_x64_malloc_page();
+    void test_memory_manager_x64_malloc_contiguous();
+    void test_memory_manager_x64_malloc_contiguous_tries();
+    void test_memory_manager_x64_malloc_aligned();
+    void test_memory_manager_x64_malloc_aligned_small();
+    void test_memory_manager_x64_realloc_alloc_free();
+    void test_memory_manager_x64_realloc_in_place();
+    void test_memory_manager_x64_realloc_copy();
+    void test_memory_manager_x64_add_heap();
+    void test_memory_manager_x64_page_pool_report();
+    void test_memory_manager_x64_pool_stats();
+    void test_memory_manager_x64_tag_report();
+    void test_memory_manager_x64_add_pages();
+    void test_memory_manager_x64_heap_token();
+    void test_memory_manager_x64_pool_generation();
     void test_memory_manager_x64_malloc_map();
+    void test_memory_manager_x64_malloc_map_aligned();
+    void test_memory_manager_x64_free_map_deferred();
+    void test_memory_manager_x64_free_map_deferred_other_cpu();
     void test_memory_manager_x64_add_md();
     void test_memory_manager_x64_add_md_invalid_type();
     void test_memory_manager_x64_add_md_unaligned_physical();
     void test_memory_manager_x64_add_md_unaligned_virtual();
+    void test_memory_manager_x64_add_md_invalid_attr();
+    void test_memory_manager_x64_add_md_non_canonical();
+    void test_memory_manager_x64_add_md_upper_half();
+    void test_memory_manager_x64_add_md_range();
+    void test_memory_manager_x64_add_md_coalesce();
+    void test_memory_manager_x64_add_md_split();
+    void test_memory_manager_x64_remove_md_range();
     void test_memory_manager_x64_remove_md_invalid_virt();
     void test_memory_manager_x64_virtint_to_physint_failure();
     void test_memory_manager_x64_physint_to_virtint_failure();
@@ -75,6 +175,8 @@ private:
     void test_memory_manager_x64_physint_to_virtint_nullptr();
     void test_memory_manager_x64_virtint_to_attrint_random_address();
     void test_memory_manager_x64_virtint_to_attrint_nullptr();
+    void test_memory_manager_x64_translate_driver_context();
+    void test_memory_manager_x64_begin_end_exit();
 
     void test_page_table_x64_add_remove_page_success_without_setting();
     void test_page_table_x64_add_remove_page_1g_success();
@@ -87,6 +189,9 @@ private:
     void test_page_table_x64_virt_to_pte_invalid();
     void test_page_table_x64_virt_to_pte_success();
     void test_page_table_x64_pt_to_mdl_success();
+    void test_page_table_x64_add_pages_success();
+    void test_page_table_x64_mixed_pages_success();
+    void test_page_table_x64_reuse_tables_success();
 
     void test_page_table_entry_x64_present();
     void test_page_table_entry_x64_rw();
@@ -110,10 +215,12 @@ private:
     void test_unique_map_ptr_x64_phys_range_constructor_invalid_args();
     void test_unique_map_ptr_x64_phys_range_constructor_mm_map_fails();
     void test_unique_map_ptr_x64_phys_range_constructor_success();
+    void test_unique_map_ptr_x64_phys_range_constructor_large();
     void test_unique_map_ptr_x64_virt_cr3_constructor_invalid_args();
     void test_unique_map_ptr_x64_virt_cr3_constructor_mm_map_fails();
     void test_unique_map_ptr_x64_virt_cr3_constructor_success_1g();
     void test_unique_map_ptr_x64_virt_cr3_constructor_success_2m();
+    void test_unique_map_ptr_x64_virt_cr3_constructor_large();
     void test_unique_map_ptr_x64_virt_cr3_constructor_success_4k();
     void test_unique_map_ptr_x64_virt_cr3_constructor_success_4k_aligned_addr();
     void test_unique_map_ptr_x64_virt_cr3_constructor_success_4k_aligned_size();
@@ -127,13 +234,39 @@ private:
     void test_unique_map_ptr_x64_reset();
     void test_unique_map_ptr_x64_swap();
     void test_unique_map_ptr_x64_flush();
+    void test_unique_map_ptr_x64_flush_large();
     void test_unique_map_ptr_x64_cache_flush();
     void test_unique_map_ptr_x64_comparison();
     void test_unique_map_ptr_x64_make_failure();
+    void test_unique_map_ptr_x64_direct_map();
+    void test_unique_map_ptr_x64_direct_map_not_covered();
+    void test_unique_map_ptr_x64_temp_map();
     void test_virt_to_phys_with_cr3_invalid();
     void test_virt_to_phys_with_cr3_1g();
     void test_virt_to_phys_with_cr3_2m();
     void test_virt_to_phys_with_cr3_4k();
+    void test_page_walk_cache_x64_invalid_args();
+    void test_page_walk_cache_x64_4k();
+    void test_page_walk_cache_x64_2m();
+    void test_page_walk_cache_x64_1g();
+    void test_page_walk_cache_x64_not_present();
+    void test_page_walk_cache_x64_flush();
+    void test_page_walk_cache_x64_cr3_change();
+    void test_page_walk_cache_x64_table_eviction();
+    void test_page_walk_cache_x64_release();
+    void test_page_walk_cache_x64_map_with_cr3();
+    void test_page_walk_cache_x64_map_with_cr3_2m();
+
+    void test_guest_copy_x64_invalid_args();
+    void test_guest_sg_iterator_x64_contiguous();
+    void test_guest_sg_iterator_x64_lazy();
+    void test_guest_sg_iterator_x64_2m();
+    void test_guest_sg_iterator_x64_not_present();
+    void test_guest_copy_x64_from_guest();
+    void test_guest_copy_x64_from_guest_cross_page();
+    void test_guest_copy_x64_to_guest();
+    void test_guest_copy_x64_to_guest_read_only();
+    void test_guest_copy_x64_with_cache();
 
     void test_root_page_table_x64_init_failure();
     void test_root_page_table_x64_init_success();
@@ -143,14 +276,34 @@ private:
     void test_root_page_table_x64_map_4k();
     void test_root_page_table_x64_map_invalid();
     void test_root_page_table_x64_map_unmap_twice_success();
+    void test_root_page_table_x64_map_range_invalid();
+    void test_root_page_table_x64_map_range_mixed();
+    void test_root_page_table_x64_map_range_1g();
+    void test_root_page_table_x64_map_range_tracked();
+    void test_root_page_table_x64_unmap_range_inside_large_page();
+    void test_root_page_table_x64_map_range_global();
+    void test_root_page_table_x64_reserve_4k();
     void test_root_page_table_x64_setup_identity_map_1g_invalid();
     void test_root_page_table_x64_setup_identity_map_1g_valid();
     void test_root_page_table_x64_setup_identity_map_2m_invalid();
     void test_root_page_table_x64_setup_identity_map_2m_valid();
     void test_root_page_table_x64_setup_identity_map_4k_invalid();
     void test_root_page_table_x64_setup_identity_map_4k_valid();
+    void test_root_page_table_x64_setup_direct_map_invalid();
+    void test_root_page_table_x64_setup_direct_map_1g();
+    void test_root_page_table_x64_setup_direct_map_2m();
+    void test_root_page_table_x64_setup_direct_map_2m_unaligned();
     void test_root_page_table_x64_pt_to_mdl();
 
+    void test_temp_map_x64_contains();
+    void test_temp_map_x64_map_success();
+    void test_temp_map_x64_map_full();
+    void test_temp_map_x64_map_invalid_cpuid();
+    void test_temp_map_x64_map_driver_context();
+    void test_temp_map_x64_map_invalid_attr();
+    void test_temp_map_x64_map_reserve_failure();
+    void test_temp_map_x64_unmap_other_cpu();
+
     void test_pat_x64_mem_attr_to_pat_index();
     void test_mem_attr_x64_mem_type_to_attr();
 };
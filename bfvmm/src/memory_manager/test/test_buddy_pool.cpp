@@ -0,0 +1,301 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#define TESTING_MEM_POOL
+
+#include <gsl/gsl>
+
+#include <vector>
+
+#include <test.h>
+#include <memory_manager/buddy_pool.h>
+
+using buddy_pool_type = buddy_pool<0x10000, 12>;
+
+alignas(0x10000) static uint8_t g_buddy_pages[0x10000] = {};
+static auto g_buddy_addr = reinterpret_cast<uintptr_t>(g_buddy_pages);
+
+alignas(0x10000) static uint8_t g_buddy_region[0x10000] = {};
+static auto g_buddy_region_addr = reinterpret_cast<uintptr_t>(g_buddy_region);
+
+void
+memory_manager_ut::test_buddy_pool_invalid_pool()
+{
+    this->expect_exception([&] { buddy_pool_type pool(0); }, ""_ut_lee);
+    this->expect_exception([&] { buddy_pool_type pool(g_buddy_addr + 8); }, ""_ut_lee);
+    this->expect_exception([&] { buddy_pool_type pool(0xFFFFFFFFFFFFF000); }, ""_ut_lee);
+}
+
+void
+memory_manager_ut::test_buddy_pool_malloc_zero()
+{
+    buddy_pool_type pool{g_buddy_addr};
+
+    this->expect_exception([&] { pool.alloc(0); }, ""_ut_ffe);
+    this->expect_exception([&] { pool.alloc_aligned(0, 0x1000); }, ""_ut_ffe);
+}
+
+void
+memory_manager_ut::test_buddy_pool_malloc_too_large()
+{
+    buddy_pool_type pool{g_buddy_addr};
+
+    this->expect_exception([&] { pool.alloc(0x10001); }, ""_ut_ffe);
+    this->expect_exception([&] { pool.alloc_contiguous(buddy_pool_max_order + 1); }, ""_ut_ffe);
+    this->expect_exception([&] { pool.alloc_contiguous(5); }, ""_ut_bae);
+}
+
+void
+memory_manager_ut::test_buddy_pool_malloc_rounds_to_order()
+{
+    buddy_pool_type pool{g_buddy_addr};
+
+    auto &&addr1 = pool.alloc(1);
+    auto &&addr2 = pool.alloc(0x1001);
+    auto &&addr3 = pool.alloc(0x3000);
+
+    this->expect_true(pool.size(addr1) == 0x1000);
+    this->expect_true(pool.size(addr2) == 0x2000);
+    this->expect_true(pool.size(addr3) == 0x4000);
+
+    this->expect_true(addr1 == g_buddy_addr);
+    this->expect_true(addr2 == g_buddy_addr + 0x2000);
+    this->expect_true(addr3 == g_buddy_addr + 0x4000);
+}
+
+void
+memory_manager_ut::test_buddy_pool_malloc_contiguous()
+{
+    buddy_pool_type pool{g_buddy_addr};
+
+    auto &&addr1 = pool.alloc_contiguous(0);
+    auto &&addr2 = pool.alloc_contiguous(3);
+    auto &&addr3 = pool.alloc_contiguous(2);
+
+    this->expect_true(addr1 == g_buddy_addr);
+    this->expect_true(addr2 == g_buddy_addr + 0x8000);
+    this->expect_true(addr3 == g_buddy_addr + 0x4000);
+
+    this->expect_true(pool.size(addr2) == 0x8000);
+    this->expect_exception([&] { pool.alloc_contiguous(3); }, ""_ut_bae);
+}
+
+void
+memory_manager_ut::test_buddy_pool_malloc_aligned()
+{
+    buddy_pool_type pool{g_buddy_addr};
+
+    this->expect_exception([&] { pool.alloc_aligned(0x1000, 0); }, ""_ut_ffe);
+    this->expect_exception([&] { pool.alloc_aligned(0x1000, 0x3000); }, ""_ut_ffe);
+
+    auto &&addr1 = pool.alloc_aligned(0x10, 0x10);
+    auto &&addr2 = pool.alloc_aligned(0x1000, 0x8000);
+
+    this->expect_true(addr1 == g_buddy_addr);
+    this->expect_true(addr2 == g_buddy_addr + 0x8000);
+    this->expect_true(pool.size(addr2) == 0x1000);
+
+    this->expect_true(pool.alloc_contiguous(2) == g_buddy_addr + 0xC000);
+    this->expect_true(pool.alloc_contiguous(2) == g_buddy_addr + 0x4000);
+
+    this->expect_exception([&] { pool.alloc_aligned(0x1000, 0x20000); }, ""_ut_bae);
+}
+
+void
+memory_manager_ut::test_buddy_pool_unaligned_start()
+{
+    buddy_pool<0x4000, 12> pool{g_buddy_addr + 0x1000};
+
+    this->expect_true(pool.alloc_contiguous(1) == g_buddy_addr + 0x2000);
+    this->expect_exception([&] { pool.alloc_contiguous(1); }, ""_ut_bae);
+
+    this->expect_true(pool.alloc(0x1000) == g_buddy_addr + 0x4000);
+    this->expect_true(pool.alloc(0x1000) == g_buddy_addr + 0x1000);
+}
+
+void
+memory_manager_ut::test_buddy_pool_free_coalesce()
+{
+    buddy_pool_type pool{g_buddy_addr};
+
+    std::vector<buddy_pool_type::integer_pointer> addrs;
+
+    for (auto i = 0; i < 16; i++)
+        addrs.push_back(pool.alloc(0x1000));
+
+    this->expect_exception([&] { pool.alloc(0x1000); }, ""_ut_bae);
+
+    for (auto i = 0; i < 16; i += 2)
+        pool.free(addrs.at(static_cast<size_t>(i)));
+
+    this->expect_exception([&] { pool.alloc_contiguous(1); }, ""_ut_bae);
+
+    for (auto i = 1; i < 16; i += 2)
+        pool.free(addrs.at(static_cast<size_t>(i)));
+
+    this->expect_true(pool.alloc_contiguous(4) == g_buddy_addr);
+}
+
+void
+memory_manager_ut::test_buddy_pool_free_invalid()
+{
+    buddy_pool_type pool{g_buddy_addr};
+
+    auto &&addr = pool.alloc_contiguous(1);
+
+    pool.free(0);
+    pool.free(addr + 0x10);
+    pool.free(addr + 0x1000);
+    pool.free(0xFFFFFFFFFFFFF000);
+
+    this->expect_true(pool.size(addr) == 0x2000);
+    this->expect_true(pool.size(addr + 0x1000) == 0);
+    this->expect_true(pool.size(addr + 0x10) == 0);
+    this->expect_true(pool.size(0) == 0);
+
+    pool.free(addr);
+    pool.free(addr);
+
+    this->expect_true(pool.size(addr) == 0);
+    this->expect_true(pool.alloc_contiguous(4) == g_buddy_addr);
+}
+
+void
+memory_manager_ut::test_buddy_pool_report()
+{
+    buddy_pool_type pool{g_buddy_addr};
+
+    auto &&report1 = pool.report();
+    this->expect_true(report1.pool_size == 0x10000);
+    this->expect_true(report1.free_size == 0x10000);
+    this->expect_true(report1.largest_free == 0x10000);
+    this->expect_true(report1.free_blocks.at(4) == 1);
+
+    auto &&addr = pool.alloc(0x1000);
+
+    auto &&report2 = pool.report();
+    this->expect_true(report2.free_size == 0xF000);
+    this->expect_true(report2.largest_free == 0x8000);
+    this->expect_true(report2.free_blocks.at(0) == 1);
+    this->expect_true(report2.free_blocks.at(1) == 1);
+    this->expect_true(report2.free_blocks.at(2) == 1);
+    this->expect_true(report2.free_blocks.at(3) == 1);
+    this->expect_true(report2.free_blocks.at(4) == 0);
+
+    pool.free(addr);
+
+    auto &&report3 = pool.report();
+    this->expect_true(report3.free_size == 0x10000);
+    this->expect_true(report3.free_blocks.at(0) == 0);
+    this->expect_true(report3.free_blocks.at(4) == 1);
+}
+
+void
+memory_manager_ut::test_buddy_pool_high_water()
+{
+    buddy_pool_type pool{g_buddy_addr};
+
+    this->expect_true(pool.report().high_water == 0);
+
+    auto &&addr1 = pool.alloc(0x1000);
+    auto &&addr2 = pool.alloc(0x3000);
+    this->expect_true(pool.report().high_water == 0x5000);
+
+    this->expect_true(pool.free(addr2) == 0x4000);
+    this->expect_true(pool.free(addr2) == 0);
+    this->expect_true(pool.report().high_water == 0x5000);
+
+    pool.alloc(0x2000);
+    this->expect_true(pool.report().high_water == 0x5000);
+
+    pool.alloc(0x8000);
+    this->expect_true(pool.report().high_water == 0xB000);
+
+    pool.free(addr1);
+    pool.clear();
+    this->expect_true(pool.report().high_water == 0);
+}
+
+void
+memory_manager_ut::test_buddy_pool_tag()
+{
+    buddy_pool_type pool{g_buddy_addr};
+
+    auto &&addr1 = pool.alloc(0x1000, 3);
+    auto &&addr2 = pool.alloc_contiguous(1, 4);
+    auto &&addr3 = pool.alloc_aligned(0x1000, 0x4000, 5);
+    auto &&addr4 = pool.alloc(0x1000);
+
+    this->expect_true(pool.tag(addr1) == 3);
+    this->expect_true(pool.tag(addr2) == 4);
+    this->expect_true(pool.tag(addr3) == 5);
+    this->expect_true(pool.tag(addr4) == 0);
+    this->expect_true(pool.tag(addr2 + 0x1000) == 0);
+    this->expect_true(pool.tag(addr1 + 8) == 0);
+    this->expect_true(pool.tag(0) == 0);
+
+    buddy_pool_type::tag_type tag = 0;
+    this->expect_true(pool.free(addr2, &tag) == 0x2000);
+    this->expect_true(tag == 4);
+    this->expect_true(pool.tag(addr2) == 0);
+}
+
+void
+memory_manager_ut::test_buddy_pool_add_region()
+{
+    buddy_pool_type pool{g_buddy_addr};
+    buddy_pool_type region{g_buddy_region_addr};
+
+    pool.add_region(nullptr);
+    pool.add_region(&pool);
+    pool.add_region(&region);
+
+    this->expect_true(pool.report().pool_size == 0x20000);
+    this->expect_true(pool.contains(g_buddy_region_addr));
+    this->expect_false(region.contains(g_buddy_region_addr + 0x10000));
+
+    auto &&addr1 = pool.alloc(0x10000);
+    auto &&addr2 = pool.alloc(0x8000);
+    auto &&addr3 = pool.alloc_aligned(0x1000, 0x8000, 3);
+
+    this->expect_true(addr1 == g_buddy_addr);
+    this->expect_true(addr2 == g_buddy_region_addr);
+    this->expect_true(addr3 == g_buddy_region_addr + 0x8000);
+    this->expect_true(pool.size(addr2) == 0x8000);
+    this->expect_true(pool.tag(addr3) == 3);
+    this->expect_exception([&] { pool.alloc_local(0x1000); }, ""_ut_bae);
+
+    auto &&report1 = pool.report();
+    this->expect_true(report1.free_size == 0x7000);
+    this->expect_true(report1.largest_free == 0x4000);
+    this->expect_true(report1.high_water == 0x19000);
+
+    this->expect_true(pool.free(addr2) == 0x8000);
+    this->expect_true(pool.report().largest_free == 0x8000);
+    this->expect_exception([&] { pool.alloc_contiguous(4); }, ""_ut_bae);
+
+    this->expect_true(pool.free(addr1) == 0x10000);
+    this->expect_true(pool.alloc_local(0x1000) == g_buddy_addr);
+
+    pool.clear();
+    this->expect_true(pool.report().free_size == 0x20000);
+}
@@ -0,0 +1,102 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#include <gsl/gsl>
+
+#include <test.h>
+#include <memory_manager/grace_period.h>
+
+void
+memory_manager_ut::test_grace_period_passed()
+{
+    grace_period gp;
+
+    auto &&epoch1 = gp.advance();
+    auto &&epoch2 = gp.advance();
+
+    this->expect_true(epoch2 == epoch1 + 1);
+    this->expect_true(gp.passed(epoch1));
+    this->expect_true(gp.passed(epoch2));
+}
+
+void
+memory_manager_ut::test_grace_period_enter_leave()
+{
+    grace_period gp;
+
+    gp.enter(0);
+    auto &&epoch1 = gp.advance();
+
+    this->expect_false(gp.passed(epoch1));
+
+    gp.enter(grace_period::driver);
+    auto &&epoch2 = gp.advance();
+
+    this->expect_false(gp.passed(epoch2));
+
+    gp.leave(0);
+
+    this->expect_true(gp.passed(epoch1));
+    this->expect_false(gp.passed(epoch2));
+
+    // A CPU that enters again is in the current epoch, and thus cannot
+    // reach what was unlinked before it
+
+    gp.enter(0);
+
+    this->expect_true(gp.passed(epoch1));
+    this->expect_false(gp.passed(epoch2));
+
+    gp.leave(grace_period::driver);
+
+    this->expect_true(gp.passed(epoch2));
+    this->expect_false(gp.passed(gp.advance()));
+
+    gp.leave(0);
+}
+
+void
+memory_manager_ut::test_grace_period_out_of_range()
+{
+    grace_period gp;
+
+    gp.enter(MAX_NUM_CPUS);
+    gp.enter(MAX_NUM_CPUS + 1);
+
+    this->expect_false(gp.passed(gp.advance()));
+
+    gp.leave(MAX_NUM_CPUS);
+    this->expect_false(gp.passed(gp.advance()));
+
+    gp.leave(MAX_NUM_CPUS + 1);
+    this->expect_true(gp.passed(gp.advance()));
+
+    // The driver has a slot of its own, even though its cpuid is out of
+    // the range of the CPUs
+
+    gp.enter(grace_period::driver);
+    auto &&epoch = gp.advance();
+
+    this->expect_false(gp.passed(epoch));
+    gp.leave(grace_period::driver);
+    this->expect_true(gp.passed(epoch));
+}
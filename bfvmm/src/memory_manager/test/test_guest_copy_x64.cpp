@@ -0,0 +1,353 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <gsl/gsl>
+
+#include <map>
+#include <array>
+#include <cstring>
+
+#include <test.h>
+#include <memory_manager/guest_copy_x64.h>
+#include <memory_manager/memory_manager_x64.h>
+
+constexpr const auto copy_cr3 = 0x1000UL;
+constexpr const auto copy_pdpt = 0x2000UL;
+constexpr const auto copy_pd = 0x3000UL;
+constexpr const auto copy_pt = 0x4000UL;
+constexpr const auto copy_data = 0x10000UL;
+constexpr const auto copy_other = 0x20000UL;
+constexpr const auto copy_large = 0x200000UL;
+
+// virt with index 1 in each of the pml4, pdpt, pd and pt
+constexpr const auto copy_virt = 0x0000008040201000UL;
+
+constexpr const auto copy_num_pages = 16UL;
+
+using page_t = std::array<uint8_t, x64::page_size>;
+
+alignas(0x1000) static page_t g_copy_mem[copy_num_pages] = {};
+static std::map<uintptr_t, size_t> g_copy_pages;
+static auto g_copy_maps = 0UL;
+
+// Guest physical memory. Each page is given its own page of g_copy_mem
+// the first time it is used, and mapping a page returns its address, so
+// that what is written through a map can be read back.
+
+static uint8_t *
+copy_page(uintptr_t phys)
+{
+    auto &&iter = g_copy_pages.find(phys);
+    if (iter != g_copy_pages.end())
+        return g_copy_mem[iter->second].data();
+
+    auto &&index = g_copy_pages.size();
+    g_copy_pages[phys] = index;
+
+    g_copy_mem[index].fill(0);
+    return g_copy_mem[index].data();
+}
+
+static temp_map_x64::integer_pointer
+copy_temp_map(temp_map_x64::integer_pointer phys, temp_map_x64::attr_type attr) noexcept
+{
+    (void) attr;
+
+    g_copy_maps++;
+    return reinterpret_cast<temp_map_x64::integer_pointer>(copy_page(phys));
+}
+
+static void
+copy_free_map(memory_manager_x64::pointer ptr, memory_manager_x64::size_type size) noexcept
+{
+    (void) ptr;
+    (void) size;
+}
+
+static void
+set_entry(uintptr_t table, uintptr_t index, uintptr_t phys, bool ps = false, bool rw = true)
+{
+    auto &&entry = reinterpret_cast<uintptr_t *>(copy_page(table))[index];
+    auto &&pte = page_table_entry_x64{&entry};
+
+    entry = 0;
+
+    pte.set_present(true);
+    pte.set_rw(rw);
+    pte.set_us(true);
+    pte.set_phys_addr(phys);
+    pte.set_ps(ps);
+}
+
+static void
+setup_copy(MockRepository &mocks)
+{
+    auto mm = mocks.Mock<memory_manager_x64>();
+    mocks.OnCallFunc(memory_manager_x64::instance).Return(mm);
+
+    // Nothing should be mapped using the memory map pool
+
+    mocks.NeverCall(mm, memory_manager_x64::alloc_map);
+    mocks.OnCall(mm, memory_manager_x64::free_map_deferred).Do(copy_free_map);
+
+    auto tm = mocks.Mock<temp_map_x64>();
+    mocks.OnCallFunc(temp_map_x64::instance).Return(tm);
+
+    mocks.OnCall(tm, temp_map_x64::map).Do(copy_temp_map);
+
+    g_copy_pages.clear();
+    g_copy_maps = 0;
+
+    set_entry(copy_cr3, 1, copy_pdpt);
+    set_entry(copy_pdpt, 1, copy_pd);
+    set_entry(copy_pd, 1, copy_pt);
+    set_entry(copy_pt, 1, copy_data);
+    set_entry(copy_pt, 2, copy_data + 0x1000);
+    set_entry(copy_pt, 3, copy_other);
+}
+
+void
+memory_manager_ut::test_guest_copy_x64_invalid_args()
+{
+    uint8_t buf[16] = {};
+    bfn::page_walk_cache_x64 cache;
+
+    this->expect_exception([&] { bfn::guest_sg_iterator_x64(0, copy_cr3, 16, 0, cache); }, ""_ut_ffe);
+    this->expect_exception([&] { bfn::guest_sg_iterator_x64(copy_virt, 0, 16, 0, cache); }, ""_ut_ffe);
+    this->expect_exception([&] { bfn::guest_sg_iterator_x64(copy_virt, copy_cr3 + 0x10, 16, 0, cache); }, ""_ut_ffe);
+
+    this->expect_exception([&] { bfn::copy_from_guest(copy_cr3, 0, buf, 16, 0, cache); }, ""_ut_ffe);
+    this->expect_exception([&] { bfn::copy_from_guest(copy_cr3, copy_virt, nullptr, 16, 0, cache); }, ""_ut_ffe);
+    this->expect_exception([&] { bfn::copy_to_guest(0, copy_virt, buf, 16, 0, cache); }, ""_ut_ffe);
+    this->expect_exception([&] { bfn::copy_to_guest(copy_cr3, copy_virt, nullptr, 16, 0, cache); }, ""_ut_ffe);
+}
+
+void
+memory_manager_ut::test_guest_sg_iterator_x64_contiguous()
+{
+    MockRepository mocks;
+    setup_copy(mocks);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        bfn::page_walk_cache_x64 cache;
+        bfn::guest_sg_iterator_x64 iter(copy_virt + 0x10, copy_cr3, 0x2FF0, 0, cache);
+        bfn::guest_sg_iterator_x64::segment_type segment;
+
+        this->expect_true(iter.remaining() == 0x2FF0);
+
+        this->expect_true(iter.next(segment));
+        this->expect_true(segment.phys == copy_data + 0x10);
+        this->expect_true(segment.size == 0x1FF0);
+        this->expect_true(iter.remaining() == 0x1000);
+
+        this->expect_true(iter.next(segment));
+        this->expect_true(segment.phys == copy_other);
+        this->expect_true(segment.size == 0x1000);
+        this->expect_true(iter.remaining() == 0);
+
+        this->expect_false(iter.next(segment));
+        this->expect_true(cache.misses() == 3);
+    });
+}
+
+void
+memory_manager_ut::test_guest_sg_iterator_x64_lazy()
+{
+    MockRepository mocks;
+    setup_copy(mocks);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        bfn::page_walk_cache_x64 cache;
+        bfn::guest_sg_iterator_x64 iter(copy_virt + 0x10, copy_cr3, 0x10, 0, cache);
+        bfn::guest_sg_iterator_x64::segment_type segment;
+
+        this->expect_true(iter.next(segment));
+        this->expect_true(segment.phys == copy_data + 0x10);
+        this->expect_true(segment.size == 0x10);
+        this->expect_false(iter.next(segment));
+        this->expect_true(cache.misses() == 1);
+    });
+}
+
+void
+memory_manager_ut::test_guest_sg_iterator_x64_2m()
+{
+    MockRepository mocks;
+    setup_copy(mocks);
+
+    set_entry(copy_pd, 1, copy_large, true);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        bfn::page_walk_cache_x64 cache;
+        bfn::guest_sg_iterator_x64 iter(copy_virt + 0x800, copy_cr3, 0x3000, 0, cache);
+        bfn::guest_sg_iterator_x64::segment_type segment;
+
+        this->expect_true(iter.next(segment));
+        this->expect_true(segment.phys == copy_large + 0x1800);
+        this->expect_true(segment.size == 0x3000);
+        this->expect_false(iter.next(segment));
+        this->expect_true(cache.misses() == 1);
+    });
+}
+
+void
+memory_manager_ut::test_guest_sg_iterator_x64_not_present()
+{
+    MockRepository mocks;
+    setup_copy(mocks);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        bfn::guest_sg_iterator_x64 iter(copy_virt + 0x3000, copy_cr3, 0x10, 0);
+        bfn::guest_sg_iterator_x64::segment_type segment;
+
+        this->expect_exception([&] { iter.next(segment); }, ""_ut_ffe);
+    });
+}
+
+void
+memory_manager_ut::test_guest_copy_x64_from_guest()
+{
+    MockRepository mocks;
+    setup_copy(mocks);
+
+    for (auto i = 0; i < 16; i++)
+        copy_page(copy_data)[0x10 + i] = gsl::narrow_cast<uint8_t>(i + 1);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        uint8_t buf[16] = {};
+
+        bfn::copy_from_guest(copy_cr3, copy_virt + 0x10, buf, sizeof(buf), 0);
+        this->expect_true(std::memcmp(buf, copy_page(copy_data) + 0x10, sizeof(buf)) == 0);
+
+        // one map for each of the 4 page tables, and one for the data
+
+        this->expect_true(g_copy_maps == 5);
+    });
+}
+
+void
+memory_manager_ut::test_guest_copy_x64_from_guest_cross_page()
+{
+    MockRepository mocks;
+    setup_copy(mocks);
+
+    std::memset(copy_page(copy_data) + 0xFF0, 0xAA, 0x10);
+    std::memset(copy_page(copy_data + 0x1000), 0xBB, 0x1000);
+    std::memset(copy_page(copy_other), 0xCC, 0x10);
+
+    std::array<uint8_t, 0x1020> buf = {};
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        bfn::copy_from_guest(copy_cr3, copy_virt + 0xFF0, buf.data(), buf.size(), 0);
+
+        this->expect_true(buf.at(0) == 0xAA && buf.at(0xF) == 0xAA);
+        this->expect_true(buf.at(0x10) == 0xBB && buf.at(0x100F) == 0xBB);
+        this->expect_true(buf.at(0x1010) == 0xCC && buf.at(0x101F) == 0xCC);
+    });
+}
+
+void
+memory_manager_ut::test_guest_copy_x64_to_guest()
+{
+    MockRepository mocks;
+    setup_copy(mocks);
+
+    std::array<uint8_t, 0x20> buf;
+    buf.fill(0x42);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        bfn::copy_to_guest(copy_cr3, copy_virt + 0x1FF0, buf.data(), buf.size(), 0);
+
+        this->expect_true(copy_page(copy_data + 0x1000)[0xFEF] == 0);
+        this->expect_true(copy_page(copy_data + 0x1000)[0xFF0] == 0x42);
+        this->expect_true(copy_page(copy_data + 0x1000)[0xFFF] == 0x42);
+        this->expect_true(copy_page(copy_other)[0x0] == 0x42);
+        this->expect_true(copy_page(copy_other)[0xF] == 0x42);
+        this->expect_true(copy_page(copy_other)[0x10] == 0);
+    });
+}
+
+void
+memory_manager_ut::test_guest_copy_x64_to_guest_read_only()
+{
+    MockRepository mocks;
+    setup_copy(mocks);
+
+    // the page at copy_virt + 0x2000 is read-only, and a read-only pdpt
+    // entry makes every page under it read-only as well
+
+    set_entry(copy_pt, 3, copy_other, false, false);
+
+    std::array<uint8_t, 0x20> buf;
+    buf.fill(0x42);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        bfn::page_walk_cache_x64 cache;
+
+        this->expect_exception([&] { bfn::copy_to_guest(copy_cr3, copy_virt + 0x1FF0, buf.data(), buf.size(), 0, cache); }, ""_ut_ree);
+        this->expect_true(copy_page(copy_data + 0x1000)[0xFF0] == 0);
+        this->expect_true(copy_page(copy_other)[0x0] == 0);
+
+        this->expect_no_exception([&] { bfn::copy_from_guest(copy_cr3, copy_virt + 0x1FF0, buf.data(), buf.size(), 0, cache); });
+
+        auto &&result = cache.translate(copy_virt + 0x2000, copy_cr3);
+        this->expect_false(result.writable);
+        this->expect_true(result.user);
+
+        set_entry(copy_pdpt, 1, copy_pd, false, false);
+        cache.flush();
+
+        this->expect_false(cache.translate(copy_virt, copy_cr3).writable);
+        this->expect_exception([&] { bfn::copy_to_guest(copy_cr3, copy_virt + 0x10, buf.data(), 0x10, 0, cache); }, ""_ut_ree);
+    });
+}
+
+void
+memory_manager_ut::test_guest_copy_x64_with_cache()
+{
+    MockRepository mocks;
+    setup_copy(mocks);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&value = 0x1234567890ABCDEFUL;
+        auto &&result = 0UL;
+
+        bfn::page_walk_cache_x64 cache;
+
+        bfn::copy_to_guest(copy_cr3, copy_virt + 0x100, &value, sizeof(value), 0, cache);
+        this->expect_true(g_copy_maps == 5);
+
+        bfn::copy_from_guest(copy_cr3, copy_virt + 0x100, &result, sizeof(result), 0, cache);
+        this->expect_true(g_copy_maps == 6);
+        this->expect_true(cache.hits() == 2);
+
+        this->expect_true(result == value);
+    });
+}
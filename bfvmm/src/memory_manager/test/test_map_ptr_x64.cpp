@@ -43,10 +43,16 @@ std::map<memory_manager_x64::integer_pointer, bool> g_unmapped;
 
 x64::memory_attr::attr_type read_write = x64::memory_attr::rw_wb;
 
+auto g_tlb_flushed = false;
+
 extern "C" void
 __invlpg(const void *virt) noexcept
 { g_flushed[virt] = true; }
 
+extern "C" void
+__flush_tlb(void) noexcept
+{ g_tlb_flushed = true; }
+
 extern "C" void
 __clflush(void *addr) noexcept
 { g_cache_flushed[addr] = true; }
@@ -91,6 +97,17 @@ static void
 mm_free_map(memory_manager_x64::pointer ptr) noexcept
 { g_freed[ptr] = true; }
 
+static void
+mm_free_map_deferred(memory_manager_x64::pointer ptr, memory_manager_x64::size_type size) noexcept
+{
+    auto &&vmap = reinterpret_cast<memory_manager_x64::integer_pointer>(ptr);
+
+    for (auto vadr = vmap; vadr < vmap + size; vadr += x64::page_size)
+        g_unmapped[vadr] = true;
+
+    g_freed[ptr] = true;
+}
+
 static void
 pt_map(memory_manager_x64::integer_pointer virt,
        memory_manager_x64::integer_pointer phys,
@@ -115,6 +132,7 @@ setup_mm(MockRepository &mocks)
 
     mocks.OnCall(mm, memory_manager_x64::alloc_map).Do(mm_alloc_map);
     mocks.OnCall(mm, memory_manager_x64::free_map).Do(mm_free_map);
+    mocks.OnCall(mm, memory_manager_x64::free_map_deferred).Do(mm_free_map_deferred);
 
     g_freed.clear();
 
@@ -130,6 +148,11 @@ setup_pt(MockRepository &mocks)
     mocks.OnCall(pt, root_page_table_x64::map_4k).Do(pt_map);
     mocks.OnCall(pt, root_page_table_x64::unmap).Do(pt_unmap);
 
+    auto tm = mocks.Mock<temp_map_x64>();
+    mocks.OnCallFunc(temp_map_x64::instance).Return(tm);
+
+    mocks.OnCall(tm, temp_map_x64::map).Return(0);
+
     g_flushed.clear();
     g_mapped.clear();
     g_unmapped.clear();
@@ -296,6 +319,34 @@ memory_manager_ut::test_unique_map_ptr_x64_phys_range_constructor_success()
     });
 }
 
+void
+memory_manager_ut::test_unique_map_ptr_x64_phys_range_constructor_large()
+{
+    MockRepository mocks;
+    auto &&mm = setup_mm(mocks);
+    auto &&pt = setup_pt(mocks);
+
+    mocks.OnCall(pt, root_page_table_x64::map_2m).Do(pt_map);
+    mocks.ExpectCall(mm, memory_manager_x64::alloc_map_aligned).With(0x401000UL, 0x200000UL, 0UL).Return(make_ptr(valid_virt));
+
+    auto &&phys_range_1 = std::make_pair(0x1111000000200000UL, 0x400000UL);
+    auto &&phys_range_2 = std::make_pair(0x1111000000800000UL, x64::page_size);
+    auto &&list = std::vector<std::pair<uintptr_t, size_t>>({phys_range_1, phys_range_2});
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&map = bfn::make_unique_map_x64<int>(list);
+
+        this->expect_true(map.get() == make_ptr(valid_virt));
+        this->expect_true(map.size() == 0x401000UL);
+
+        this->expect_true(g_mapped.size() == 3);
+        this->expect_true(g_mapped[valid_virt] == 0x1111000000200000UL);
+        this->expect_true(g_mapped[valid_virt + 0x200000] == 0x1111000000400000UL);
+        this->expect_true(g_mapped[valid_virt + 0x400000] == 0x1111000000800000UL);
+    });
+}
+
 void
 memory_manager_ut::test_unique_map_ptr_x64_virt_cr3_constructor_invalid_args()
 {
@@ -404,6 +455,35 @@ memory_manager_ut::test_unique_map_ptr_x64_virt_cr3_constructor_success_2m()
     });
 }
 
+void
+memory_manager_ut::test_unique_map_ptr_x64_virt_cr3_constructor_large()
+{
+    MockRepository mocks;
+    setup_mm(mocks);
+    auto &&pt = setup_pt(mocks);
+
+    mocks.OnCall(pt, root_page_table_x64::map_2m).Do(pt_map);
+
+    auto &&size = x64::page_table::pd::size_bytes + x64::page_size;
+
+    g_pte_large_page = true;
+    g_pte_large_page_count = 3;
+    g_pte_large_page_reset = 3;
+    auto ___ = gsl::finally([&] { g_pte_large_page = false; });
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&map = bfn::unique_map_ptr_x64<int>(valid_virt, valid_virt, valid_phys, size, 0x0);
+
+        this->expect_true(map.size() == size);
+        this->expect_true(g_tlb_flushed);
+
+        this->expect_true(g_mapped[valid_virt] == valid_phys);
+        this->expect_true(g_mapped.count(valid_virt + x64::page_size) == 0);
+        this->expect_true(g_mapped[valid_virt + x64::page_table::pd::size_bytes] == valid_phys);
+    });
+}
+
 void
 memory_manager_ut::test_unique_map_ptr_x64_virt_cr3_constructor_success_4k()
 {
@@ -750,6 +830,28 @@ memory_manager_ut::test_unique_map_ptr_x64_flush()
     });
 }
 
+void
+memory_manager_ut::test_unique_map_ptr_x64_flush_large()
+{
+    MockRepository mocks;
+    setup_mm(mocks);
+    setup_pt(mocks);
+
+    auto &&phys_range_1 = std::make_pair(0x1111000000000000UL, x64::page_size * static_cast<size_t>(TLB_FLUSH_RANGE_THRESHOLD));
+    auto &&phys_range_2 = std::make_pair(0x1111000000100000UL, x64::page_size);
+    auto &&list = {phys_range_1, phys_range_2};
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        g_tlb_flushed = false;
+        auto &&map = bfn::unique_map_ptr_x64<int>(valid_virt, list, read_write);
+
+        this->expect_true(g_tlb_flushed);
+        this->expect_false(g_flushed[make_ptr(valid_virt)]);
+        this->expect_true(g_mapped[valid_virt + (TLB_FLUSH_RANGE_THRESHOLD * x64::page_size)] == 0x1111000000100000UL);
+    });
+}
+
 void
 memory_manager_ut::test_unique_map_ptr_x64_cache_flush()
 {
@@ -849,6 +951,99 @@ memory_manager_ut::test_unique_map_ptr_x64_make_failure()
     });
 }
 
+void
+memory_manager_ut::test_unique_map_ptr_x64_direct_map()
+{
+    MockRepository mocks;
+    auto &&mm = setup_mm(mocks);
+    auto &&pt = setup_pt(mocks);
+
+    mocks.OnCallFunc(direct_map_size).Return(0x40000000UL);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        {
+            mocks.NeverCall(mm, memory_manager_x64::alloc_map);
+            mocks.NeverCall(mm, memory_manager_x64::free_map);
+            mocks.NeverCall(pt, root_page_table_x64::map_4k);
+            mocks.NeverCall(pt, root_page_table_x64::unmap);
+
+            auto &&map1 = bfn::make_unique_map_x64<int>(0x1000UL);
+            auto &&map2 = bfn::make_unique_map_x64<int>(reinterpret_cast<int *>(0x3FFFF000UL));
+
+            this->expect_true(map1.get() == make_ptr(DIRECT_MAP_START + 0x1000UL));
+            this->expect_true(map1.size() == x64::page_size);
+            this->expect_true(map2.get() == make_ptr(DIRECT_MAP_START + 0x3FFFF000UL));
+
+            map1.flush();
+            this->expect_false(g_flushed[make_ptr(DIRECT_MAP_START + 0x1000UL)]);
+        }
+    });
+}
+
+void
+memory_manager_ut::test_unique_map_ptr_x64_temp_map()
+{
+    MockRepository mocks;
+    setup_mm(mocks);
+
+    auto tm = mocks.Mock<temp_map_x64>();
+    mocks.OnCallFunc(temp_map_x64::instance).Return(tm);
+
+    mocks.ExpectCall(tm, temp_map_x64::map).With(0x40000000UL, x64::memory_attr::rw_wb).Return(TEMP_MAP_START);
+    mocks.ExpectCall(tm, temp_map_x64::unmap).With(TEMP_MAP_START);
+    mocks.ExpectCall(tm, temp_map_x64::map).With(0x40001000UL, x64::memory_attr::rw_uc).Return(TEMP_MAP_START + 0x1000);
+    mocks.ExpectCall(tm, temp_map_x64::unmap).With(TEMP_MAP_START + 0x1000);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        {
+            auto &&map = bfn::make_unique_map_x64<int>(0x40000000UL);
+            this->expect_true(map.get() == reinterpret_cast<int *>(TEMP_MAP_START));
+        }
+
+        {
+            auto &&map = bfn::make_unique_map_x64<int>(reinterpret_cast<int *>(0x40001000UL), x64::memory_attr::rw_uc);
+            this->expect_true(map.get() == reinterpret_cast<int *>(TEMP_MAP_START + 0x1000));
+        }
+
+        this->expect_true(g_freed.empty());
+    });
+}
+
+void
+memory_manager_ut::test_unique_map_ptr_x64_direct_map_not_covered()
+{
+    MockRepository mocks;
+    setup_mm(mocks);
+    setup_pt(mocks);
+
+    mocks.OnCallFunc(direct_map_size).Return(0x40000000UL);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        {
+            auto &&map = bfn::make_unique_map_x64<int>(0x1000UL, x64::memory_attr::rw_uc);
+            this->expect_true(map.get() == reinterpret_cast<int *>(dummy_pt.get()));
+        }
+
+        this->expect_true(g_freed[dummy_pt.get()]);
+
+        g_freed.clear();
+
+        {
+            auto &&map = bfn::make_unique_map_x64<int>(0x40000000UL);
+            this->expect_true(map.get() == reinterpret_cast<int *>(dummy_pt.get()));
+        }
+
+        this->expect_true(g_freed[dummy_pt.get()]);
+
+        g_freed.clear();
+        this->expect_exception([&]{ bfn::make_unique_map_x64<int>(0x1010UL); }, ""_ut_ffe);
+        this->expect_true(g_freed[dummy_pt.get()]);
+    });
+}
+
 void
 memory_manager_ut::test_virt_to_phys_with_cr3_invalid()
 {
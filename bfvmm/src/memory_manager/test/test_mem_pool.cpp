@@ -23,6 +23,7 @@
 
 #include <gsl/gsl>
 
+#include <random>
 #include <vector>
 
 #include <test.h>
@@ -210,3 +211,425 @@ memory_manager_ut::test_mem_pool_contains()
     this->expect_true(pool.contains(100));
     this->expect_true(pool.contains(227));
 }
+
+void
+memory_manager_ut::test_mem_pool_free_not_start_of_allocation()
+{
+    mem_pool<128, 3> pool{100};
+
+    auto &&addr1 = pool.alloc(1 << 4);
+    auto &&addr2 = pool.alloc(1 << 3);
+
+    pool.free(addr1 + (1 << 3));
+    this->expect_true(pool.size(addr1) == (1 << 4));
+    this->expect_true(pool.size(addr1 + (1 << 3)) == 0);
+    this->expect_true(pool.size(addr2) == (1 << 3));
+
+    pool.free(addr1);
+    this->expect_true(pool.size(addr1) == 0);
+    this->expect_true(pool.size(addr2) == (1 << 3));
+}
+
+void
+memory_manager_ut::test_mem_pool_malloc_spans_words()
+{
+    mem_pool<0x1000, 3> pool{0x1000};
+
+    auto &&addr1 = pool.alloc(60 << 3);
+    auto &&addr2 = pool.alloc(200 << 3);
+    auto &&addr3 = pool.alloc(1 << 3);
+
+    this->expect_true(addr2 == addr1 + (60 << 3));
+    this->expect_true(addr3 == addr2 + (200 << 3));
+    this->expect_true(pool.size(addr2) == (200 << 3));
+
+    pool.free(addr2);
+    this->expect_true(pool.size(addr2) == 0);
+    this->expect_true(pool.size(addr3) == (1 << 3));
+
+    this->expect_true(pool.alloc(251 << 3) == addr3 + (1 << 3));
+    this->expect_true(pool.alloc(200 << 3) == addr2);
+    this->expect_exception([&] { pool.alloc(1 << 3); }, ""_ut_bae);
+}
+
+void
+memory_manager_ut::test_mem_pool_malloc_skips_used_words()
+{
+    mem_pool<0x10000, 3> pool{0x10000};
+    std::vector<mem_pool<0x10000, 3>::integer_pointer> addrs;
+
+    for (auto i = 0; i < 8192; i++)
+        addrs.push_back(pool.alloc(1 << 3));
+
+    pool.free(addrs.at(4000));
+    pool.free(addrs.at(8000));
+    pool.free(addrs.at(8001));
+
+    this->expect_true(pool.alloc(1 << 4) == addrs.at(8000));
+    this->expect_true(pool.alloc(1 << 3) == addrs.at(4000));
+    this->expect_exception([&] { pool.alloc(1 << 3); }, ""_ut_bae);
+}
+
+void
+memory_manager_ut::test_mem_pool_alloc_aligned_invalid()
+{
+    mem_pool<128, 3> pool{104};
+
+    this->expect_exception([&] { pool.alloc_aligned(0, 64, 0); }, ""_ut_ffe);
+    this->expect_exception([&] { pool.alloc_aligned(256, 64, 0); }, ""_ut_ffe);
+    this->expect_exception([&] { pool.alloc_aligned(8, 0, 0); }, ""_ut_ffe);
+    this->expect_exception([&] { pool.alloc_aligned(8, 24, 0); }, ""_ut_ffe);
+    this->expect_exception([&] { pool.alloc_aligned(8, 4, 0); }, ""_ut_ffe);
+    this->expect_exception([&] { pool.alloc_aligned(8, 64, 64); }, ""_ut_ffe);
+    this->expect_exception([&] { pool.alloc_aligned(8, 64, 4); }, ""_ut_ffe);
+    this->expect_exception([&] { pool.alloc_aligned(128, 64, 0); }, ""_ut_bae);
+}
+
+void
+memory_manager_ut::test_mem_pool_alloc_aligned()
+{
+    mem_pool<1024, 3> pool{104};
+
+    auto &&addr1 = pool.alloc_aligned(16, 64, 0);
+    auto &&addr2 = pool.alloc_aligned(8, 64, 16);
+    auto &&addr3 = pool.alloc_aligned(8, 64, 16);
+
+    this->expect_true(addr1 == 128);
+    this->expect_true(addr2 == 144);
+    this->expect_true(addr3 == 208);
+    this->expect_true(pool.size(addr1) == 16);
+
+    auto &&addr4 = pool.alloc(8);
+    this->expect_true(addr4 == 216);
+
+    pool.free(addr1);
+    this->expect_true(pool.alloc_aligned(8, 64, 0) == 128);
+
+    this->expect_true(pool.alloc_aligned(104 + 1024 - 256, 128, 0) == 256);
+    this->expect_exception([&] { pool.alloc_aligned(8, 512, 0); }, ""_ut_bae);
+}
+
+void
+memory_manager_ut::test_mem_pool_resize_invalid()
+{
+    mem_pool<128, 3> pool{100};
+
+    auto &&addr = pool.alloc(16);
+
+    this->expect_false(pool.resize(addr, 0));
+    this->expect_false(pool.resize(addr, 256));
+    this->expect_false(pool.resize(0, 16));
+    this->expect_false(pool.resize(addr + 16, 16));
+    this->expect_true(pool.size(addr) == 16);
+}
+
+void
+memory_manager_ut::test_mem_pool_resize_grow()
+{
+    mem_pool<128, 3> pool{100};
+
+    auto &&addr1 = pool.alloc(16);
+    auto &&addr2 = pool.alloc(16);
+    auto &&addr3 = pool.alloc(16);
+
+    pool.free(addr2);
+
+    this->expect_true(pool.resize(addr1, 30));
+    this->expect_true(pool.size(addr1) == 32);
+    this->expect_false(pool.resize(addr1, 40));
+    this->expect_true(pool.size(addr1) == 32);
+
+    this->expect_true(pool.resize(addr3, 128 - 32));
+    this->expect_true(pool.size(addr3) == 128 - 32);
+    this->expect_false(pool.resize(addr3, 128 - 24));
+
+    this->expect_exception([&] { pool.alloc(8); }, ""_ut_bae);
+}
+
+void
+memory_manager_ut::test_mem_pool_resize_shrink()
+{
+    mem_pool<128, 3> pool{100};
+
+    auto &&addr1 = pool.alloc(64);
+    auto &&addr2 = pool.alloc(64);
+
+    this->expect_true(pool.resize(addr1, 8));
+    this->expect_true(pool.size(addr1) == 8);
+    this->expect_true(pool.size(addr2) == 64);
+
+    this->expect_true(pool.alloc(56) == addr1 + 8);
+}
+
+void
+memory_manager_ut::test_mem_pool_resize_spans_words()
+{
+    mem_pool<0x1000, 3> pool{0x1000};
+
+    auto &&addr = pool.alloc(8);
+
+    this->expect_true(pool.resize(addr, 0x800));
+    this->expect_true(pool.size(addr) == 0x800);
+
+    auto &&next = pool.alloc(8);
+    this->expect_true(next == addr + 0x800);
+
+    this->expect_true(pool.resize(addr, 0x400));
+    this->expect_true(pool.size(addr) == 0x400);
+    this->expect_true(pool.resize(addr, 0x800));
+    this->expect_false(pool.resize(addr, 0x808));
+}
+
+void
+memory_manager_ut::test_mem_pool_add_region()
+{
+    mem_pool<128, 3> pool{0x1000};
+    mem_pool<128, 3> region{0x2000};
+
+    pool.add_region(nullptr);
+    pool.add_region(&pool);
+    pool.add_region(&region);
+
+    this->expect_true(pool.capacity() == 256);
+    this->expect_true(pool.contains(0x2000));
+    this->expect_false(pool.contains(0x2000 + 128));
+
+    auto &&addr1 = pool.alloc(96);
+    auto &&addr2 = pool.alloc(96);
+
+    this->expect_true(addr1 == 0x1000);
+    this->expect_true(addr2 == 0x2000);
+    this->expect_true(pool.size(addr2) == 96);
+    this->expect_true(pool.allocated() == 192);
+
+    this->expect_true(pool.resize(addr2, 128));
+    this->expect_true(pool.allocated() == 224);
+    this->expect_exception([&] { pool.alloc(64); }, ""_ut_bae);
+
+    pool.free(addr2);
+    this->expect_true(pool.size(addr2) == 0);
+    this->expect_true(pool.allocated() == 96);
+    this->expect_true(pool.alloc(64) == 0x2000);
+
+    this->expect_exception([&] { pool.alloc_local(64); }, ""_ut_bae);
+    this->expect_true(pool.alloc_local(32) == 0x1000 + 96);
+
+    pool.clear();
+    this->expect_true(pool.allocated() == 0);
+}
+
+void
+memory_manager_ut::test_mem_pool_high_water()
+{
+    mem_pool<128, 3> pool{0x1000};
+    mem_pool<128, 3> region{0x2000};
+
+    pool.add_region(&region);
+
+    auto &&addr1 = pool.alloc(64);
+    auto &&addr2 = pool.alloc(32);
+    this->expect_true(pool.high_water() == 96);
+
+    pool.free(addr1);
+    pool.free(addr2);
+    this->expect_true(pool.allocated() == 0);
+    this->expect_true(pool.high_water() == 96);
+
+    pool.alloc(64);
+    this->expect_true(pool.high_water() == 96);
+
+    pool.alloc(128);
+    this->expect_true(pool.high_water() == 224);
+
+    pool.clear();
+    this->expect_true(pool.high_water() == 0);
+
+    auto &&addr3 = pool.alloc(8);
+    this->expect_true(pool.resize(addr3, 120));
+    this->expect_true(pool.high_water() == 120);
+}
+
+void
+memory_manager_ut::test_mem_pool_largest_free()
+{
+    mem_pool<128, 3> pool{0x1000};
+    mem_pool<256, 3> large{0x2000};
+
+    this->expect_true(pool.largest_free() == 128);
+
+    auto &&addr1 = pool.alloc(32);
+    auto &&addr2 = pool.alloc(32);
+    pool.alloc(32);
+
+    this->expect_true(pool.free(addr1) == 32);
+    this->expect_true(pool.free(addr1) == 0);
+    this->expect_true(pool.largest_free() == 32);
+
+    pool.free(addr2);
+    this->expect_true(pool.largest_free() == 64);
+
+    this->expect_true(large.largest_free() == 256);
+    this->expect_true(large.free(0x1000) == 0);
+}
+
+void
+memory_manager_ut::test_mem_pool_tag()
+{
+    // The tag of a tagged allocation is stored in the memory in front of
+    // it, so the pool has to be backed by real memory
+
+    alignas(8) static uint8_t buf[256] = {};
+    auto &&addr = reinterpret_cast<uintptr_t>(buf);
+
+    mem_pool<128, 3> pool{addr};
+    mem_pool<128, 3> region{addr + 128};
+
+    pool.add_region(&region);
+
+    auto &&addr1 = pool.alloc(16, 5);
+    auto &&addr2 = pool.alloc(16);
+    auto &&addr3 = pool.alloc(120, 7);
+
+    this->expect_true(addr1 == addr + 8);
+    this->expect_true(addr2 == addr + 24);
+    this->expect_true(addr3 == addr + 136);
+
+    this->expect_true(pool.tag(addr1) == 5);
+    this->expect_true(pool.tag(addr2) == 0);
+    this->expect_true(pool.tag(addr3) == 7);
+    this->expect_true(pool.tag(addr1 + 8) == 0);
+    this->expect_true(pool.tag(addr1 - 8) == 0);
+    this->expect_true(pool.tag(0x3000) == 0);
+
+    this->expect_true(pool.size(addr1) == 16);
+    this->expect_true(pool.size(addr1 - 8) == 0);
+    this->expect_true(pool.size(addr3) == 120);
+
+    this->expect_true(pool.resize(addr1, 8));
+    this->expect_true(pool.tag(addr1) == 5);
+    this->expect_true(pool.size(addr1) == 8);
+
+    mem_pool<128, 3>::tag_type tag = 0;
+    this->expect_true(pool.free(addr1 - 8, &tag) == 0);
+    this->expect_true(pool.free(addr3, &tag) == 120);
+    this->expect_true(tag == 7);
+    this->expect_true(pool.tag(addr3) == 0);
+
+    this->expect_true(pool.alloc(128) == addr3 - 8);
+    this->expect_true(pool.tag(addr3 - 8) == 0);
+
+    auto &&addr4 = pool.alloc_aligned(8, 32, 0, 3);
+
+    this->expect_true((addr4 & 31) == 0);
+    this->expect_true(pool.tag(addr4) == 3);
+    this->expect_true(pool.free(addr4) == 8);
+}
+
+void
+memory_manager_ut::test_mem_pool_large_fragmented()
+{
+    // Large searches skip over the pool using the summary bitmaps, so check
+    // them against a brute force next fit model of the same pool after a
+    // long run of random allocations and frees of small and large sizes.
+
+    constexpr const auto num_blocks = 0x8000UL >> 3;
+
+    mem_pool<0x8000, 3> pool{0x10000};
+
+    std::vector<bool> used(num_blocks);
+    std::vector<std::pair<uintptr_t, size_t>> allocs;
+    std::mt19937 rng{7};
+
+    auto &&first_fit = [&](size_t from, size_t total) -> size_t
+    {
+        for (auto start = from; start + total <= num_blocks; ++start)
+        {
+            auto run = 0UL;
+            while (run < total && !used[start + run])
+                ++run;
+
+            if (run == total)
+                return start;
+
+            start += run;
+        }
+
+        return num_blocks;
+    };
+
+    auto next = 0UL;
+    auto mismatches = 0UL;
+
+    for (auto i = 0; i < 4000; i++)
+    {
+        if (allocs.empty() || rng() % 3 != 0)
+        {
+            auto &&total = 1UL + rng() % 96;
+            auto &&start = first_fit(next, total);
+
+            if (start == num_blocks)
+                start = first_fit(0, total);
+
+            if (start == num_blocks)
+            {
+                this->expect_exception([&] { pool.alloc(total << 3); }, ""_ut_bae);
+                continue;
+            }
+
+            if (pool.alloc(total << 3) != 0x10000 + (start << 3))
+                mismatches++;
+
+            for (auto b = start; b < start + total; b++)
+                used[b] = true;
+
+            allocs.emplace_back(0x10000 + (start << 3), total);
+            next = start + total;
+        }
+        else
+        {
+            auto &&index = rng() % allocs.size();
+            auto &&alloc = allocs[index];
+
+            if (pool.free(alloc.first) != alloc.second << 3)
+                mismatches++;
+
+            auto &&start = (alloc.first - 0x10000) >> 3;
+            for (auto b = start; b < start + alloc.second; b++)
+                used[b] = false;
+
+            allocs[index] = allocs.back();
+            allocs.pop_back();
+        }
+    }
+
+    this->expect_true(mismatches == 0);
+}
+
+void
+memory_manager_ut::test_mem_pool_large_spans_chunks()
+{
+    mem_pool<0x800, 3> pool{0x10000};
+
+    // Fill the pool, then leave free runs that start or end in the middle of
+    // a 16 block chunk, so the search has to extend the run backward and
+    // forward from the empty chunks it finds.
+
+    auto &&addr1 = pool.alloc(8 * 40);
+    auto &&addr2 = pool.alloc(8 * 40);
+    auto &&addr3 = pool.alloc(8 * 176);
+
+    this->expect_true(addr1 == 0x10000);
+    this->expect_true(pool.free(addr2) == 8 * 40);
+    this->expect_true(pool.alloc(8 * 40) == addr2);
+
+    this->expect_true(pool.resize(addr2, 8 * 8));
+    this->expect_true(pool.alloc(8 * 32) == addr2 + 8 * 8);
+    this->expect_exception([&] { pool.alloc(8 * 31); }, ""_ut_bae);
+
+    this->expect_true(pool.free(addr1) == 8 * 40);
+    this->expect_exception([&] { pool.alloc(8 * 41); }, ""_ut_bae);
+    this->expect_true(pool.alloc(8 * 38) == addr1);
+
+    this->expect_true(pool.free(addr3) == 8 * 176);
+    this->expect_true(pool.alloc(8 * 176) == addr3);
+}
@@ -0,0 +1,95 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#include <gsl/gsl>
+
+#include <test.h>
+#include <memory_manager/mem_stats.h>
+
+using mem_stats_type = mem_stats<2>;
+
+void
+memory_manager_ut::test_mem_stats_record()
+{
+    mem_stats_type stats;
+
+    stats.record_alloc(20, 32);
+    stats.record_alloc(100, 128);
+    stats.record_free(32);
+    stats.record_failure();
+
+    auto &&report = stats.report();
+    this->expect_true(report.allocs == 2);
+    this->expect_true(report.frees == 1);
+    this->expect_true(report.failed == 1);
+    this->expect_true(report.bytes_allocated == 160);
+    this->expect_true(report.bytes_freed == 32);
+    this->expect_true(report.histogram.at(4) == 1);
+    this->expect_true(report.histogram.at(6) == 1);
+
+    stats.clear();
+    this->expect_true(stats.report().allocs == 0);
+    this->expect_true(stats.report().histogram.at(4) == 0);
+}
+
+void
+memory_manager_ut::test_mem_stats_per_cpu()
+{
+    mem_stats_type stats;
+
+    MockRepository mocks;
+    uint64_t cpuid = 0;
+    mocks.OnCallFunc(thread_context_cpuid).Do([&] { return cpuid; });
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        stats.record_alloc(16, 16);
+
+        cpuid = 1;
+        stats.record_alloc(16, 16);
+        stats.record_free(16);
+
+        cpuid = 5;
+        stats.record_alloc(4096, 4096);
+        stats.record_failure();
+
+        auto &&report = stats.report();
+        this->expect_true(report.allocs == 3);
+        this->expect_true(report.frees == 1);
+        this->expect_true(report.failed == 1);
+        this->expect_true(report.bytes_allocated == 4128);
+        this->expect_true(report.histogram.at(4) == 2);
+        this->expect_true(report.histogram.at(12) == 1);
+    });
+}
+
+void
+memory_manager_ut::test_mem_stats_bucket()
+{
+    this->expect_true(mem_stats_type::bucket(0) == 0);
+    this->expect_true(mem_stats_type::bucket(1) == 0);
+    this->expect_true(mem_stats_type::bucket(2) == 1);
+    this->expect_true(mem_stats_type::bucket(3) == 1);
+    this->expect_true(mem_stats_type::bucket(4096) == 12);
+    this->expect_true(mem_stats_type::bucket(8191) == 12);
+    this->expect_true(mem_stats_type::bucket(1UL << 40) == mem_stats_num_buckets - 1);
+}
@@ -0,0 +1,91 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <gsl/gsl>
+
+#include <test.h>
+#include <thread_context.h>
+#include <memory_manager/mem_tag.h>
+
+void
+memory_manager_ut::test_mem_tag_scope()
+{
+    this->expect_true(current_mem_tag() == mem_tag::untagged);
+
+    {
+        mem_tag_scope vmcs(mem_tag::vmcs);
+        this->expect_true(current_mem_tag() == mem_tag::vmcs);
+
+        {
+            mem_tag_scope stack(mem_tag::exit_handler_stack);
+            this->expect_true(current_mem_tag() == mem_tag::exit_handler_stack);
+        }
+
+        this->expect_true(current_mem_tag() == mem_tag::vmcs);
+    }
+
+    this->expect_true(current_mem_tag() == mem_tag::untagged);
+
+    {
+        mem_tag_scope invalid(static_cast<mem_tag::type>(mem_tag_num_tags));
+        this->expect_true(current_mem_tag() == mem_tag::untagged);
+    }
+
+    auto &&ptr = new (mem_tag::vmxon) uint32_t[1024];
+    this->expect_true(current_mem_tag() == mem_tag::untagged);
+
+    delete[] ptr;
+}
+
+void
+memory_manager_ut::test_mem_tag_per_cpu()
+{
+    MockRepository mocks;
+    uint64_t cpuid = 0;
+    mocks.OnCallFunc(thread_context_cpuid).Do([&] { return cpuid; });
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        mem_tag_scope scope(mem_tag::debug_ring);
+
+        cpuid = 1;
+        this->expect_true(current_mem_tag() == mem_tag::untagged);
+
+        cpuid = MAX_NUM_CPUS + 10;
+        set_current_mem_tag(mem_tag::state_save);
+
+        cpuid = MAX_NUM_CPUS;
+        this->expect_true(current_mem_tag() == mem_tag::state_save);
+        set_current_mem_tag(mem_tag::untagged);
+
+        cpuid = 0;
+        this->expect_true(current_mem_tag() == mem_tag::debug_ring);
+    });
+}
+
+void
+memory_manager_ut::test_mem_tag_name()
+{
+    this->expect_true(std::string(mem_tag_name(mem_tag::untagged)) == "untagged");
+    this->expect_true(std::string(mem_tag_name(mem_tag::vcpu_factory)) == "vcpu_factory");
+    this->expect_true(std::string(mem_tag_name(mem_tag::exit_handler_stack)) == "exit_handler_stack");
+    this->expect_true(std::string(mem_tag_name(mem_tag::user)) == "user");
+}
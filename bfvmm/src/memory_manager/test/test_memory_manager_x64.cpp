@@ -34,6 +34,12 @@ using namespace x64;
 extern "C" int64_t
 add_md(struct memory_descriptor *md) noexcept;
 
+extern uint8_t g_page_pool_owner[MAX_PAGE_POOL];
+
+extern "C" uint64_t
+__read_tsc(void) noexcept
+{ return 0x1234567890ABCDEF; }
+
 void
 memory_manager_ut::test_memory_manager_x64_size_out_of_bounds()
 {
@@ -75,6 +81,412 @@ memory_manager_ut::test_memory_manager_x64_malloc_page()
     g_mm->free(ptr);
 }
 
+void
+memory_manager_ut::test_memory_manager_x64_malloc_contiguous()
+{
+    auto &&pool = reinterpret_cast<uintptr_t>(g_page_pool_owner);
+    auto &&phys = 0x100000000UL + (pool & 0x1FFFFF);
+    auto &&free_size = g_mm->page_pool_report().free_size;
+
+    this->expect_true(g_mm->alloc_contiguous(64) == nullptr);
+
+    // without any descriptors, nothing in the page pool is known to be
+    // physically contiguous
+
+    this->expect_true(g_mm->alloc_contiguous(9) == nullptr);
+    this->expect_true(g_mm->page_pool_report().free_size == free_size);
+
+    g_mm->add_md_range(pool, phys, MAX_PAGE_POOL, MEMORY_TYPE_R | MEMORY_TYPE_W);
+
+    auto &&ptr1 = g_mm->alloc_contiguous(9);
+    auto &&virt1 = reinterpret_cast<uintptr_t>(ptr1);
+
+    this->expect_true(ptr1 != nullptr);
+    this->expect_true((virt1 & 0x1FFFFF) == 0);
+    this->expect_true(g_mm->size(ptr1) == 0x200000);
+
+    g_mm->free(ptr1);
+
+    // breaking up the physical memory behind the block that was just
+    // returned means that it has to be skipped
+
+    g_mm->add_md(virt1 + 0x1000, phys + MAX_PAGE_POOL, MEMORY_TYPE_R | MEMORY_TYPE_W);
+
+    auto &&ptr2 = g_mm->alloc_contiguous(9);
+    auto &&virt2 = reinterpret_cast<uintptr_t>(ptr2);
+
+    this->expect_true(ptr2 != nullptr);
+    this->expect_true(ptr2 != ptr1);
+    this->expect_true(g_mm->virtint_to_physint(virt2 + 0x1FF000) == g_mm->virtint_to_physint(virt2) + 0x1FF000);
+
+    g_mm->free(ptr2);
+    this->expect_true(g_mm->page_pool_report().free_size == free_size);
+
+    g_mm->remove_md_range(pool, MAX_PAGE_POOL);
+    this->expect_true(g_mm->descriptors().empty());
+
+    // physically contiguous memory that is not aligned to the size of the
+    // block is skipped as well, which leaves single pages
+
+    g_mm->add_md_range(pool, phys + 0x1000, MAX_PAGE_POOL, MEMORY_TYPE_R | MEMORY_TYPE_W);
+
+    this->expect_true(g_mm->alloc_contiguous(9) == nullptr);
+    this->expect_true(g_mm->alloc_contiguous(1) == nullptr);
+    this->expect_true(g_mm->page_pool_report().free_size == free_size);
+
+    auto &&ptr3 = g_mm->alloc_contiguous(0);
+
+    this->expect_true(ptr3 != nullptr);
+    g_mm->free(ptr3);
+
+    g_mm->remove_md_range(pool, MAX_PAGE_POOL);
+    this->expect_true(g_mm->descriptors().empty());
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_malloc_contiguous_tries()
+{
+    auto &&pool = reinterpret_cast<uintptr_t>(g_page_pool_owner);
+    auto &&phys = 0x100000000UL + (pool & 0x1FFFFF);
+    auto &&free_size = g_mm->page_pool_report().free_size;
+
+    auto &&pair = (pool + MAX_PAGE_POOL / 2) & ~0x1FFFUL;
+
+    // only one pair of pages in the middle of the pool is physically
+    // contiguous, which is far more blocks than are tried
+
+    for (auto virt = pool; virt < pool + MAX_PAGE_POOL; virt += 0x1000)
+    {
+        if (virt != pair && virt != pair + 0x1000)
+            g_mm->add_md(virt, phys + (virt - pool) * 2, MEMORY_TYPE_R | MEMORY_TYPE_W);
+    }
+
+    g_mm->add_md_range(pair, phys + MAX_PAGE_POOL * 2, 0x2000, MEMORY_TYPE_R | MEMORY_TYPE_W);
+
+    this->expect_true(g_mm->alloc_contiguous(1) == nullptr);
+    this->expect_true(g_mm->page_pool_report().free_size == free_size);
+
+    g_mm->remove_md_range(pool, MAX_PAGE_POOL);
+    this->expect_true(g_mm->descriptors().empty());
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_malloc_aligned()
+{
+    this->expect_true(g_mm->alloc_aligned(0, page_size) == nullptr);
+    this->expect_true(g_mm->alloc_aligned(page_size, 3) == nullptr);
+
+    auto &&ptr = g_mm->alloc_aligned(page_size, 0x200000);
+
+    this->expect_true(ptr != nullptr);
+    this->expect_true((reinterpret_cast<uintptr_t>(ptr) & 0x1FFFFF) == 0);
+    this->expect_true(g_mm->size(ptr) == page_size);
+
+    g_mm->free(ptr);
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_malloc_aligned_small()
+{
+    auto &&ptr1 = g_mm->alloc_aligned(24, 64);
+    auto &&ptr2 = g_mm->alloc_aligned(3000, 64);
+    auto &&ptr3 = g_mm->alloc_aligned(3000, 256);
+
+    this->expect_true((reinterpret_cast<uintptr_t>(ptr1) & 63) == 0);
+    this->expect_true((reinterpret_cast<uintptr_t>(ptr2) & 63) == 0);
+    this->expect_true((reinterpret_cast<uintptr_t>(ptr3) & 255) == 0);
+
+    this->expect_true(g_mm->size(ptr1) == 64);
+    this->expect_true(g_mm->size(ptr2) == 3008);
+    this->expect_true(g_mm->size(ptr3) == page_size);
+
+    g_mm->free(ptr1);
+    g_mm->free(ptr2);
+    g_mm->free(ptr3);
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_realloc_alloc_free()
+{
+    auto &&ptr = g_mm->realloc(nullptr, 100);
+
+    this->expect_true(ptr != nullptr);
+    this->expect_true(g_mm->size(ptr) == 128);
+
+    this->expect_true(g_mm->realloc(ptr, 0) == nullptr);
+    this->expect_true(g_mm->realloc(make_ptr(0xFFFFFFFFFFFFFF00), 16) == nullptr);
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_realloc_in_place()
+{
+    auto &&ptr1 = g_mm->alloc(3000);
+    auto &&ptr2 = g_mm->realloc(ptr1, 6000);
+
+    this->expect_true(ptr2 == ptr1);
+    this->expect_true(g_mm->size(ptr2) == 6016);
+
+    auto &&ptr3 = g_mm->realloc(ptr2, 2500);
+
+    this->expect_true(ptr3 == ptr1);
+    this->expect_true(g_mm->size(ptr3) == 2560);
+
+    auto &&ptr4 = g_mm->alloc(100);
+    auto &&ptr5 = g_mm->realloc(ptr4, 120);
+
+    this->expect_true(ptr5 == ptr4);
+
+    g_mm->free(ptr3);
+    g_mm->free(ptr5);
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_realloc_copy()
+{
+    auto &&ptr1 = static_cast<char *>(g_mm->alloc(100));
+
+    for (auto i = 0; i < 100; i++)
+        ptr1[i] = static_cast<char>(i);
+
+    auto &&ptr2 = static_cast<char *>(g_mm->realloc(ptr1, 5000));
+
+    this->expect_true(ptr2 != ptr1);
+    this->expect_true(g_mm->size(ptr2) >= 5000);
+
+    auto same = true;
+    for (auto i = 0; i < 100; i++)
+        same = same && ptr2[i] == static_cast<char>(i);
+
+    this->expect_true(same);
+    g_mm->free(ptr2);
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_add_heap()
+{
+    alignas(0x1000) static uint8_t chunk[MAX_HEAP_POOL] = {};
+    auto &&virt = reinterpret_cast<uintptr_t>(chunk);
+
+    this->expect_exception([&] { g_mm->add_heap(0, MAX_HEAP_POOL); }, ""_ut_ffe);
+    this->expect_exception([&] { g_mm->add_heap(virt + 0x10, MAX_HEAP_POOL); }, ""_ut_ffe);
+    this->expect_exception([&] { g_mm->add_heap(virt, 0); }, ""_ut_ffe);
+    this->expect_exception([&] { g_mm->add_heap(virt, page_size); }, ""_ut_ffe);
+
+    this->expect_true(g_mm->heap_chunks_needed() == 0);
+
+    auto &&size = MAX_HEAP_POOL - MAX_HEAP_POOL / 8 - cache_line_size;
+    auto &&ptr1 = g_mm->alloc(size);
+
+    this->expect_true(ptr1 != nullptr);
+    this->expect_true(g_mm->heap_chunks_needed() == 1);
+
+    this->expect_no_exception([&] { g_mm->add_heap(virt, MAX_HEAP_POOL); });
+    this->expect_true(g_mm->heap_chunks_needed() == 0);
+
+    auto &&ptr2 = g_mm->alloc(size);
+
+    this->expect_true(reinterpret_cast<uintptr_t>(ptr2) >= virt);
+    this->expect_true(reinterpret_cast<uintptr_t>(ptr2) < virt + MAX_HEAP_POOL);
+    this->expect_true(g_mm->size(ptr2) == size);
+
+    g_mm->free(ptr1);
+    g_mm->free(ptr2);
+
+    this->expect_true(g_mm->size(ptr2) == 0);
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_page_pool_report()
+{
+    auto &&report1 = g_mm->page_pool_report();
+    auto &&ptr = g_mm->alloc(page_size);
+    auto &&report2 = g_mm->page_pool_report();
+
+    this->expect_true(report1.pool_size == MAX_PAGE_POOL);
+    this->expect_true(report2.free_size == report1.free_size - page_size);
+
+    g_mm->free(ptr);
+    this->expect_true(g_mm->page_pool_report().free_size == report1.free_size);
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_pool_stats()
+{
+    auto &&heap1 = g_mm->pool_stats(memory_manager_pool::heap);
+    auto &&page1 = g_mm->pool_stats(memory_manager_pool::page);
+    auto &&slab1 = g_mm->pool_stats(memory_manager_pool::slab);
+    auto &&map1 = g_mm->pool_stats(memory_manager_pool::map);
+
+    auto &&ptr1 = g_mm->alloc(100);
+    auto &&ptr2 = g_mm->alloc(page_size);
+    auto &&ptr3 = g_mm->alloc(0x3000 + 1);
+    auto &&ptr4 = g_mm->alloc_map(page_size + 1);
+
+    g_mm->free(ptr1);
+    g_mm->free(ptr2);
+    g_mm->free(ptr3);
+    g_mm->free_map(ptr4);
+
+    this->expect_true(g_mm->alloc(MAX_PAGE_POOL * 2) == nullptr);
+
+    auto &&heap2 = g_mm->pool_stats(memory_manager_pool::heap);
+    auto &&page2 = g_mm->pool_stats(memory_manager_pool::page);
+    auto &&slab2 = g_mm->pool_stats(memory_manager_pool::slab);
+    auto &&map2 = g_mm->pool_stats(memory_manager_pool::map);
+
+    this->expect_true(slab2.counters.allocs == slab1.counters.allocs + 1);
+    this->expect_true(slab2.counters.frees == slab1.counters.frees + 1);
+    this->expect_true(slab2.counters.bytes_allocated == slab1.counters.bytes_allocated + 128);
+    this->expect_true(slab2.counters.histogram.at(6) == slab1.counters.histogram.at(6) + 1);
+    this->expect_true(slab2.capacity >= page_size);
+
+    this->expect_true(page2.counters.allocs == page1.counters.allocs + 1);
+    this->expect_true(page2.counters.bytes_freed == page1.counters.bytes_freed + page_size);
+    this->expect_true(page2.counters.failed == page1.counters.failed + 1);
+    this->expect_true(page2.capacity == MAX_PAGE_POOL);
+    this->expect_true(page2.high_water >= page_size);
+    this->expect_true(page2.largest_free != 0);
+
+    this->expect_true(heap2.counters.allocs == heap1.counters.allocs + 1);
+    this->expect_true(heap2.counters.bytes_allocated == heap1.counters.bytes_allocated + 0x3000 + cache_line_size);
+    this->expect_true(heap2.counters.bytes_freed == heap1.counters.bytes_freed + 0x3000 + cache_line_size);
+    this->expect_true(heap2.high_water >= 0x3000 + cache_line_size);
+    this->expect_true(heap2.capacity >= MAX_HEAP_POOL);
+    this->expect_true(heap2.largest_free != 0);
+
+    this->expect_true(map2.counters.allocs == map1.counters.allocs + 1);
+    this->expect_true(map2.counters.bytes_allocated == map1.counters.bytes_allocated + page_size * 2);
+    this->expect_true(map2.capacity == MAX_MEM_MAP_POOL);
+    this->expect_true(map2.high_water >= page_size * 2);
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_tag_report()
+{
+    auto &&report1 = g_mm->tag_report();
+    auto &&slab1 = g_mm->pool_stats(memory_manager_pool::slab);
+
+    memory_manager_x64::pointer ptr1 = nullptr;
+    memory_manager_x64::pointer ptr2 = nullptr;
+    memory_manager_x64::pointer ptr3 = nullptr;
+
+    {
+        mem_tag_scope scope(mem_tag::vmcs);
+
+        ptr1 = g_mm->alloc(100);
+        ptr2 = g_mm->alloc(page_size);
+
+        mem_tag_scope stack(mem_tag::exit_handler_stack);
+        ptr3 = g_mm->alloc_aligned(100, 16);
+    }
+
+    auto &&ptr4 = g_mm->alloc(100);
+
+    auto &&report2 = g_mm->tag_report();
+    auto &&slab2 = g_mm->pool_stats(memory_manager_pool::slab);
+
+    this->expect_true(report2.at(mem_tag::vmcs) == report1.at(mem_tag::vmcs) + 128 + page_size);
+    this->expect_true(report2.at(mem_tag::exit_handler_stack) == report1.at(mem_tag::exit_handler_stack) + 128);
+    this->expect_true(report2.at(mem_tag::untagged) == report1.at(mem_tag::untagged) + 128);
+    this->expect_true(slab2.counters.allocs == slab1.counters.allocs + 3);
+
+    ptr1 = g_mm->realloc(ptr1, 200);
+    this->expect_true(g_mm->tag_report().at(mem_tag::vmcs) == report1.at(mem_tag::vmcs) + 256 + page_size);
+
+    ptr2 = g_mm->realloc(ptr2, page_size * 2);
+    this->expect_true(g_mm->tag_report().at(mem_tag::vmcs) == report1.at(mem_tag::vmcs) + 256 + page_size * 2);
+
+    g_mm->free(ptr1);
+    g_mm->free(ptr2);
+    g_mm->free(ptr3);
+    g_mm->free(ptr4);
+
+    auto &&report3 = g_mm->tag_report();
+
+    this->expect_true(report3.at(mem_tag::vmcs) == report1.at(mem_tag::vmcs));
+    this->expect_true(report3.at(mem_tag::exit_handler_stack) == report1.at(mem_tag::exit_handler_stack));
+    this->expect_true(report3.at(mem_tag::untagged) == report1.at(mem_tag::untagged));
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_add_pages()
+{
+    alignas(0x1000) static uint8_t chunk[MAX_PAGE_POOL] = {};
+    auto &&virt = reinterpret_cast<uintptr_t>(chunk);
+
+    this->expect_exception([&] { g_mm->add_pages(0, MAX_PAGE_POOL); }, ""_ut_ffe);
+    this->expect_exception([&] { g_mm->add_pages(virt + 0x10, MAX_PAGE_POOL); }, ""_ut_ffe);
+    this->expect_exception([&] { g_mm->add_pages(virt, 0); }, ""_ut_ffe);
+    this->expect_exception([&] { g_mm->add_pages(virt, page_size); }, ""_ut_ffe);
+
+    this->expect_true(g_mm->page_chunks_needed() == 0);
+
+    auto &&ptr1 = g_mm->alloc(MAX_PAGE_POOL / 2);
+    auto &&ptr2 = g_mm->alloc(MAX_PAGE_POOL / 4);
+    auto &&ptr3 = g_mm->alloc(MAX_PAGE_POOL / 16);
+
+    this->expect_true(ptr1 != nullptr);
+    this->expect_true(ptr2 != nullptr);
+    this->expect_true(ptr3 != nullptr);
+    this->expect_true(g_mm->alloc(MAX_PAGE_POOL / 2) == nullptr);
+    this->expect_true(g_mm->page_chunks_needed() == 1);
+
+    this->expect_no_exception([&] { g_mm->add_pages(virt, MAX_PAGE_POOL); });
+    this->expect_true(g_mm->page_chunks_needed() == 0);
+    this->expect_true(g_mm->page_pool_report().pool_size == MAX_PAGE_POOL * 2);
+
+    auto &&ptr4 = g_mm->alloc(MAX_PAGE_POOL / 2);
+
+    this->expect_true(reinterpret_cast<uintptr_t>(ptr4) >= virt);
+    this->expect_true(reinterpret_cast<uintptr_t>(ptr4) < virt + MAX_PAGE_POOL);
+    this->expect_true(g_mm->size(ptr4) == MAX_PAGE_POOL / 2);
+
+    g_mm->free(ptr1);
+    g_mm->free(ptr2);
+    g_mm->free(ptr3);
+    g_mm->free(ptr4);
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_heap_token()
+{
+    auto token = g_heap_token;
+
+    this->expect_true(token != 0);
+    this->expect_true(g_mm->valid_heap_token(token));
+    this->expect_false(g_mm->valid_heap_token(0));
+    this->expect_false(g_mm->valid_heap_token(token ^ 1));
+
+    g_heap_token = 0;
+    this->expect_true(g_mm->valid_heap_token(token));
+
+    g_heap_token = token;
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_pool_generation()
+{
+    auto &&generation = g_pool_generation.load();
+
+    auto &&ptr1 = g_mm->alloc(cache_line_size);
+    this->expect_true(g_pool_generation.load() == generation);
+
+    auto &&ptr2 = g_mm->alloc(page_size);
+    this->expect_true(g_pool_generation.load() == generation + 1);
+
+    auto &&ptr3 = g_mm->alloc(0x1010);
+    this->expect_true(g_pool_generation.load() == generation + 2);
+
+    this->expect_true(g_mm->alloc(MAX_PAGE_POOL * 4) == nullptr);
+    this->expect_true(g_pool_generation.load() == generation + 2);
+
+    g_mm->free(ptr1);
+    g_mm->free(ptr2);
+    g_mm->free(ptr3);
+
+    this->expect_true(g_pool_generation.load() == generation + 2);
+}
+
 void
 memory_manager_ut::test_memory_manager_x64_malloc_map()
 {
@@ -86,10 +498,149 @@ memory_manager_ut::test_memory_manager_x64_malloc_map()
     g_mm->free_map(ptr);
 }
 
+void
+memory_manager_ut::test_memory_manager_x64_malloc_map_aligned()
+{
+    this->expect_true(g_mm->alloc_map_aligned(0, 0x200000, 0) == nullptr);
+    this->expect_true(g_mm->alloc_map_aligned(page_size, 0x200000, 0x200000) == nullptr);
+
+    auto &&ptr = g_mm->alloc_map_aligned(page_size * 2, 0x200000, 0x3000);
+    auto &&addr = reinterpret_cast<memory_manager_x64::integer_pointer>(ptr);
+
+    this->expect_true(ptr != nullptr);
+    this->expect_true(((addr - 0x3000) & (0x200000 - 1)) == 0);
+    this->expect_true(g_mm->size_map(ptr) == page_size * 2);
+
+    g_mm->free_map(ptr);
+}
+
+auto g_unmap_range_count = 0UL;
+
+static void
+pt_unmap_range(memory_manager_x64::integer_pointer virt, memory_manager_x64::size_type size) noexcept
+{
+    (void) virt;
+    (void) size;
+
+    g_unmap_range_count++;
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_free_map_deferred()
+{
+    MockRepository mocks;
+    auto &&pt = mocks.Mock<root_page_table_x64>();
+
+    mocks.OnCallFunc(root_pt).Return(pt);
+    mocks.OnCall(pt, root_page_table_x64::unmap_range).Do(pt_unmap_range);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        std::vector<memory_manager_x64::pointer> ptrs;
+
+        g_mm->flush_deferred_maps();
+        g_unmap_range_count = 0;
+
+        this->expect_no_exception([&] { g_mm->free_map_deferred(nullptr, page_size); });
+        this->expect_no_exception([&] { g_mm->free_map_deferred(g_mm->alloc_map(page_size), 0); });
+
+        for (auto i = 0UL; i < MAX_DEFERRED_UNMAPS; i++)
+            ptrs.push_back(g_mm->alloc_map(page_size));
+
+        for (auto i = 0UL; i < MAX_DEFERRED_UNMAPS - 1; i++)
+            g_mm->free_map_deferred(ptrs.at(i), page_size);
+
+        this->expect_true(g_unmap_range_count == 0);
+        this->expect_true(g_mm->size_map(ptrs.front()) == page_size);
+
+        g_mm->free_map_deferred(ptrs.back(), page_size);
+
+        this->expect_true(g_unmap_range_count == MAX_DEFERRED_UNMAPS);
+        for (const auto &ptr : ptrs)
+            this->expect_true(g_mm->size_map(ptr) == 0);
+
+        auto &&ptr = g_mm->alloc_map(page_size);
+        g_mm->free_map_deferred(ptr, page_size);
+        this->expect_true(g_mm->size_map(ptr) == page_size);
+
+        g_mm->flush_deferred_maps();
+        this->expect_true(g_unmap_range_count == MAX_DEFERRED_UNMAPS + 1);
+        this->expect_true(g_mm->size_map(ptr) == 0);
+    });
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_free_map_deferred_other_cpu()
+{
+    MockRepository mocks;
+    auto &&pt = mocks.Mock<root_page_table_x64>();
+
+    auto cpuid = 1UL;
+    auto flushes = 0UL;
+
+    mocks.OnCallFunc(root_pt).Return(pt);
+    mocks.OnCall(pt, root_page_table_x64::unmap_range).Do(pt_unmap_range);
+    mocks.OnCallFunc(thread_context_cpuid).Do([&] { return cpuid; });
+    mocks.OnCallFunc(__flush_tlb).Do([&] { flushes++; });
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        std::vector<memory_manager_x64::pointer> ptrs;
+
+        g_mm->flush_deferred_maps();
+
+        // CPU 1 is in the VMM while CPU 0 unmaps, so it might still have
+        // TLB entries for the maps, which thus cannot be reused yet
+
+        g_mm->begin_exit();
+        cpuid = 0;
+
+        for (auto i = 0UL; i < MAX_DEFERRED_UNMAPS; i++)
+            ptrs.push_back(g_mm->alloc_map(page_size));
+
+        for (const auto &ptr : ptrs)
+            g_mm->free_map_deferred(ptr, page_size);
+
+        for (const auto &ptr : ptrs)
+            this->expect_true(g_mm->size_map(ptr) == page_size);
+
+        cpuid = 1;
+        g_mm->end_exit();
+        cpuid = 0;
+
+        g_mm->flush_deferred_maps();
+
+        for (const auto &ptr : ptrs)
+            this->expect_true(g_mm->size_map(ptr) == 0);
+
+        // Since maps were unmapped, CPU 1 flushes its TLB the next time it
+        // handles a VM exit, but only that one time
+
+        cpuid = 1;
+        flushes = 0;
+
+        g_mm->begin_exit();
+        g_mm->end_exit();
+        this->expect_true(flushes == 1);
+
+        g_mm->begin_exit();
+        g_mm->end_exit();
+        this->expect_true(flushes == 1);
+
+        // CPUs without a slot of their own always flush
+
+        cpuid = MAX_NUM_CPUS;
+
+        g_mm->begin_exit();
+        g_mm->end_exit();
+        this->expect_true(flushes == 2);
+    });
+}
+
 void
 memory_manager_ut::test_memory_manager_x64_add_md()
 {
-    memory_descriptor md = {0, 0, 0};
+    memory_descriptor md = {0, 0, 0, 0};
 
     this->expect_true(add_md(nullptr) == MEMORY_MANAGER_FAILURE);
     this->expect_true(add_md(&md) == MEMORY_MANAGER_FAILURE);
@@ -128,6 +679,185 @@ memory_manager_ut::test_memory_manager_x64_add_md_unaligned_virtual()
     this->expect_true(g_mm->descriptors().empty());
 }
 
+void
+memory_manager_ut::test_memory_manager_x64_add_md_invalid_attr()
+{
+    memory_manager_x64::integer_pointer virt = 0x12345000;
+    memory_manager_x64::integer_pointer phys = 0x54321000;
+    memory_manager_x64::attr_type attr = page_size;
+
+    this->expect_exception([&] { g_mm->add_md(virt, phys, attr); }, ""_ut_ffe);
+    this->expect_true(g_mm->descriptors().empty());
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_add_md_non_canonical()
+{
+    memory_manager_x64::integer_pointer virt = 0x0000800000000000;
+    memory_manager_x64::integer_pointer phys = 0x54321000;
+    memory_manager_x64::attr_type attr = MEMORY_TYPE_R | MEMORY_TYPE_W | MEMORY_TYPE_E;
+
+    this->expect_exception([&] { g_mm->add_md(virt, phys, attr); }, ""_ut_ffe);
+    this->expect_exception([&] { g_mm->virtint_to_physint(virt); }, ""_ut_ore);
+    this->expect_true(g_mm->descriptors().empty());
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_add_md_upper_half()
+{
+    memory_manager_x64::integer_pointer virt = 0xFFFF800012345000;
+    memory_manager_x64::integer_pointer phys = 0x54321000;
+    memory_manager_x64::attr_type attr = MEMORY_TYPE_R | MEMORY_TYPE_W;
+
+    this->expect_no_exception([&] { g_mm->add_md(virt, phys, attr); });
+
+    this->expect_true(g_mm->virtint_to_physint(virt + 0x10) == phys + 0x10);
+    this->expect_true(g_mm->physint_to_virtint(phys + 0x10) == virt + 0x10);
+    this->expect_true(g_mm->virtint_to_attrint(virt) == attr);
+    this->expect_exception([&] { g_mm->virtint_to_physint(0x0000800012345000); }, ""_ut_ore);
+
+    auto &&list = g_mm->descriptors();
+    this->expect_true(list.size() == 1);
+    this->expect_true(list.at(0).virt == virt);
+    this->expect_true(list.at(0).phys == phys);
+    this->expect_true(list.at(0).type == attr);
+
+    g_mm->remove_md(virt);
+    this->expect_true(g_mm->descriptors().empty());
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_add_md_range()
+{
+    memory_manager_x64::integer_pointer virt = 0x12340000;
+    memory_manager_x64::integer_pointer phys = 0x54320000;
+    memory_manager_x64::attr_type attr = MEMORY_TYPE_R | MEMORY_TYPE_W;
+
+    this->expect_exception([&] { g_mm->add_md_range(virt, phys, 0, attr); }, ""_ut_ffe);
+    this->expect_exception([&] { g_mm->add_md_range(virt, phys, 0x1010, attr); }, ""_ut_ffe);
+    this->expect_true(g_mm->descriptors().empty());
+
+    this->expect_no_exception([&] { g_mm->add_md_range(virt, phys, 0x4000, attr); });
+
+    this->expect_true(g_mm->virtint_to_physint(virt + 0x3010) == phys + 0x3010);
+    this->expect_true(g_mm->physint_to_virtint(phys + 0x2010) == virt + 0x2010);
+    this->expect_true(g_mm->virtint_to_attrint(virt + 0x1000) == attr);
+    this->expect_exception([&] { g_mm->virtint_to_physint(virt + 0x4000); }, ""_ut_ore);
+
+    auto &&list = g_mm->descriptors();
+    this->expect_true(list.size() == 1);
+    this->expect_true(list.at(0).virt == virt);
+    this->expect_true(list.at(0).phys == phys);
+    this->expect_true(list.at(0).size == 0x4000);
+
+    for (auto offset = 0UL; offset < 0x4000; offset += page_size)
+        g_mm->remove_md(virt + offset);
+
+    this->expect_true(g_mm->descriptors().empty());
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_add_md_coalesce()
+{
+    memory_manager_x64::integer_pointer virt = 0x12340000;
+    memory_manager_x64::integer_pointer phys = 0x54320000;
+    memory_manager_x64::attr_type attr = MEMORY_TYPE_R | MEMORY_TYPE_W;
+
+    g_mm->add_md(virt + 0x1000, phys + 0x1000, attr);
+    g_mm->add_md(virt + 0x3000, phys + 0x3000, attr);
+    this->expect_true(g_mm->descriptors().size() == 2);
+
+    g_mm->add_md(virt + 0x2000, phys + 0x2000, attr);
+    g_mm->add_md(virt, phys, attr);
+    this->expect_true(g_mm->descriptors().size() == 1);
+    this->expect_true(g_mm->descriptors().at(0).size == 0x4000);
+
+    g_mm->add_md(virt + 0x4000, phys + 0x8000, attr);
+    g_mm->add_md(virt + 0x5000, phys + 0x9000, MEMORY_TYPE_R | MEMORY_TYPE_E);
+
+    auto &&list = g_mm->descriptors();
+    this->expect_true(list.size() == 3);
+    this->expect_true(list.at(1).virt == virt + 0x4000);
+    this->expect_true(list.at(1).phys == phys + 0x8000);
+    this->expect_true(list.at(1).size == 0x1000);
+    this->expect_true(list.at(2).type == (MEMORY_TYPE_R | MEMORY_TYPE_E));
+
+    for (auto offset = 0UL; offset < 0x6000; offset += page_size)
+        g_mm->remove_md(virt + offset);
+
+    this->expect_true(g_mm->descriptors().empty());
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_add_md_split()
+{
+    memory_manager_x64::integer_pointer virt = 0x12340000;
+    memory_manager_x64::integer_pointer phys = 0x54320000;
+    memory_manager_x64::attr_type attr = MEMORY_TYPE_R | MEMORY_TYPE_W;
+
+    g_mm->add_md_range(virt, phys, 0x4000, attr);
+    g_mm->remove_md(virt + 0x1000);
+
+    auto &&list1 = g_mm->descriptors();
+    this->expect_true(list1.size() == 2);
+    this->expect_true(list1.at(0).size == 0x1000);
+    this->expect_true(list1.at(1).virt == virt + 0x2000);
+    this->expect_true(list1.at(1).phys == phys + 0x2000);
+    this->expect_true(list1.at(1).size == 0x2000);
+    this->expect_exception([&] { g_mm->virtint_to_physint(virt + 0x1000); }, ""_ut_ore);
+
+    g_mm->add_md(virt + 0x2000, phys + 0x10000, attr);
+    this->expect_exception([&] { g_mm->physint_to_virtint(phys + 0x2000); }, ""_ut_ore);
+    this->expect_true(g_mm->virtint_to_physint(virt + 0x2000) == phys + 0x10000);
+
+    auto &&list2 = g_mm->descriptors();
+    this->expect_true(list2.size() == 3);
+    this->expect_true(list2.at(1).phys == phys + 0x10000);
+    this->expect_true(list2.at(2).virt == virt + 0x3000);
+    this->expect_true(list2.at(2).phys == phys + 0x3000);
+
+    g_mm->remove_md(virt);
+    g_mm->remove_md(virt + 0x2000);
+    g_mm->remove_md(virt + 0x3000);
+
+    this->expect_true(g_mm->descriptors().empty());
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_remove_md_range()
+{
+    memory_manager_x64::integer_pointer virt = 0x12340000;
+    memory_manager_x64::integer_pointer phys = 0x54320000;
+    memory_manager_x64::attr_type attr = MEMORY_TYPE_R | MEMORY_TYPE_W;
+
+    g_mm->add_md_range(virt, phys, 0x4000, attr);
+    g_mm->add_md(virt + 0x10000, phys + 0x1000, attr);
+
+    this->expect_no_exception([&] { g_mm->remove_md_range(0, 0x1000); });
+    this->expect_no_exception([&] { g_mm->remove_md_range(virt + 0x10, 0x1000); });
+    this->expect_no_exception([&] { g_mm->remove_md_range(virt, 0x10); });
+    this->expect_true(g_mm->descriptors().size() == 2);
+
+    g_mm->remove_md_range(virt + 0x1000, 0x2000);
+
+    auto &&list = g_mm->descriptors();
+    this->expect_true(list.size() == 3);
+    this->expect_true(list.at(0).size == 0x1000);
+    this->expect_true(list.at(1).virt == virt + 0x3000);
+    this->expect_exception([&] { g_mm->virtint_to_physint(virt + 0x2000); }, ""_ut_ore);
+    this->expect_exception([&] { g_mm->physint_to_virtint(phys + 0x2000); }, ""_ut_ore);
+
+    // phys + 0x1000 is now mapped at virt + 0x10000, so removing the old
+    // mapping must not remove the reverse lookup of the new one
+
+    this->expect_true(g_mm->physint_to_virtint(phys + 0x1000) == virt + 0x10000);
+
+    g_mm->remove_md_range(virt, 0x4000);
+    g_mm->remove_md_range(virt + 0x10000, 0x1000);
+
+    this->expect_true(g_mm->descriptors().empty());
+}
+
 void
 memory_manager_ut::test_memory_manager_x64_remove_md_invalid_virt()
 {
@@ -232,3 +962,51 @@ memory_manager_ut::test_memory_manager_x64_virtint_to_attrint_nullptr()
     this->expect_exception([&] { g_mm->virtint_to_attrint(0); }, ""_ut_ffe);
     this->expect_exception([&] { g_mm->virtptr_to_attrint(nullptr); }, ""_ut_ffe);
 }
+
+void
+memory_manager_ut::test_memory_manager_x64_translate_driver_context()
+{
+    MockRepository mocks;
+    mocks.OnCallFunc(thread_context_vmx_root).Return(0);
+
+    memory_manager_x64::integer_pointer virt = 0x12340000;
+    memory_manager_x64::integer_pointer phys = 0x54320000;
+    memory_manager_x64::attr_type attr = MEMORY_TYPE_R | MEMORY_TYPE_W;
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        g_mm->add_md(virt, phys, attr);
+
+        this->expect_true(g_mm->virtint_to_physint(virt + 0x10) == phys + 0x10);
+        this->expect_true(g_mm->physint_to_virtint(phys + 0x10) == virt + 0x10);
+        this->expect_true(g_mm->virtint_to_attrint(virt) == attr);
+
+        g_mm->remove_md(virt);
+        this->expect_exception([&] { g_mm->virtint_to_physint(virt); }, ""_ut_ore);
+    });
+}
+
+void
+memory_manager_ut::test_memory_manager_x64_begin_end_exit()
+{
+    memory_manager_x64::integer_pointer virt = 0x12340000;
+    memory_manager_x64::integer_pointer phys = 0x54320000;
+    memory_manager_x64::attr_type attr = MEMORY_TYPE_R | MEMORY_TYPE_W;
+
+    // While this CPU is handling an exit, the nodes that remove_md leaves
+    // empty are retired, not reused, but the table stays correct
+
+    g_mm->begin_exit();
+
+    g_mm->add_md(virt, phys, attr);
+    g_mm->remove_md(virt);
+    g_mm->add_md(virt, phys, attr);
+
+    this->expect_true(g_mm->virtint_to_physint(virt) == phys);
+    this->expect_true(g_mm->physint_to_virtint(phys) == virt);
+
+    g_mm->end_exit();
+
+    g_mm->remove_md(virt);
+    this->expect_true(g_mm->descriptors().empty());
+}
@@ -21,6 +21,8 @@
 
 #include <gsl/gsl>
 
+#include <map>
+
 #include <test.h>
 #include <memory_manager/page_table_x64.h>
 #include <memory_manager/memory_manager_x64.h>
@@ -28,13 +30,47 @@
 bool virt_to_phys_return_nullptr = false;
 constexpr page_table_x64::integer_pointer virt = 0x0000100000000000UL;
 
+// The memory manager mocks hand out a unique (fake) physical address for
+// each page table, starting at 0x0000000ABCDEF0000. The page tables keep
+// track of the virtual addresses of their children themselves, so the
+// physical addresses are never translated back.
+
+std::map<uintptr_t, uintptr_t> g_pt_virt_to_phys;
+
+static uintptr_t
+pt_virtint_to_physint(uintptr_t table)
+{
+    auto &&iter = g_pt_virt_to_phys.find(table);
+    if (iter != g_pt_virt_to_phys.end())
+        return iter->second;
+
+    auto &&phys = 0x0000000ABCDEF0000UL + (g_pt_virt_to_phys.size() << 12);
+
+    g_pt_virt_to_phys[table] = phys;
+
+    return phys;
+}
+
+static uintptr_t
+pt_virtptr_to_physint(void *table)
+{ return pt_virtint_to_physint(reinterpret_cast<uintptr_t>(table)); }
+
+void
+setup_page_table_mm(MockRepository &mocks, memory_manager_x64 *mm)
+{
+    g_pt_virt_to_phys.clear();
+
+    mocks.OnCall(mm, memory_manager_x64::virtptr_to_physint).Do(pt_virtptr_to_physint);
+    mocks.OnCall(mm, memory_manager_x64::virtint_to_physint).Do(pt_virtint_to_physint);
+    mocks.NeverCall(mm, memory_manager_x64::physint_to_virtptr);
+}
+
 static auto
 setup_mm(MockRepository &mocks)
 {
     auto mm = mocks.Mock<memory_manager_x64>();
     mocks.OnCallFunc(memory_manager_x64::instance).Return(mm);
-    mocks.OnCall(mm, memory_manager_x64::virtptr_to_physint).Return(0x0000000ABCDEF0000);
-    mocks.OnCall(mm, memory_manager_x64::virtint_to_physint).Return(0x0000000ABCDEF0000);
+    setup_page_table_mm(mocks, mm);
 
     return mm;
 }
@@ -52,27 +88,27 @@ memory_manager_ut::test_page_table_x64_add_remove_page_success_without_setting()
 
         pml4->add_page_4k(virt);
         this->expect_true(pml4->global_size() == 3);
-        this->expect_true(pml4->global_capacity() == 512 * 3);
+        this->expect_true(pml4->global_tables() == 4);
 
         pml4->add_page_4k(virt + 0x1000);
         this->expect_true(pml4->global_size() == 3);
-        this->expect_true(pml4->global_capacity() == 512 * 3);
+        this->expect_true(pml4->global_tables() == 4);
 
         pml4->add_page_4k(virt + 0x10000);
         this->expect_true(pml4->global_size() == 3);
-        this->expect_true(pml4->global_capacity() == 512 * 3);
+        this->expect_true(pml4->global_tables() == 4);
 
         pml4->remove_page(virt);
         this->expect_true(pml4->global_size() == 0);
-        this->expect_true(pml4->global_capacity() == 512 * 1);
+        this->expect_true(pml4->global_tables() == 1);
 
         pml4->remove_page(virt + 0x1000);
         this->expect_true(pml4->global_size() == 0);
-        this->expect_true(pml4->global_capacity() == 512 * 1);
+        this->expect_true(pml4->global_tables() == 1);
 
         pml4->remove_page(virt + 0x10000);
         this->expect_true(pml4->global_size() == 0);
-        this->expect_true(pml4->global_capacity() == 512 * 1);
+        this->expect_true(pml4->global_tables() == 1);
     });
 }
 
@@ -90,34 +126,34 @@ memory_manager_ut::test_page_table_x64_add_remove_page_1g_success()
         auto &&entry1 = pml4->add_page_1g(virt);
         entry1.set_present(true);
         this->expect_true(pml4->global_size() == 2);
-        this->expect_true(pml4->global_capacity() == 512 * 1);
+        this->expect_true(pml4->global_tables() == 2);
 
         auto &&entry2 = pml4->add_page_1g(virt + 0x100);
         entry2.set_present(true);
         this->expect_true(pml4->global_size() == 2);
-        this->expect_true(pml4->global_capacity() == 512 * 1);
+        this->expect_true(pml4->global_tables() == 2);
 
         auto &&entry3 = pml4->add_page_1g(virt + 0x40000000);
         entry3.set_present(true);
         this->expect_true(pml4->global_size() == 3);
-        this->expect_true(pml4->global_capacity() == 512 * 1);
+        this->expect_true(pml4->global_tables() == 2);
 
         auto &&entry4 = pml4->add_page_1g(virt + 0x400000000);
         entry4.set_present(true);
         this->expect_true(pml4->global_size() == 4);
-        this->expect_true(pml4->global_capacity() == 512 * 1);
+        this->expect_true(pml4->global_tables() == 2);
 
         pml4->remove_page(virt);
         this->expect_true(pml4->global_size() == 3);
-        this->expect_true(pml4->global_capacity() == 512 * 1);
+        this->expect_true(pml4->global_tables() == 2);
 
         pml4->remove_page(virt + 0x40000000);
         this->expect_true(pml4->global_size() == 2);
-        this->expect_true(pml4->global_capacity() == 512 * 1);
+        this->expect_true(pml4->global_tables() == 2);
 
         pml4->remove_page(virt + 0x400000000);
         this->expect_true(pml4->global_size() == 0);
-        this->expect_true(pml4->global_capacity() == 512 * 1);
+        this->expect_true(pml4->global_tables() == 1);
     });
 }
 
@@ -135,34 +171,34 @@ memory_manager_ut::test_page_table_x64_add_remove_page_2m_success()
         auto &&entry1 = pml4->add_page_2m(virt);
         entry1.set_present(true);
         this->expect_true(pml4->global_size() == 3);
-        this->expect_true(pml4->global_capacity() == 512 * 2);
+        this->expect_true(pml4->global_tables() == 3);
 
         auto &&entry2 = pml4->add_page_2m(virt + 0x100);
         entry2.set_present(true);
         this->expect_true(pml4->global_size() == 3);
-        this->expect_true(pml4->global_capacity() == 512 * 2);
+        this->expect_true(pml4->global_tables() == 3);
 
         auto &&entry3 = pml4->add_page_2m(virt + 0x200000);
         entry3.set_present(true);
         this->expect_true(pml4->global_size() == 4);
-        this->expect_true(pml4->global_capacity() == 512 * 2);
+        this->expect_true(pml4->global_tables() == 3);
 
         auto &&entry4 = pml4->add_page_2m(virt + 0x2000000);
         entry4.set_present(true);
         this->expect_true(pml4->global_size() == 5);
-        this->expect_true(pml4->global_capacity() == 512 * 2);
+        this->expect_true(pml4->global_tables() == 3);
 
         pml4->remove_page(virt);
         this->expect_true(pml4->global_size() == 4);
-        this->expect_true(pml4->global_capacity() == 512 * 2);
+        this->expect_true(pml4->global_tables() == 3);
 
         pml4->remove_page(virt + 0x200000);
         this->expect_true(pml4->global_size() == 3);
-        this->expect_true(pml4->global_capacity() == 512 * 2);
+        this->expect_true(pml4->global_tables() == 3);
 
         pml4->remove_page(virt + 0x2000000);
         this->expect_true(pml4->global_size() == 0);
-        this->expect_true(pml4->global_capacity() == 512 * 1);
+        this->expect_true(pml4->global_tables() == 1);
     });
 }
 
@@ -180,34 +216,34 @@ memory_manager_ut::test_page_table_x64_add_remove_page_4k_success()
         auto &&entry1 = pml4->add_page_4k(virt);
         entry1.set_present(true);
         this->expect_true(pml4->global_size() == 4);
-        this->expect_true(pml4->global_capacity() == 512 * 3);
+        this->expect_true(pml4->global_tables() == 4);
 
         auto &&entry2 = pml4->add_page_4k(virt + 0x100);
         entry2.set_present(true);
         this->expect_true(pml4->global_size() == 4);
-        this->expect_true(pml4->global_capacity() == 512 * 3);
+        this->expect_true(pml4->global_tables() == 4);
 
         auto &&entry3 = pml4->add_page_4k(virt + 0x1000);
         entry3.set_present(true);
         this->expect_true(pml4->global_size() == 5);
-        this->expect_true(pml4->global_capacity() == 512 * 3);
+        this->expect_true(pml4->global_tables() == 4);
 
         auto &&entry4 = pml4->add_page_4k(virt + 0x10000);
         entry4.set_present(true);
         this->expect_true(pml4->global_size() == 6);
-        this->expect_true(pml4->global_capacity() == 512 * 3);
+        this->expect_true(pml4->global_tables() == 4);
 
         pml4->remove_page(virt);
         this->expect_true(pml4->global_size() == 5);
-        this->expect_true(pml4->global_capacity() == 512 * 3);
+        this->expect_true(pml4->global_tables() == 4);
 
         pml4->remove_page(virt + 0x1000);
         this->expect_true(pml4->global_size() == 4);
-        this->expect_true(pml4->global_capacity() == 512 * 3);
+        this->expect_true(pml4->global_tables() == 4);
 
         pml4->remove_page(virt + 0x10000);
         this->expect_true(pml4->global_size() == 0);
-        this->expect_true(pml4->global_capacity() == 512 * 1);
+        this->expect_true(pml4->global_tables() == 1);
     });
 }
 
@@ -225,39 +261,39 @@ memory_manager_ut::test_page_table_x64_add_remove_page_swap_success()
         auto &&entry1 = pml4->add_page_4k(virt);
         entry1.set_present(true);
         this->expect_true(pml4->global_size() == 4);
-        this->expect_true(pml4->global_capacity() == 512 * 3);
+        this->expect_true(pml4->global_tables() == 4);
 
         pml4->remove_page(virt);
         this->expect_true(pml4->global_size() == 0);
-        this->expect_true(pml4->global_capacity() == 512 * 1);
+        this->expect_true(pml4->global_tables() == 1);
 
         auto &&entry2 = pml4->add_page_2m(virt);
         entry2.set_present(true);
         this->expect_true(pml4->global_size() == 3);
-        this->expect_true(pml4->global_capacity() == 512 * 2);
+        this->expect_true(pml4->global_tables() == 3);
 
         pml4->remove_page(virt);
         this->expect_true(pml4->global_size() == 0);
-        this->expect_true(pml4->global_capacity() == 512 * 1);
+        this->expect_true(pml4->global_tables() == 1);
 
         auto &&entry3 = pml4->add_page_4k(virt);
         entry3.set_present(true);
         this->expect_true(pml4->global_size() == 4);
-        this->expect_true(pml4->global_capacity() == 512 * 3);
+        this->expect_true(pml4->global_tables() == 4);
 
         auto &&entry4 = pml4->add_page_2m(virt);
         entry4.set_present(true);
         this->expect_true(pml4->global_size() == 3);
-        this->expect_true(pml4->global_capacity() == 512 * 2);
+        this->expect_true(pml4->global_tables() == 3);
 
         auto &&entry5 = pml4->add_page_4k(virt);
         entry5.set_present(true);
         this->expect_true(pml4->global_size() == 4);
-        this->expect_true(pml4->global_capacity() == 512 * 3);
+        this->expect_true(pml4->global_tables() == 4);
 
         pml4->remove_page(virt);
         this->expect_true(pml4->global_size() == 0);
-        this->expect_true(pml4->global_capacity() == 512 * 1);
+        this->expect_true(pml4->global_tables() == 1);
     });
 }
 
@@ -375,3 +411,110 @@ memory_manager_ut::test_page_table_x64_pt_to_mdl_success()
         this->expect_true(pml4->global_size() == 0);
     });
 }
+
+void
+memory_manager_ut::test_page_table_x64_add_pages_success()
+{
+    MockRepository mocks;
+    setup_mm(mocks);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&scr3 = 0x0UL;
+        auto &&pml4 = std::make_unique<page_table_x64>(&scr3);
+
+        this->expect_exception([&] { pml4->add_pages_4k(virt, 0); }, ""_ut_ffe);
+
+        auto &&entries1 = pml4->add_pages_4k(virt + 0x1FE000, 4);
+        this->expect_true(entries1.size() == 2);
+
+        for (auto &element : entries1)
+            page_table_entry_x64(&element).set_present(true);
+
+        this->expect_true(pml4->global_size() == 5);
+        this->expect_true(pml4->virt_to_pte(virt + 0x1FF000).present());
+
+        auto &&entries2 = pml4->add_pages_2m(virt + 0x40000000, 1024);
+        this->expect_true(entries2.size() == 512);
+
+        auto &&entries3 = pml4->add_pages_1g(virt, 1);
+        this->expect_true(entries3.size() == 1);
+        this->expect_true(pml4->global_tables() == 3);
+    });
+}
+
+void
+memory_manager_ut::test_page_table_x64_mixed_pages_success()
+{
+    MockRepository mocks;
+    setup_mm(mocks);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&scr3 = 0x0UL;
+        auto &&pml4 = std::make_unique<page_table_x64>(&scr3);
+
+        auto &&entry1 = pml4->add_page_2m(virt);
+        entry1.set_present(true);
+        auto &&entry2 = pml4->add_page_4k(virt + 0x200000);
+        entry2.set_present(true);
+        this->expect_true(pml4->global_size() == 5);
+        this->expect_true(pml4->global_tables() == 4);
+
+        this->expect_true(pml4->virt_to_pte(virt + 0x1000).present());
+        this->expect_true(pml4->virt_to_pte(virt + 0x200000).present());
+        this->expect_exception([&] { pml4->virt_to_pte(virt + 0x400000); }, ""_ut_ree);
+
+        this->expect_true(pml4->remove_page(virt + 0x200000) == 0x1000);
+        this->expect_true(pml4->remove_page(virt + 0x200000) == 0);
+        this->expect_true(pml4->remove_page(virt) == 0x200000);
+        this->expect_true(pml4->global_size() == 0);
+
+        auto &&entry3 = pml4->add_page_4k(virt + 0x200000);
+        entry3.set_present(true);
+        auto &&entry4 = pml4->add_page_2m(virt + 0x200000);
+        entry4.set_present(true);
+        this->expect_true(pml4->global_size() == 3);
+        this->expect_true(pml4->global_tables() == 3);
+
+        this->expect_true(pml4->remove_page(virt + 0x200000) == 0x200000);
+        this->expect_true(pml4->global_size() == 0);
+    });
+}
+
+void
+memory_manager_ut::test_page_table_x64_reuse_tables_success()
+{
+    MockRepository mocks;
+    setup_mm(mocks);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&scr3 = 0x0UL;
+        auto &&pml4 = std::make_unique<page_table_x64>(&scr3);
+
+        auto &&entry1 = pml4->add_page_4k(virt);
+        entry1.set_present(true);
+        this->expect_true(pml4->global_tables() == 4);
+        this->expect_true(pml4->m_num_free == 0);
+        this->expect_true(g_pt_virt_to_phys.size() == 4);
+
+        pml4->remove_page(virt);
+        this->expect_true(pml4->global_tables() == 1);
+        this->expect_true(pml4->m_num_free == 3);
+
+        auto &&entry2 = pml4->add_page_4k(virt + 0x40000000);
+        entry2.set_present(true);
+        this->expect_true(pml4->global_tables() == 4);
+        this->expect_true(pml4->m_num_free == 0);
+        this->expect_true(g_pt_virt_to_phys.size() == 4);
+        this->expect_true(pml4->virt_to_pte(virt + 0x40000000).present());
+
+        for (auto i = 0UL; i < page_table_x64_max_free_tables + 1; i++)
+            pml4->add_page_4k(virt + (i << x64::page_table::pd::from));
+
+        pml4->add_page_1g(virt);
+        this->expect_true(pml4->m_num_free == page_table_x64_max_free_tables);
+        this->expect_true(pml4->global_tables() == 4);
+    });
+}
@@ -0,0 +1,440 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <gsl/gsl>
+
+#include <map>
+#include <algorithm>
+#include <array>
+#include <cstring>
+
+#include <test.h>
+#include <memory_manager/page_walk_cache_x64.h>
+#include <memory_manager/memory_manager_x64.h>
+#include <memory_manager/root_page_table_x64.h>
+
+using table_t = std::array<uintptr_t, x64::page_table::num_entries>;
+
+constexpr const auto walk_cr3 = 0x1000UL;
+constexpr const auto walk_pdpt = 0x2000UL;
+constexpr const auto walk_pd = 0x3000UL;
+constexpr const auto walk_pt = 0x4000UL;
+constexpr const auto walk_data = 0x0000333300000000UL;
+
+// virt with index 1 in each of the pml4, pdpt, pd and pt
+constexpr const auto walk_virt = 0x0000008040201000UL;
+
+constexpr const auto walk_num_pages = 32UL;
+
+alignas(0x1000) static table_t g_walk_pages[walk_num_pages] = {};
+static auto g_walk_next = 0UL;
+static auto g_walk_allocs = 0UL;
+static auto g_walk_frees = 0UL;
+
+static std::map<uintptr_t, table_t> g_walk_guest;
+static std::map<uintptr_t, uintptr_t> g_walk_mapped;
+
+static memory_manager_x64::pointer
+walk_alloc_map(memory_manager_x64::size_type size) noexcept
+{
+    auto &&page = &g_walk_pages[g_walk_next];
+
+    g_walk_next += (size + x64::page_size - 1) >> x64::page_shift;
+    g_walk_allocs++;
+
+    return reinterpret_cast<memory_manager_x64::pointer>(page);
+}
+
+static void
+walk_free_map(memory_manager_x64::pointer ptr, memory_manager_x64::size_type size) noexcept
+{
+    (void) ptr;
+    (void) size;
+
+    g_walk_frees++;
+}
+
+static void
+walk_map_4k(memory_manager_x64::integer_pointer virt,
+            memory_manager_x64::integer_pointer phys,
+            memory_manager_x64::attr_type attr)
+{
+    (void) attr;
+
+    auto &&iter = g_walk_guest.find(phys);
+    if (iter != g_walk_guest.end())
+        std::memcpy(reinterpret_cast<void *>(virt), iter->second.data(), x64::page_size);
+
+    g_walk_mapped[virt] = phys;
+}
+
+static void
+walk_map_2m(memory_manager_x64::integer_pointer virt,
+            memory_manager_x64::integer_pointer phys,
+            memory_manager_x64::attr_type attr)
+{
+    (void) attr;
+    g_walk_mapped[virt] = phys;
+}
+
+static void
+set_entry(uintptr_t table, uintptr_t index, uintptr_t phys, bool ps = false)
+{
+    auto &&entry = g_walk_guest[table].at(index);
+    auto &&pte = page_table_entry_x64{&entry};
+
+    entry = 0;
+
+    pte.set_present(true);
+    pte.set_phys_addr(phys);
+    pte.set_ps(ps);
+}
+
+static auto
+setup_walk(MockRepository &mocks)
+{
+    auto mm = mocks.Mock<memory_manager_x64>();
+    mocks.OnCallFunc(memory_manager_x64::instance).Return(mm);
+
+    mocks.OnCall(mm, memory_manager_x64::alloc_map).Do(walk_alloc_map);
+    mocks.OnCall(mm, memory_manager_x64::free_map_deferred).Do(walk_free_map);
+
+    auto pt = mocks.Mock<root_page_table_x64>();
+    mocks.OnCallFunc(root_pt).Return(pt);
+
+    mocks.OnCall(pt, root_page_table_x64::map_4k).Do(walk_map_4k);
+
+    auto tm = mocks.Mock<temp_map_x64>();
+    mocks.OnCallFunc(temp_map_x64::instance).Return(tm);
+
+    mocks.OnCall(tm, temp_map_x64::map).Return(0);
+
+    g_walk_next = 0;
+    g_walk_allocs = 0;
+    g_walk_frees = 0;
+
+    g_walk_guest.clear();
+    g_walk_mapped.clear();
+
+    set_entry(walk_cr3, 1, walk_pdpt);
+    set_entry(walk_pdpt, 1, walk_pd);
+    set_entry(walk_pd, 1, walk_pt);
+    set_entry(walk_pt, 1, walk_data);
+    set_entry(walk_pt, 2, walk_data + 0x5000);
+
+    return mm;
+}
+
+void
+memory_manager_ut::test_page_walk_cache_x64_invalid_args()
+{
+    bfn::page_walk_cache_x64 cache;
+
+    this->expect_exception([&] { cache.translate(0, walk_cr3); }, ""_ut_ffe);
+    this->expect_exception([&] { cache.translate(walk_virt, 0); }, ""_ut_ffe);
+    this->expect_exception([&] { cache.translate(walk_virt, walk_cr3 + 0x10); }, ""_ut_ffe);
+}
+
+void
+memory_manager_ut::test_page_walk_cache_x64_4k()
+{
+    MockRepository mocks;
+    setup_walk(mocks);
+
+    g_walk_guest[walk_pt].at(1) |= 0x80;
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        bfn::page_walk_cache_x64 cache;
+
+        auto &&result = cache.translate(walk_virt + 0x123, walk_cr3);
+        this->expect_true(result.phys == walk_data + 0x123);
+        this->expect_true(result.pati == 4);
+        this->expect_true(result.size == x64::page_table::pt::size_bytes);
+        this->expect_true(cache.misses() == 1);
+        this->expect_true(g_walk_allocs == 4);
+
+        this->expect_true(cache.virt_to_phys(walk_virt + 0x456, walk_cr3) == walk_data + 0x456);
+        this->expect_true(cache.translate(walk_virt, walk_cr3).pati == 4);
+        this->expect_true(cache.hits() == 2);
+        this->expect_true(cache.misses() == 1);
+
+        this->expect_true(cache.virt_to_phys(walk_virt + 0x1010, walk_cr3) == walk_data + 0x5010);
+        this->expect_true(cache.misses() == 2);
+        this->expect_true(g_walk_allocs == 4);
+    });
+}
+
+void
+memory_manager_ut::test_page_walk_cache_x64_2m()
+{
+    MockRepository mocks;
+    setup_walk(mocks);
+
+    set_entry(walk_pd, 1, walk_data, true);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        bfn::page_walk_cache_x64 cache;
+
+        this->expect_true(cache.virt_to_phys(walk_virt + 0x123, walk_cr3) == walk_data + 0x1123);
+        this->expect_true(cache.virt_to_phys(walk_virt + 0x1123, walk_cr3) == walk_data + 0x2123);
+        this->expect_true(cache.translate(walk_virt, walk_cr3).size == x64::page_table::pd::size_bytes);
+        this->expect_true(cache.misses() == 2);
+        this->expect_true(g_walk_allocs == 3);
+    });
+}
+
+void
+memory_manager_ut::test_page_walk_cache_x64_1g()
+{
+    MockRepository mocks;
+    setup_walk(mocks);
+
+    set_entry(walk_pdpt, 1, walk_data, true);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        bfn::page_walk_cache_x64 cache;
+
+        this->expect_true(cache.virt_to_phys(walk_virt + 0x123, walk_cr3) == walk_data + 0x201123);
+        this->expect_true(cache.translate(walk_virt, walk_cr3).size == x64::page_table::pdpt::size_bytes);
+        this->expect_true(cache.misses() == 1);
+        this->expect_true(g_walk_allocs == 2);
+    });
+}
+
+void
+memory_manager_ut::test_page_walk_cache_x64_not_present()
+{
+    MockRepository mocks;
+    setup_walk(mocks);
+
+    g_walk_guest[walk_pt].at(1) = 0;
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        bfn::page_walk_cache_x64 cache;
+
+        this->expect_exception([&] { cache.translate(walk_virt, walk_cr3); }, ""_ut_ffe);
+        this->expect_exception([&] { cache.translate(walk_virt, walk_cr3); }, ""_ut_ffe);
+        this->expect_true(cache.hits() == 0);
+    });
+}
+
+void
+memory_manager_ut::test_page_walk_cache_x64_flush()
+{
+    MockRepository mocks;
+    setup_walk(mocks);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        bfn::page_walk_cache_x64 cache;
+
+        this->expect_true(cache.virt_to_phys(walk_virt, walk_cr3) == walk_data);
+
+        // Cached translations are stale until they are flushed, while the
+        // page tables themselves are read again by each walk.
+
+        auto &&mapped_pt = std::find_if(g_walk_mapped.begin(), g_walk_mapped.end(), [](const auto & p)
+        { return p.second == walk_pt; });
+
+        auto &&pt = reinterpret_cast<uintptr_t *>(mapped_pt->first);
+        pt[1] = (pt[1] & 0xFFF) | (walk_data + 0x7000);
+
+        this->expect_true(cache.virt_to_phys(walk_virt, walk_cr3) == walk_data);
+
+        cache.flush(walk_virt + 0x1000);
+        this->expect_true(cache.virt_to_phys(walk_virt, walk_cr3) == walk_data);
+
+        cache.flush(walk_virt + 0x10);
+        this->expect_true(cache.virt_to_phys(walk_virt, walk_cr3) == walk_data + 0x7000);
+
+        pt[1] = (pt[1] & 0xFFF) | walk_data;
+
+        cache.flush();
+        this->expect_true(cache.virt_to_phys(walk_virt, walk_cr3) == walk_data);
+
+        this->expect_true(cache.misses() == 3);
+        this->expect_true(g_walk_allocs == 4);
+        this->expect_true(g_walk_frees == 0);
+    });
+}
+
+void
+memory_manager_ut::test_page_walk_cache_x64_cr3_change()
+{
+    MockRepository mocks;
+    setup_walk(mocks);
+
+    auto &&cr3 = 0x5000UL;
+    auto &&pdpt = 0x6000UL;
+
+    set_entry(cr3, 1, pdpt);
+    set_entry(pdpt, 1, walk_pd);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        bfn::page_walk_cache_x64 cache;
+
+        this->expect_true(cache.virt_to_phys(walk_virt, walk_cr3) == walk_data);
+        this->expect_true(cache.virt_to_phys(walk_virt, cr3) == walk_data);
+        this->expect_true(cache.virt_to_phys(walk_virt, walk_cr3) == walk_data);
+
+        this->expect_true(cache.hits() == 0);
+        this->expect_true(cache.misses() == 3);
+
+        // pd and pt are shared by both address spaces
+        this->expect_true(g_walk_allocs == 6);
+    });
+}
+
+void
+memory_manager_ut::test_page_walk_cache_x64_table_eviction()
+{
+    MockRepository mocks;
+    setup_walk(mocks);
+
+    for (auto i = 2UL; i < 8UL; i++)
+    {
+        set_entry(walk_pd, i, walk_pt + (i << 12));
+        set_entry(walk_pt + (i << 12), 1, walk_data + (i << 12));
+    }
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        bfn::page_walk_cache_x64 cache;
+
+        this->expect_true(cache.virt_to_phys(walk_virt, walk_cr3) == walk_data);
+
+        for (auto i = 2UL; i < 8UL; i++)
+        {
+            auto &&virt = walk_virt - 0x200000 + (i << 21);
+            this->expect_true(cache.virt_to_phys(virt, walk_cr3) == walk_data + (i << 12));
+        }
+
+        this->expect_true(g_walk_allocs == 10);
+        this->expect_true(g_walk_frees == 2);
+
+        cache.flush();
+        this->expect_true(cache.virt_to_phys(walk_virt, walk_cr3) == walk_data);
+        this->expect_true(g_walk_allocs == 11);
+    });
+}
+
+void
+memory_manager_ut::test_page_walk_cache_x64_release()
+{
+    MockRepository mocks;
+    setup_walk(mocks);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        bfn::page_walk_cache_x64 cache;
+
+        this->expect_true(cache.virt_to_phys(walk_virt, walk_cr3) == walk_data);
+        this->expect_true(g_walk_allocs == 4);
+
+        cache.release();
+        this->expect_true(g_walk_frees == 4);
+
+        this->expect_true(cache.virt_to_phys(walk_virt, walk_cr3) == walk_data);
+        this->expect_true(cache.misses() == 2);
+        this->expect_true(g_walk_allocs == 8);
+    });
+}
+
+void
+memory_manager_ut::test_page_walk_cache_x64_map_with_cr3()
+{
+    MockRepository mocks;
+    setup_walk(mocks);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        bfn::page_walk_cache_x64 cache;
+
+        {
+            auto &&map = bfn::make_unique_map_x64<char>(walk_virt + 0x10, walk_cr3, x64::page_size, 0, cache);
+            auto &&vmap = reinterpret_cast<uintptr_t>(map.get()) - 0x10;
+
+            this->expect_true(map.size() == x64::page_size);
+            this->expect_true(g_walk_mapped[vmap] == walk_data);
+            this->expect_true(g_walk_mapped[vmap + x64::page_size] == walk_data + 0x5000);
+        }
+
+        this->expect_true(g_walk_allocs == 5);
+        this->expect_true(g_walk_frees == 1);
+
+        {
+            auto &&map = bfn::make_unique_map_x64<char>(walk_virt, walk_cr3, x64::page_size, 0, cache);
+            auto &&vmap = reinterpret_cast<uintptr_t>(map.get());
+
+            this->expect_true(g_walk_mapped[vmap] == walk_data);
+        }
+
+        this->expect_true(g_walk_allocs == 6);
+        this->expect_true(cache.hits() == 1);
+        this->expect_true(cache.misses() == 2);
+    });
+}
+
+void
+memory_manager_ut::test_page_walk_cache_x64_map_with_cr3_2m()
+{
+    MockRepository mocks;
+    auto &&mm = setup_walk(mocks);
+    auto &&pt = root_pt();
+
+    constexpr const auto large_virt = 0x0000008040400000UL;
+    constexpr const auto large_vmap = 0x0000001000000000UL;
+
+    set_entry(walk_pd, 2, 0x40000000, true);
+    set_entry(walk_pd, 3, 0x40200000, true);
+
+    mocks.OnCall(mm, memory_manager_x64::alloc_map_aligned).With(0x201000, 0x200000, 0).Return(reinterpret_cast<void *>(large_vmap));
+    mocks.OnCall(pt, root_page_table_x64::map_2m).Do(walk_map_2m);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        bfn::page_walk_cache_x64 cache;
+
+        {
+            auto &&map = bfn::make_unique_map_x64<char>(large_virt, walk_cr3, 0x201000, 0, cache);
+
+            this->expect_true(reinterpret_cast<uintptr_t>(map.get()) == large_vmap);
+            this->expect_true(g_walk_mapped[large_vmap] == 0x40000000);
+            this->expect_true(g_walk_mapped[large_vmap + 0x200000] == 0x40200000);
+            this->expect_true(g_walk_mapped.count(large_vmap + 0x1000) == 0);
+        }
+
+        g_walk_mapped.clear();
+
+        {
+            auto &&map = bfn::make_unique_map_x64<char>(large_virt + 0x1000, walk_cr3, 0x1000, 0, cache);
+            auto &&vmap = reinterpret_cast<uintptr_t>(map.get());
+
+            this->expect_true(g_walk_mapped[vmap] == 0x40001000);
+            this->expect_true(g_walk_mapped.size() == 1);
+        }
+    });
+}
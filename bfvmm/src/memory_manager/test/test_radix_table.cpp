@@ -0,0 +1,218 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#include <gsl/gsl>
+
+#include <vector>
+#include <utility>
+
+#include <test.h>
+#include <memory_manager/radix_table.h>
+
+void
+memory_manager_ut::test_radix_table_get_empty()
+{
+    radix_table<36> table;
+
+    this->expect_true(table.get(0) == 0);
+    this->expect_true(table.get(0x123456789) == 0);
+    this->expect_true(table.get(0xFFFFFFFFF) == 0);
+    this->expect_true(table.get(0x1000000000) == 0);
+}
+
+void
+memory_manager_ut::test_radix_table_set_get()
+{
+    radix_table<36> table;
+
+    table.set(0, 0x10);
+    table.set(0x123456789, 0x20);
+    table.set(0xFFFFFFFFF, 0x30);
+
+    this->expect_true(table.get(0) == 0x10);
+    this->expect_true(table.get(0x123456789) == 0x20);
+    this->expect_true(table.get(0xFFFFFFFFF) == 0x30);
+
+    this->expect_true(table.get(1) == 0);
+    this->expect_true(table.get(0x123456788) == 0);
+
+    table.set(0x123456789, 0x40);
+    this->expect_true(table.get(0x123456789) == 0x40);
+}
+
+void
+memory_manager_ut::test_radix_table_set_invalid()
+{
+    radix_table<36> table;
+
+    this->expect_exception([&] { table.set(0x1000000000, 0x10); }, ""_ut_ffe);
+    this->expect_exception([&] { table.set(0x10, 0); }, ""_ut_ffe);
+
+    this->expect_true(table.get(0x10) == 0);
+}
+
+void
+memory_manager_ut::test_radix_table_clear()
+{
+    radix_table<36> table;
+
+    table.set(0x123456789, 0x20);
+    table.set(0x12345678A, 0x30);
+
+    table.clear(0x123456789);
+    table.clear(0x123456789);
+    table.clear(0x987654321);
+    table.clear(0x1000000000);
+
+    this->expect_true(table.get(0x123456789) == 0);
+    this->expect_true(table.get(0x12345678A) == 0x30);
+}
+
+void
+memory_manager_ut::test_radix_table_for_each()
+{
+    radix_table<40> table;
+    std::vector<std::pair<uintptr_t, uintptr_t>> pairs;
+
+    table.set(0xFFFFFFFFFF, 0x30);
+    table.set(0x200, 0x20);
+    table.set(0x1, 0x10);
+    table.set(0x2, 0x40);
+    table.clear(0x2);
+
+    table.for_each([&](auto key, auto value)
+    { pairs.push_back({key, value}); });
+
+    this->expect_true(pairs.size() == 3);
+    this->expect_true(pairs.at(0) == std::make_pair(0x1UL, 0x10UL));
+    this->expect_true(pairs.at(1) == std::make_pair(0x200UL, 0x20UL));
+    this->expect_true(pairs.at(2) == std::make_pair(0xFFFFFFFFFFUL, 0x30UL));
+}
+
+void
+memory_manager_ut::test_radix_table_single_level()
+{
+    radix_table<9> table;
+
+    table.set(0x1FF, 0x10);
+
+    this->expect_true(table.get(0x1FF) == 0x10);
+    this->expect_true(table.get(0x200) == 0);
+    this->expect_exception([&] { table.set(0x200, 0x10); }, ""_ut_ffe);
+}
+
+void
+memory_manager_ut::test_radix_table_clear_reclaims_nodes()
+{
+    grace_period gp;
+    radix_table<36> table{&gp};
+
+    table.set(0x123456789, 0x20);
+    table.set(0x12345678A, 0x30);
+    this->expect_true(table.nodes() == 3);
+
+    table.clear(0x123456789);
+    this->expect_true(table.nodes() == 3);
+
+    table.clear(0x12345678A);
+    this->expect_true(table.nodes() == 0);
+    this->expect_true(table.retired() == 3);
+    this->expect_true(table.get(0x12345678A) == 0);
+
+    // every key below is in its own leaf, so each set / clear allocates and
+    // retires a leaf, which, with no CPU in the VMM, can be reused right away
+
+    for (auto key = 0UL; key < 0x10000; key += radix_table_node_size)
+    {
+        table.set(key, key + 1);
+        this->expect_true(table.get(key) == key + 1);
+
+        table.clear(key);
+        this->expect_true(table.get(key) == 0);
+    }
+
+    this->expect_true(table.nodes() == 0);
+    this->expect_true(table.retired() <= 3);
+
+    table.set(0xFFFFFFFFF, 0x10);
+    this->expect_true(table.nodes() == 3);
+    this->expect_true(table.get(0xFFFFFFFFF) == 0x10);
+    this->expect_true(table.get(0xFFFFFFFFE) == 0);
+}
+
+void
+memory_manager_ut::test_radix_table_clear_without_grace_period()
+{
+    radix_table<36> table;
+
+    table.set(0x123456789, 0x20);
+    table.clear(0x123456789);
+
+    this->expect_true(table.nodes() == 3);
+    this->expect_true(table.retired() == 0);
+    this->expect_true(table.get(0x123456789) == 0);
+
+    table.set(0x123456789, 0x30);
+    this->expect_true(table.nodes() == 3);
+    this->expect_true(table.get(0x123456789) == 0x30);
+}
+
+void
+memory_manager_ut::test_radix_table_clear_waits_for_readers()
+{
+    grace_period gp;
+    radix_table<36> table{&gp};
+
+    // A CPU that entered the VMM before a node was retired might still be
+    // using it, so the node is neither reused nor freed until it leaves.
+    // Once the retire queue is full, empty nodes are left linked instead.
+
+    gp.enter(1);
+
+    for (auto key = 0UL; key < 0x10000; key += radix_table_node_size)
+    {
+        table.set(key, key + 1);
+        table.clear(key);
+    }
+
+    this->expect_true(table.retired() == radix_table_max_retired);
+    this->expect_true(table.nodes() != 0);
+
+    for (auto key = 0UL; key < 0x10000; key += radix_table_node_size)
+        this->expect_true(table.get(key) == 0);
+
+    gp.leave(1);
+
+    table.set(0x10000, 0x10);
+    this->expect_true(table.retired() == radix_table_max_retired - 1);
+    table.clear(0x10000);
+
+    // A CPU that entered after the nodes were retired cannot reach them
+
+    gp.enter(2);
+
+    auto &&retired = table.retired();
+    table.set(0x20000, 0x10);
+    this->expect_true(table.retired() == retired - 1);
+
+    gp.leave(2);
+}
@@ -25,24 +25,26 @@
 #include <memory_manager/root_page_table_x64.h>
 
 extern bool g_terminate_called;
+void setup_page_table_mm(MockRepository &mocks, memory_manager_x64 *mm);
 
 static auto
 setup_mm(MockRepository &mocks)
 {
     auto descriptor_list =
     {
-        memory_descriptor{0x12345000, 0x54321000, MEMORY_TYPE_R | MEMORY_TYPE_W},
-        memory_descriptor{0x12346000, 0x54322000, MEMORY_TYPE_R | MEMORY_TYPE_E},
+        memory_descriptor{0x12345000, 0x54321000, MEMORY_TYPE_R | MEMORY_TYPE_W, 0x1000},
+        memory_descriptor{0x12346000, 0x54322000, MEMORY_TYPE_R | MEMORY_TYPE_E, 0x1000},
     };
 
     auto mm = mocks.Mock<memory_manager_x64>();
     mocks.OnCallFunc(memory_manager_x64::instance).Return(mm);
 
     mocks.OnCall(mm, memory_manager_x64::descriptors).Return(descriptor_list);
-    mocks.OnCall(mm, memory_manager_x64::virtptr_to_physint).Return(0x0000000ABCDEF0000);
-    mocks.OnCall(mm, memory_manager_x64::virtint_to_physint).Return(0x0000000ABCDEF0000);
+    setup_page_table_mm(mocks, mm);
     mocks.OnCall(mm, memory_manager_x64::add_md);
+    mocks.OnCall(mm, memory_manager_x64::add_md_range);
     mocks.OnCall(mm, memory_manager_x64::remove_md);
+    mocks.OnCall(mm, memory_manager_x64::remove_md_range);
 
     return mm;
 }
@@ -53,7 +55,7 @@ memory_manager_ut::test_root_page_table_x64_init_failure()
     MockRepository mocks;
     auto &&mm = setup_mm(mocks);
 
-    mocks.OnCall(mm, memory_manager_x64::add_md).With(0x54321000, _, _).Throw(std::runtime_error("error"));
+    mocks.OnCall(mm, memory_manager_x64::add_md_range).With(0x54321000, _, _, _).Throw(std::runtime_error("error"));
 
     RUN_UNITTEST_WITH_MOCKS(mocks, [&]
     {
@@ -684,6 +686,200 @@ memory_manager_ut::test_root_page_table_x64_map_unmap_twice_success()
     });
 }
 
+void
+memory_manager_ut::test_root_page_table_x64_map_range_invalid()
+{
+    MockRepository mocks;
+    setup_mm(mocks);
+    auto &&root_cr3 = root_page_table_x64{};
+
+    mocks.OnCallFunc(__cpuid_edx).Return(0);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_exception([&] { root_cr3.map_range(0x1010, 0x1000, 0x1000, x64::memory_attr::rw_wb); }, ""_ut_ffe);
+        this->expect_exception([&] { root_cr3.map_range(0x1000, 0x1010, 0x1000, x64::memory_attr::rw_wb); }, ""_ut_ffe);
+        this->expect_exception([&] { root_cr3.map_range(0x1000, 0x1000, 0x0, x64::memory_attr::rw_wb); }, ""_ut_ffe);
+        this->expect_exception([&] { root_cr3.map_range(0x1000, 0x1000, 0x1010, x64::memory_attr::rw_wb); }, ""_ut_ffe);
+
+        this->expect_exception([&] { root_cr3.map_range(0x1000, 0x1000, 0x2000, 0x0); }, ""_ut_lee);
+        this->expect_exception([&] { root_cr3.virt_to_pte(0x1000); }, ""_ut_ree);
+        this->expect_exception([&] { root_cr3.virt_to_pte(0x2000); }, ""_ut_ree);
+    });
+}
+
+void
+memory_manager_ut::test_root_page_table_x64_map_range_mixed()
+{
+    MockRepository mocks;
+    setup_mm(mocks);
+    auto &&root_cr3 = root_page_table_x64{};
+
+    mocks.OnCallFunc(__cpuid_edx).Return(0);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&] { root_cr3.map_range(0x1FF000, 0x1FF000, 0x203000, x64::memory_attr::rw_wb); });
+
+        auto &&entry1 = root_cr3.virt_to_pte(0x1FF000);
+        this->expect_false(entry1.ps());
+        this->expect_true(entry1.rw());
+        this->expect_true(entry1.nx());
+        this->expect_true(entry1.phys_addr() == 0x1FF000);
+        this->expect_true(entry1.pat_index_4k() == x64::pat::mem_attr_to_pat_index(x64::memory_attr::rw_wb));
+
+        auto &&entry2 = root_cr3.virt_to_pte(0x3FF000);
+        this->expect_true(entry2.ps());
+        this->expect_true(entry2.rw());
+        this->expect_true(entry2.nx());
+        this->expect_true(entry2.phys_addr() == 0x200000);
+        this->expect_true(entry2.pat_index_large() == x64::pat::mem_attr_to_pat_index(x64::memory_attr::rw_wb));
+
+        auto &&entry3 = root_cr3.virt_to_pte(0x401000);
+        this->expect_false(entry3.ps());
+        this->expect_true(entry3.phys_addr() == 0x401000);
+
+        this->expect_false(root_cr3.virt_to_pte(0x402000).present());
+
+        this->expect_no_exception([&] { root_cr3.unmap_range(0x1FF000, 0x203000); });
+        this->expect_exception([&] { root_cr3.virt_to_pte(0x1FF000); }, ""_ut_ree);
+        this->expect_exception([&] { root_cr3.virt_to_pte(0x200000); }, ""_ut_ree);
+        this->expect_exception([&] { root_cr3.virt_to_pte(0x401000); }, ""_ut_ree);
+
+        this->expect_no_exception([&] { root_cr3.map_range(0x200000, 0x201000, 0x200000, x64::memory_attr::re_wb); });
+
+        auto &&entry4 = root_cr3.virt_to_pte(0x200000);
+        this->expect_false(entry4.ps());
+        this->expect_false(entry4.rw());
+        this->expect_true(entry4.phys_addr() == 0x201000);
+
+        this->expect_no_exception([&] { root_cr3.unmap_range(0x200000, 0x200000); });
+        this->expect_exception([&] { root_cr3.virt_to_pte(0x200000); }, ""_ut_ree);
+    });
+}
+
+void
+memory_manager_ut::test_root_page_table_x64_map_range_1g()
+{
+    MockRepository mocks;
+    setup_mm(mocks);
+    auto &&root_cr3 = root_page_table_x64{};
+
+    mocks.OnCallFunc(__cpuid_edx).Return(0x1U << 26);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&] { root_cr3.map_range(0x40000000, 0x80000000, 0x40200000, x64::memory_attr::pt_wb); });
+
+        auto &&entry1 = root_cr3.virt_to_pte(0x40001000);
+        this->expect_true(entry1.ps());
+        this->expect_true(entry1.rw());
+        this->expect_false(entry1.nx());
+        this->expect_true(entry1.phys_addr() == 0x80000000);
+
+        auto &&entry2 = root_cr3.virt_to_pte(0x80000000);
+        this->expect_true(entry2.ps());
+        this->expect_true(entry2.phys_addr() == 0xC0000000);
+
+        this->expect_no_exception([&] { root_cr3.unmap_range(0x40000000, 0x40200000); });
+        this->expect_exception([&] { root_cr3.virt_to_pte(0x40000000); }, ""_ut_ree);
+        this->expect_exception([&] { root_cr3.virt_to_pte(0x80000000); }, ""_ut_ree);
+    });
+}
+
+void
+memory_manager_ut::test_root_page_table_x64_map_range_tracked()
+{
+    MockRepository mocks;
+    auto &&mm = setup_mm(mocks);
+    auto &&root_cr3 = root_page_table_x64{true};
+
+    mocks.OnCallFunc(__cpuid_edx).Return(0);
+    mocks.ExpectCall(mm, memory_manager_x64::add_md_range).With(0x200000, 0x400000, 0x201000, x64::memory_attr::rw_wb);
+    mocks.ExpectCall(mm, memory_manager_x64::remove_md_range).With(0x200000, 0x201000);
+    mocks.NeverCall(mm, memory_manager_x64::remove_md);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&] { root_cr3.map_range(0x200000, 0x400000, 0x201000, x64::memory_attr::rw_wb); });
+        this->expect_no_exception([&] { root_cr3.unmap_range(0x200000, 0x201000); });
+    });
+}
+
+void
+memory_manager_ut::test_root_page_table_x64_unmap_range_inside_large_page()
+{
+    MockRepository mocks;
+    setup_mm(mocks);
+    auto &&root_cr3 = root_page_table_x64{};
+
+    mocks.OnCallFunc(__cpuid_edx).Return(0);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&] { root_cr3.map_range(0x200000, 0x200000, 0x202000, x64::memory_attr::rw_wb); });
+        this->expect_true(root_cr3.virt_to_pte(0x200000).ps());
+
+        this->expect_no_exception([&] { root_cr3.unmap_range(0x201000, 0x201000); });
+        this->expect_exception([&] { root_cr3.virt_to_pte(0x200000); }, ""_ut_ree);
+        this->expect_exception([&] { root_cr3.virt_to_pte(0x400000); }, ""_ut_ree);
+        this->expect_exception([&] { root_cr3.virt_to_pte(0x401000); }, ""_ut_ree);
+    });
+}
+
+void
+memory_manager_ut::test_root_page_table_x64_map_range_global()
+{
+    MockRepository mocks;
+    setup_mm(mocks);
+    auto &&root_cr3 = root_page_table_x64{};
+
+    mocks.OnCallFunc(__cpuid_edx).Return(0);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&] { root_cr3.map_range(0x1FF000, 0x1FF000, 0x202000, x64::memory_attr::re_wb, true); });
+        this->expect_no_exception([&] { root_cr3.map_range(0x600000, 0x600000, 0x1000, x64::memory_attr::rw_wb); });
+
+        this->expect_true(root_cr3.virt_to_pte(0x1FF000).global());
+        this->expect_true(root_cr3.virt_to_pte(0x200000).global());
+        this->expect_true(root_cr3.virt_to_pte(0x200000).ps());
+        this->expect_true(root_cr3.virt_to_pte(0x400000).global());
+        this->expect_false(root_cr3.virt_to_pte(0x600000).global());
+
+        auto value = root_page_table_x64::pte_4k(0x1000, x64::memory_attr::rw_wb);
+        this->expect_false(page_table_entry_x64(&value).global());
+
+        this->expect_no_exception([&] { root_cr3.unmap_range(0x1FF000, 0x202000); });
+        this->expect_no_exception([&] { root_cr3.unmap_range(0x600000, 0x1000); });
+    });
+}
+
+void
+memory_manager_ut::test_root_page_table_x64_reserve_4k()
+{
+    MockRepository mocks;
+    setup_mm(mocks);
+    auto &&root_cr3 = root_page_table_x64{};
+
+    this->expect_exception([&] { root_cr3.reserve_4k(0x300000000001); }, ""_ut_ffe);
+
+    uintptr_t *entry = nullptr;
+    this->expect_no_exception([&] { entry = root_cr3.reserve_4k(0x300000000000); });
+
+    this->expect_true(entry != nullptr);
+    this->expect_true(*entry == 0);
+    this->expect_false(root_cr3.virt_to_pte(0x300000000000).present());
+
+    *entry = root_page_table_x64::pte_4k(0x54321000, x64::memory_attr::rw_wb);
+
+    this->expect_true(root_cr3.virt_to_pte(0x300000000000).present());
+    this->expect_true(root_cr3.virt_to_pte(0x300000000000).rw());
+    this->expect_true(root_cr3.virt_to_pte(0x300000000000).phys_addr() == 0x54321000);
+
+    this->expect_exception([&] { root_page_table_x64::pte_4k(0x54321000, x64::memory_attr::invalid); }, ""_ut_lee);
+}
+
 void
 memory_manager_ut::test_root_page_table_x64_setup_identity_map_1g_invalid()
 {
@@ -756,6 +952,108 @@ memory_manager_ut::test_root_page_table_x64_setup_identity_map_4k_valid()
     this->expect_no_exception([&] { root_cr3.unmap_identity_map_4k(0x0, 0x1000); });
 }
 
+void
+memory_manager_ut::test_root_page_table_x64_setup_direct_map_invalid()
+{
+    MockRepository mocks;
+    setup_mm(mocks);
+    auto &&root_cr3 = root_page_table_x64{};
+
+    this->expect_exception([&] { root_cr3.setup_direct_map(0); }, ""_ut_ffe);
+    this->expect_exception([&] { root_cr3.setup_direct_map(0x1000); }, ""_ut_ffe);
+    this->expect_exception([&] { root_cr3.setup_direct_map(0x800000000000UL); }, ""_ut_ffe);
+}
+
+void
+memory_manager_ut::test_root_page_table_x64_setup_direct_map_1g()
+{
+    MockRepository mocks;
+    setup_mm(mocks);
+    auto &&root_cr3 = root_page_table_x64{};
+
+    mocks.OnCallFunc(__cpuid_edx).Return(0x1U << 26);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&size = direct_map_size();
+
+        this->expect_no_exception([&] { root_cr3.setup_direct_map(0x80000000UL); });
+
+        auto &&entry1 = root_cr3.virt_to_pte(DIRECT_MAP_START);
+        this->expect_true(entry1.ps());
+        this->expect_true(entry1.phys_addr() == 0x0UL);
+
+        auto &&entry2 = root_cr3.virt_to_pte(DIRECT_MAP_START + 0x40000000UL);
+        this->expect_true(entry2.ps());
+        this->expect_true(entry2.rw());
+        this->expect_true(entry2.nx());
+        this->expect_true(entry2.phys_addr() == 0x40000000UL);
+        this->expect_true(entry2.pat_index_large() == x64::pat::mem_attr_to_pat_index(x64::memory_attr::rw_wb));
+        this->expect_true(entry2.global());
+
+        auto &&entry3 = root_cr3.virt_to_pte(DIRECT_MAP_START + 0x40200000UL);
+        this->expect_true(entry3.phys_addr() == 0x40000000UL);
+
+        this->expect_true(direct_map_size() == size);
+    });
+}
+
+void
+memory_manager_ut::test_root_page_table_x64_setup_direct_map_2m()
+{
+    MockRepository mocks;
+    setup_mm(mocks);
+    auto &&root_cr3 = root_page_table_x64{};
+
+    mocks.OnCallFunc(__cpuid_edx).Return(0);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&size = direct_map_size();
+
+        this->expect_no_exception([&] { root_cr3.setup_direct_map(0x400000UL); });
+
+        auto &&entry1 = root_cr3.virt_to_pte(DIRECT_MAP_START);
+        this->expect_true(entry1.ps());
+        this->expect_true(entry1.phys_addr() == 0x0UL);
+
+        auto &&entry2 = root_cr3.virt_to_pte(DIRECT_MAP_START + 0x200000UL);
+        this->expect_true(entry2.ps());
+        this->expect_true(entry2.phys_addr() == 0x200000UL);
+
+        this->expect_true(direct_map_size() == size);
+    });
+}
+
+void
+memory_manager_ut::test_root_page_table_x64_setup_direct_map_2m_unaligned()
+{
+    MockRepository mocks;
+    setup_mm(mocks);
+    auto &&root_cr3 = root_page_table_x64{};
+
+    mocks.OnCallFunc(__cpuid_edx).Return(0x1U << 26);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&size = direct_map_size();
+
+        this->expect_no_exception([&] { root_cr3.setup_direct_map(0x40200000UL); });
+
+        auto &&entry1 = root_cr3.virt_to_pte(DIRECT_MAP_START + 0x3FE00000UL);
+        this->expect_true(entry1.ps());
+        this->expect_true(entry1.phys_addr() == 0x0UL);
+
+        auto &&entry2 = root_cr3.virt_to_pte(DIRECT_MAP_START + 0x40000000UL);
+        this->expect_true(entry2.ps());
+        this->expect_true(entry2.phys_addr() == 0x40000000UL);
+
+        this->expect_false(root_cr3.virt_to_pte(DIRECT_MAP_START + 0x40200000UL).present());
+
+        this->expect_true(direct_map_size() == size);
+    });
+}
+
 void
 memory_manager_ut::test_root_page_table_x64_pt_to_mdl()
 {
@@ -0,0 +1,202 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#define TESTING_MEM_POOL
+
+#include <gsl/gsl>
+
+#include <vector>
+
+#include <test.h>
+#include <memory_manager/slab_cache.h>
+
+using page_pool_type = mem_pool<0x4000, 12>;
+using slab_pool_type = slab_pool<0x4000, 12>;
+using slab_cache_type = slab_cache<slab_pool_type, 2, 4>;
+
+alignas(0x1000) static uint8_t g_cache_pages[0x4000] = {};
+static auto g_cache_addr = reinterpret_cast<uintptr_t>(g_cache_pages);
+
+void
+memory_manager_ut::test_slab_pool_alloc_batch()
+{
+    page_pool_type pages{g_cache_addr};
+    slab_pool_type pool{pages, g_cache_addr};
+
+    slab_pool_type::integer_pointer objs[4] = {};
+
+    this->expect_exception([&] { pool.alloc_batch(0, objs, 4); }, ""_ut_ffe);
+    this->expect_exception([&] { pool.alloc_batch(16, nullptr, 4); }, ""_ut_ffe);
+
+    this->expect_true(pool.alloc_batch(16, objs, 4) == 4);
+    this->expect_true(objs[1] == objs[0] + 16);
+    this->expect_true(objs[3] == objs[0] + 48);
+
+    this->expect_true(pool.alloc_batch(2048, objs, 4) == 2);
+    this->expect_true(pool.alloc_batch(2048, objs, 4) == 2);
+}
+
+void
+memory_manager_ut::test_slab_pool_free_batch()
+{
+    page_pool_type pages{g_cache_addr};
+    slab_pool_type pool{pages, g_cache_addr};
+
+    slab_pool_type::integer_pointer objs[2] = {};
+
+    this->expect_true(pool.alloc_batch(64, objs, 2) == 2);
+
+    pool.free_batch(nullptr, 2);
+    pool.free_batch(objs, 2);
+
+    this->expect_true(pool.alloc(64) == objs[1]);
+    this->expect_true(pool.alloc(64) == objs[0]);
+}
+
+void
+memory_manager_ut::test_slab_cache_alloc()
+{
+    page_pool_type pages{g_cache_addr};
+    slab_pool_type pool{pages, g_cache_addr};
+    slab_cache_type cache{pool};
+
+    this->expect_exception([&] { cache.alloc(0); }, ""_ut_ffe);
+    this->expect_exception([&] { cache.alloc(slab_cache_type::max_size() + 1); }, ""_ut_ffe);
+
+    auto &&addr1 = cache.alloc(32);
+    this->expect_true(cache.cached(32) == 1);
+    this->expect_true(cache.cached(16) == 0);
+
+    auto &&addr2 = cache.alloc(32);
+    this->expect_true(cache.cached(32) == 0);
+    this->expect_true(addr1 == addr2 + 32);
+
+    this->expect_true(pool.size(addr1) == 32);
+    this->expect_true(pool.alloc(32) == addr1 + 32);
+}
+
+void
+memory_manager_ut::test_slab_cache_free()
+{
+    page_pool_type pages{g_cache_addr};
+    slab_pool_type pool{pages, g_cache_addr};
+    slab_cache_type cache{pool};
+
+    std::vector<slab_cache_type::integer_pointer> addrs;
+
+    for (auto i = 0; i < 5; i++)
+        addrs.push_back(cache.alloc(128));
+
+    cache.free(0);
+    cache.free(g_cache_addr + 0x3000);
+    this->expect_true(cache.cached(128) == 1);
+
+    for (auto i = 0; i < 3; i++)
+        cache.free(addrs.at(static_cast<size_t>(i)));
+
+    this->expect_true(cache.cached(128) == 4);
+
+    cache.free(addrs.at(3));
+    this->expect_true(cache.cached(128) == 3);
+    this->expect_true(pool.alloc(128) == addrs.at(2));
+
+    this->expect_true(cache.alloc(128) == addrs.at(3));
+}
+
+void
+memory_manager_ut::test_slab_cache_flush()
+{
+    page_pool_type pages{g_cache_addr};
+    slab_pool_type pool{pages, g_cache_addr};
+    slab_cache_type cache{pool};
+
+    auto &&addr = cache.alloc(256);
+    cache.free(addr);
+
+    this->expect_true(cache.cached(256) == 2);
+
+    cache.flush();
+    this->expect_true(cache.cached(256) == 0);
+
+    this->expect_true(pool.alloc(256) == addr);
+}
+
+void
+memory_manager_ut::test_slab_cache_per_cpu()
+{
+    page_pool_type pages{g_cache_addr};
+    slab_pool_type pool{pages, g_cache_addr};
+    slab_cache_type cache{pool};
+
+    MockRepository mocks;
+    uint64_t cpuid = 0;
+    mocks.OnCallFunc(thread_context_cpuid).Do([&] { return cpuid; });
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&addr1 = cache.alloc(16);
+        this->expect_true(cache.cached(16) == 1);
+
+        cpuid = 1;
+        this->expect_true(cache.cached(16) == 0);
+
+        auto &&addr2 = cache.alloc(16);
+        this->expect_true(addr2 != addr1);
+        this->expect_true(cache.cached(16) == 1);
+
+        cache.free(addr1);
+        this->expect_true(cache.cached(16) == 2);
+
+        cpuid = 0;
+        this->expect_true(cache.cached(16) == 1);
+
+        cpuid = 2;
+        this->expect_true(cache.cached(16) == 0);
+        this->expect_true(cache.alloc(16) == addr2 + 16);
+        cache.flush();
+    });
+}
+
+void
+memory_manager_ut::test_slab_cache_driver_context()
+{
+    page_pool_type pages{g_cache_addr};
+    slab_pool_type pool{pages, g_cache_addr};
+    slab_cache_type cache{pool};
+
+    MockRepository mocks;
+    mocks.OnCallFunc(thread_context_cpuid).Return(0);
+    mocks.OnCallFunc(thread_context_vmx_root).Return(0);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        auto &&addr1 = cache.alloc(16);
+        auto &&addr2 = cache.alloc(16);
+
+        this->expect_true(addr2 == addr1 + 16);
+        this->expect_true(cache.cached(16) == 0);
+
+        this->expect_true(cache.free(addr1) == 16);
+        this->expect_true(cache.cached(16) == 0);
+        this->expect_true(cache.alloc(16) == addr1);
+    });
+}
@@ -0,0 +1,182 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#define TESTING_MEM_POOL
+
+#include <gsl/gsl>
+
+#include <vector>
+
+#include <test.h>
+#include <memory_manager/slab_pool.h>
+
+using page_pool_type = mem_pool<0x4000, 12>;
+using slab_pool_type = slab_pool<0x4000, 12>;
+
+alignas(0x1000) static uint8_t g_slab_pages[0x4000] = {};
+static auto g_slab_addr = reinterpret_cast<uintptr_t>(g_slab_pages);
+
+void
+memory_manager_ut::test_slab_pool_invalid_pool()
+{
+    page_pool_type pages{g_slab_addr};
+
+    this->expect_exception([&] { slab_pool_type pool(pages, 0); }, ""_ut_lee);
+    this->expect_exception([&] { slab_pool_type pool(pages, g_slab_addr + 8); }, ""_ut_lee);
+}
+
+void
+memory_manager_ut::test_slab_pool_malloc_zero()
+{
+    page_pool_type pages{g_slab_addr};
+    slab_pool_type pool{pages, g_slab_addr};
+
+    this->expect_exception([&] { pool.alloc(0); }, ""_ut_ffe);
+}
+
+void
+memory_manager_ut::test_slab_pool_malloc_too_large()
+{
+    page_pool_type pages{g_slab_addr};
+    slab_pool_type pool{pages, g_slab_addr};
+
+    this->expect_exception([&] { pool.alloc(slab_pool_type::max_size() + 1); }, ""_ut_ffe);
+}
+
+void
+memory_manager_ut::test_slab_pool_size_classes()
+{
+    page_pool_type pages{g_slab_addr};
+    slab_pool_type pool{pages, g_slab_addr};
+
+    auto &&addr1 = pool.alloc(1);
+    auto &&addr2 = pool.alloc(16);
+    auto &&addr3 = pool.alloc(17);
+    auto &&addr4 = pool.alloc(1000);
+    auto &&addr5 = pool.alloc(2048);
+
+    this->expect_true(pool.size(addr1) == 16);
+    this->expect_true(pool.size(addr2) == 16);
+    this->expect_true(pool.size(addr3) == 32);
+    this->expect_true(pool.size(addr4) == 1024);
+    this->expect_true(pool.size(addr5) == 2048);
+
+    this->expect_true(addr2 == addr1 + 16);
+    this->expect_true((addr3 & (32 - 1)) == 0);
+    this->expect_true((addr4 & (1024 - 1)) == 0);
+    this->expect_true((addr5 & (2048 - 1)) == 0);
+}
+
+void
+memory_manager_ut::test_slab_pool_free_reuse()
+{
+    page_pool_type pages{g_slab_addr};
+    slab_pool_type pool{pages, g_slab_addr};
+
+    auto &&addr1 = pool.alloc(64);
+    auto &&addr2 = pool.alloc(64);
+
+    pool.free(addr1);
+    this->expect_true(pool.alloc(64) == addr1);
+
+    pool.free(addr2);
+    pool.free(addr1);
+    this->expect_true(pool.alloc(64) == addr1);
+    this->expect_true(pool.alloc(64) == addr2);
+}
+
+void
+memory_manager_ut::test_slab_pool_free_invalid()
+{
+    page_pool_type pages{g_slab_addr};
+    slab_pool_type pool{pages, g_slab_addr};
+
+    pool.free(0);
+    pool.free(g_slab_addr);
+    pool.free(0xFFFFFFFFFFFFFFFF);
+}
+
+void
+memory_manager_ut::test_slab_pool_out_of_memory()
+{
+    page_pool_type pages{g_slab_addr};
+    slab_pool_type pool{pages, g_slab_addr};
+
+    std::vector<slab_pool_type::integer_pointer> addrs;
+
+    for (auto i = 0; i < 8; i++)
+        addrs.push_back(pool.alloc(2048));
+
+    this->expect_exception([&] { pool.alloc(2048); }, ""_ut_bae);
+    this->expect_exception([&] { pool.alloc(16); }, ""_ut_bae);
+
+    pool.free(addrs.back());
+    this->expect_true(pool.alloc(2048) == addrs.back());
+}
+
+void
+memory_manager_ut::test_slab_pool_contains()
+{
+    page_pool_type pages{g_slab_addr};
+    slab_pool_type pool{pages, g_slab_addr};
+
+    auto &&page = pages.alloc(0x1000);
+    auto &&addr = pool.alloc(128);
+
+    this->expect_false(pool.contains(0));
+    this->expect_false(pool.contains(page));
+    this->expect_true(pool.contains(addr));
+    this->expect_false(pool.contains(g_slab_addr + 0x4000));
+
+    this->expect_true(pool.size(page) == 0);
+}
+
+void
+memory_manager_ut::test_slab_pool_tag()
+{
+    page_pool_type pages{g_slab_addr};
+    slab_pool_type pool{pages, g_slab_addr};
+
+    auto &&addr1 = pool.alloc(128);
+    auto &&addr2 = pool.alloc(128, 5);
+    auto &&addr3 = pool.alloc(128, 5);
+
+    // tagged objects come from a slab of their own
+
+    this->expect_true((addr1 >> 12) != (addr2 >> 12));
+    this->expect_true((addr2 >> 12) == (addr3 >> 12));
+
+    this->expect_true(pool.tag(addr1) == 0);
+    this->expect_true(pool.tag(addr2) == 5);
+    this->expect_true(pool.tag(addr3) == 5);
+    this->expect_true(pool.tag(0) == 0);
+
+    this->expect_exception([&] { pool.alloc(128, mem_tag_num_tags); }, ""_ut_ffe);
+
+    pool.free(addr2);
+    this->expect_true(pool.alloc(128) != addr2);
+    this->expect_true(pool.alloc(128, 5) == addr2);
+
+    slab_pool_type::integer_pointer objs[1] = {addr3};
+    pool.free_batch(objs, 1);
+
+    this->expect_true(pool.alloc(128, 5) == addr3);
+}
@@ -0,0 +1,214 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#include <gsl/gsl>
+
+#include <array>
+
+#include <test.h>
+#include <thread_context.h>
+#include <memory_manager/temp_map_x64.h>
+#include <memory_manager/root_page_table_x64.h>
+
+static std::array<uintptr_t, MAX_NUM_CPUS * TEMP_MAP_SLOTS> g_temp_ptes;
+
+static uintptr_t *
+temp_reserve_4k(uintptr_t virt)
+{ return &gsl::at(g_temp_ptes, (virt - TEMP_MAP_START) >> x64::page_shift); }
+
+static uintptr_t
+temp_pte(uint64_t cpuid, uint64_t slot)
+{ return gsl::at(g_temp_ptes, (cpuid * TEMP_MAP_SLOTS) + slot); }
+
+static auto
+setup_pt(MockRepository &mocks)
+{
+    auto pt = mocks.Mock<root_page_table_x64>();
+    mocks.OnCallFunc(root_pt).Return(pt);
+
+    g_temp_ptes.fill(0);
+
+    return pt;
+}
+
+void
+memory_manager_ut::test_temp_map_x64_contains()
+{
+    this->expect_true(temp_map_x64::contains(TEMP_MAP_START));
+    this->expect_true(temp_map_x64::contains(temp_map_x64::slot_addr(MAX_NUM_CPUS - 1, TEMP_MAP_SLOTS - 1)));
+    this->expect_true(temp_map_x64::contains(temp_map_x64::slot_addr(1, 1) + 0x10));
+    this->expect_false(temp_map_x64::contains(0));
+    this->expect_false(temp_map_x64::contains(TEMP_MAP_START - 1));
+    this->expect_false(temp_map_x64::contains(temp_map_x64::slot_addr(MAX_NUM_CPUS, 0)));
+}
+
+void
+memory_manager_ut::test_temp_map_x64_map_success()
+{
+    MockRepository mocks;
+    auto &&pt = setup_pt(mocks);
+    auto &&cpuid = 1UL;
+
+    mocks.OnCall(pt, root_page_table_x64::reserve_4k).Do(temp_reserve_4k);
+    mocks.OnCallFunc(thread_context_cpuid).Do([&] { return cpuid; });
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        temp_map_x64 tm;
+
+        auto &&virt1 = tm.map(0x54321000, x64::memory_attr::rw_wb);
+        auto &&virt2 = tm.map(0x12345000, x64::memory_attr::re_wb);
+
+        this->expect_true(virt1 == temp_map_x64::slot_addr(1, 0));
+        this->expect_true(virt2 == temp_map_x64::slot_addr(1, 1));
+
+        this->expect_true(temp_pte(1, 0) == root_page_table_x64::pte_4k(0x54321000, x64::memory_attr::rw_wb));
+        this->expect_true(temp_pte(1, 1) == root_page_table_x64::pte_4k(0x12345000, x64::memory_attr::re_wb));
+
+        tm.unmap(virt1);
+        this->expect_true(temp_pte(1, 0) == 0);
+        this->expect_true(temp_pte(1, 1) != 0);
+
+        this->expect_true(tm.map(0x11111000, x64::memory_attr::rw_wb) == virt1);
+
+        tm.unmap(0x1000);
+        tm.unmap(temp_map_x64::slot_addr(1, 2));
+        this->expect_true(temp_pte(1, 0) != 0);
+    });
+}
+
+void
+memory_manager_ut::test_temp_map_x64_map_full()
+{
+    MockRepository mocks;
+    auto &&pt = setup_pt(mocks);
+    auto &&cpuid = 2UL;
+
+    mocks.OnCall(pt, root_page_table_x64::reserve_4k).Do(temp_reserve_4k);
+    mocks.OnCallFunc(thread_context_cpuid).Do([&] { return cpuid; });
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        temp_map_x64 tm;
+
+        for (auto slot = 0UL; slot < TEMP_MAP_SLOTS; slot++)
+            this->expect_true(tm.map(0x1000, x64::memory_attr::rw_wb) == temp_map_x64::slot_addr(2, slot));
+
+        this->expect_true(tm.map(0x1000, x64::memory_attr::rw_wb) == 0);
+
+        tm.unmap(temp_map_x64::slot_addr(2, 5));
+        this->expect_true(tm.map(0x1000, x64::memory_attr::rw_wb) == temp_map_x64::slot_addr(2, 5));
+    });
+}
+
+void
+memory_manager_ut::test_temp_map_x64_map_invalid_cpuid()
+{
+    MockRepository mocks;
+    auto &&pt = setup_pt(mocks);
+
+    mocks.NeverCall(pt, root_page_table_x64::reserve_4k);
+    mocks.OnCallFunc(thread_context_cpuid).Return(MAX_NUM_CPUS);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        temp_map_x64 tm;
+        this->expect_true(tm.map(0x1000, x64::memory_attr::rw_wb) == 0);
+    });
+}
+
+void
+memory_manager_ut::test_temp_map_x64_map_driver_context()
+{
+    MockRepository mocks;
+    auto &&pt = setup_pt(mocks);
+
+    mocks.NeverCall(pt, root_page_table_x64::reserve_4k);
+    mocks.OnCallFunc(thread_context_cpuid).Return(0);
+    mocks.OnCallFunc(thread_context_vmx_root).Return(0);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        temp_map_x64 tm;
+        this->expect_true(tm.map(0x1000, x64::memory_attr::rw_wb) == 0);
+    });
+}
+
+void
+memory_manager_ut::test_temp_map_x64_map_invalid_attr()
+{
+    MockRepository mocks;
+    auto &&pt = setup_pt(mocks);
+
+    mocks.OnCall(pt, root_page_table_x64::reserve_4k).Do(temp_reserve_4k);
+    mocks.OnCallFunc(thread_context_cpuid).Return(0);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        temp_map_x64 tm;
+
+        this->expect_true(tm.map(0x1000, x64::memory_attr::invalid) == 0);
+        this->expect_true(tm.map(0x1000, x64::memory_attr::rw_wb) == temp_map_x64::slot_addr(0, 0));
+    });
+}
+
+void
+memory_manager_ut::test_temp_map_x64_map_reserve_failure()
+{
+    MockRepository mocks;
+    auto &&pt = setup_pt(mocks);
+
+    mocks.OnCall(pt, root_page_table_x64::reserve_4k).Throw(std::runtime_error("error"));
+    mocks.OnCallFunc(thread_context_cpuid).Return(0);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        temp_map_x64 tm;
+        this->expect_true(tm.map(0x1000, x64::memory_attr::rw_wb) == 0);
+    });
+}
+
+void
+memory_manager_ut::test_temp_map_x64_unmap_other_cpu()
+{
+    MockRepository mocks;
+    auto &&pt = setup_pt(mocks);
+    auto &&cpuid = 3UL;
+
+    mocks.OnCall(pt, root_page_table_x64::reserve_4k).Do(temp_reserve_4k);
+    mocks.OnCallFunc(thread_context_cpuid).Do([&] { return cpuid; });
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        temp_map_x64 tm;
+
+        auto &&virt = tm.map(0x1000, x64::memory_attr::rw_wb);
+        this->expect_true(virt == temp_map_x64::slot_addr(3, 0));
+
+        cpuid = 4;
+        tm.unmap(virt);
+        this->expect_true(temp_pte(3, 0) == 0);
+
+        cpuid = 3;
+        this->expect_true(tm.map(0x2000, x64::memory_attr::rw_wb) == virt);
+    });
+}
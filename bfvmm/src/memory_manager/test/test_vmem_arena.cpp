@@ -0,0 +1,161 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+
+#define TESTING_MEM_POOL
+
+#include <gsl/gsl>
+
+#include <test.h>
+#include <memory_manager/vmem_arena.h>
+
+using vmem_arena_type = vmem_arena<0x100000, 12, 8>;
+constexpr const auto g_arena_addr = 0x100000UL;
+
+void
+memory_manager_ut::test_vmem_arena_invalid_arena()
+{
+    this->expect_exception([&] { vmem_arena_type arena(0); }, ""_ut_lee);
+    this->expect_exception([&] { vmem_arena_type arena(g_arena_addr + 8); }, ""_ut_lee);
+    this->expect_exception([&] { vmem_arena_type arena(0xFFFFFFFFFFFFF000); }, ""_ut_lee);
+}
+
+void
+memory_manager_ut::test_vmem_arena_malloc_invalid()
+{
+    vmem_arena_type arena{g_arena_addr};
+
+    this->expect_exception([&] { arena.alloc(0); }, ""_ut_ffe);
+    this->expect_exception([&] { arena.alloc(0x100001); }, ""_ut_ffe);
+    this->expect_exception([&] { arena.alloc_aligned(0x1000, 0x3000, 0); }, ""_ut_ffe);
+    this->expect_exception([&] { arena.alloc_aligned(0x1000, 0x800, 0); }, ""_ut_ffe);
+    this->expect_exception([&] { arena.alloc_aligned(0x1000, 0x2000, 0x2000); }, ""_ut_ffe);
+    this->expect_exception([&] { arena.alloc_aligned(0x1000, 0x2000, 0x800); }, ""_ut_ffe);
+}
+
+void
+memory_manager_ut::test_vmem_arena_alloc_free()
+{
+    vmem_arena_type arena{g_arena_addr};
+
+    auto &&addr1 = arena.alloc(0x1000);
+    auto &&addr2 = arena.alloc(0x2001);
+
+    this->expect_true(addr1 == g_arena_addr);
+    this->expect_true(addr2 == g_arena_addr + 0x1000);
+    this->expect_true(arena.size(addr1) == 0x1000);
+    this->expect_true(arena.size(addr2) == 0x3000);
+    this->expect_true(arena.size(addr2 + 0x1000) == 0);
+    this->expect_true(arena.allocated() == 0x4000);
+    this->expect_true(arena.contains(addr2));
+    this->expect_false(arena.contains(g_arena_addr + 0x100000));
+
+    this->expect_true(arena.free(addr2 + 8) == 0);
+    this->expect_true(arena.free(0) == 0);
+    this->expect_true(arena.free(addr2) == 0x3000);
+    this->expect_true(arena.free(addr2) == 0);
+    this->expect_true(arena.free(addr1) == 0x1000);
+    this->expect_true(arena.size(addr1) == 0);
+
+    this->expect_true(arena.allocated() == 0);
+    this->expect_true(arena.high_water() == 0x4000);
+    this->expect_true(arena.capacity() == 0x100000);
+}
+
+void
+memory_manager_ut::test_vmem_arena_coalesce()
+{
+    vmem_arena_type arena{g_arena_addr};
+
+    auto &&addr1 = arena.alloc(0x10000);
+    auto &&addr2 = arena.alloc(0x10000);
+    auto &&addr3 = arena.alloc(0x10000);
+
+    this->expect_true(arena.largest_free() == 0x100000 - 0x30000);
+
+    arena.free(addr2);
+    arena.free(addr1);
+    this->expect_true(arena.alloc(0x20000) == addr1);
+
+    arena.free(addr1);
+    arena.free(addr3);
+    this->expect_true(arena.largest_free() == 0x100000);
+    this->expect_true(arena.alloc(0x100000) == g_arena_addr);
+}
+
+void
+memory_manager_ut::test_vmem_arena_qcache()
+{
+    vmem_arena_type arena{g_arena_addr};
+
+    auto &&addr1 = arena.alloc(0x1000);
+    auto &&addr2 = arena.alloc(0x1000);
+    auto &&addr3 = arena.alloc(0x2000);
+
+    arena.free(addr1);
+    arena.free(addr2);
+    this->expect_true(arena.size(addr1) == 0);
+    this->expect_true(arena.largest_free() == 0x100000 - 0x4000);
+
+    this->expect_true(arena.alloc(0x1000) == addr2);
+    this->expect_true(arena.alloc(0x1000) == addr1);
+
+    arena.free(addr1);
+    arena.free(addr2);
+    arena.free(addr3);
+
+    this->expect_true(arena.alloc(0x100000) == g_arena_addr);
+    this->expect_true(arena.allocated() == 0x100000);
+}
+
+void
+memory_manager_ut::test_vmem_arena_alloc_aligned()
+{
+    vmem_arena_type arena{g_arena_addr};
+
+    auto &&addr1 = arena.alloc(0x1000);
+    auto &&addr2 = arena.alloc_aligned(0x2000, 0x10000, 0x3000);
+    auto &&addr3 = arena.alloc(0x2000);
+
+    this->expect_true(addr1 == g_arena_addr);
+    this->expect_true(addr2 == g_arena_addr + 0x3000);
+    this->expect_true(addr3 == g_arena_addr + 0x1000);
+
+    auto &&addr4 = arena.alloc_aligned(0x1000, 0x80000, 0);
+    this->expect_true(addr4 == g_arena_addr + 0x80000);
+
+    this->expect_exception([&] { arena.alloc_aligned(0x80000, 0x80000, 0); }, ""_ut_bae);
+}
+
+void
+memory_manager_ut::test_vmem_arena_out_of_segments()
+{
+    vmem_arena_type arena{g_arena_addr};
+
+    for (auto i = 0; i < 7; i++)
+        arena.alloc(0x2000);
+
+    this->expect_exception([&] { arena.alloc(0x2000); }, ""_ut_bae);
+    this->expect_true(arena.alloc(0x100000 - 0xE000) == g_arena_addr + 0xE000);
+
+    arena.free(g_arena_addr + 0x2000);
+    this->expect_true(arena.alloc(0x2000) == g_arena_addr + 0x2000);
+}
@@ -25,6 +25,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <malloc.h>
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/time.h>
@@ -304,11 +305,17 @@ mkdir(const char *path, mode_t mode)
 extern "C" int
 posix_memalign(void **memptr, size_t alignment, size_t size)
 {
-    (void) memptr;
-    (void) alignment;
-    (void) size;
+    if (memptr == nullptr || alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0)
+        return EINVAL;
 
-    UNHANDLED();
+    if (size == 0)
+    {
+        *memptr = nullptr;
+        return 0;
+    }
+
+    if ((*memptr = _memalign_r(0, alignment, size)) == nullptr)
+        return ENOMEM;
 
     return 0;
 }
@@ -384,6 +391,18 @@ realloc(void *ptr, size_t size)
     return _realloc_r(0, ptr, size);
 }
 
+extern "C" void *
+memalign(size_t alignment, size_t size)
+{
+    return _memalign_r(0, alignment, size);
+}
+
+extern "C" void *
+aligned_alloc(size_t alignment, size_t size)
+{
+    return _memalign_r(0, alignment, size);
+}
+
 extern "C" int
 fstat(int file, struct stat *sbuf)
 {
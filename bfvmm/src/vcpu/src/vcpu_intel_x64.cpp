@@ -21,6 +21,7 @@
 
 #include <gsl/gsl>
 #include <vcpu/vcpu_intel_x64.h>
+#include <memory_manager/mem_tag.h>
 
 vcpu_intel_x64::vcpu_intel_x64(
     vcpuid::type id,
@@ -47,7 +48,7 @@ vcpu_intel_x64::init(user_data *data)
     { this->fini(); });
 
     if (!m_state_save)
-        m_state_save = std::make_unique<state_save_intel_x64>();
+        m_state_save = std::unique_ptr<state_save_intel_x64>(new (mem_tag::state_save) state_save_intel_x64());
 
     if (!m_vmxon)
         m_vmxon = std::make_unique<vmxon_intel_x64>();
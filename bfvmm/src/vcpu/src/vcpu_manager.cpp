@@ -21,6 +21,7 @@
 
 #include <gsl/gsl>
 #include <vcpu/vcpu_manager.h>
+#include <memory_manager/mem_tag.h>
 
 // -----------------------------------------------------------------------------
 // Mutex
@@ -50,7 +51,10 @@ vcpu_manager::create_vcpu(vcpuid::type vcpuid, user_data *data)
     });
 
     if (auto && vcpu = add_vcpu(vcpuid, data))
+    {
+        mem_tag_scope scope(mem_tag::user_data);
         vcpu->init(data);
+    }
 }
 
 void
@@ -70,7 +74,10 @@ void
 vcpu_manager::run_vcpu(vcpuid::type vcpuid, user_data *data)
 {
     if (auto && vcpu = get_vcpu(vcpuid))
+    {
+        mem_tag_scope scope(mem_tag::user_data);
         vcpu->run(data);
+    }
 }
 
 void
@@ -100,7 +107,13 @@ vcpu_manager::add_vcpu(vcpuid::type vcpuid, user_data *data)
     if (auto && vcpu = get_vcpu(vcpuid))
         return vcpu;
 
-    if (auto && vcpu = m_vcpu_factory->make_vcpu(vcpuid, data))
+    auto &&vcpu = [&]
+    {
+        mem_tag_scope scope(mem_tag::vcpu_factory);
+        return m_vcpu_factory->make_vcpu(vcpuid, data);
+    }();
+
+    if (vcpu)
     {
         std::lock_guard<std::mutex> guard(g_vcpu_manager_mutex);
         return m_vcpus[vcpuid] = std::move(vcpu);
@@ -72,6 +72,8 @@ SOURCES+=vmcs_intel_x64_check_host.cpp
 SOURCES+=vmcs_intel_x64_check_misc.cpp
 SOURCES+=vmcs_intel_x64_vmm_state.cpp
 SOURCES+=vmcs_intel_x64_host_vm_state.cpp
+SOURCES+=vmcs_intel_x64_io_bitmap.cpp
+SOURCES+=vmcs_intel_x64_msr_bitmap.cpp
 SOURCES+=vmcs_intel_x64_promote.asm
 SOURCES+=vmcs_intel_x64_resume.asm
 SOURCES+=vmcs_intel_x64_launch.asm
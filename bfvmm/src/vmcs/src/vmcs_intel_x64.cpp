@@ -21,6 +21,8 @@
 
 #include <gsl/gsl>
 
+#include <atomic>
+
 #include <constants.h>
 #include <thread_context.h>
 #include <memory_manager/memory_manager_x64.h>
@@ -32,24 +34,45 @@
 #include <vmcs/vmcs_intel_x64_launch.h>
 #include <vmcs/vmcs_intel_x64_resume.h>
 #include <vmcs/vmcs_intel_x64_promote.h>
+#include <vmcs/vmcs_intel_x64_16bit_control_fields.h>
 #include <vmcs/vmcs_intel_x64_16bit_host_state_fields.h>
 #include <vmcs/vmcs_intel_x64_16bit_guest_state_fields.h>
 #include <vmcs/vmcs_intel_x64_32bit_control_fields.h>
 #include <vmcs/vmcs_intel_x64_32bit_guest_state_fields.h>
 #include <vmcs/vmcs_intel_x64_32bit_host_state_field.h>
+#include <vmcs/vmcs_intel_x64_64bit_control_fields.h>
 #include <vmcs/vmcs_intel_x64_64bit_guest_state_fields.h>
 #include <vmcs/vmcs_intel_x64_64bit_host_state_fields.h>
 #include <vmcs/vmcs_intel_x64_natural_width_guest_state_fields.h>
 #include <vmcs/vmcs_intel_x64_natural_width_host_state_fields.h>
 
+#include <intrinsics/crs_intel_x64.h>
+#include <intrinsics/vmx_intel_x64.h>
+#include <intrinsics/msrs_intel_x64.h>
+
 using namespace x64;
 using namespace intel_x64;
 using namespace vmcs;
 
+static std::atomic<uint16_t> g_next_vpid{1};
+
+static void
+flush_all_tlb_entries() noexcept
+{
+    auto value = cr4::get();
+
+    cr4::set(value ^ cr4::page_global_enable::mask);
+    cr4::set(value);
+}
+
 vmcs_intel_x64::vmcs_intel_x64() :
     m_vmcs_region_phys(0),
+    m_vpid(0),
     m_state_save(nullptr)
-{ }
+{
+    while (m_vpid == 0)
+        m_vpid = g_next_vpid++;
+}
 
 void
 vmcs_intel_x64::launch(gsl::not_null<vmcs_intel_x64_state *> host_state,
@@ -75,6 +98,21 @@ vmcs_intel_x64::launch(gsl::not_null<vmcs_intel_x64_state *> host_state,
     auto ___ = gsl::on_failure([&]
     { vmcs::check::all(); });
 
+    // The guest's TLB entries are tagged with m_vpid, so stale entries
+    // from a previous VMCS with the same VPID have to be invalidated. The
+    // VMM's entries are tagged with VPID 0 (and VMM_PCID), which the
+    // current address space might also be using, so those are flushed too.
+
+    if (secondary_processor_based_vm_execution_controls::enable_vpid::is_enabled())
+    {
+        if (msrs::ia32_vmx_ept_vpid_cap::invvpid_single_context_support::get())
+            vmx::invvpid_single_context(m_vpid);
+        else
+            vmx::invvpid_all_contexts();
+    }
+
+    flush_all_tlb_entries();
+
     if (guest_state->is_guest())
     {
         vmcs_launch(m_state_save);
@@ -108,13 +146,38 @@ void
 vmcs_intel_x64::clear()
 { vm::clear(&m_vmcs_region_phys); }
 
+vmcs_intel_x64_msr_bitmap &
+vmcs_intel_x64::msr_bitmap()
+{
+    if (!m_msr_bitmap)
+    {
+        m_msr_bitmap = std::make_unique<vmcs_intel_x64_msr_bitmap>();
+
+        // The CPU does not save IA32_PERF_GLOBAL_CTRL on a VM exit, so
+        // the guest's writes have to go through the VMCS (handle_wrmsr).
+
+        m_msr_bitmap->trap_on_write(msrs::ia32_perf_global_ctrl::addr);
+    }
+
+    return *m_msr_bitmap;
+}
+
+vmcs_intel_x64_io_bitmap &
+vmcs_intel_x64::io_bitmap()
+{
+    if (!m_io_bitmap)
+        m_io_bitmap = std::make_unique<vmcs_intel_x64_io_bitmap>();
+
+    return *m_io_bitmap;
+}
+
 void
 vmcs_intel_x64::create_vmcs_region()
 {
     auto ___ = gsl::on_failure([&]
     { this->release_vmcs_region(); });
 
-    m_vmcs_region = std::make_unique<uint32_t[]>(1024);
+    m_vmcs_region = std::unique_ptr<uint32_t[]>(new (mem_tag::vmcs) uint32_t[1024]());
     m_vmcs_region_phys = g_mm->virtptr_to_physint(m_vmcs_region.get());
 
     gsl::span<uint32_t> id{m_vmcs_region.get(), 1024};
@@ -130,7 +193,7 @@ vmcs_intel_x64::release_vmcs_region() noexcept
 
 void
 vmcs_intel_x64::create_exit_handler_stack()
-{ m_exit_handler_stack = std::make_unique<char[]>(STACK_SIZE * 2); }
+{ m_exit_handler_stack = std::unique_ptr<char[]>(new (mem_tag::exit_handler_stack) char[STACK_SIZE * 2]()); }
 
 void
 vmcs_intel_x64::release_exit_handler_stack() noexcept
@@ -167,7 +230,8 @@ vmcs_intel_x64::write_16bit_control_state(gsl::not_null<vmcs_intel_x64_state *>
 {
     (void) state;
 
-    // unused: VMCS_VIRTUAL_PROCESSOR_IDENTIFIER
+    vmcs::virtual_processor_identifier::set_if_exists(m_vpid);
+
     // unused: VMCS_POSTED_INTERRUPT_NOTIFICATION_VECTOR
     // unused: VMCS_EPTP_INDEX
 }
@@ -177,9 +241,10 @@ vmcs_intel_x64::write_64bit_control_state(gsl::not_null<vmcs_intel_x64_state *>
 {
     (void) state;
 
-    // unused: VMCS_ADDRESS_OF_IO_BITMAP_A
-    // unused: VMCS_ADDRESS_OF_IO_BITMAP_B
-    // unused: VMCS_ADDRESS_OF_MSR_BITMAPS
+    vmcs::address_of_io_bitmap_a::set(this->io_bitmap().phys_a());
+    vmcs::address_of_io_bitmap_b::set(this->io_bitmap().phys_b());
+    vmcs::address_of_msr_bitmap::set(this->msr_bitmap().phys());
+
     // unused: VMCS_VM_EXIT_MSR_STORE_ADDRESS
     // unused: VMCS_VM_EXIT_MSR_LOAD_ADDRESS
     // unused: VMCS_VM_ENTRY_MSR_LOAD_ADDRESS
@@ -391,6 +456,7 @@ vmcs_intel_x64::write_natural_host_state(gsl::not_null<vmcs_intel_x64_state *> s
     auto tc = reinterpret_cast<thread_context_t *>(stack_top - sizeof(thread_context_t));
     tc->cpuid = thread_context_cpuid();
     tc->tlsptr = thread_context_tlsptr();
+    tc->vmx_root = 1;
 
     vmcs::host_cr0::set(state->cr0());
     vmcs::host_cr3::set(state->cr3());
@@ -438,9 +504,9 @@ vmcs_intel_x64::primary_processor_based_vm_execution_controls()
     // primary_processor_based_vm_execution_controls::nmi_window_exiting::enable();
     // primary_processor_based_vm_execution_controls::mov_dr_exiting::enable();
     // primary_processor_based_vm_execution_controls::unconditional_io_exiting::enable();
-    // primary_processor_based_vm_execution_controls::use_io_bitmaps::enable();
+    primary_processor_based_vm_execution_controls::use_io_bitmaps::enable();
     // primary_processor_based_vm_execution_controls::monitor_trap_flag::enable();
-    // primary_processor_based_vm_execution_controls::use_msr_bitmaps::enable();
+    primary_processor_based_vm_execution_controls::use_msr_bitmap::enable();
     // primary_processor_based_vm_execution_controls::monitor_exiting::enable();
     // primary_processor_based_vm_execution_controls::pause_exiting::enable();
     primary_processor_based_vm_execution_controls::activate_secondary_controls::enable();
@@ -456,7 +522,7 @@ vmcs_intel_x64::secondary_processor_based_vm_execution_controls()
     // secondary_processor_based_vm_execution_controls::descriptor_table_exiting::enable_if_allowed(verbose);
     secondary_processor_based_vm_execution_controls::enable_rdtscp::enable_if_allowed(verbose);
     // secondary_processor_based_vm_execution_controls::virtualize_x2apic_mode::enable_if_allowed(verbose);
-    // secondary_processor_based_vm_execution_controls::enable_vpid::enable_if_allowed(verbose);
+    secondary_processor_based_vm_execution_controls::enable_vpid::enable_if_allowed(verbose);
     // secondary_processor_based_vm_execution_controls::wbinvd_exiting::enable_if_allowed(verbose);
     // secondary_processor_based_vm_execution_controls::unrestricted_guest::enable_if_allowed(verbose);
     // secondary_processor_based_vm_execution_controls::apic_register_virtualization::enable_if_allowed(verbose);
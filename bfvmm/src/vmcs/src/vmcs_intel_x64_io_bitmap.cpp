@@ -0,0 +1,80 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <gsl/gsl>
+
+#include <algorithm>
+
+#include <vmcs/vmcs_intel_x64_io_bitmap.h>
+#include <memory_manager/memory_manager_x64.h>
+
+// first port covered by bitmap B
+constexpr const auto io_bitmap_b_first = 0x8000U;
+
+static uint8_t
+bit_mask(vmcs_intel_x64_io_bitmap::port_type port) noexcept
+{ return gsl::narrow_cast<uint8_t>(1U << (port & 7U)); }
+
+static std::ptrdiff_t
+byte_index(vmcs_intel_x64_io_bitmap::port_type port) noexcept
+{ return gsl::narrow_cast<std::ptrdiff_t>((port & (io_bitmap_b_first - 1U)) >> 3); }
+
+vmcs_intel_x64_io_bitmap::vmcs_intel_x64_io_bitmap() :
+    m_bitmap_a(new (mem_tag::vmcs) uint8_t[x64::page_size]()),
+    m_bitmap_b(new (mem_tag::vmcs) uint8_t[x64::page_size]()),
+    m_bitmap_a_phys(g_mm->virtptr_to_physint(m_bitmap_a.get())),
+    m_bitmap_b_phys(g_mm->virtptr_to_physint(m_bitmap_b.get()))
+{ }
+
+void
+vmcs_intel_x64_io_bitmap::trap_on_access(port_type port)
+{ this->bitmap(port)[byte_index(port)] |= bit_mask(port); }
+
+void
+vmcs_intel_x64_io_bitmap::pass_through_access(port_type port)
+{ this->bitmap(port)[byte_index(port)] &= gsl::narrow_cast<uint8_t>(~bit_mask(port)); }
+
+void
+vmcs_intel_x64_io_bitmap::trap_on_all_accesses() noexcept
+{
+    std::fill(m_bitmap_a.get(), m_bitmap_a.get() + x64::page_size, 0xFF);
+    std::fill(m_bitmap_b.get(), m_bitmap_b.get() + x64::page_size, 0xFF);
+}
+
+void
+vmcs_intel_x64_io_bitmap::pass_through_all_accesses() noexcept
+{
+    std::fill(m_bitmap_a.get(), m_bitmap_a.get() + x64::page_size, 0x00);
+    std::fill(m_bitmap_b.get(), m_bitmap_b.get() + x64::page_size, 0x00);
+}
+
+bool
+vmcs_intel_x64_io_bitmap::is_trapped(port_type port) const
+{ return (this->bitmap(port)[byte_index(port)] & bit_mask(port)) != 0; }
+
+gsl::span<uint8_t>
+vmcs_intel_x64_io_bitmap::bitmap(port_type port) const
+{
+    if (port < io_bitmap_b_first)
+        return gsl::span<uint8_t>(m_bitmap_a.get(), x64::page_size);
+
+    return gsl::span<uint8_t>(m_bitmap_b.get(), x64::page_size);
+}
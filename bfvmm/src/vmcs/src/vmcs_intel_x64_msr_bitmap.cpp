@@ -0,0 +1,136 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <gsl/gsl>
+
+#include <algorithm>
+
+#include <vmcs/vmcs_intel_x64_msr_bitmap.h>
+#include <memory_manager/memory_manager_x64.h>
+
+constexpr const auto msr_bitmap_low_last = 0x00001FFFU;
+constexpr const auto msr_bitmap_high_first = 0xC0000000U;
+constexpr const auto msr_bitmap_high_last = 0xC0001FFFU;
+
+// offsets (in bytes) of the bitmaps within the page
+constexpr const auto msr_bitmap_high_offset = 0x400UL;
+constexpr const auto msr_bitmap_write_offset = 0x800UL;
+
+static bool
+is_covered(vmcs_intel_x64_msr_bitmap::msr_type msr) noexcept
+{ return msr <= msr_bitmap_low_last || (msr >= msr_bitmap_high_first && msr <= msr_bitmap_high_last); }
+
+static std::ptrdiff_t
+byte_index(vmcs_intel_x64_msr_bitmap::msr_type msr, bool write) noexcept
+{
+    std::size_t index = (msr & msr_bitmap_low_last) >> 3;
+
+    if (msr >= msr_bitmap_high_first)
+        index += msr_bitmap_high_offset;
+
+    if (write)
+        index += msr_bitmap_write_offset;
+
+    return gsl::narrow_cast<std::ptrdiff_t>(index);
+}
+
+static uint8_t
+bit_mask(vmcs_intel_x64_msr_bitmap::msr_type msr) noexcept
+{ return gsl::narrow_cast<uint8_t>(1U << (msr & 7U)); }
+
+vmcs_intel_x64_msr_bitmap::vmcs_intel_x64_msr_bitmap() :
+    m_bitmap(new (mem_tag::vmcs) uint8_t[x64::page_size]()),
+    m_bitmap_phys(g_mm->virtptr_to_physint(m_bitmap.get()))
+{ }
+
+void
+vmcs_intel_x64_msr_bitmap::trap_on_read(msr_type msr)
+{ this->set_bit(msr, false, true); }
+
+void
+vmcs_intel_x64_msr_bitmap::trap_on_write(msr_type msr)
+{ this->set_bit(msr, true, true); }
+
+void
+vmcs_intel_x64_msr_bitmap::trap_on_access(msr_type msr)
+{
+    this->set_bit(msr, false, true);
+    this->set_bit(msr, true, true);
+}
+
+void
+vmcs_intel_x64_msr_bitmap::pass_through_read(msr_type msr)
+{ this->set_bit(msr, false, false); }
+
+void
+vmcs_intel_x64_msr_bitmap::pass_through_write(msr_type msr)
+{ this->set_bit(msr, true, false); }
+
+void
+vmcs_intel_x64_msr_bitmap::pass_through_access(msr_type msr)
+{
+    this->set_bit(msr, false, false);
+    this->set_bit(msr, true, false);
+}
+
+void
+vmcs_intel_x64_msr_bitmap::trap_on_all_accesses() noexcept
+{ std::fill(m_bitmap.get(), m_bitmap.get() + x64::page_size, 0xFF); }
+
+void
+vmcs_intel_x64_msr_bitmap::pass_through_all_accesses() noexcept
+{ std::fill(m_bitmap.get(), m_bitmap.get() + x64::page_size, 0x00); }
+
+bool
+vmcs_intel_x64_msr_bitmap::is_read_trapped(msr_type msr) const
+{ return this->get_bit(msr, false); }
+
+bool
+vmcs_intel_x64_msr_bitmap::is_write_trapped(msr_type msr) const
+{ return this->get_bit(msr, true); }
+
+void
+vmcs_intel_x64_msr_bitmap::set_bit(msr_type msr, bool write, bool trap)
+{
+    if (!is_covered(msr))
+    {
+        expects(trap);
+        return;
+    }
+
+    auto &&bitmap = gsl::span<uint8_t>(m_bitmap.get(), x64::page_size);
+    auto &&byte = bitmap[byte_index(msr, write)];
+
+    if (trap)
+        byte |= bit_mask(msr);
+    else
+        byte &= gsl::narrow_cast<uint8_t>(~bit_mask(msr));
+}
+
+bool
+vmcs_intel_x64_msr_bitmap::get_bit(msr_type msr, bool write) const
+{
+    if (!is_covered(msr))
+        return true;
+
+    auto &&bitmap = gsl::span<const uint8_t>(m_bitmap.get(), x64::page_size);
+    return (bitmap[byte_index(msr, write)] & bit_mask(msr)) != 0;
+}
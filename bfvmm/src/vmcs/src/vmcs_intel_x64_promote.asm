@@ -118,6 +118,23 @@ vmcs_promote:
     vmread rdi, rsi
     call __write_cr4 wrt ..plt
 
+    ;
+    ; Flush the TLB
+    ;
+    ; Toggling CR4.PGE flushes every TLB entry, including the VMM's global
+    ; entries, and the entries tagged with the VMM's PCID, neither of which
+    ; are valid for the guest once it is running without the VMM.
+    ;
+
+    mov rsi, VMCS_GUEST_CR4
+    vmread rdi, rsi
+    xor rdi, 0x80
+    call __write_cr4 wrt ..plt
+
+    mov rsi, VMCS_GUEST_CR4
+    vmread rdi, rsi
+    call __write_cr4 wrt ..plt
+
     mov rsi, VMCS_GUEST_DR7
     vmread rdi, rsi
     call __write_dr7 wrt ..plt
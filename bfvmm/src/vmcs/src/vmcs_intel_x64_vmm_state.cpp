@@ -19,6 +19,7 @@
 // License along with this library; if not, write to the Free Software
 // Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
 
+#include <constants.h>
 #include <vmcs/vmcs_intel_x64_vmm_state.h>
 
 #include <memory_manager/pat_x64.h>
@@ -103,6 +104,13 @@ vmcs_intel_x64_vmm_state::vmcs_intel_x64_vmm_state()
     if (cpuid::extended_feature_flags::subleaf0::ebx::smap::get())
         m_cr4 |= cr4::smap_enable_bit::mask;
 
+    if (cpuid::feature_information::ecx::pcid::get())
+    {
+        m_cr3 &= ~(x64::page_size - 1);
+        m_cr3 |= VMM_PCID;
+        m_cr4 |= cr4::pcid_enable_bit::mask;
+    }
+
     m_rflags = 0;
 
     m_ia32_pat_msr = x64::pat::pat_value;
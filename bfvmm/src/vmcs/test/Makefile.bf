@@ -58,6 +58,8 @@ SOURCES+=test_vmcs_intel_x64_check_guest.cpp
 SOURCES+=test_vmcs_intel_x64_state.cpp
 SOURCES+=test_vmcs_intel_x64_vmm_state.cpp
 SOURCES+=test_vmcs_intel_x64_host_vm_state.cpp
+SOURCES+=test_vmcs_intel_x64_msr_bitmap.cpp
+SOURCES+=test_vmcs_intel_x64_io_bitmap.cpp
 
 INCLUDE_PATHS+=./
 INCLUDE_PATHS+=%HYPER_ABS%/include/
@@ -31,6 +31,7 @@ using namespace intel_x64;
 std::map<uint32_t, uint64_t> g_msrs;
 std::map<uint64_t, uint64_t> g_vmcs_fields;
 std::map<uint32_t, uint32_t> g_eax_cpuid;
+uint32_t g_ecx_cpuid = 0x04000000U;
 
 struct cpuid_regs g_cpuid_regs;
 
@@ -40,6 +41,8 @@ bool g_vmlaunch_fails = false;
 bool g_virt_to_phys_return_nullptr = false;
 bool g_phys_to_virt_return_nullptr = false;
 
+uint64_t g_invvpid_type = 0U;
+
 uint64_t g_test_addr = 0U;
 uint64_t g_virt_apic_addr = 0U;
 uint8_t g_virt_apic_mem[0x81] = {0U};
@@ -132,7 +135,7 @@ __cpuid_eax(uint32_t val) noexcept
 
 extern "C" uint32_t
 __cpuid_ecx(uint32_t val) noexcept
-{ (void) val; return 0x04000000U; }
+{ (void) val; return g_ecx_cpuid; }
 
 extern "C" void
 __cpuid(void *eax, void *ebx, void *ecx, void *edx) noexcept
@@ -169,6 +172,10 @@ extern "C" bool
 __vmlaunch_demote(void) noexcept
 { return !g_vmlaunch_fails; }
 
+extern "C" bool
+__invvpid(uint64_t type, void *ptr) noexcept
+{ (void)ptr; g_invvpid_type = type; return true; }
+
 uintptr_t
 virtptr_to_physint(void *ptr)
 {
@@ -211,6 +218,9 @@ void
 vmcs_ut::list_vmcs_intel_x64_cpp()
 {
     this->test_launch_success();
+    this->test_launch_vpid();
+    this->test_launch_msr_bitmap();
+    this->test_launch_io_bitmap();
     this->test_launch_vmlaunch_failure();
     this->test_launch_vmlaunch_demote_failure();
     this->test_launch_create_vmcs_region_failure();
@@ -1483,6 +1493,7 @@ vmcs_ut::list()
     this->test_vmm_state_gdt_not_setup();
     this->test_vmm_state_segment_registers();
     this->test_vmm_state_control_registers();
+    this->test_vmm_state_control_registers_pcid();
     this->test_vmm_state_rflags();
     this->test_vmm_state_gdt_base();
     this->test_vmm_state_idt_base();
@@ -1494,6 +1505,16 @@ vmcs_ut::list()
     this->test_vmm_state_ia32_efer_msr();
     this->test_vmm_state_dump();
 
+    this->test_msr_bitmap_pass_through_by_default();
+    this->test_msr_bitmap_trap();
+    this->test_msr_bitmap_pass_through();
+    this->test_msr_bitmap_all();
+    this->test_msr_bitmap_out_of_range();
+
+    this->test_io_bitmap_pass_through_by_default();
+    this->test_io_bitmap_trap();
+    this->test_io_bitmap_all();
+
     return true;
 }
 
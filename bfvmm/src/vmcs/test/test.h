@@ -58,6 +58,8 @@ struct cpuid_regs
 extern std::map<uint32_t, uint64_t> g_msrs;
 extern std::map<uint64_t, uint64_t> g_vmcs_fields;
 extern std::map<uint32_t, uint32_t> g_eax_cpuid;
+extern uint32_t g_ecx_cpuid;
+extern uint64_t g_invvpid_type;
 extern bool g_virt_to_phys_return_nullptr;
 extern bool g_phys_to_virt_return_nullptr;
 extern uintptr_t g_test_addr;
@@ -156,6 +158,9 @@ private:
     void list_checks_on_guest_state();
 
     void test_launch_success();
+    void test_launch_vpid();
+    void test_launch_msr_bitmap();
+    void test_launch_io_bitmap();
     void test_launch_vmlaunch_failure();
     void test_launch_vmlaunch_demote_failure();
     void test_launch_create_vmcs_region_failure();
@@ -1310,6 +1315,7 @@ private:
     void test_vmm_state();
     void test_vmm_state_segment_registers();
     void test_vmm_state_control_registers();
+    void test_vmm_state_control_registers_pcid();
     void test_vmm_state_rflags();
     void test_vmm_state_gdt_base();
     void test_vmm_state_idt_base();
@@ -1320,6 +1326,16 @@ private:
     void test_vmm_state_segment_registers_base();
     void test_vmm_state_ia32_efer_msr();
     void test_vmm_state_dump();
+
+    void test_msr_bitmap_pass_through_by_default();
+    void test_msr_bitmap_trap();
+    void test_msr_bitmap_pass_through();
+    void test_msr_bitmap_all();
+    void test_msr_bitmap_out_of_range();
+
+    void test_io_bitmap_pass_through_by_default();
+    void test_io_bitmap_trap();
+    void test_io_bitmap_all();
 };
 
 #endif
@@ -338,6 +338,104 @@ vmcs_ut::test_launch_success()
     });
 }
 
+void
+vmcs_ut::test_launch_vpid()
+{
+    MockRepository mocks;
+    auto mm = mocks.Mock<memory_manager_x64>();
+    auto host_state = mocks.Mock<vmcs_intel_x64_state>();
+    auto guest_state = mocks.Mock<vmcs_intel_x64_state>();
+
+    setup_vmcs_intrinsics(mocks, mm);
+    setup_vmcs_x64_state_intrinsics(mocks, host_state);
+    setup_vmcs_x64_state_intrinsics(mocks, guest_state);
+    setup_launch_success_msrs();
+
+    auto ___ = gsl::finally([&]
+    { g_msrs[msrs::ia32_vmx_ept_vpid_cap::addr] = 0; });
+
+    g_msrs[msrs::ia32_vmx_ept_vpid_cap::addr] = msrs::ia32_vmx_ept_vpid_cap::invvpid_single_context_support::mask;
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        vmcs_intel_x64 vmcs1{};
+        vmcs_intel_x64 vmcs2{};
+
+        g_invvpid_type = 0;
+        this->expect_no_exception([&] { vmcs1.launch(host_state, guest_state); });
+        this->expect_true(secondary_processor_based_vm_execution_controls::enable_vpid::is_enabled());
+        this->expect_true(g_invvpid_type == 1);
+
+        auto &&vpid1 = vmcs::virtual_processor_identifier::get();
+
+        this->expect_no_exception([&] { vmcs2.launch(host_state, guest_state); });
+        auto &&vpid2 = vmcs::virtual_processor_identifier::get();
+
+        this->expect_true(vpid1 != 0);
+        this->expect_true(vpid2 != 0);
+        this->expect_true(vpid1 != vpid2);
+    });
+}
+
+void
+vmcs_ut::test_launch_msr_bitmap()
+{
+    MockRepository mocks;
+    auto mm = mocks.Mock<memory_manager_x64>();
+    auto host_state = mocks.Mock<vmcs_intel_x64_state>();
+    auto guest_state = mocks.Mock<vmcs_intel_x64_state>();
+
+    setup_vmcs_intrinsics(mocks, mm);
+    setup_vmcs_x64_state_intrinsics(mocks, host_state);
+    setup_vmcs_x64_state_intrinsics(mocks, guest_state);
+    setup_launch_success_msrs();
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        vmcs_intel_x64 vmcs{};
+
+        vmcs.msr_bitmap().trap_on_read(ia32_sysenter_cs::addr);
+
+        this->expect_no_exception([&] { vmcs.launch(host_state, guest_state); });
+        this->expect_true(primary_processor_based_vm_execution_controls::use_msr_bitmap::is_enabled());
+        this->expect_true(g_vmcs_fields[address_of_msr_bitmap::addr] == vmcs.msr_bitmap().phys());
+
+        this->expect_true(vmcs.msr_bitmap().is_read_trapped(ia32_sysenter_cs::addr));
+        this->expect_true(vmcs.msr_bitmap().is_write_trapped(ia32_perf_global_ctrl::addr));
+        this->expect_false(vmcs.msr_bitmap().is_read_trapped(ia32_perf_global_ctrl::addr));
+        this->expect_false(vmcs.msr_bitmap().is_read_trapped(ia32_fs_base::addr));
+    });
+}
+
+void
+vmcs_ut::test_launch_io_bitmap()
+{
+    MockRepository mocks;
+    auto mm = mocks.Mock<memory_manager_x64>();
+    auto host_state = mocks.Mock<vmcs_intel_x64_state>();
+    auto guest_state = mocks.Mock<vmcs_intel_x64_state>();
+
+    setup_vmcs_intrinsics(mocks, mm);
+    setup_vmcs_x64_state_intrinsics(mocks, host_state);
+    setup_vmcs_x64_state_intrinsics(mocks, guest_state);
+    setup_launch_success_msrs();
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        vmcs_intel_x64 vmcs{};
+
+        vmcs.io_bitmap().trap_on_access(0x3F8);
+
+        this->expect_no_exception([&] { vmcs.launch(host_state, guest_state); });
+        this->expect_true(primary_processor_based_vm_execution_controls::use_io_bitmaps::is_enabled());
+        this->expect_true(g_vmcs_fields[address_of_io_bitmap_a::addr] == vmcs.io_bitmap().phys_a());
+        this->expect_true(g_vmcs_fields[address_of_io_bitmap_b::addr] == vmcs.io_bitmap().phys_b());
+
+        this->expect_true(vmcs.io_bitmap().is_trapped(0x3F8));
+        this->expect_false(vmcs.io_bitmap().is_trapped(0x2F8));
+    });
+}
+
 void
 vmcs_ut::test_launch_vmlaunch_failure()
 {
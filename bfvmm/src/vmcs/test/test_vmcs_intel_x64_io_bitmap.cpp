@@ -0,0 +1,101 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <test.h>
+
+#include <vmcs/vmcs_intel_x64_io_bitmap.h>
+#include <memory_manager/memory_manager_x64.h>
+
+static void
+setup_io_bitmap(MockRepository &mocks)
+{
+    auto mm = mocks.Mock<memory_manager_x64>();
+
+    mocks.OnCallFunc(memory_manager_x64::instance).Return(mm);
+    mocks.OnCall(mm, memory_manager_x64::virtptr_to_physint).Do(virtptr_to_physint);
+}
+
+void
+vmcs_ut::test_io_bitmap_pass_through_by_default()
+{
+    MockRepository mocks;
+    setup_io_bitmap(mocks);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        vmcs_intel_x64_io_bitmap bitmap{};
+
+        this->expect_true(bitmap.phys_a() == 0x0000000ABCDEF0000);
+        this->expect_true(bitmap.phys_b() == 0x0000000ABCDEF0000);
+
+        this->expect_false(bitmap.is_trapped(0x0));
+        this->expect_false(bitmap.is_trapped(0x7FFF));
+        this->expect_false(bitmap.is_trapped(0x8000));
+        this->expect_false(bitmap.is_trapped(0xFFFF));
+    });
+}
+
+void
+vmcs_ut::test_io_bitmap_trap()
+{
+    MockRepository mocks;
+    setup_io_bitmap(mocks);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        vmcs_intel_x64_io_bitmap bitmap{};
+
+        bitmap.trap_on_access(0x3F8);
+        this->expect_true(bitmap.is_trapped(0x3F8));
+        this->expect_false(bitmap.is_trapped(0x3F9));
+        this->expect_false(bitmap.is_trapped(0x83F8));
+
+        bitmap.trap_on_access(0xFFFF);
+        this->expect_true(bitmap.is_trapped(0xFFFF));
+        this->expect_false(bitmap.is_trapped(0x7FFF));
+
+        bitmap.pass_through_access(0x3F8);
+        this->expect_false(bitmap.is_trapped(0x3F8));
+        this->expect_true(bitmap.is_trapped(0xFFFF));
+    });
+}
+
+void
+vmcs_ut::test_io_bitmap_all()
+{
+    MockRepository mocks;
+    setup_io_bitmap(mocks);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        vmcs_intel_x64_io_bitmap bitmap{};
+
+        bitmap.trap_on_all_accesses();
+        this->expect_true(bitmap.is_trapped(0x0));
+        this->expect_true(bitmap.is_trapped(0xCFC));
+        this->expect_true(bitmap.is_trapped(0xC000));
+
+        bitmap.pass_through_all_accesses();
+        this->expect_false(bitmap.is_trapped(0x0));
+        this->expect_false(bitmap.is_trapped(0xCFC));
+        this->expect_false(bitmap.is_trapped(0xC000));
+    });
+}
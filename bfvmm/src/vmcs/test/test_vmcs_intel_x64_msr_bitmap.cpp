@@ -0,0 +1,148 @@
+//
+// Bareflank Hypervisor
+//
+// Copyright (C) 2015 Assured Information Security, Inc.
+// Author: Rian Quinn        <quinnr@ainfosec.com>
+// Author: Brendan Kerrigan  <kerriganb@ainfosec.com>
+//
+// This library is free software; you can redistribute it and/or
+// modify it under the terms of the GNU Lesser General Public
+// License as published by the Free Software Foundation; either
+// version 2.1 of the License, or (at your option) any later version.
+//
+// This library is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+// Lesser General Public License for more details.
+//
+// You should have received a copy of the GNU Lesser General Public
+// License along with this library; if not, write to the Free Software
+// Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+
+#include <test.h>
+
+#include <vmcs/vmcs_intel_x64_msr_bitmap.h>
+#include <memory_manager/memory_manager_x64.h>
+
+static void
+setup_msr_bitmap(MockRepository &mocks)
+{
+    auto mm = mocks.Mock<memory_manager_x64>();
+
+    mocks.OnCallFunc(memory_manager_x64::instance).Return(mm);
+    mocks.OnCall(mm, memory_manager_x64::virtptr_to_physint).Do(virtptr_to_physint);
+}
+
+void
+vmcs_ut::test_msr_bitmap_pass_through_by_default()
+{
+    MockRepository mocks;
+    setup_msr_bitmap(mocks);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        vmcs_intel_x64_msr_bitmap bitmap{};
+
+        this->expect_true(bitmap.phys() == 0x0000000ABCDEF0000);
+
+        this->expect_false(bitmap.is_read_trapped(0x0));
+        this->expect_false(bitmap.is_write_trapped(0x1FFF));
+        this->expect_false(bitmap.is_read_trapped(0xC0000100));
+        this->expect_false(bitmap.is_write_trapped(0xC0001FFF));
+    });
+}
+
+void
+vmcs_ut::test_msr_bitmap_trap()
+{
+    MockRepository mocks;
+    setup_msr_bitmap(mocks);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        vmcs_intel_x64_msr_bitmap bitmap{};
+
+        bitmap.trap_on_read(0x6E0);
+        this->expect_true(bitmap.is_read_trapped(0x6E0));
+        this->expect_false(bitmap.is_write_trapped(0x6E0));
+        this->expect_false(bitmap.is_read_trapped(0x6E1));
+        this->expect_false(bitmap.is_read_trapped(0xC00006E0));
+
+        bitmap.trap_on_write(0xC0000100);
+        this->expect_true(bitmap.is_write_trapped(0xC0000100));
+        this->expect_false(bitmap.is_read_trapped(0xC0000100));
+        this->expect_false(bitmap.is_write_trapped(0x100));
+
+        bitmap.trap_on_access(0x1FFF);
+        this->expect_true(bitmap.is_read_trapped(0x1FFF));
+        this->expect_true(bitmap.is_write_trapped(0x1FFF));
+        this->expect_false(bitmap.is_read_trapped(0x1FF8));
+    });
+}
+
+void
+vmcs_ut::test_msr_bitmap_pass_through()
+{
+    MockRepository mocks;
+    setup_msr_bitmap(mocks);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        vmcs_intel_x64_msr_bitmap bitmap{};
+
+        bitmap.trap_on_access(0xC0000101);
+        bitmap.trap_on_access(0xC0000102);
+
+        bitmap.pass_through_read(0xC0000101);
+        this->expect_false(bitmap.is_read_trapped(0xC0000101));
+        this->expect_true(bitmap.is_write_trapped(0xC0000101));
+
+        bitmap.pass_through_write(0xC0000101);
+        this->expect_false(bitmap.is_write_trapped(0xC0000101));
+
+        bitmap.pass_through_access(0xC0000102);
+        this->expect_false(bitmap.is_read_trapped(0xC0000102));
+        this->expect_false(bitmap.is_write_trapped(0xC0000102));
+    });
+}
+
+void
+vmcs_ut::test_msr_bitmap_all()
+{
+    MockRepository mocks;
+    setup_msr_bitmap(mocks);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        vmcs_intel_x64_msr_bitmap bitmap{};
+
+        bitmap.trap_on_all_accesses();
+        this->expect_true(bitmap.is_read_trapped(0x10));
+        this->expect_true(bitmap.is_write_trapped(0xC0001000));
+
+        bitmap.pass_through_all_accesses();
+        this->expect_false(bitmap.is_read_trapped(0x10));
+        this->expect_false(bitmap.is_write_trapped(0xC0001000));
+    });
+}
+
+void
+vmcs_ut::test_msr_bitmap_out_of_range()
+{
+    MockRepository mocks;
+    setup_msr_bitmap(mocks);
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        vmcs_intel_x64_msr_bitmap bitmap{};
+
+        this->expect_true(bitmap.is_read_trapped(0x2000));
+        this->expect_true(bitmap.is_write_trapped(0xC0002000));
+        this->expect_true(bitmap.is_read_trapped(0xC0010000));
+
+        this->expect_no_exception([&] { bitmap.trap_on_access(0x2000); });
+        this->expect_exception([&] { bitmap.pass_through_read(0x2000); }, ""_ut_ffe);
+        this->expect_exception([&] { bitmap.pass_through_write(0xBFFFFFFF); }, ""_ut_ffe);
+        this->expect_exception([&] { bitmap.pass_through_access(0xC0002000); }, ""_ut_ffe);
+    });
+}
@@ -160,6 +160,31 @@ vmcs_ut::test_vmm_state_control_registers()
     });
 }
 
+void
+vmcs_ut::test_vmm_state_control_registers_pcid()
+{
+    MockRepository mocks;
+    setup_vmm_state(mocks);
+
+    g_cpuid_regs.ebx = 0x00100080UL;
+
+    auto ___ = gsl::finally([&]
+    { g_ecx_cpuid = 0x04000000U; });
+
+    g_ecx_cpuid |= cpuid::feature_information::ecx::pcid::mask;
+
+    RUN_UNITTEST_WITH_MOCKS(mocks, [&]
+    {
+        this->expect_no_exception([&]
+        {
+            vmcs_intel_x64_vmm_state state{};
+
+            this->expect_true(state.cr3() == ((test_cr3 & ~0xFFFUL) | VMM_PCID));
+            this->expect_true(state.cr4() == (test_cr4 | cr4::pcid_enable_bit::mask));
+        });
+    });
+}
+
 void
 vmcs_ut::test_vmm_state_rflags()
 {
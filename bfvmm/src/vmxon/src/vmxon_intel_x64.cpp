@@ -146,7 +146,7 @@ vmxon_intel_x64::create_vmxon_region()
     auto ___ = gsl::on_failure([&]
     { this->release_vmxon_region(); });
 
-    m_vmxon_region = std::make_unique<uint32_t[]>(1024);
+    m_vmxon_region = std::unique_ptr<uint32_t[]>(new (mem_tag::vmxon) uint32_t[1024]());
     m_vmxon_region_phys = g_mm->virtptr_to_physint(m_vmxon_region.get());
 
     gsl::span<uint32_t> id{m_vmxon_region.get(), 1024};
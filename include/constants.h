@@ -142,16 +142,56 @@
 #define MAX_PAGE_POOL (32 * 256ULL * MAX_PAGE_SIZE)
 #endif
 
+/*
+ * Heap Chunks
+ *
+ * On top of the static heap pool, the driver donates chunks of memory to
+ * the VMM's heap. Each chunk is MAX_HEAP_POOL bytes, and is added to the
+ * heap as another region. When the VMM is loaded, one chunk
+ * is donated for every HEAP_CHUNK_CPUS CPUs (plus any extra chunks that
+ * are asked for at load time), and more are donated while the VMM is
+ * running whenever the heap's usage crosses HEAP_HIGH_WATER_MARK. The
+ * page pool grows the same way while the VMM is running, using chunks of
+ * MAX_PAGE_POOL bytes. The driver checks the VMM's pools every
+ * HEAP_POLL_INTERVAL, and only asks the VMM how many chunks it needs if
+ * either pool has served an allocation since the last check.
+ *
+ * Note: HEAP_CHUNK_CPUS is in number of CPUs, MAX_HEAP_CHUNKS and
+ * MAX_PAGE_CHUNKS are the max number of chunks the driver will donate to
+ * each pool, HEAP_HIGH_WATER_MARK is a percentage of the pool's
+ * capacity, and HEAP_POLL_INTERVAL is in milliseconds.
+ */
+#ifndef HEAP_CHUNK_CPUS
+#define HEAP_CHUNK_CPUS (16ULL)
+#endif
+
+#ifndef MAX_HEAP_CHUNKS
+#define MAX_HEAP_CHUNKS (64ULL)
+#endif
+
+#ifndef MAX_PAGE_CHUNKS
+#define MAX_PAGE_CHUNKS (16ULL)
+#endif
+
+#ifndef HEAP_HIGH_WATER_MARK
+#define HEAP_HIGH_WATER_MARK (75ULL)
+#endif
+
+#ifndef HEAP_POLL_INTERVAL
+#define HEAP_POLL_INTERVAL (100ULL)
+#endif
+
 /*
  * Max Memory Map Pool
  *
  * This defines the virtual memory that the hypervisor will use for mapping
- * memory
+ * memory. This memory is only virtual address space (page tables are only
+ * created for the parts of it that are mapped), so it can be very large.
  *
- * Note: defined in bytes (defaults to 8MB)
+ * Note: defined in bytes (defaults to 16TB)
  */
 #ifndef MAX_MEM_MAP_POOL
-#define MAX_MEM_MAP_POOL (256ULL * MAX_PAGE_SIZE  * sizeof(uintptr_t))
+#define MAX_MEM_MAP_POOL 0x100000000000ULL
 #endif
 
 /*
@@ -160,10 +200,136 @@
  * This defines the starting location of the virtual memory that is used
  * for memory mapping.
  *
- * Note: defined in bytes (defaults to 2MB)
+ * Note: defined in bytes (defaults to 16TB)
  */
 #ifndef MEM_MAP_POOL_START
-#define MEM_MAP_POOL_START 0x200000ULL
+#define MEM_MAP_POOL_START 0x100000000000ULL
+#endif
+
+/*
+ * Max Memory Map Segments
+ *
+ * This defines the maximum number of segments the memory map pool can
+ * track. Each map, and each free range between maps, uses a segment, so
+ * this limits the number of maps that can exist at the same time (roughly
+ * half of this value when the pool is fragmented).
+ *
+ * Note: must be a power of 2 (defaults to 4096)
+ */
+#ifndef MAX_MEM_MAP_SEGMENTS
+#define MAX_MEM_MAP_SEGMENTS (4096ULL)
+#endif
+
+/*
+ * Direct Map Size
+ *
+ * When this is not 0, the VMM maps the first DIRECT_MAP_SIZE bytes of
+ * physical memory into its own page tables once (using 1GB pages when the
+ * CPU supports them, 2MB pages otherwise), and single page, write-back maps
+ * of this memory become pointer arithmetic instead of mapping a page into
+ * the memory map pool. Maps that need other memory types still use the
+ * memory map pool.
+ *
+ * Note: defined in bytes, must be a multiple of 2MB (defaults to disabled)
+ */
+#ifndef DIRECT_MAP_SIZE
+#define DIRECT_MAP_SIZE 0ULL
+#endif
+
+/*
+ * Direct Map Start
+ *
+ * This defines the virtual address of the direct map, i.e. physical
+ * address 0 is mapped at DIRECT_MAP_START.
+ *
+ * Note: defined in bytes (defaults to 64TB)
+ */
+#ifndef DIRECT_MAP_START
+#define DIRECT_MAP_START 0x400000000000ULL
+#endif
+
+/*
+ * TLB Flush Range Threshold
+ *
+ * When the TLB entries of a range of pages have to be invalidated (e.g.
+ * when memory is mapped), each page is invalidated with an INVLPG, unless
+ * the range is larger than this many pages, in which case the whole TLB is
+ * flushed instead.
+ *
+ * Note: defined in pages (defaults to 32)
+ */
+#ifndef TLB_FLUSH_RANGE_THRESHOLD
+#define TLB_FLUSH_RANGE_THRESHOLD (32ULL)
+#endif
+
+/*
+ * Max Deferred Unmaps
+ *
+ * When a map from the memory map pool is released, it is not unmapped
+ * right away. Instead, the map is queued, and once this many maps are
+ * queued, they are unmapped, the TLB is invalidated once for all of them,
+ * and their virtual memory is returned to the memory map pool.
+ *
+ * Note: defined in maps (defaults to 16)
+ */
+#ifndef MAX_DEFERRED_UNMAPS
+#define MAX_DEFERRED_UNMAPS (16ULL)
+#endif
+
+/*
+ * Max Retired Maps
+ *
+ * Once a map from the memory map pool is unmapped, other cores might still
+ * have a TLB entry for it, so its virtual memory is only returned to the
+ * memory map pool once every core has flushed its TLB (see
+ * memory_manager_x64::begin_exit). Until then, the map is retired. If more
+ * than this many maps are retired at once, the rest are never reused.
+ *
+ * Note: defined in maps (defaults to 64)
+ */
+#ifndef MAX_RETIRED_MAPS
+#define MAX_RETIRED_MAPS (64ULL)
+#endif
+
+/*
+ * Temporary Map Start
+ *
+ * This defines the virtual address of the temporary map slots. Each CPU
+ * is given TEMP_MAP_SLOTS pages starting at
+ * TEMP_MAP_START + (cpuid * TEMP_MAP_SLOTS * page size), which are used to
+ * map single pages without allocating virtual memory.
+ *
+ * Note: defined in bytes (defaults to 48TB)
+ */
+#ifndef TEMP_MAP_START
+#define TEMP_MAP_START 0x300000000000ULL
+#endif
+
+/*
+ * Temporary Map Slots
+ *
+ * This defines the number of temporary map slots each CPU has. When a
+ * CPU's slots are all in use, single pages are mapped using the memory
+ * map pool instead.
+ *
+ * Note: defined in pages (defaults to 16, max 64)
+ */
+#ifndef TEMP_MAP_SLOTS
+#define TEMP_MAP_SLOTS (16ULL)
+#endif
+
+/*
+ * VMM PCID
+ *
+ * When the CPU supports PCIDs, the VMM's CR3 is tagged with this PCID, so
+ * that loading the VMM's CR3 on a VM exit does not discard the VMM's TLB
+ * entries. Guests are given their own VPID, so this PCID does not have to
+ * be different from the PCIDs a guest uses.
+ *
+ * Note: must be between 1 and 4095 (defaults to 1)
+ */
+#ifndef VMM_PCID
+#define VMM_PCID (1ULL)
 #endif
 
 /*
@@ -177,6 +343,30 @@
 #define MAX_NUM_MODULES (75LL)
 #endif
 
+/*
+ * Max Supported CPUs
+ *
+ * The maximum number of CPUs that the VMM keeps per-CPU allocation caches
+ * for. CPUs whose id is larger than this are still supported, but their
+ * allocations go directly to the shared memory pools.
+ */
+#ifndef MAX_NUM_CPUS
+#define MAX_NUM_CPUS (128ULL)
+#endif
+
+/*
+ * Slab Cache Size
+ *
+ * The number of free objects each CPU caches per slab size class. When a
+ * cache is empty, half of this is allocated from the slab pool in one batch,
+ * and when a cache is full, half of it is returned in one batch.
+ *
+ * Note: defined in number of objects, must be a multiple of 2
+ */
+#ifndef SLAB_CACHE_SIZE
+#define SLAB_CACHE_SIZE (32ULL)
+#endif
+
 /**
  * Debug Ring Shift
  *
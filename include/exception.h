@@ -189,6 +189,26 @@ private:
 
 #define unknown_vmcall_data_type(a) bfn::unknown_vmcall_data_type_error(a)
 
+// -----------------------------------------------------------------------------
+// Unknown Stats Type Error
+// -----------------------------------------------------------------------------
+
+class unknown_stats_type_error : public bfn::general_exception
+{
+public:
+    unknown_stats_type_error(std::string mesg) :
+        m_mesg(std::move(mesg))
+    {}
+
+    std::ostream &print(std::ostream &os) const override
+    { return os << "unknown stats type: `" << m_mesg << "`"; }
+
+private:
+    std::string m_mesg;
+};
+
+#define unknown_stats_type(a) bfn::unknown_stats_type_error(a)
+
 // -----------------------------------------------------------------------------
 // Missing Argument Error
 // -----------------------------------------------------------------------------
@@ -141,6 +141,18 @@
 /// CPUID emulation for us. Note that you could also leave this last part out
 /// and emulate the CPUID instruction yourself.
 ///
+/// Instead of overloading handle_exit, the same can be done by registering
+/// a handler (or a pre / post hook) for the CPUID exit with the exit
+/// handler's dispatch table (see exit_handler_intel_x64::register_handler).
+/// Exits are dispatched by indexing this table with their exit reason, so
+/// stacking several extensions this way does not add a chain of overloads
+/// to each exit.
+///
+/// @code
+/// ehlr->register_pre_hook(vmcs::exit_reason::basic_exit_reason::cpuid,
+///                         [](exit_handler_intel_x64 &) { g_count++; });
+/// @endcode
+///
 /// The next step is to tell the VMM how to create your exit handler instead
 /// of the default one. To do this, you need to provide a new vcpu_factory.
 /// The vcpu_manager uses the vcpu_factory to create vCPUs. Thus providing a
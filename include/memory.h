@@ -44,9 +44,11 @@ extern "C" {
  * Memory Descriptor
  *
  * A memory descriptor provides information about a block of memory.
- * Typically, each page of memory that the VMM uses will have a memory
- * descriptor associated with it. The VMM will use this information to create
- * its resources, as well as generate page tables as needed.
+ * Each descriptor describes an extent: a range of pages that is both
+ * virtually and physically contiguous, and that shares the same type, so a
+ * physically contiguous allocation only needs a single descriptor. The VMM
+ * will use this information to create its resources, as well as generate
+ * page tables as needed.
  *
  * @var memory_descriptor::phys
  *     the starting physical address of the block of memory
@@ -55,12 +57,16 @@ extern "C" {
  * @var memory_descriptor::type
  *     the type of memory block. This is likely architecture specific as
  *     this holds information about access rights, etc...
+ * @var memory_descriptor::size
+ *     the size in bytes of the block of memory. This must be a multiple of
+ *     the page size
  */
 struct memory_descriptor
 {
     uint64_t phys;
     uint64_t virt;
     uint64_t type;
+    uint64_t size;
 };
 
 /**
@@ -70,7 +76,7 @@ struct memory_descriptor
  * @ensures none
  *
  * This is used by the driver entry to add an MD to VMM. The driver entry
- * will need to collect memory descriptors for every page of memory that the
+ * will need to collect memory descriptors for all of the memory that the
  * VMM is using so that the memory manager can provide mappings as needed.
  */
 typedef int64_t (*add_md_t)(struct memory_descriptor *md);
@@ -45,6 +45,20 @@ uint64_t thread_context_cpuid(void);
  */
 uint64_t thread_context_tlsptr(void);
 
+/**
+ * Get Thread Context VMX Root
+ *
+ * The VMM's code runs either on an exit handler stack (VMX root), or on the
+ * driver's stack when the driver calls into the VMM (e.g. add_md, or
+ * start_vmm). In the latter case, the host OS can preempt the caller, and
+ * the cpuid in the thread context is the one the driver asked for, not
+ * necessarily the core the code is running on.
+ *
+ * @return returns 1 if the current thread context is an exit handler's
+ *     (i.e. the code is running in VMX root), 0 otherwise
+ */
+uint64_t thread_context_vmx_root(void);
+
 /**
  * Thread Context
  *
@@ -62,8 +76,8 @@ struct thread_context_t
 {
     uint64_t cpuid;
     uint64_t tlsptr;
-    uint64_t reserved1;
-    uint64_t reserved2;
+    uint64_t vmx_root;
+    uint64_t reserved;
 };
 
 #ifdef __cplusplus
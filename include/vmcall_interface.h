@@ -216,6 +216,83 @@ enum vmcall_opcode
      */
     VMCALL_STOP = 6,
 
+    /*
+     * Heap
+     *
+     * This vmcall is used by the bfdriver common.c to grow the VMM's heap
+     * and page pool while the hypervisor is running. If the address is 0,
+     * the VMM returns the number of heap chunks (of MAX_HEAP_POOL bytes
+     * each) and page chunks (of MAX_PAGE_POOL bytes each) it would like to
+     * be donated, which are non-zero once the pool's usage crosses
+     * HEAP_HIGH_WATER_MARK (the driver only queries when the VMM's exported
+     * g_pool_generation has changed). Otherwise the VMM maps the virtually contiguous
+     * buffer provided (using the caller's CR3) into its own address space
+     * and adds it to the pool selected by r4. Buffers whose memory the VMM
+     * has already mapped are rejected. The buffer must stay allocated for
+     * as long as the VMM is loaded. The vmcall is only accepted at CPL 0,
+     * with the token the driver took from the VMM's g_heap_token (which is
+     * then set to 0) while the VMM was being loaded.
+     *
+     * In:
+     * r0 = VMCALL_HEAP
+     * r1 = VMCALL_MAGIC_NUMBER
+     * r2 = addr (0 == query, addr of virtually contiguous buffer otherwise)
+     * r3 = size (multiple of MAX_HEAP_POOL / MAX_PAGE_POOL)
+     * r4 = pool (vmcall_heap_pool)
+     * r5 = heap token
+     *
+     * Out:
+     * r1 = 0 == success, error code otherwise
+     * r2 = number of heap chunks requested (query only)
+     * r3 = number of page chunks requested (query only)
+     */
+    VMCALL_HEAP = 7,
+
+    /*
+     * Stats
+     *
+     * Returns statistics collected by the VMM as a JSON string. The index
+     * selects which statistics are returned (see vmcall_stats_index). Like
+     * the data vmcall, the output buffer is mapped into the VMM, and
+     * out_size must be set to the max size of the buffer. On return,
+     * out_size contains the number of bytes written.
+     *
+     * In:
+     * r0 = VMCALL_STATS
+     * r1 = VMCALL_MAGIC_NUMBER
+     * r2 = index (vmcall_stats_index)
+     * r3 = index specific (e.g. reset for VMCALL_STATS_EXITS)
+     * r8 = out_addr (addr of virtually contiguous buffer)
+     * r9 = out_size (size of virtually contiguous buffer)
+     *
+     * Out:
+     * r1 = 0 == success, error code otherwise
+     * r7 = out_type (VMCALL_DATA_STRING_JSON)
+     * r9 = out_size (number of bytes written)
+     */
+    VMCALL_STATS = 8,
+
+    /*
+     * Flush
+     *
+     * The VMM caches the translations of the guest virtual addresses that
+     * are passed to it (e.g. the buffers of the data vmcall), and since
+     * CR3 loads and INVLPG are not trapped, these are only dropped when
+     * the guest's CR3 changes. This vmcall tells every vCPU to drop its
+     * translations before it handles its next vmcall, and must be made
+     * before passing an address whose mapping may have changed since it
+     * was last passed with the same CR3 (the bfdriver common.c does this
+     * before forwarding a vmcall on behalf of a process).
+     *
+     * In:
+     * r0 = VMCALL_FLUSH
+     * r1 = VMCALL_MAGIC_NUMBER
+     *
+     * Out:
+     * r1 = 0 == success, error code otherwise
+     */
+    VMCALL_FLUSH = 9,
+
     /*
      * Unit Test
      *
@@ -256,6 +333,44 @@ enum vmcall_versions
     VMCALL_VERSION_USER = 10,
 };
 
+/*
+ * VMCall Heap Pool
+ *
+ * Defines which of the VMM's pools the memory donated using the heap
+ * vmcall is added to.
+ */
+enum vmcall_heap_pool
+{
+    VMCALL_HEAP_POOL_HEAP = 0,
+    VMCALL_HEAP_POOL_PAGE = 1,
+};
+
+/*
+ * VMCall Stats Index
+ *
+ * Defines the different statistics that can be returned by the stats
+ * vmcall.
+ *
+ * @note: indexes 0x0000000000000000 -> 0x7FFFFFFFFFFFFFFF are reserved
+ *     for Bareflank. The remaining indexes may be used by custom
+ *     extensions to return their own statistics
+ */
+enum vmcall_stats_index
+{
+    VMCALL_STATS_MEMORY = 1,
+
+    /*
+     * Exits
+     *
+     * Returns the number of VM exits handled by the vCPU that executed the
+     * vmcall for each exit reason, and of vmcalls for each opcode, along
+     * with the cycles (TSC ticks) spent handling them, and a histogram of
+     * these cycles (bucket n counts exits that took [2^n, 2^(n+1)) cycles).
+     * If r3 != 0, the statistics are reset once they have been returned.
+     */
+    VMCALL_STATS_EXITS = 2,
+};
+
 /*
  * VMCall Data Type
  *